@@ -18,6 +18,7 @@
 #include "pb/event_user_left.pb.h"
 #include "pb/event_user_message.pb.h"
 #include "pb/server_message.pb.h"
+#include "serialized_server_message.h"
 
 #include <google/protobuf/descriptor.h>
 
@@ -130,6 +131,12 @@ void AbstractClient::processProtocolItem(const ServerMessage &item)
             emit roomEventReceived(item.room_event());
             break;
         }
+        case ServerMessage::COMPRESSED: {
+            ServerMessage uncompressed;
+            if (SerializedServerMessage::uncompress(item, uncompressed))
+                processProtocolItem(uncompressed);
+            break;
+        }
     }
 }
 
@@ -0,0 +1,264 @@
+#include "picture_file_index.h"
+
+#include <QDataStream>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QFileSystemWatcher>
+#include <QSaveFile>
+
+static const quint32 CACHE_MAGIC = 0x50494458; // "PIDX"
+static const qint32 CACHE_VERSION = 1;
+
+PictureFileIndex::PictureFileIndex(QObject *parent)
+    : QObject(parent), maxDepth(-1), built(false), watcher(nullptr)
+{
+}
+
+void PictureFileIndex::setRootPath(const QString &_rootPath, int _maxDepth, const QString &_cacheFilePath)
+{
+    rootPath = _rootPath.isEmpty() ? QString() : QDir::cleanPath(_rootPath);
+    maxDepth = _maxDepth;
+    cacheFilePath = _cacheFilePath;
+
+    delete watcher;
+    watcher = nullptr;
+    directories.clear();
+    filesByName.clear();
+    canonicalDirectories.clear();
+    built = false;
+}
+
+void PictureFileIndex::build()
+{
+    built = true;
+    if (rootPath.isEmpty()) {
+        return;
+    }
+
+    // created here rather than in the constructor, so that it belongs to the thread doing the lookups
+    watcher = new QFileSystemWatcher(this);
+    connect(watcher, &QFileSystemWatcher::directoryChanged, this, &PictureFileIndex::directoryChanged);
+
+    QElapsedTimer timer;
+    timer.start();
+    scanDirectory(rootPath, 0, loadCache());
+    qCInfo(PictureFileIndexLog).nospace() << "Indexed " << rootPath << ": " << directories.size() << " directories, "
+                                          << filesByName.size() << " names in " << timer.elapsed() << "ms";
+}
+
+QStringList PictureFileIndex::namesOf(const QString &fileName)
+{
+    const QFileInfo fileInfo(fileName.toLower());
+    QStringList names{fileInfo.fileName()};
+    if (!names.contains(fileInfo.completeBaseName())) {
+        names << fileInfo.completeBaseName();
+    }
+    if (!names.contains(fileInfo.baseName())) {
+        names << fileInfo.baseName();
+    }
+    return names;
+}
+
+void PictureFileIndex::indexFile(const QString &dirPath, const QString &fileName)
+{
+    const QString filePath = dirPath + "/" + fileName;
+    for (const QString &name : namesOf(fileName)) {
+        filesByName[name].append(filePath);
+    }
+}
+
+void PictureFileIndex::unindexFile(const QString &dirPath, const QString &fileName)
+{
+    const QString filePath = dirPath + "/" + fileName;
+    for (const QString &name : namesOf(fileName)) {
+        auto it = filesByName.find(name);
+        if (it == filesByName.end()) {
+            continue;
+        }
+        it->removeAll(filePath);
+        if (it->isEmpty()) {
+            filesByName.erase(it);
+        }
+    }
+}
+
+void PictureFileIndex::scanDirectory(const QString &dirPath,
+                                     int depth,
+                                     const QHash<QString, DirectoryEntry> &cachedDirectories)
+{
+    const QFileInfo dirInfo(dirPath);
+    if (!dirInfo.isDir()) {
+        return;
+    }
+    const QString canonicalPath = dirInfo.canonicalFilePath();
+    if (canonicalDirectories.contains(canonicalPath)) {
+        return;
+    }
+
+    DirectoryEntry entry;
+    auto cached = cachedDirectories.constFind(dirPath);
+    if (cached != cachedDirectories.constEnd() && cached->depth == depth &&
+        cached->lastModified == dirInfo.lastModified()) {
+        // nothing has been added, removed or renamed in there since it was listed
+        entry = cached.value();
+    } else {
+        entry.lastModified = dirInfo.lastModified();
+        entry.depth = depth;
+        QDir::Filters filters = QDir::Files | QDir::NoDotAndDotDot;
+        if (maxDepth < 0 || depth < maxDepth) {
+            filters |= QDir::Dirs;
+        }
+        for (const QFileInfo &childInfo : QDir(dirPath).entryInfoList(filters)) {
+            if (childInfo.isDir()) {
+                entry.subdirectories << dirPath + "/" + childInfo.fileName();
+            } else {
+                entry.fileNames << childInfo.fileName();
+            }
+        }
+    }
+    entry.canonicalPath = canonicalPath;
+
+    canonicalDirectories.insert(canonicalPath);
+    directories.insert(dirPath, entry);
+    watcher->addPath(dirPath);
+
+    for (const QString &fileName : entry.fileNames) {
+        indexFile(dirPath, fileName);
+    }
+    for (const QString &subdirectory : entry.subdirectories) {
+        scanDirectory(subdirectory, depth + 1, cachedDirectories);
+    }
+}
+
+void PictureFileIndex::removeDirectory(const QString &dirPath, QHash<QString, DirectoryEntry> &removedDirectories)
+{
+    auto it = directories.find(dirPath);
+    if (it == directories.end()) {
+        return;
+    }
+    const DirectoryEntry entry = it.value();
+    directories.erase(it);
+    canonicalDirectories.remove(entry.canonicalPath);
+    watcher->removePath(dirPath);
+
+    for (const QString &fileName : entry.fileNames) {
+        unindexFile(dirPath, fileName);
+    }
+    for (const QString &subdirectory : entry.subdirectories) {
+        removeDirectory(subdirectory, removedDirectories);
+    }
+    removedDirectories.insert(dirPath, entry);
+}
+
+void PictureFileIndex::directoryChanged(const QString &dirPath)
+{
+    auto it = directories.constFind(dirPath);
+    if (it == directories.constEnd()) {
+        return;
+    }
+    const int depth = it->depth;
+
+    // list the directory again; its subdirectories are only listed again if they changed too
+    QHash<QString, DirectoryEntry> removedDirectories;
+    removeDirectory(dirPath, removedDirectories);
+    scanDirectory(dirPath, depth, removedDirectories);
+}
+
+QStringList PictureFileIndex::findFiles(const QString &name)
+{
+    if (!built) {
+        build();
+    }
+    return filesByName.value(name.toLower());
+}
+
+QStringList PictureFileIndex::findFilesIn(const QString &dirPath, const QString &name)
+{
+    if (!built) {
+        build();
+    }
+
+    QStringList result;
+    const QString cleanDirPath = QDir::cleanPath(dirPath);
+    auto it = filesByName.constFind(name.toLower());
+    if (it == filesByName.constEnd()) {
+        return result;
+    }
+    for (const QString &filePath : it.value()) {
+        const int separator = filePath.lastIndexOf('/');
+        if (filePath.left(separator).compare(cleanDirPath, Qt::CaseInsensitive) != 0) {
+            continue;
+        }
+        // the base name alone would also match "<name>.full.jpg" when looking for "<name>"
+        const QFileInfo fileInfo(filePath.mid(separator + 1));
+        if (fileInfo.fileName().compare(name, Qt::CaseInsensitive) == 0 ||
+            fileInfo.completeBaseName().compare(name, Qt::CaseInsensitive) == 0) {
+            result << filePath;
+        }
+    }
+    return result;
+}
+
+QHash<QString, PictureFileIndex::DirectoryEntry> PictureFileIndex::loadCache() const
+{
+    QHash<QString, DirectoryEntry> cachedDirectories;
+    if (cacheFilePath.isEmpty()) {
+        return cachedDirectories;
+    }
+
+    QFile file(cacheFilePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return cachedDirectories;
+    }
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_0);
+    quint32 magic;
+    qint32 version, cachedMaxDepth, count;
+    QString cachedRootPath;
+    stream >> magic >> version >> cachedRootPath >> cachedMaxDepth >> count;
+    if (stream.status() != QDataStream::Ok || magic != CACHE_MAGIC || version != CACHE_VERSION ||
+        cachedRootPath != rootPath || cachedMaxDepth != maxDepth) {
+        return cachedDirectories;
+    }
+
+    for (qint32 i = 0; i < count && stream.status() == QDataStream::Ok; ++i) {
+        QString dirPath;
+        DirectoryEntry entry;
+        qint32 depth;
+        stream >> dirPath >> entry.lastModified >> depth >> entry.fileNames >> entry.subdirectories;
+        entry.depth = depth;
+        cachedDirectories.insert(dirPath, entry);
+    }
+
+    if (stream.status() != QDataStream::Ok) {
+        qCWarning(PictureFileIndexLog) << "Ignoring corrupted picture index" << cacheFilePath;
+        cachedDirectories.clear();
+    }
+    return cachedDirectories;
+}
+
+void PictureFileIndex::saveCache() const
+{
+    if (cacheFilePath.isEmpty() || !built) {
+        return;
+    }
+
+    QSaveFile file(cacheFilePath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qCWarning(PictureFileIndexLog) << "Could not save picture index" << cacheFilePath;
+        return;
+    }
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_0);
+    stream << CACHE_MAGIC << CACHE_VERSION << rootPath << static_cast<qint32>(maxDepth)
+           << static_cast<qint32>(directories.size());
+    for (auto it = directories.cbegin(); it != directories.cend(); ++it) {
+        stream << it.key() << it->lastModified << static_cast<qint32>(it->depth) << it->fileNames
+               << it->subdirectories;
+    }
+    file.commit();
+}
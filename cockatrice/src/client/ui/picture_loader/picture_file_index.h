@@ -0,0 +1,86 @@
+#ifndef PICTURE_FILE_INDEX_H
+#define PICTURE_FILE_INDEX_H
+
+#include <QDateTime>
+#include <QHash>
+#include <QLoggingCategory>
+#include <QObject>
+#include <QSet>
+#include <QStringList>
+
+inline Q_LOGGING_CATEGORY(PictureFileIndexLog, "picture_loader.file_index");
+
+class QFileSystemWatcher;
+
+/**
+ * Index of the files below a picture folder, so that finding the pictures of a card doesn't have to walk the folder.
+ *
+ * Files are indexed by their file name, complete base name and base name, all compared case-insensitively: set
+ * folders and card names don't always agree on case, and some file systems don't care. The index is kept current with a
+ * QFileSystemWatcher on every indexed directory. It can be saved to a cache file; when it is loaded back, only the
+ * directories that have been modified since are listed again.
+ *
+ * The index lives in the thread of the picture loader worker and isn't thread safe.
+ */
+class PictureFileIndex : public QObject
+{
+    Q_OBJECT
+private:
+    struct DirectoryEntry
+    {
+        QDateTime lastModified;
+        int depth = 0;
+        QString canonicalPath;
+        QStringList fileNames;
+        QStringList subdirectories;
+    };
+
+    QString rootPath;
+    int maxDepth;
+    QString cacheFilePath;
+    bool built;
+    QFileSystemWatcher *watcher;
+    // directory path -> contents
+    QHash<QString, DirectoryEntry> directories;
+    // lower case file name, complete base name or base name -> file paths
+    QHash<QString, QStringList> filesByName;
+    // guards against symlink loops
+    QSet<QString> canonicalDirectories;
+
+    void build();
+    void scanDirectory(const QString &dirPath, int depth, const QHash<QString, DirectoryEntry> &cachedDirectories);
+    void removeDirectory(const QString &dirPath, QHash<QString, DirectoryEntry> &removedDirectories);
+    void indexFile(const QString &dirPath, const QString &fileName);
+    void unindexFile(const QString &dirPath, const QString &fileName);
+    static QStringList namesOf(const QString &fileName);
+    QHash<QString, DirectoryEntry> loadCache() const;
+
+private slots:
+    void directoryChanged(const QString &dirPath);
+
+public:
+    explicit PictureFileIndex(QObject *parent = nullptr);
+
+    /**
+     * Points the index to a new folder. The folder is only scanned on the first lookup.
+     *
+     * @param _rootPath the folder to index
+     * @param _maxDepth how many levels of subdirectories are indexed; -1 for all of them
+     * @param _cacheFilePath where the index is saved across restarts; empty to never save it
+     */
+    void setRootPath(const QString &_rootPath, int _maxDepth = -1, const QString &_cacheFilePath = QString());
+
+    /** Paths of the files whose file name, complete base name or base name is `name`, ignoring case. */
+    QStringList findFiles(const QString &name);
+
+    /**
+     * Paths of the files directly in `dirPath` whose file name or complete base name is `name`, ignoring case. The
+     * paths are spelled the way they are on disk.
+     */
+    QStringList findFilesIn(const QString &dirPath, const QString &name);
+
+public slots:
+    void saveCache() const;
+};
+
+#endif // PICTURE_FILE_INDEX_H
@@ -2,9 +2,9 @@
 
 #include "../../../game/cards/card_database_manager.h"
 #include "../../../settings/cache_settings.h"
+#include "picture_file_index.h"
 
 #include <QBuffer>
-#include <QDirIterator>
 #include <QMovie>
 #include <QNetworkDiskCache>
 #include <QNetworkReply>
@@ -54,6 +54,14 @@ PictureLoaderWorker::PictureLoaderWorker()
     connect(QCoreApplication::instance(), &QCoreApplication::aboutToQuit, this,
             &PictureLoaderWorker::saveRedirectCache);
 
+    // The indexes are built on their first lookup, in the worker thread
+    customPicsIndex = new PictureFileIndex(this);
+    picsIndex = new PictureFileIndex(this);
+    updatePictureIndexes();
+    connect(QCoreApplication::instance(), &QCoreApplication::aboutToQuit, customPicsIndex,
+            &PictureFileIndex::saveCache);
+    connect(QCoreApplication::instance(), &QCoreApplication::aboutToQuit, picsIndex, &PictureFileIndex::saveCache);
+
     pictureLoaderThread = new QThread;
     pictureLoaderThread->start(QThread::LowPriority);
     moveToThread(pictureLoaderThread);
@@ -126,26 +134,20 @@ bool PictureLoaderWorker::cardImageExistsOnDisk(QString &setName, QString &corre
     QList<QString> picsPaths = QList<QString>();
 
     if (searchCustomPics) {
-        QDirIterator it(customPicsPath, QDirIterator::Subdirectories | QDirIterator::FollowSymlinks);
-
-        // Recursively check all subdirectories of the CUSTOM folder
-        while (it.hasNext()) {
-            QString thisPath(it.next());
-            QFileInfo thisFileInfo(thisPath);
-
-            if (thisFileInfo.isFile() &&
-                (thisFileInfo.fileName() == correctedCardname || thisFileInfo.completeBaseName() == correctedCardname ||
-                 thisFileInfo.baseName() == correctedCardname)) {
-                picsPaths << thisPath; // Card found in the CUSTOM directory, somewhere
-            }
-        }
+        // Card found in the CUSTOM directory, somewhere
+        picsPaths << customPicsIndex->findFiles(correctedCardname);
     }
 
     if (!setName.isEmpty()) {
-        picsPaths << picsPath + "/" + setName + "/" + correctedCardname
-                  // We no longer store downloaded images there, but don't just ignore
-                  // stuff that old versions have put there.
-                  << picsPath + "/downloadedPics/" + setName + "/" + correctedCardname;
+        // We no longer store downloaded images in downloadedPics, but don't just ignore
+        // stuff that old versions have put there.
+        const QStringList setPaths = {picsPath + "/" + setName, picsPath + "/downloadedPics/" + setName};
+        for (const QString &setPath : setPaths) {
+            // Only probe the files by that name, with or without extension, as they are spelled on disk
+            picsPaths << picsIndex->findFilesIn(setPath, correctedCardname)
+                      << picsIndex->findFilesIn(setPath, correctedCardname + ".full")
+                      << picsIndex->findFilesIn(setPath, correctedCardname + ".xlhq");
+        }
     }
 
     // Iterates through the list of paths, searching for images with the desired
@@ -487,6 +489,15 @@ void PictureLoaderWorker::picsPathChanged()
     QMutexLocker locker(&mutex);
     picsPath = SettingsCache::instance().getPicsPath();
     customPicsPath = SettingsCache::instance().getCustomPicsPath();
+    updatePictureIndexes();
+}
+
+void PictureLoaderWorker::updatePictureIndexes()
+{
+    const QString cacheDirPath = SettingsCache::instance().getRedirectCachePath();
+    customPicsIndex->setRootPath(customPicsPath, -1, cacheDirPath + CUSTOM_PICS_INDEX_FILENAME);
+    // <set>/ and downloadedPics/<set>/
+    picsIndex->setRootPath(picsPath, 2, cacheDirPath + PICS_INDEX_FILENAME);
 }
 
 void PictureLoaderWorker::setOverrideAllCardArtWithPersonalPreference(bool _overrideAllCardArtWithPersonalPreference)
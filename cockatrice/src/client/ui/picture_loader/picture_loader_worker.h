@@ -14,9 +14,13 @@
 #define REDIRECT_URL "redirect"
 #define REDIRECT_TIMESTAMP "timestamp"
 #define REDIRECT_CACHE_FILENAME "cache.ini"
+#define CUSTOM_PICS_INDEX_FILENAME "custom_pics_index.dat"
+#define PICS_INDEX_FILENAME "pics_index.dat"
 
 inline Q_LOGGING_CATEGORY(PictureLoaderWorkerLog, "picture_loader.worker");
 
+class PictureFileIndex;
+
 class PictureLoaderWorker : public QObject
 {
     Q_OBJECT
@@ -32,6 +36,8 @@ private:
 
     QThread *pictureLoaderThread;
     QString picsPath, customPicsPath;
+    // the whole CUSTOM folder, and the set folders of picsPath
+    PictureFileIndex *customPicsIndex, *picsIndex;
     QList<PictureToLoad> loadQueue;
     QMutex mutex;
     QNetworkAccessManager *networkManager;
@@ -59,6 +65,7 @@ private:
     void loadRedirectCache();
     void saveRedirectCache() const;
     void cleanStaleEntries();
+    void updatePictureIndexes();
 
 private slots:
     void picDownloadFinished(QNetworkReply *reply);
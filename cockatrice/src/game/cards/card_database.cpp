@@ -54,6 +54,11 @@ void CardDatabase::clear()
 
     cards.clear();
     simpleNameCards.clear();
+    printingsByProviderId.clear();
+    printingsBySetAndNumber.clear();
+    preferredPrintingsLock.lockForWrite();
+    preferredPrintings.clear();
+    preferredPrintingsLock.unlock();
 
     sets.clear();
     ICardDatabaseParser::clearSetlist();
@@ -75,7 +80,11 @@ void CardDatabase::addCard(CardInfoPtr card)
         CardInfoPtr sameCard = cards[card->getName()];
         for (const auto &cardInfoPerSetList : card->getSets()) {
             for (const CardInfoPerSet &set : cardInfoPerSetList) {
+                const bool isNewPrinting = !sameCard->getSets().value(set.getPtr()->getShortName()).contains(set);
                 sameCard->addToSet(set.getPtr(), set);
+                if (isNewPrinting) {
+                    indexPrinting(sameCard, set);
+                }
             }
         }
         return;
@@ -84,6 +93,11 @@ void CardDatabase::addCard(CardInfoPtr card)
     addCardMutex->lock();
     cards.insert(card->getName(), card);
     simpleNameCards.insert(card->getSimpleName(), card);
+    for (const auto &cardInfoPerSetList : card->getSets()) {
+        for (const CardInfoPerSet &set : cardInfoPerSetList) {
+            indexPrinting(card, set);
+        }
+    }
     addCardMutex->unlock();
     emit cardAdded(card);
 }
@@ -107,6 +121,10 @@ void CardDatabase::removeCard(CardInfoPtr card)
     removeCardMutex->lock();
     cards.remove(card->getName());
     simpleNameCards.remove(card->getSimpleName());
+    unindexPrintings(card);
+    preferredPrintingsLock.lockForWrite();
+    preferredPrintings.remove(card->getName());
+    preferredPrintingsLock.unlock();
     removeCardMutex->unlock();
     emit cardRemoved(card);
 }
@@ -147,17 +165,77 @@ CardInfoPtr CardDatabase::getCardByNameAndProviderId(const QString &cardName, co
         return info;
     }
 
-    for (const auto &cardInfoPerSetList : info->getSets()) {
-        for (const auto &set : cardInfoPerSetList) {
-            if (set.getProperty("uuid") == providerId) {
-                CardInfoPtr cardFromSpecificSet = info->clone();
-                cardFromSpecificSet->setPixmapCacheKey(QLatin1String("card_") + QString(info->getName()) +
-                                                       QString("_") + QString(set.getProperty("uuid")));
-                return cardFromSpecificSet;
+    if (findPrintingByProviderId(cardName, providerId)) {
+        CardInfoPtr cardFromSpecificSet = info->clone();
+        cardFromSpecificSet->setPixmapCacheKey(QLatin1String("card_") + QString(info->getName()) + QString("_") +
+                                               providerId);
+        return cardFromSpecificSet;
+    }
+    return {};
+}
+
+template <typename Key, typename PrintingRef>
+static bool containsPrintingOf(const QMultiHash<Key, PrintingRef> &index, const Key &key, const CardInfoPtr &card)
+{
+    for (auto it = index.constFind(key); it != index.constEnd() && it.key() == key; ++it) {
+        if (it->card == card) {
+            return true;
+        }
+    }
+    return false;
+}
+
+template <typename Key, typename PrintingRef>
+static void removePrintingsOf(QMultiHash<Key, PrintingRef> &index, const Key &key, const CardInfoPtr &card)
+{
+    auto it = index.find(key);
+    while (it != index.end() && it.key() == key) {
+        if (it->card == card) {
+            it = index.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void CardDatabase::indexPrinting(const CardInfoPtr &card, const CardInfoPerSet &printing)
+{
+    // the first printing of a card wins, as it would when scanning its sets
+    const QString providerId = printing.getProperty("uuid");
+    if (!providerId.isEmpty() && !containsPrintingOf(printingsByProviderId, providerId, card)) {
+        printingsByProviderId.insert(providerId, {card, printing});
+    }
+    if (printing.getPtr()) {
+        const auto setAndNumber = qMakePair(printing.getPtr()->getShortName(), printing.getProperty("num"));
+        if (!containsPrintingOf(printingsBySetAndNumber, setAndNumber, card)) {
+            printingsBySetAndNumber.insert(setAndNumber, {card, printing});
+        }
+    }
+}
+
+void CardDatabase::unindexPrintings(const CardInfoPtr &card)
+{
+    for (const auto &cardInfoPerSetList : card->getSets()) {
+        for (const auto &printing : cardInfoPerSetList) {
+            removePrintingsOf(printingsByProviderId, printing.getProperty("uuid"), card);
+            if (printing.getPtr()) {
+                removePrintingsOf(printingsBySetAndNumber,
+                                  qMakePair(printing.getPtr()->getShortName(), printing.getProperty("num")), card);
             }
         }
     }
-    return {};
+}
+
+const CardDatabase::PrintingRef *CardDatabase::findPrintingByProviderId(const QString &cardName,
+                                                                        const QString &providerId) const
+{
+    for (auto it = printingsByProviderId.constFind(providerId);
+         it != printingsByProviderId.constEnd() && it.key() == providerId; ++it) {
+        if (it->card->getName() == cardName) {
+            return &it.value();
+        }
+    }
+    return nullptr;
 }
 
 CardInfoPtr CardDatabase::getCardBySimpleName(const QString &cardName) const
@@ -302,30 +380,21 @@ LoadStatus CardDatabase::loadCardDatabases()
 
 void CardDatabase::refreshPreferredPrintings()
 {
+    cachePreferredPrintings();
     for (const CardInfoPtr &card : cards) {
         card->setPixmapCacheKey(QLatin1String("card_") + QString(card->getName()) + QString("_") +
                                 QString(getPreferredPrintingProviderIdForCard(card->getName())));
     }
 }
 
-CardInfoPerSet CardDatabase::getPreferredSetForCard(const QString &cardName) const
+CardInfoPerSet CardDatabase::findPreferredPrinting(const CardInfoPtr &card)
 {
-    CardInfoPtr cardInfo = getCard(cardName);
-    if (!cardInfo) {
-        return CardInfoPerSet(nullptr);
-    }
-
-    CardInfoPerSetMap setMap = cardInfo->getSets();
-    if (setMap.empty()) {
-        return CardInfoPerSet(nullptr);
-    }
-
     CardSetPtr preferredSet = nullptr;
     CardInfoPerSet preferredCard;
     SetPriorityComparator comparator;
 
-    for (const auto &cardInfoPerSetList : setMap) {
-        for (auto &cardInfoForSet : cardInfoPerSetList) {
+    for (const auto &cardInfoPerSetList : card->getSets()) {
+        for (const auto &cardInfoForSet : cardInfoPerSetList) {
             CardSetPtr currentSet = cardInfoForSet.getPtr();
             if (!preferredSet || comparator(currentSet, preferredSet)) {
                 preferredSet = currentSet;
@@ -341,20 +410,54 @@ CardInfoPerSet CardDatabase::getPreferredSetForCard(const QString &cardName) con
     return CardInfoPerSet(nullptr);
 }
 
-CardInfoPerSet CardDatabase::getSpecificSetForCard(const QString &cardName, const QString &providerId) const
+void CardDatabase::cachePreferredPrintings()
 {
+    // built aside, so readers on other threads only wait for the swap
+    QHash<QString, CardInfoPerSet> newPreferredPrintings;
+    newPreferredPrintings.reserve(cards.size());
+    for (const CardInfoPtr &card : cards) {
+        newPreferredPrintings.insert(card->getName(), findPreferredPrinting(card));
+    }
+
+    preferredPrintingsLock.lockForWrite();
+    preferredPrintings.swap(newPreferredPrintings);
+    preferredPrintingsLock.unlock();
+}
+
+CardInfoPerSet CardDatabase::getPreferredSetForCard(const QString &cardName) const
+{
+    preferredPrintingsLock.lockForRead();
+    auto cached = preferredPrintings.constFind(cardName);
+    if (cached != preferredPrintings.constEnd()) {
+        const CardInfoPerSet preferredPrinting = cached.value();
+        preferredPrintingsLock.unlock();
+        return preferredPrinting;
+    }
+    preferredPrintingsLock.unlock();
+
+    // cards added since the cache was last built
     CardInfoPtr cardInfo = getCard(cardName);
     if (!cardInfo) {
         return CardInfoPerSet(nullptr);
     }
+    return findPreferredPrinting(cardInfo);
+}
 
-    CardInfoPerSetMap setMap = cardInfo->getSets();
-    if (setMap.empty()) {
+CardInfoPerSet CardDatabase::getSpecificSetForCard(const QString &cardName, const QString &providerId) const
+{
+    if (!providerId.isEmpty()) {
+        const PrintingRef *printingRef = findPrintingByProviderId(cardName, providerId);
+        return printingRef ? printingRef->printing : CardInfoPerSet(nullptr);
+    }
+
+    CardInfoPtr cardInfo = getCard(cardName);
+    if (!cardInfo) {
         return CardInfoPerSet(nullptr);
     }
 
-    for (const auto &cardInfoPerSetList : setMap) {
-        for (auto &cardInfoForSet : cardInfoPerSetList) {
+    // printings without a provider id aren't indexed
+    for (const auto &cardInfoPerSetList : cardInfo->getSets()) {
+        for (const auto &cardInfoForSet : cardInfoPerSetList) {
             if (cardInfoForSet.getProperty("uuid") == providerId) {
                 return cardInfoForSet;
             }
@@ -372,23 +475,23 @@ CardInfoPerSet CardDatabase::getSpecificSetForCard(const QString &cardName,
                                                    const QString &setShortName,
                                                    const QString &collectorNumber) const
 {
-    CardInfoPtr cardInfo = getCard(cardName);
-    if (!cardInfo) {
-        return CardInfoPerSet(nullptr);
-    }
-
-    CardInfoPerSetMap setMap = cardInfo->getSets();
-    if (setMap.empty()) {
-        return CardInfoPerSet(nullptr);
+    if (collectorNumber.isEmpty()) {
+        CardInfoPtr cardInfo = getCard(cardName);
+        if (!cardInfo) {
+            return CardInfoPerSet(nullptr);
+        }
+        const auto setIterator = cardInfo->getSets().constFind(setShortName);
+        if (setIterator == cardInfo->getSets().constEnd() || setIterator->isEmpty()) {
+            return CardInfoPerSet(nullptr);
+        }
+        return setIterator->first();
     }
 
-    for (const auto &cardInfoPerSetList : setMap) {
-        for (auto &cardInfoForSet : cardInfoPerSetList) {
-            if (cardInfoForSet.getPtr()->getShortName() == setShortName) {
-                if (cardInfoForSet.getProperty("num") == collectorNumber || collectorNumber.isEmpty()) {
-                    return cardInfoForSet;
-                }
-            }
+    const auto setAndNumber = qMakePair(setShortName, collectorNumber);
+    for (auto it = printingsBySetAndNumber.constFind(setAndNumber);
+         it != printingsBySetAndNumber.constEnd() && it.key() == setAndNumber; ++it) {
+        if (it->card->getName() == cardName) {
+            return it->printing;
         }
     }
 
@@ -538,6 +641,7 @@ void CardDatabase::enableAllUnknownSets()
 {
     auto _sets = getSetList();
     _sets.enableAllUnknown();
+    cachePreferredPrintings();
 }
 
 void CardDatabase::markAllSetsAsKnown()
@@ -552,6 +656,9 @@ void CardDatabase::notifyEnabledSetsChanged()
     for (const CardInfoPtr &card : cards)
         card->refreshCachedSetNames();
 
+    // the preferred printings follow the order of the enabled sets
+    cachePreferredPrintings();
+
     // inform the carddatabasemodels that they need to re-check their list of cards
     emit cardDatabaseEnabledSetsChanged();
 }
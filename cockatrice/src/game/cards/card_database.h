@@ -8,6 +8,9 @@
 #include <QHash>
 #include <QList>
 #include <QLoggingCategory>
+#include <QMultiHash>
+#include <QPair>
+#include <QReadWriteLock>
 #include <QStringList>
 #include <QVector>
 #include <utility>
@@ -52,9 +55,40 @@ protected:
     QVector<ICardDatabaseParser *> availableParsers;
 
 private:
+    struct PrintingRef
+    {
+        CardInfoPtr card;
+        CardInfoPerSet printing;
+    };
+
+    /*
+     * The printings of all the cards, indexed by provider id (uuid).
+     * Several cards may share a provider id, e.g. the faces of a double-faced card.
+     */
+    QMultiHash<QString, PrintingRef> printingsByProviderId;
+
+    /*
+     * The printings of all the cards, indexed by set short name and collector number.
+     */
+    QMultiHash<QPair<QString, QString>, PrintingRef> printingsBySetAndNumber;
+
+    /*
+     * The preferred printing of each card, indexed by card name.
+     * Depends on the order and enabled state of the sets, see cachePreferredPrintings().
+     * The picture loader thread reads it too, so it is only accessed with preferredPrintingsLock held.
+     */
+    QHash<QString, CardInfoPerSet> preferredPrintings;
+    mutable QReadWriteLock preferredPrintingsLock;
+
     CardInfoPtr getCardFromMap(const CardNameMap &cardMap, const QString &cardName) const;
     void checkUnknownSets();
     void refreshCachedReverseRelatedCards();
+    void indexPrinting(const CardInfoPtr &card, const CardInfoPerSet &printing);
+    void unindexPrintings(const CardInfoPtr &card);
+    [[nodiscard]] const PrintingRef *findPrintingByProviderId(const QString &cardName,
+                                                              const QString &providerId) const;
+    static CardInfoPerSet findPreferredPrinting(const CardInfoPtr &card);
+    void cachePreferredPrintings();
 
     QBasicMutex *reloadDatabaseMutex = new QBasicMutex(), *clearDatabaseMutex = new QBasicMutex(),
                 *loadFromFileMutex = new QBasicMutex(), *addCardMutex = new QBasicMutex(),
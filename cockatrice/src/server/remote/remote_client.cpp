@@ -13,6 +13,7 @@
 #include "pb/response_register.pb.h"
 #include "pb/server_message.pb.h"
 #include "pb/session_commands.pb.h"
+#include "serialized_server_message.h"
 #include "version_string.h"
 
 #include <QCryptographicHash>
@@ -397,12 +398,10 @@ void RemoteClient::readData()
         ServerMessage newServerMessage;
         newServerMessage.ParseFromArray(inputBuffer.data(), messageLength);
 
-        qCDebug(RemoteClientLog).noquote() << "IN" << getSafeDebugString(newServerMessage);
-
         inputBuffer.remove(0, messageLength);
         messageInProgress = false;
 
-        processProtocolItem(newServerMessage);
+        processServerMessage(newServerMessage);
 
         if (getStatus() == StatusDisconnecting) // use thread-safe getter
             doDisconnectFromServer();
@@ -415,9 +414,25 @@ void RemoteClient::websocketMessageReceived(const QByteArray &message)
     ServerMessage newServerMessage;
     newServerMessage.ParseFromArray(message.data(), message.length());
 
-    qCDebug(RemoteClientLog).noquote() << "IN" << getSafeDebugString(newServerMessage);
+    processServerMessage(newServerMessage);
+}
+
+void RemoteClient::processServerMessage(const ServerMessage &message)
+{
+    if (message.message_type() != ServerMessage::COMPRESSED) {
+        qCDebug(RemoteClientLog).noquote() << "IN" << getSafeDebugString(message);
+        processProtocolItem(message);
+        return;
+    }
 
-    processProtocolItem(newServerMessage);
+    ServerMessage uncompressedMessage;
+    if (!SerializedServerMessage::uncompress(message, uncompressedMessage)) {
+        qCWarning(RemoteClientLog) << "Could not uncompress message of" << message.compressed_message().size()
+                                   << "bytes";
+        return;
+    }
+    qCDebug(RemoteClientLog).noquote() << "IN" << getSafeDebugString(uncompressedMessage);
+    processProtocolItem(uncompressedMessage);
 }
 
 void RemoteClient::sendCommandContainer(const CommandContainer &cont)
@@ -109,6 +109,7 @@ private:
     bool newMissingFeatureFound(const QString &_serversMissingFeatures);
     void clearNewClientFeatures();
     void connectToHost(const QString &hostname, unsigned int port);
+    void processServerMessage(const ServerMessage &message);
 
 protected slots:
     void sendCommandContainer(const CommandContainer &cont) override;
@@ -0,0 +1,50 @@
+#include "framed_input_buffer.h"
+
+FramedInputBuffer::FramedInputBuffer() : readPos(0), messageLength(0), messageInProgress(false)
+{
+}
+
+void FramedInputBuffer::append(const QByteArray &data)
+{
+    if (isEmpty() && !messageInProgress) {
+        // nothing pending, adopt the (implicitly shared) data without copying
+        buffer = data;
+        readPos = 0;
+    } else {
+        buffer.append(data);
+    }
+}
+
+bool FramedInputBuffer::nextFrame(const char *&data, int &length)
+{
+    if (!messageInProgress) {
+        if (bytesAvailable() < headerSize)
+            return false;
+        const char *header = buffer.constData() + readPos;
+        messageLength = static_cast<int>((((quint32)(unsigned char)header[0]) << 24) +
+                                         (((quint32)(unsigned char)header[1]) << 16) +
+                                         (((quint32)(unsigned char)header[2]) << 8) +
+                                         ((quint32)(unsigned char)header[3]));
+        readPos += headerSize;
+        messageInProgress = true;
+    }
+    if (messageLength < 0 || bytesAvailable() < messageLength)
+        return false;
+
+    data = buffer.constData() + readPos;
+    length = messageLength;
+    readPos += messageLength;
+    messageInProgress = false;
+    return true;
+}
+
+void FramedInputBuffer::compact()
+{
+    if (readPos == 0)
+        return;
+    if (readPos >= buffer.size())
+        buffer.clear();
+    else
+        buffer.remove(0, readPos);
+    readPos = 0;
+}
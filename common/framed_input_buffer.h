@@ -0,0 +1,47 @@
+#ifndef FRAMED_INPUT_BUFFER_H
+#define FRAMED_INPUT_BUFFER_H
+
+#include <QByteArray>
+
+/**
+ * Input buffer for the length-prefixed stream protocol (4 byte big-endian length followed by the payload).
+ *
+ * Complete frames are handed out as views into the buffer instead of being cut off the front one by one, so
+ * consumed bytes are only discarded once per batch of received data. This keeps parsing linear in the amount of data
+ * received even when a peer pipelines many small messages into a single read.
+ */
+class FramedInputBuffer
+{
+public:
+    static const int headerSize = 4;
+
+private:
+    QByteArray buffer;
+    int readPos;
+    int messageLength;
+    bool messageInProgress;
+
+public:
+    FramedInputBuffer();
+
+    void append(const QByteArray &data);
+    // Returns the next complete frame's payload. The pointer stays valid until the next append() or compact() call.
+    bool nextFrame(const char *&data, int &length);
+    // Drops the bytes of all frames returned so far; call after a batch of frames has been processed.
+    void compact();
+
+    bool isEmpty() const
+    {
+        return readPos >= buffer.size();
+    }
+    int bytesAvailable() const
+    {
+        return buffer.size() - readPos;
+    }
+    QByteArray peekUnread() const
+    {
+        return buffer.mid(readPos);
+    }
+};
+
+#endif
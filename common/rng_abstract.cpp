@@ -2,6 +2,17 @@
 
 #include <QDebug>
 
+QVector<unsigned int> RNG_Abstract::makeShuffleDraws(int start, int end)
+{
+    QVector<unsigned int> result;
+    if (end <= start)
+        return result;
+    result.reserve(end - start);
+    for (int i = end; i > start; --i)
+        result.append(rand(start, i));
+    return result;
+}
+
 QVector<int> RNG_Abstract::makeNumbersVector(int n, int min, int max)
 {
     const int bins = max - min + 1;
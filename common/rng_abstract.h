@@ -12,6 +12,12 @@ public:
     {
     }
     virtual unsigned int rand(int min, int max) = 0;
+    /**
+     * Returns the swap partners of a Fisher-Yates shuffle of the positions [start, end]:
+     * entry k is uniformly distributed in [start, end - k] and is the position swapped with position end - k.
+     * Implementations can override this to draw the numbers in one go.
+     */
+    virtual QVector<unsigned int> makeShuffleDraws(int start, int end);
     QVector<int> makeNumbersVector(int n, int min, int max);
     double testRandom(const QVector<int> &numbers) const;
 };
@@ -1,8 +1,10 @@
 #include "rng_sfmt.h"
 
+#include <QAtomicInteger>
 #include <QDateTime>
 #include <algorithm>
 #include <climits>
+#include <memory>
 #include <stdexcept>
 
 // This is from gcc sources, namely from fixincludes/inclhack.def
@@ -11,12 +13,51 @@
 #define UINT64_MAX (~(uint64_t)0)
 #endif
 
-RNG_SFMT::RNG_SFMT(QObject *parent) : RNG_Abstract(parent)
+// number of 32bit words drawn from the master stream to seed a thread's stream
+static const int streamSeedLength = 8;
+
+static QAtomicInteger<quint64> lastGeneration;
+
+RNG_SFMT::RNG_SFMT(QObject *parent) : RNG_Abstract(parent), generation(++lastGeneration)
 {
-    // initialize the random number generator with a 32bit integer seed (timestamp)
+    // initialize the master stream with a 32bit integer seed (timestamp)
     sfmt_init_gen_rand(&sfmt, QDateTime::currentDateTime().toSecsSinceEpoch());
 }
 
+uint64_t RNG_SFMT::Stream::generate()
+{
+    if (next == SFMT_N64) {
+        sfmt_fill_array64(&sfmt, block, SFMT_N64);
+        next = 0;
+    }
+    return block[next++];
+}
+
+/**
+ * Returns the stream of the calling thread, seeding it from the master stream on first use.
+ * The stream is freed when the thread exits.
+ */
+RNG_SFMT::Stream &RNG_SFMT::localStream()
+{
+    static thread_local std::unique_ptr<Stream> stream;
+    static thread_local quint64 streamGeneration = 0;
+
+    if (!stream || streamGeneration != generation) {
+        stream = std::make_unique<Stream>();
+        uint32_t seed[streamSeedLength];
+        mutex.lock();
+        for (int i = 0; i < streamSeedLength; i += 2) {
+            const uint64_t value = sfmt_genrand_uint64(&sfmt);
+            seed[i] = static_cast<uint32_t>(value);
+            seed[i + 1] = static_cast<uint32_t>(value >> 32);
+        }
+        mutex.unlock();
+        sfmt_init_by_array(&stream->sfmt, seed, streamSeedLength);
+        streamGeneration = generation;
+    }
+    return *stream;
+}
+
 /**
  * This method is the rand() equivalent which calls the cdf with proper bounds.
  *
@@ -50,11 +91,32 @@ unsigned int RNG_SFMT::rand(int min, int max)
     // This is the only time when min > max is (sort of) legal.
     // Not handling this will cause the application to crash.
     if (min == 0 && max < 0) {
-        return cdf(0, -max);
+        return cdf(localStream(), 0, -max);
     }
 
     // No special cases are left, except !(min > max) which is caught in the cdf itself.
-    return cdf(min, max);
+    return cdf(localStream(), min, max);
+}
+
+/**
+ * Draws all swap partners of a shuffle from the calling thread's stream at once.
+ */
+QVector<unsigned int> RNG_SFMT::makeShuffleDraws(int start, int end)
+{
+    if (start < 0) {
+        throw std::invalid_argument(
+            QString("Invalid bounds for RNG: Got min " + QString::number(start) + " < 0!\n").toStdString());
+    }
+
+    QVector<unsigned int> result;
+    if (end <= start)
+        return result;
+
+    Stream &stream = localStream();
+    result.resize(end - start);
+    for (int i = end; i > start; --i)
+        result[end - i] = cdf(stream, start, i);
+    return result;
 }
 
 /**
@@ -99,7 +161,7 @@ unsigned int RNG_SFMT::rand(int min, int max)
  * Otherwise you will probably skew the outcome of the rand() method or worsen the
  * performance of the application.
  */
-unsigned int RNG_SFMT::cdf(unsigned int min, unsigned int max)
+unsigned int RNG_SFMT::cdf(Stream &stream, unsigned int min, unsigned int max)
 {
     // This all makes no sense if min > max, which should never happen.
     if (min > max) {
@@ -123,13 +185,10 @@ unsigned int RNG_SFMT::cdf(unsigned int min, unsigned int max)
     const uint64_t limit = diameter * buckets;
 
     uint64_t rand;
-    // To make the random number generation thread-safe, a mutex is created around
-    // the generation. Outside of the loop of course, to avoid lock/unlock overhead.
-    mutex.lock();
+    // The stream belongs to the calling thread, so no lock is needed here.
     do {
-        rand = sfmt_genrand_uint64(&sfmt);
+        rand = stream.generate();
     } while (rand >= limit);
-    mutex.unlock();
 
     // Now determine the bucket containing the SFMT() random number and after adding
     // the lower bound, a random number from [min, max] can be returned.
@@ -24,20 +24,39 @@
  * These are mapped to values from the interval [min, max] without bias by using Knuth's
  * "Algorithm S (Selection sampling technique)" from "The Art of Computer Programming 3rd
  * Edition Volume 2 / Seminumerical Algorithms".
+ *
+ * Every thread draws from its own SFMT stream, so no lock is taken per number. The streams
+ * are seeded from the master stream of the generator the first time a thread asks for a
+ * number; only that seeding is done under the mutex. Each stream fills a whole block of numbers at once with
+ * SFMT's array generation.
  */
 
 class RNG_SFMT : public RNG_Abstract
 {
     Q_OBJECT
 private:
+    struct Stream
+    {
+        sfmt_t sfmt;
+        alignas(16) uint64_t block[SFMT_N64];
+        int next = SFMT_N64;
+
+        uint64_t generate();
+    };
+
     QMutex mutex;
     sfmt_t sfmt;
+    // tells the streams seeded by this generator apart from those of an earlier one
+    const quint64 generation;
+
+    Stream &localStream();
     // The discrete cumulative distribution function for the RNG
-    unsigned int cdf(unsigned int min, unsigned int max);
+    static unsigned int cdf(Stream &stream, unsigned int min, unsigned int max);
 
 public:
     explicit RNG_SFMT(QObject *parent = nullptr);
     unsigned int rand(int min, int max) override;
+    QVector<unsigned int> makeShuffleDraws(int start, int end) override;
 };
 
 #endif
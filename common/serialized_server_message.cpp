@@ -0,0 +1,105 @@
+#include "serialized_server_message.h"
+
+SerializedServerMessage::SerializedServerMessage(const ServerMessage &item)
+{
+    serialize(item);
+}
+
+SerializedServerMessage::SerializedServerMessage(const Response &item)
+{
+    ServerMessage msg;
+    msg.mutable_response()->CopyFrom(item);
+    msg.set_message_type(ServerMessage::RESPONSE);
+    serialize(msg);
+}
+
+SerializedServerMessage::SerializedServerMessage(const SessionEvent &item)
+{
+    ServerMessage msg;
+    msg.mutable_session_event()->CopyFrom(item);
+    msg.set_message_type(ServerMessage::SESSION_EVENT);
+    serialize(msg);
+}
+
+SerializedServerMessage::SerializedServerMessage(const GameEventContainer &item)
+{
+    ServerMessage msg;
+    msg.mutable_game_event_container()->CopyFrom(item);
+    msg.set_message_type(ServerMessage::GAME_EVENT_CONTAINER);
+    serialize(msg);
+}
+
+SerializedServerMessage::SerializedServerMessage(const RoomEvent &item)
+{
+    ServerMessage msg;
+    msg.mutable_room_event()->CopyFrom(item);
+    msg.set_message_type(ServerMessage::ROOM_EVENT);
+    serialize(msg);
+}
+
+void SerializedServerMessage::serialize(const ServerMessage &item)
+{
+#if GOOGLE_PROTOBUF_VERSION > 3001000
+    unsigned int size = static_cast<unsigned int>(item.ByteSizeLong());
+#else
+    unsigned int size = static_cast<unsigned int>(item.ByteSize());
+#endif
+    frame.resize(size + headerSize);
+    item.SerializeToArray(frame.data() + headerSize, size);
+    frame.data()[3] = (unsigned char)size;
+    frame.data()[2] = (unsigned char)(size >> 8);
+    frame.data()[1] = (unsigned char)(size >> 16);
+    frame.data()[0] = (unsigned char)(size >> 24);
+    if (size >= static_cast<unsigned int>(minCompressiblePayloadSize))
+        compressedFrame = QSharedPointer<CompressedFrame>::create();
+}
+
+bool SerializedServerMessage::toServerMessage(ServerMessage &result) const
+{
+    if (isNull())
+        return false;
+    return result.ParseFromArray(frame.constData() + headerSize, frame.size() - headerSize);
+}
+
+SerializedServerMessage SerializedServerMessage::compressed(bool *compressedNow) const
+{
+    if (compressedNow)
+        *compressedNow = false;
+
+    SerializedServerMessage result;
+    if (!compressedFrame)
+        return result;
+
+    QMutexLocker locker(&compressedFrame->mutex);
+    if (!compressedFrame->done) {
+        const QByteArray compressedPayload =
+            qCompress(reinterpret_cast<const uchar *>(frame.constData() + headerSize), getPayloadSize());
+        ServerMessage msg;
+        msg.set_message_type(ServerMessage::COMPRESSED);
+        msg.set_compressed_message(compressedPayload.constData(), compressedPayload.size());
+        result.serialize(msg);
+        if (result.frame.size() < frame.size())
+            compressedFrame->frame = result.frame;
+        compressedFrame->done = true;
+        if (compressedNow)
+            *compressedNow = true;
+    }
+
+    result.frame = compressedFrame->frame;
+    // the wrapper is never compressed again
+    result.compressedFrame.reset();
+    return result;
+}
+
+bool SerializedServerMessage::uncompress(const ServerMessage &item, ServerMessage &result)
+{
+    if (item.message_type() != ServerMessage::COMPRESSED || !item.has_compressed_message())
+        return false;
+
+    const std::string &compressedPayload = item.compressed_message();
+    const QByteArray payload = qUncompress(reinterpret_cast<const uchar *>(compressedPayload.data()),
+                                           static_cast<int>(compressedPayload.size()));
+    if (payload.isEmpty())
+        return false;
+    return result.ParseFromArray(payload.constData(), payload.size());
+}
@@ -0,0 +1,77 @@
+#ifndef SERIALIZED_SERVER_MESSAGE_H
+#define SERIALIZED_SERVER_MESSAGE_H
+
+#include "pb/server_message.pb.h"
+
+#include <QByteArray>
+#include <QMutex>
+#include <QSharedPointer>
+
+/**
+ * A ServerMessage that has been serialized exactly once and framed for the wire: a 4 byte big-endian length prefix
+ * followed by the protobuf payload.
+ *
+ * The frame is stored in an implicitly shared QByteArray, so copies only bump a reference count and the same bytes
+ * can be queued on any number of sockets, from any thread, without touching protobuf again. The compressed form is
+ * shared the same way: whichever socket asks for it first compresses the frame, the others reuse it.
+ */
+class SerializedServerMessage
+{
+public:
+    static const int headerSize = 4;
+    // smaller payloads don't get shorter by compression, so they don't carry a compressed frame cache
+    static const int minCompressiblePayloadSize = 128;
+
+private:
+    struct CompressedFrame
+    {
+        QMutex mutex;
+        bool done = false;
+        QByteArray frame; // empty if compression didn't pay off
+    };
+
+    QByteArray frame;
+    QSharedPointer<CompressedFrame> compressedFrame;
+
+    void serialize(const ServerMessage &item);
+
+public:
+    SerializedServerMessage() = default;
+    explicit SerializedServerMessage(const ServerMessage &item);
+    explicit SerializedServerMessage(const Response &item);
+    explicit SerializedServerMessage(const SessionEvent &item);
+    explicit SerializedServerMessage(const GameEventContainer &item);
+    explicit SerializedServerMessage(const RoomEvent &item);
+
+    bool isNull() const
+    {
+        return frame.isEmpty();
+    }
+    // Length prefix + payload, as expected by stream based transports (tcp)
+    const QByteArray &getFrame() const
+    {
+        return frame;
+    }
+    // Payload only, as expected by message based transports (websocket).
+    // The returned array references the frame's memory and must not outlive this object.
+    QByteArray getPayload() const
+    {
+        if (isNull())
+            return QByteArray();
+        return QByteArray::fromRawData(frame.constData() + headerSize, frame.size() - headerSize);
+    }
+    int getPayloadSize() const
+    {
+        return isNull() ? 0 : frame.size() - headerSize;
+    }
+    bool toServerMessage(ServerMessage &result) const;
+
+    // This message wrapped into a COMPRESSED ServerMessage, or a null message if that would not be smaller.
+    // The frame is compressed by the first call on any copy of this message; compressedNow tells whether it was this
+    // one.
+    SerializedServerMessage compressed(bool *compressedNow = nullptr) const;
+    // Unpacks a COMPRESSED ServerMessage; fails for any other message type.
+    static bool uncompress(const ServerMessage &item, ServerMessage &result);
+};
+
+#endif
@@ -27,6 +27,7 @@
 #include "pb/event_user_left.pb.h"
 #include "pb/isl_message.pb.h"
 #include "pb/session_event.pb.h"
+#include "serialized_server_message.h"
 #include "server_counter.h"
 #include "server_database_interface.h"
 #include "server_game.h"
@@ -37,9 +38,11 @@
 
 #include <QCoreApplication>
 #include <QDebug>
+#include <QElapsedTimer>
 #include <QThread>
 
-Server::Server(QObject *parent) : QObject(parent), nextLocalGameId(0), tcpUserCount(0), webSocketUserCount(0)
+Server::Server(QObject *parent)
+    : QObject(parent), nextLocalGameId(0), tcpUserCount(0), webSocketUserCount(0)
 {
     qRegisterMetaType<ServerInfo_Ban>("ServerInfo_Ban");
     qRegisterMetaType<ServerInfo_Game>("ServerInfo_Game");
@@ -109,82 +112,156 @@ AuthenticationResult Server::loginUser(Server_ProtocolHandler *session,
     data.set_address(session->getAddress().toStdString());
     name = QString::fromStdString(data.name()); // Compensate for case indifference
 
+    // Login runs in stages so that the database round trips don't happen under clientsLock: only the insertion into
+    // the user maps below is done with the write lock held.
     if (authState == PasswordRight) {
-        if (users.contains(name) || databaseInterface->userSessionExists(name)) {
-            if (users.contains(name)) {
-                qDebug("Session already logged in, logging old session out");
-                Event_ConnectionClosed event;
-                event.set_reason(Event_ConnectionClosed::LOGGEDINELSEWERE);
-                event.set_reason_str("You have been logged out due to logging in at another location.");
-                event.set_end_time(QDateTime::currentDateTime().toSecsSinceEpoch());
-
-                SessionEvent *se = users.value(name)->prepareSessionEvent(event);
-                users.value(name)->sendProtocolItem(*se);
-                delete se;
-
-                users.value(name)->prepareDestroy();
-            } else {
-                qDebug() << "Active session and sessions table inconsistent, please validate session table information "
-                            "for user "
-                         << name;
-            }
+        Server_ProtocolHandler *oldSession;
+        {
+            QReadLocker locker(&clientsLock);
+            oldSession = users.value(name);
+        }
+        if (oldSession) {
+            logOutSupersededSession(oldSession);
+        } else if (databaseInterface->userSessionExists(name)) {
+            qDebug() << "Active session and sessions table inconsistent, please validate session table information "
+                        "for user "
+                     << name;
         }
-
     } else if (authState == UnknownUser) {
         // Change user name so that no two users have the same names,
         // don't interfere with registered user names though.
         if (getRegOnlyServerEnabled()) {
             qDebug("Login denied: registration required");
-            databaseInterface->unlockSessionTables();
             return RegistrationRequired;
         }
 
-        QString tempName = name;
-        int i = 0;
-        while (users.contains(tempName) || databaseInterface->activeUserExists(tempName) ||
-               databaseInterface->userSessionExists(tempName))
-            tempName = name + "_" + QString::number(++i);
-        name = tempName;
+        name = reserveUnregisteredUserName(name, databaseInterface);
         data.set_name(name.toStdString());
     }
 
-    QWriteLocker locker(&clientsLock);
-    databaseInterface->lockSessionTables();
-    users.insert(name, session);
-    qDebug() << "Server::loginUser:" << session << "name=" << name;
-
     data.set_session_id(static_cast<google::protobuf::uint64>(
         databaseInterface->startSession(name, session->getAddress(), clientid, session->getConnectionType())));
-    databaseInterface->unlockSessionTables();
+    session->setUserInfo(data);
 
-    usersBySessionId.insert(data.session_id(), session);
+    Server_ProtocolHandler *supersededSession;
+    {
+        QElapsedTimer lockWaitTimer;
+        lockWaitTimer.start();
+        QWriteLocker locker(&clientsLock);
+        metrics.observeLockWait(ServerMetrics::ClientsLock, lockWaitTimer.nsecsElapsed());
+        // a concurrent login of the same user may have got in first
+        supersededSession = users.value(name);
+        users.insert(name, session);
+        usersBySessionId.insert(data.session_id(), session);
+        if (authState == UnknownUser) {
+            QMutexLocker pendingLocker(&pendingLoginNamesMutex);
+            pendingLoginNames.remove(name);
+        }
+    }
+    qDebug() << "Server::loginUser:" << session << "name=" << name << "session id:" << data.session_id();
 
-    qDebug() << "session id:" << data.session_id();
-    session->setUserInfo(data);
+    if (supersededSession && supersededSession != session) {
+        logOutSupersededSession(supersededSession);
+    }
 
-    Event_UserJoined event;
-    event.mutable_user_info()->CopyFrom(session->copyUserInfo(false));
-    SessionEvent *se = Server_ProtocolHandler::prepareSessionEvent(event);
-    for (auto &client : clients)
-        if (client->getAcceptsUserListChanges())
-            client->sendProtocolItem(*se);
-    delete se;
+    queueUserJoinedEvent(name, session->copyUserInfo(false));
+    {
+        QReadLocker locker(&clientsLock);
+        sendPendingUserJoinedEvents();
+    }
 
+    Event_UserJoined event;
     event.mutable_user_info()->CopyFrom(session->copyUserInfo(true, true, true));
-    locker.unlock();
 
     if (hasClientId) {
         // update users database table with client id
         databaseInterface->updateUsersClientID(name, clientid);
     }
     databaseInterface->updateUsersLastLoginData(name, clientVersion);
-    se = Server_ProtocolHandler::prepareSessionEvent(event);
+    SessionEvent *se = Server_ProtocolHandler::prepareSessionEvent(event);
     sendIsl_SessionEvent(*se);
     delete se;
 
     return authState;
 }
 
+void Server::logOutSupersededSession(Server_ProtocolHandler *oldSession)
+{
+    qDebug("Session already logged in, logging old session out");
+    Event_ConnectionClosed event;
+    event.set_reason(Event_ConnectionClosed::LOGGEDINELSEWERE);
+    event.set_reason_str("You have been logged out due to logging in at another location.");
+    event.set_end_time(QDateTime::currentDateTime().toSecsSinceEpoch());
+
+    SessionEvent *se = oldSession->prepareSessionEvent(event);
+    oldSession->sendProtocolItem(*se);
+    delete se;
+
+    oldSession->prepareDestroy();
+}
+
+QString Server::reserveUnregisteredUserName(const QString &name, Server_DatabaseInterface *databaseInterface)
+{
+    QString tempName = name;
+    int i = 0;
+    forever
+    {
+        if (!databaseInterface->activeUserExists(tempName) && !databaseInterface->userSessionExists(tempName)) {
+            QReadLocker clientsLocker(&clientsLock);
+            QMutexLocker locker(&pendingLoginNamesMutex);
+            if (!users.contains(tempName) && !pendingLoginNames.contains(tempName)) {
+                pendingLoginNames.insert(tempName);
+                return tempName;
+            }
+        }
+        tempName = name + "_" + QString::number(++i);
+    }
+}
+
+void Server::queueUserJoinedEvent(const QString &userName, const ServerInfo_User &userInfo)
+{
+    Event_UserJoined event;
+    event.mutable_user_info()->CopyFrom(userInfo);
+    SessionEvent *se = Server_ProtocolHandler::prepareSessionEvent(event);
+    const SerializedServerMessage serializedEvent(*se);
+    delete se;
+
+    QMutexLocker locker(&pendingUserJoinedMutex);
+    if (!pendingUserJoinedEvents.contains(userName))
+        pendingUserJoinedNames.append(userName);
+    pendingUserJoinedEvents.insert(userName, serializedEvent);
+}
+
+void Server::sendPendingUserJoinedEvents()
+{
+    // Call this only with clientsLock set.
+
+    QList<SerializedServerMessage> events;
+    {
+        QMutexLocker locker(&pendingUserJoinedMutex);
+        if (pendingUserJoinedNames.isEmpty())
+            return;
+        events.reserve(pendingUserJoinedNames.size());
+        for (const QString &userName : pendingUserJoinedNames)
+            events.append(pendingUserJoinedEvents.value(userName));
+        pendingUserJoinedNames.clear();
+        pendingUserJoinedEvents.clear();
+    }
+
+    // one pass over the clients for every login that queued up in the meantime
+    for (auto &client : clients)
+        if (client->getAcceptsUserListChanges())
+            for (const SerializedServerMessage &event : events)
+                client->sendProtocolItem(event);
+}
+
+void Server::dropPendingUserJoinedEvent(const QString &userName)
+{
+    QMutexLocker locker(&pendingUserJoinedMutex);
+    if (pendingUserJoinedEvents.remove(userName))
+        pendingUserJoinedNames.removeOne(userName);
+}
+
 void Server::addPersistentPlayer(const QString &userName, int roomId, int gameId, int playerId)
 {
     QWriteLocker locker(&persistentPlayersLock);
@@ -222,7 +299,10 @@ void Server::addClient(Server_ProtocolHandler *client)
     if (client->getConnectionType() == "websocket")
         webSocketUserCount++;
 
+    QElapsedTimer lockWaitTimer;
+    lockWaitTimer.start();
     QWriteLocker locker(&clientsLock);
+    metrics.observeLockWait(ServerMetrics::ClientsLock, lockWaitTimer.nsecsElapsed());
     clients << client;
 }
 
@@ -240,22 +320,42 @@ void Server::removeClient(Server_ProtocolHandler *client)
     if (client->getConnectionType() == "websocket")
         webSocketUserCount--;
 
+    QElapsedTimer lockWaitTimer;
+    lockWaitTimer.start();
     QWriteLocker locker(&clientsLock);
+    metrics.observeLockWait(ServerMetrics::ClientsLock, lockWaitTimer.nsecsElapsed());
     clients.removeAt(clientIndex);
     ServerInfo_User *data = client->getUserInfo();
+    // the user may have logged in again in the meantime, with another session
+    if (data && users.value(QString::fromStdString(data->name())) != client) {
+        if (data->has_session_id()) {
+            const qint64 sessionId = data->session_id();
+            usersBySessionId.remove(sessionId);
+            emit endSession(sessionId);
+        }
+        data = nullptr;
+    }
     if (data) {
+        // a join nobody has been told about yet
+        dropPendingUserJoinedEvent(QString::fromStdString(data->name()));
+
         Event_UserLeft event;
         event.set_name(data->name());
         SessionEvent *se = Server_ProtocolHandler::prepareSessionEvent(event);
+        const SerializedServerMessage serializedEvent(*se);
         for (auto &_client : clients)
             if (_client->getAcceptsUserListChanges())
-                _client->sendProtocolItem(*se);
+                _client->sendProtocolItem(serializedEvent);
         sendIsl_SessionEvent(*se);
         delete se;
 
         users.remove(QString::fromStdString(data->name()));
         qDebug() << "Server::removeClient: name=" << QString::fromStdString(data->name());
 
+        Server_DatabaseInterface *databaseInterface = getDatabaseInterface();
+        if (databaseInterface)
+            databaseInterface->releaseUserLists(QString::fromStdString(data->name()));
+
         if (data->has_session_id()) {
             const qint64 sessionId = data->session_id();
             usersBySessionId.remove(sessionId);
@@ -287,6 +387,12 @@ void Server::externalUserJoined(const ServerInfo_User &userInfo)
     // This function is always called from the main thread via signal/slot.
     clientsLock.lockForWrite();
 
+    // a state sync may repeat a join that was already relayed
+    if (externalUsers.contains(QString::fromStdString(userInfo.name()))) {
+        clientsLock.unlock();
+        return;
+    }
+
     Server_RemoteUserInterface *newUser = new Server_RemoteUserInterface(this, ServerInfo_User_Container(userInfo));
     externalUsers.insert(QString::fromStdString(userInfo.name()), newUser);
     externalUsersBySessionId.insert(userInfo.session_id(), newUser);
@@ -295,9 +401,10 @@ void Server::externalUserJoined(const ServerInfo_User &userInfo)
     event.mutable_user_info()->CopyFrom(userInfo);
 
     SessionEvent *se = Server_ProtocolHandler::prepareSessionEvent(event);
+    const SerializedServerMessage serializedEvent(*se);
     for (auto &client : clients)
         if (client->getAcceptsUserListChanges())
-            client->sendProtocolItem(*se);
+            client->sendProtocolItem(serializedEvent);
     delete se;
     clientsLock.unlock();
 
@@ -312,6 +419,10 @@ void Server::externalUserLeft(const QString &userName)
 
     clientsLock.lockForWrite();
     Server_AbstractUserInterface *user = externalUsers.take(userName);
+    if (!user) {
+        clientsLock.unlock();
+        return;
+    }
     externalUsersBySessionId.remove(user->getUserInfo()->session_id());
     clientsLock.unlock();
 
@@ -344,10 +455,11 @@ void Server::externalUserLeft(const QString &userName)
     event.set_name(userName.toStdString());
 
     SessionEvent *se = Server_ProtocolHandler::prepareSessionEvent(event);
+    const SerializedServerMessage serializedEvent(*se);
     clientsLock.lockForRead();
     for (auto &client : clients)
         if (client->getAcceptsUserListChanges())
-            client->sendProtocolItem(*se);
+            client->sendProtocolItem(serializedEvent);
     clientsLock.unlock();
     delete se;
 }
@@ -549,11 +661,12 @@ void Server::broadcastRoomUpdate(const ServerInfo_Room &roomInfo, bool sendToIsl
     event.add_room_list()->CopyFrom(roomInfo);
 
     SessionEvent *se = Server_ProtocolHandler::prepareSessionEvent(event);
+    const SerializedServerMessage serializedEvent(*se);
 
     clientsLock.lockForRead();
     for (auto &client : clients)
         if (client->getAcceptsRoomListChanges())
-            client->sendProtocolItem(*se);
+            client->sendProtocolItem(serializedEvent);
     clientsLock.unlock();
 
     if (sendToIsl)
@@ -583,11 +696,8 @@ int Server::getGamesCount() const
     int result = 0;
     QReadLocker locker(&roomsLock);
     QMapIterator<int, Server_Room *> roomIterator(rooms);
-    while (roomIterator.hasNext()) {
-        Server_Room *room = roomIterator.next().value();
-        QReadLocker roomLocker(&room->gamesLock);
-        result += room->getGames().size();
-    }
+    while (roomIterator.hasNext())
+        result += roomIterator.next().value()->getGameCount();
     return result;
 }
 
@@ -6,13 +6,17 @@
 #include "pb/serverinfo_chat_message.pb.h"
 #include "pb/serverinfo_user.pb.h"
 #include "pb/serverinfo_warning.pb.h"
+#include "serialized_server_message.h"
+#include "server_metrics.h"
 #include "server_player_reference.h"
 
+#include <QHash>
 #include <QMap>
 #include <QMultiMap>
 #include <QMutex>
 #include <QObject>
 #include <QReadWriteLock>
+#include <QSet>
 #include <QStringList>
 
 class Server_DatabaseInterface;
@@ -20,7 +24,7 @@ class Server_Game;
 class Server_Room;
 class Server_ProtocolHandler;
 class Server_AbstractUserInterface;
-class GameReplay;
+class Server_ReplayWriter;
 class IslMessage;
 class SessionEvent;
 class RoomEvent;
@@ -158,6 +162,10 @@ public:
     {
         return -1;
     }
+    virtual int getGameListUpdateInterval() const
+    {
+        return 0;
+    }
     virtual int getCommandCountingInterval() const
     {
         return 0;
@@ -212,11 +220,32 @@ public:
         return webSocketUserCount;
     }
 
+    // Sends the user joined events queued by logins to the clients. Call this only with clientsLock set.
+    void sendPendingUserJoinedEvents();
+
+    ServerMetrics &getMetrics()
+    {
+        return metrics;
+    }
+
 private:
     QMultiMap<QString, PlayerReference> persistentPlayers;
     mutable QReadWriteLock persistentPlayersLock;
     int nextLocalGameId, tcpUserCount, webSocketUserCount;
     QMutex nextLocalGameIdMutex;
+    ServerMetrics metrics;
+    // names handed to unregistered users whose login hasn't completed yet
+    QMutex pendingLoginNamesMutex;
+    QSet<QString> pendingLoginNames;
+    // user joined events not sent yet, coalesced by user name
+    QMutex pendingUserJoinedMutex;
+    QStringList pendingUserJoinedNames;
+    QHash<QString, SerializedServerMessage> pendingUserJoinedEvents;
+
+    void logOutSupersededSession(Server_ProtocolHandler *oldSession);
+    QString reserveUnregisteredUserName(const QString &name, Server_DatabaseInterface *databaseInterface);
+    void queueUserJoinedEvent(const QString &userName, const ServerInfo_User &userInfo);
+    void dropPendingUserJoinedEvent(const QString &userName);
 
 protected slots:
     void externalUserJoined(const ServerInfo_User &userInfo);
@@ -62,6 +62,9 @@ void Server_AbstractUserInterface::sendResponseContainer(const ResponseContainer
         sendProtocolItem(response);
     }
 
+    for (const SerializedServerMessage &item : responseContainer.getSerializedPostResponseQueue())
+        sendProtocolItem(item);
+
     const QList<QPair<ServerMessage::MessageType, ::google::protobuf::Message *>> &postResponseQueue =
         responseContainer.getPostResponseQueue();
     for (int i = 0; i < postResponseQueue.size(); ++i)
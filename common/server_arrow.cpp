@@ -18,11 +18,11 @@ void Server_Arrow::getInfo(ServerInfo_Arrow *info)
     info->set_start_card_id(startCard->getId());
     info->mutable_arrow_color()->CopyFrom(arrowColor);
 
-    Server_Card *targetCard = qobject_cast<Server_Card *>(targetItem);
+    Server_Card *targetCard = dynamic_cast<Server_Card *>(targetItem);
     if (targetCard) {
         info->set_target_player_id(targetCard->getZone()->getPlayer()->getPlayerId());
         info->set_target_zone(targetCard->getZone()->getName().toStdString());
         info->set_target_card_id(targetCard->getId());
     } else
-        info->set_target_player_id(static_cast<Server_Player *>(targetItem)->getPlayerId());
+        info->set_target_player_id(dynamic_cast<Server_Player *>(targetItem)->getPlayerId());
 }
@@ -1,11 +1,12 @@
 #ifndef SERVER_ARROWTARGET_H
 #define SERVER_ARROWTARGET_H
 
-#include <QObject>
-
-class Server_ArrowTarget : public QObject
+// A card or a player, something an arrow can point at. Deliberately not a QObject: a game creates and destroys
+// hundreds of cards, and they don't need signals, slots or thread affinity.
+class Server_ArrowTarget
 {
-    Q_OBJECT
+public:
+    virtual ~Server_ArrowTarget() = default;
 };
 
 #endif
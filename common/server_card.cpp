@@ -25,7 +25,137 @@
 #include "server_cardzone.h"
 #include "server_player.h"
 
+#include <QMutex>
 #include <QVariant>
+#include <cstddef>
+
+namespace
+{
+// Decks are created on every game start and mulligan, and tokens come and go by the hundreds, so the memory of
+// destroyed cards is kept for the next ones instead of going back to the general purpose allocator.
+//
+// Game commands run on the connection pool threads, and each thread allocates from a pool of its own. A card can
+// be destroyed on another thread than the one that created it, so it remembers its pool and goes back there;
+// otherwise the memory would pile up on whichever threads happen to destroy cards. A pool outlives its thread
+// until all of its cards are gone.
+class CardPool;
+
+struct alignas(alignof(std::max_align_t)) CardHeader
+{
+    // null for cards allocated while their thread was shutting down
+    CardPool *pool;
+    CardHeader *nextFree;
+};
+
+class CardPool
+{
+private:
+    static const int maxFreeCards = 4096;
+
+    // only contended when another thread returns a card
+    QMutex mutex;
+    CardHeader *freeList = nullptr;
+    int freeCount = 0;
+    // cards of this pool that are alive
+    int liveCards = 0;
+    bool threadFinished = false;
+
+public:
+    void *allocate(std::size_t size)
+    {
+        CardHeader *header;
+        {
+            QMutexLocker locker(&mutex);
+            ++liveCards;
+            header = freeList;
+            if (header) {
+                freeList = header->nextFree;
+                --freeCount;
+            }
+        }
+        if (!header) {
+            header = static_cast<CardHeader *>(::operator new(sizeof(CardHeader) + size));
+            header->pool = this;
+        }
+        return header + 1;
+    }
+
+    // May be called on any thread
+    static void release(void *ptr)
+    {
+        CardHeader *header = static_cast<CardHeader *>(ptr) - 1;
+        CardPool *pool = header->pool;
+        bool deletePool = false;
+        if (pool) {
+            QMutexLocker locker(&pool->mutex);
+            --pool->liveCards;
+            if (!pool->threadFinished && pool->freeCount < maxFreeCards) {
+                header->nextFree = pool->freeList;
+                pool->freeList = header;
+                ++pool->freeCount;
+                return;
+            }
+            deletePool = pool->threadFinished && pool->liveCards == 0;
+        }
+        ::operator delete(header);
+        if (deletePool)
+            delete pool;
+    }
+
+    // Called when the thread of the pool exits
+    void finishThread()
+    {
+        CardHeader *header;
+        bool deletePool;
+        {
+            QMutexLocker locker(&mutex);
+            threadFinished = true;
+            header = freeList;
+            freeList = nullptr;
+            freeCount = 0;
+            deletePool = liveCards == 0;
+        }
+        while (header) {
+            CardHeader *next = header->nextFree;
+            ::operator delete(header);
+            header = next;
+        }
+        if (deletePool)
+            delete this;
+    }
+};
+
+// Plain pointers stay valid during thread shutdown, after the destructors of thread_local objects have run
+thread_local CardPool *threadCardPool = nullptr;
+thread_local bool threadCardPoolFinished = false;
+
+struct CardPoolThreadExit
+{
+    ~CardPoolThreadExit()
+    {
+        threadCardPoolFinished = true;
+        if (threadCardPool)
+            threadCardPool->finishThread();
+        threadCardPool = nullptr;
+    }
+};
+thread_local CardPoolThreadExit cardPoolThreadExit;
+
+void *allocateCard(std::size_t size)
+{
+    if (!threadCardPool && !threadCardPoolFinished) {
+        // constructs the exit hook of this thread
+        (void)&cardPoolThreadExit;
+        threadCardPool = new CardPool;
+    }
+    if (threadCardPool)
+        return threadCardPool->allocate(size);
+
+    auto *header = static_cast<CardHeader *>(::operator new(sizeof(CardHeader) + size));
+    header->pool = nullptr;
+    return header + 1;
+}
+} // namespace
 
 Server_Card::Server_Card(QString _name,
                          QString _provider_id,
@@ -33,12 +163,29 @@ Server_Card::Server_Card(QString _name,
                          int _coord_x,
                          int _coord_y,
                          Server_CardZone *_zone)
-    : zone(_zone), id(_id), coord_x(_coord_x), coord_y(_coord_y), name(_name), provider_id(_provider_id), tapped(false),
-      attacking(false), facedown(false), color(), ptString(), annotation(), destroyOnZoneChange(false),
-      doesntUntap(false), parentCard(0), stashedCard(nullptr)
+    : zone(_zone), zonePosition(-1), id(_id), coord_x(_coord_x), coord_y(_coord_y), name(_name),
+      provider_id(_provider_id), tapped(false), attacking(false), facedown(false), color(), ptString(), annotation(),
+      destroyOnZoneChange(false), doesntUntap(false), parentCard(0), stashedCard(nullptr)
 {
 }
 
+void *Server_Card::operator new(std::size_t size)
+{
+    if (size == sizeof(Server_Card))
+        return allocateCard(size);
+    return ::operator new(size);
+}
+
+void Server_Card::operator delete(void *ptr, std::size_t size)
+{
+    if (!ptr)
+        return;
+    if (size == sizeof(Server_Card))
+        CardPool::release(ptr);
+    else
+        ::operator delete(ptr);
+}
+
 Server_Card::~Server_Card()
 {
     // setParentCard(0) leads to the item being removed from our list, so we can't iterate properly
@@ -49,14 +196,40 @@ Server_Card::~Server_Card()
         parentCard->removeAttachedCard(this);
 
     if (stashedCard) {
-        stashedCard->deleteLater();
+        delete stashedCard;
         stashedCard = nullptr;
     }
 }
 
+void Server_Card::changed()
+{
+    if (zone)
+        zone->invalidateCardListCache();
+    // the attached cards show where their parent is
+    for (Server_Card *attachedCard : attachedCards)
+        if (attachedCard->zone)
+            attachedCard->zone->invalidateCardListCache();
+}
+
+void Server_Card::setZone(Server_CardZone *_zone)
+{
+    zone = _zone;
+    changed();
+}
+
+void Server_Card::setId(int _id)
+{
+    const int oldId = id;
+    id = _id;
+    if (zone)
+        zone->cardIdChanged(this, oldId);
+    changed();
+}
+
 void Server_Card::resetState(bool keepAnnotations)
 {
     counters.clear();
+    changed();
     setTapped(false);
     setAttacking(false);
     setPT(QString());
@@ -116,6 +289,7 @@ void Server_Card::setCounter(int _id, int value, Event_SetCardCounter *event)
         counters.insert(_id, value);
     else
         counters.remove(_id);
+    changed();
 
     if (event) {
         event->set_counter_id(_id);
@@ -130,6 +304,7 @@ void Server_Card::setParentCard(Server_Card *_parentCard)
     parentCard = _parentCard;
     if (parentCard)
         parentCard->addAttachedCard(this);
+    changed();
 }
 
 void Server_Card::getInfo(ServerInfo_Card *info)
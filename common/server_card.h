@@ -26,6 +26,7 @@
 
 #include <QMap>
 #include <QString>
+#include <cstddef>
 
 class Server_CardZone;
 class Event_SetCardCounter;
@@ -33,9 +34,9 @@ class Event_SetCardAttr;
 
 class Server_Card : public Server_ArrowTarget
 {
-    Q_OBJECT
 private:
     Server_CardZone *zone;
+    int zonePosition; // cached by the zone, only valid while the zone says so
     int id;
     int coord_x, coord_y;
     QString name;
@@ -54,6 +55,9 @@ private:
     QList<Server_Card *> attachedCards;
     Server_Card *stashedCard;
 
+    // Invalidates the card lists cached by the zones showing this card
+    void changed();
+
 public:
     Server_Card(QString _name,
                 QString _provider_id,
@@ -63,13 +67,22 @@ public:
                 Server_CardZone *_zone = nullptr);
     ~Server_Card() override;
 
+    // Cards are allocated from a recycling pool, see server_card.cpp
+    static void *operator new(std::size_t size);
+    static void operator delete(void *ptr, std::size_t size);
+
     Server_CardZone *getZone() const
     {
         return zone;
     }
-    void setZone(Server_CardZone *_zone)
+    void setZone(Server_CardZone *_zone);
+    int getZonePosition() const
+    {
+        return zonePosition;
+    }
+    void setZonePosition(int _zonePosition)
     {
-        zone = _zone;
+        zonePosition = _zonePosition;
     }
 
     int getId() const
@@ -141,51 +154,58 @@ public:
         return attachedCards;
     }
 
-    void setId(int _id)
-    {
-        id = _id;
-    }
+    void setId(int _id);
     void setCoords(int x, int y)
     {
         coord_x = x;
         coord_y = y;
+        changed();
     }
     void setName(const QString &_name)
     {
         name = _name;
+        changed();
     }
     void setCounter(int _id, int value, Event_SetCardCounter *event = nullptr);
     void setTapped(bool _tapped)
     {
         tapped = _tapped;
+        changed();
     }
     void setAttacking(bool _attacking)
     {
         attacking = _attacking;
+        changed();
     }
     void setFaceDown(bool _facedown)
     {
         facedown = _facedown;
+        changed();
     }
     void setColor(const QString &_color)
     {
         color = _color;
+        changed();
     }
     void setPT(const QString &_pt)
     {
         ptString = _pt;
+        changed();
     }
     void setAnnotation(const QString &_annotation)
     {
         annotation = _annotation;
+        changed();
     }
     void setDestroyOnZoneChange(bool _destroy)
     {
         destroyOnZoneChange = _destroy;
+        changed();
     }
     void setDoesntUntap(bool _doesntUntap)
     {
         doesntUntap = _doesntUntap;
+        changed();
     }
     void setParentCard(Server_Card *_parentCard);
     void addAttachedCard(Server_Card *card)
@@ -206,7 +226,7 @@ public:
         // be stashed.
         if (card->stashedCard || card->getDestroyOnZoneChange()) {
             stashedCard = card->takeStashedCard();
-            card->deleteLater();
+            delete card;
         } else {
             stashedCard = card;
         }
@@ -32,7 +32,8 @@ Server_CardZone::Server_CardZone(Server_Player *_player,
                                  bool _has_coords,
                                  ServerInfo_Zone::ZoneType _type)
     : player(_player), name(_name), has_coords(_has_coords), type(_type), cardsBeingLookedAt(0),
-      alwaysRevealTopCard(false), alwaysLookAtTopCard(false)
+      alwaysRevealTopCard(false), alwaysLookAtTopCard(false), validPositions(0),
+      cardListCacheValid(false)
 {
 }
 
@@ -61,14 +62,16 @@ void Server_CardZone::shuffle(int start, int end)
     if (start < 0 || end < 0 || start >= cards.size() || end >= cards.size())
         return;
 
+    const QVector<unsigned int> draws = rng->makeShuffleDraws(start, end);
     for (int i = end; i > start; i--) {
-        int j = rng->rand(start, i);
+        int j = static_cast<int>(draws[end - i]);
 #if (QT_VERSION >= QT_VERSION_CHECK(5, 13, 0))
         cards.swapItemsAt(j, i);
 #else
         cards.swap(j, i);
 #endif
     }
+    invalidatePositionsFrom(start);
     playersWithWritePermission.clear();
 }
 
@@ -122,6 +125,38 @@ void Server_CardZone::insertCardIntoCoordMap(Server_Card *card, int x, int y)
     }
 }
 
+int Server_CardZone::positionOf(Server_Card *card)
+{
+    const int cachedPosition = card->getZonePosition();
+    if (cachedPosition >= 0 && cachedPosition < validPositions && cards.at(cachedPosition) == card)
+        return cachedPosition;
+
+    // Only the positions up to the card are refreshed: when cards are taken out front to back, as a mass move does,
+    // every card is scanned once for the whole batch rather than once per card.
+    for (int i = validPositions; i < cards.size(); ++i) {
+        cards.at(i)->setZonePosition(i);
+        if (cards.at(i) == card) {
+            validPositions = i + 1;
+            return i;
+        }
+    }
+    validPositions = static_cast<int>(cards.size());
+    return -1;
+}
+
+void Server_CardZone::takeCardAt(int index)
+{
+    Server_Card *card = cards.takeAt(index);
+    cardsById.remove(card->getId(), card);
+    invalidatePositionsFrom(index);
+}
+
+void Server_CardZone::cardIdChanged(Server_Card *card, int oldId)
+{
+    if (cardsById.remove(oldId, card))
+        cardsById.insert(card->getId(), card);
+}
+
 int Server_CardZone::removeCard(Server_Card *card)
 {
     bool wasLookedAt;
@@ -130,12 +165,13 @@ int Server_CardZone::removeCard(Server_Card *card)
 
 int Server_CardZone::removeCard(Server_Card *card, bool &wasLookedAt)
 {
-    int index = cards.indexOf(card);
+    int index = positionOf(card);
     wasLookedAt = isCardAtPosLookedAt(index);
     if (wasLookedAt && cardsBeingLookedAt > 0) {
         cardsBeingLookedAt -= 1;
     }
-    cards.removeAt(index);
+    if (index != -1)
+        takeCardAt(index);
     if (has_coords) {
         removeCardFromCoordMap(card, card->getX(), card->getY());
     }
@@ -147,19 +183,19 @@ int Server_CardZone::removeCard(Server_Card *card, bool &wasLookedAt)
 Server_Card *Server_CardZone::getCard(int id, int *position, bool remove)
 {
     if (type != ServerInfo_Zone::HiddenZone) {
-        for (int i = 0; i < cards.size(); ++i) {
-            Server_Card *tmp = cards[i];
-            if (tmp->getId() == id) {
-                if (position)
-                    *position = i;
-                if (remove) {
-                    cards.removeAt(i);
-                    tmp->setZone(nullptr);
-                }
-                return tmp;
+        Server_Card *tmp = cardsById.value(id);
+        if (!tmp)
+            return nullptr;
+        if (position || remove) {
+            const int i = positionOf(tmp);
+            if (position)
+                *position = i;
+            if (remove) {
+                takeCardAt(i);
+                tmp->setZone(nullptr);
             }
         }
-        return nullptr;
+        return tmp;
     } else {
         if ((id >= cards.size()) || (id < 0))
             return nullptr;
@@ -167,7 +203,7 @@ Server_Card *Server_CardZone::getCard(int id, int *position, bool remove)
         if (position)
             *position = id;
         if (remove) {
-            cards.removeAt(id);
+            takeCardAt(id);
             tmp->setZone(nullptr);
         }
         return tmp;
@@ -286,17 +322,23 @@ void Server_CardZone::updateCardCoordinates(Server_Card *card, int oldX, int old
 
 void Server_CardZone::insertCard(Server_Card *card, int x, int y)
 {
+    if (!hasCoords() && 0 <= x && x < cards.length()) {
+        cards.insert(x, card);
+        invalidatePositionsFrom(x);
+    } else {
+        if (validPositions == cards.size()) {
+            card->setZonePosition(static_cast<int>(cards.size()));
+            ++validPositions;
+        }
+        cards.append(card);
+    }
+    cardsById.insert(card->getId(), card);
+
     if (hasCoords()) {
         card->setCoords(x, y);
-        cards.append(card);
         insertCardIntoCoordMap(card, x, y);
     } else {
         card->setCoords(0, 0);
-        if (0 <= x && x < cards.length()) {
-            cards.insert(x, card);
-        } else {
-            cards.append(card);
-        }
     }
     card->setZone(this);
 }
@@ -306,6 +348,9 @@ void Server_CardZone::clear()
     for (auto card : cards)
         delete card;
     cards.clear();
+    cardsById.clear();
+    validPositions = 0;
+    cardListCacheValid = false;
     coordinateMap.clear();
     freePilesMap.clear();
     freeSpaceMap.clear();
@@ -332,8 +377,14 @@ void Server_CardZone::getInfo(ServerInfo_Zone *info, Server_Player *playerWhosAs
     const auto otherPlayerAsking = playerWhosAsking != player;
     const auto zonesOthersCanSee = type == ServerInfo_Zone::PublicZone;
     if ((selfPlayerAsking && zonesSelfCanSee) || (otherPlayerAsking && zonesOthersCanSee)) {
-        QListIterator<Server_Card *> cardIterator(cards);
-        while (cardIterator.hasNext())
-            cardIterator.next()->getInfo(info->add_card_list());
+        // Everyone allowed to see the cards sees the same list, and the game state is sent to every player and
+        // spectator at once; only walk the cards again if one of them has changed since.
+        if (!cardListCacheValid) {
+            cardListCache.clear_card_list();
+            for (Server_Card *card : cards)
+                card->getInfo(cardListCache.add_card_list());
+            cardListCacheValid = true;
+        }
+        info->mutable_card_list()->CopyFrom(cardListCache.card_list());
     }
 }
@@ -24,6 +24,7 @@
 
 #include <QList>
 #include <QMap>
+#include <QMultiHash>
 #include <QSet>
 #include <QString>
 
@@ -44,11 +45,24 @@ private:
     bool alwaysRevealTopCard;
     bool alwaysLookAtTopCard;
     QList<Server_Card *> cards;
+    QMultiHash<int, Server_Card *> cardsById;
+    // the zone positions cached in cards[0 .. validPositions - 1] are up to date
+    int validPositions;
+    // the card list shown to the players allowed to see the cards, rebuilt after a card has changed
+    ServerInfo_Zone cardListCache;
+    bool cardListCacheValid;
     QMap<int, QMap<int, Server_Card *>> coordinateMap; // y -> (x -> card)
     QMap<int, QMultiMap<QString, int>> freePilesMap;   // y -> (cardName -> x)
     QMap<int, int> freeSpaceMap;                       // y -> x
     void removeCardFromCoordMap(Server_Card *card, int oldX, int oldY);
     void insertCardIntoCoordMap(Server_Card *card, int x, int y);
+    int positionOf(Server_Card *card);
+    void takeCardAt(int index);
+    void invalidatePositionsFrom(int index)
+    {
+        validPositions = qMin(validPositions, index);
+        cardListCacheValid = false;
+    }
 
 public:
     Server_CardZone(Server_Player *_player, const QString &_name, bool _has_coords, ServerInfo_Zone::ZoneType _type);
@@ -61,6 +75,12 @@ public:
     int removeCard(Server_Card *card);
     int removeCard(Server_Card *card, bool &wasLookedAt);
     Server_Card *getCard(int id, int *position = nullptr, bool remove = false);
+    // Keeps the id index current, called by Server_Card::setId()
+    void cardIdChanged(Server_Card *card, int oldId);
+    void invalidateCardListCache()
+    {
+        cardListCacheValid = false;
+    }
 
     int getCardsBeingLookedAt() const
     {
@@ -4,6 +4,7 @@
 #include "server.h"
 
 #include <QObject>
+#include <QSharedPointer>
 
 class Server_DatabaseInterface : public QObject
 {
@@ -56,13 +57,17 @@ public:
     {
         return false;
     }
+    // Called when a user logs out; their buddy and ignore lists no longer need to be kept at hand.
+    virtual void releaseUserLists(const QString & /* name */)
+    {
+    }
     virtual ServerInfo_User getUserData(const QString &name, bool withId = false) = 0;
     virtual void storeGameInformation(const QString & /* roomName */,
                                       const QStringList & /* roomGameTypes */,
                                       const ServerInfo_Game & /* gameInfo */,
                                       const QSet<QString> & /* allPlayersEver */,
                                       const QSet<QString> & /* allSpectatorsEver */,
-                                      const QList<GameReplay *> & /* replayList */)
+                                      const QList<QSharedPointer<Server_ReplayWriter>> & /* replayList */)
     {
     }
     virtual DeckList *getDeckFromDatabase(int /* deckId */, int /* userId */)
@@ -43,6 +43,7 @@
 #include "server_database_interface.h"
 #include "server_player.h"
 #include "server_protocolhandler.h"
+#include "server_replay_writer.h"
 #include "server_room.h"
 
 #include <QDebug>
@@ -77,13 +78,14 @@ Server_Game::Server_Game(const ServerInfo_User &_creatorInfo,
       gameMutex(QMutex::Recursive)
 #endif
 {
-    currentReplay = new GameReplay;
-    currentReplay->set_replay_id(room->getServer()->getDatabaseInterface()->getNextReplayId());
     description = _description.simplified();
 
     connect(this, &Server_Game::sigStartGameIfReady, this, &Server_Game::doStartGameIfReady, Qt::QueuedConnection);
 
-    getInfo(*currentReplay->mutable_game_info());
+    ServerInfo_Game gameInfo;
+    getInfo(gameInfo);
+    currentReplay =
+        new Server_ReplayWriter(room->getServer()->getDatabaseInterface()->getNextReplayId(), gameInfo);
 
     if (room->getServer()->getGameShouldPing()) {
         pingClock = new QTimer(this);
@@ -100,6 +102,7 @@ Server_Game::~Server_Game()
     gameClosed = true;
     sendGameEventContainer(prepareGameEvent(Event_GameClosed(), -1));
     for (auto *player : players.values()) {
+        room->playerLeftGame(QString::fromStdString(player->getUserInfo()->name()), gameId);
         player->prepareDestroy();
     }
     players.clear();
@@ -110,13 +113,10 @@ Server_Game::~Server_Game()
 
     gameMutex.unlock();
     room->gamesLock.unlock();
-    currentReplay->set_duration_seconds(secondsElapsed - startTimeOfThisGame);
-    replayList.append(currentReplay);
+    currentReplay->finish(secondsElapsed - startTimeOfThisGame);
+    replayList.append(QSharedPointer<Server_ReplayWriter>(currentReplay));
+    // the database interface keeps the replays until it has read them back from their spill files
     storeGameInformation();
-
-    for (auto *replay : replayList) {
-        delete replay;
-    }
     replayList.clear();
 
     room = nullptr;
@@ -134,7 +134,7 @@ Server_Game::~Server_Game()
 
 void Server_Game::storeGameInformation()
 {
-    const ServerInfo_Game &gameInfo = replayList.first()->game_info();
+    const ServerInfo_Game &gameInfo = replayList.first()->getGameInfo();
 
     Event_ReplayAdded replayEvent;
     ServerInfo_ReplayMatch *replayMatchInfo = replayEvent.mutable_match_info();
@@ -155,9 +155,9 @@ void Server_Game::storeGameInformation()
 
     for (int i = 0; i < replayList.size(); ++i) {
         ServerInfo_Replay *replayInfo = replayMatchInfo->add_replay_list();
-        replayInfo->set_replay_id(replayList[i]->replay_id());
+        replayInfo->set_replay_id(replayList[i]->getReplayId());
         replayInfo->set_replay_name(gameInfo.description());
-        replayInfo->set_duration(replayList[i]->duration_seconds());
+        replayInfo->set_duration(replayList[i]->getDurationSeconds());
     }
 
     SessionEvent *sessionEvent = Server_ProtocolHandler::prepareSessionEvent(replayEvent);
@@ -282,7 +282,7 @@ void Server_Game::sendGameStateToPlayers()
     GameEventContainer *replayCont = prepareGameEvent(omniscientEvent, -1);
     replayCont->set_seconds_elapsed(secondsElapsed - startTimeOfThisGame);
     replayCont->clear_game_id();
-    currentReplay->add_event_list()->CopyFrom(*replayCont);
+    currentReplay->addEvent(*replayCont);
     delete replayCont;
 
     // If spectators are not omniscient, we need an additional createGameStateChangedEvent call, otherwise we can use
@@ -292,6 +292,7 @@ void Server_Game::sendGameStateToPlayers()
     createGameStateChangedEvent(&spectatorNormalEvent, nullptr, false, false);
 
     // send game state info to clients according to their role in the game
+    eventDispatcher.flush();
     for (Server_Player *player : players.values()) {
         GameEventContainer *gec;
         if (player->getSpectator()) {
@@ -345,13 +346,12 @@ void Server_Game::doStartGameIfReady(bool forceStartGame)
     }
 
     if (firstGameStarted) {
-        currentReplay->set_duration_seconds(secondsElapsed - startTimeOfThisGame);
-        replayList.append(currentReplay);
-        currentReplay = new GameReplay;
-        currentReplay->set_replay_id(databaseInterface->getNextReplayId());
-        ServerInfo_Game *gameInfo = currentReplay->mutable_game_info();
-        getInfo(*gameInfo);
-        gameInfo->set_started(false);
+        currentReplay->finish(secondsElapsed - startTimeOfThisGame);
+        replayList.append(QSharedPointer<Server_ReplayWriter>(currentReplay));
+        ServerInfo_Game gameInfo;
+        getInfo(gameInfo);
+        gameInfo.set_started(false);
+        currentReplay = new Server_ReplayWriter(databaseInterface->getNextReplayId(), gameInfo);
 
         Event_GameStateChanged omniscientEvent;
         createGameStateChangedEvent(&omniscientEvent, nullptr, true, true);
@@ -359,7 +359,7 @@ void Server_Game::doStartGameIfReady(bool forceStartGame)
         GameEventContainer *replayCont = prepareGameEvent(omniscientEvent, -1);
         replayCont->set_seconds_elapsed(0);
         replayCont->clear_game_id();
-        currentReplay->add_event_list()->CopyFrom(*replayCont);
+        currentReplay->addEvent(*replayCont);
         delete replayCont;
 
         startTimeOfThisGame = secondsElapsed;
@@ -483,6 +483,7 @@ void Server_Game::addPlayer(Server_AbstractUserInterface *userInterface,
 
     const QString playerName = QString::fromStdString(newPlayer->getUserInfo()->name());
     players.insert(newPlayer->getPlayerId(), newPlayer);
+    room->playerJoinedGame(playerName, gameId);
     if (spectator) {
         allSpectatorsEver.insert(playerName);
     } else {
@@ -518,6 +519,7 @@ void Server_Game::removePlayer(Server_Player *player, Event_Leave::LeaveReason r
     room->getServer()->removePersistentPlayer(QString::fromStdString(player->getUserInfo()->name()), room->getId(),
                                               gameId, player->getPlayerId());
     players.remove(player->getPlayerId());
+    room->playerLeftGame(QString::fromStdString(player->getUserInfo()->name()), gameId);
 
     GameEventStorage ges;
     removeArrowsRelatedToPlayer(ges, player);
@@ -526,6 +528,7 @@ void Server_Game::removePlayer(Server_Player *player, Event_Leave::LeaveReason r
     Event_Leave event;
     event.set_reason(reason);
     ges.enqueueGameEvent(event, player->getPlayerId());
+    // also drains every pending dispatch that still references the leaving player
     ges.sendToGame(this);
 
     bool playerActive = activePlayer == player->getPlayerId();
@@ -576,11 +579,11 @@ void Server_Game::removeArrowsRelatedToPlayer(GameEventStorage &ges, Server_Play
         QList<Server_Arrow *> toDelete;
         for (int i = 0; i < arrows.size(); ++i) {
             Server_Arrow *a = arrows[i];
-            Server_Card *targetCard = qobject_cast<Server_Card *>(a->getTargetItem());
+            Server_Card *targetCard = dynamic_cast<Server_Card *>(a->getTargetItem());
             if (targetCard) {
                 if (targetCard->getZone() != nullptr && targetCard->getZone()->getPlayer() == player)
                     toDelete.append(a);
-            } else if (static_cast<Server_Player *>(a->getTargetItem()) == player)
+            } else if (dynamic_cast<Server_Player *>(a->getTargetItem()) == player)
                 toDelete.append(a);
 
             // Don't use else here! It has to happen regardless of whether targetCard == 0.
@@ -628,6 +631,7 @@ bool Server_Game::kickPlayer(int playerId)
         return false;
 
     GameEventContainer *gec = prepareGameEvent(Event_Kicked(), -1);
+    eventDispatcher.flush();
     playerToKick->sendGameEvent(*gec);
     delete gec;
 
@@ -737,21 +741,49 @@ void Server_Game::sendGameEventContainer(GameEventContainer *cont,
 {
     QMutexLocker locker(&gameMutex);
 
-    cont->set_game_id(gameId);
-    for (Server_Player *player : players.values()) {
-        const bool playerPrivate = (player->getPlayerId() == privatePlayerId) ||
-                                   (player->getSpectator() && (spectatorsSeeEverything || player->getJudge()));
-        if ((recipients.testFlag(GameEventStorageItem::SendToPrivate) && playerPrivate) ||
-            (recipients.testFlag(GameEventStorageItem::SendToOthers) && !playerPrivate))
-            player->sendGameEvent(*cont);
-    }
-    if (recipients.testFlag(GameEventStorageItem::SendToPrivate)) {
-        cont->set_seconds_elapsed(secondsElapsed - startTimeOfThisGame);
-        cont->clear_game_id();
-        currentReplay->add_event_list()->CopyFrom(*cont);
+    if (!(recipients & (GameEventStorageItem::SendToPrivate | GameEventStorageItem::SendToOthers))) {
+        delete cont;
+        return;
     }
+    queueGameEventContainers(recipients.testFlag(GameEventStorageItem::SendToPrivate) ? cont : nullptr,
+                             recipients.testFlag(GameEventStorageItem::SendToOthers) ? cont : nullptr,
+                             privatePlayerId);
+    eventDispatcher.flush();
+}
+
+void Server_Game::queueGameEventContainers(GameEventContainer *contPrivate,
+                                           GameEventContainer *contOthers,
+                                           int privatePlayerId)
+{
+    QMutexLocker locker(&gameMutex);
 
-    delete cont;
+    QList<Server_GameEventDispatcher::Recipient> recipients;
+    recipients.reserve(players.size());
+    for (Server_Player *player : players.values()) {
+        Server_GameEventDispatcher::VisibilityClass visibility;
+        if (player->getPlayerId() == privatePlayerId)
+            visibility = Server_GameEventDispatcher::PrivatePlayer;
+        else if (!player->getSpectator())
+            visibility = Server_GameEventDispatcher::OtherPlayer;
+        else if (spectatorsSeeEverything || player->getJudge())
+            visibility = Server_GameEventDispatcher::OmniscientSpectator;
+        else
+            visibility = Server_GameEventDispatcher::Spectator;
+        recipients.append({player, visibility});
+    }
+
+    if (contPrivate) {
+        // written in replay form straight away, before the container is shared with the dispatcher
+        contPrivate->clear_game_id();
+        contPrivate->set_seconds_elapsed(secondsElapsed - startTimeOfThisGame);
+        currentReplay->addEvent(*contPrivate);
+        contPrivate->clear_seconds_elapsed();
+        contPrivate->set_game_id(gameId);
+    }
+    if (contOthers)
+        contOthers->set_game_id(gameId);
+
+    eventDispatcher.enqueue(contPrivate, contOthers, recipients);
 }
 
 GameEventContainer *
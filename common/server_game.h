@@ -23,6 +23,7 @@
 #include "pb/event_leave.pb.h"
 #include "pb/response.pb.h"
 #include "pb/serverinfo_game.pb.h"
+#include "server_game_event_dispatcher.h"
 #include "server_response_containers.h"
 
 #include <QDateTime>
@@ -30,11 +31,12 @@
 #include <QMutex>
 #include <QObject>
 #include <QSet>
+#include <QSharedPointer>
 #include <QStringList>
 
 class QTimer;
 class GameEventContainer;
-class GameReplay;
+class Server_ReplayWriter;
 class Server_Room;
 class Server_Player;
 class ServerInfo_User;
@@ -73,8 +75,9 @@ private:
     bool turnOrderReversed;
     QDateTime startTime;
     QTimer *pingClock;
-    QList<GameReplay *> replayList;
-    GameReplay *currentReplay;
+    QList<QSharedPointer<Server_ReplayWriter>> replayList;
+    Server_ReplayWriter *currentReplay;
+    Server_GameEventDispatcher eventDispatcher;
 
     void createGameStateChangedEvent(Event_GameStateChanged *event,
                                      Server_Player *playerWhosAsking,
@@ -213,6 +216,13 @@ public:
                                 GameEventStorageItem::EventRecipients recipients = GameEventStorageItem::SendToPrivate |
                                                                                    GameEventStorageItem::SendToOthers,
                                 int privatePlayerId = -1);
+    // Records the containers in the replay and snapshots their recipients; nothing is sent before flushGameEvents().
+    void queueGameEventContainers(GameEventContainer *contPrivate, GameEventContainer *contOthers, int privatePlayerId);
+    // May be called without holding gameMutex, as long as the game itself stays alive.
+    void flushGameEvents()
+    {
+        eventDispatcher.flush();
+    }
 };
 
 #endif
@@ -0,0 +1,76 @@
+#include "server_game_event_dispatcher.h"
+
+#include "pb/game_event_container.pb.h"
+#include "serialized_server_message.h"
+#include "server_player.h"
+
+Server_GameEventDispatcher::Server_GameEventDispatcher()
+    :
+#if (QT_VERSION >= QT_VERSION_CHECK(5, 14, 0))
+      deliveryMutex(),
+#else
+      deliveryMutex(QMutex::Recursive),
+#endif
+      delivering(false)
+{
+}
+
+void Server_GameEventDispatcher::enqueue(GameEventContainer *privateCont,
+                                         GameEventContainer *othersCont,
+                                         const QList<Recipient> &recipients)
+{
+    PendingDispatch dispatch;
+    dispatch.privateCont = QSharedPointer<GameEventContainer>(privateCont);
+    dispatch.othersCont =
+        othersCont == privateCont ? dispatch.privateCont : QSharedPointer<GameEventContainer>(othersCont);
+    dispatch.recipients = recipients;
+
+    QMutexLocker locker(&queueMutex);
+    queue.append(dispatch);
+}
+
+void Server_GameEventDispatcher::flush()
+{
+    QMutexLocker deliveryLocker(&deliveryMutex);
+    // A recipient may answer synchronously on this thread (local games) and cause another flush; the outer loop
+    // picks up whatever that enqueued, so returning here keeps the delivery order intact.
+    if (delivering)
+        return;
+    delivering = true;
+
+    forever {
+        QList<PendingDispatch> batch;
+        queueMutex.lock();
+        batch.swap(queue);
+        queueMutex.unlock();
+        if (batch.isEmpty())
+            break;
+
+        for (const PendingDispatch &dispatch : batch)
+            deliver(dispatch);
+    }
+
+    delivering = false;
+}
+
+void Server_GameEventDispatcher::deliver(const PendingDispatch &dispatch)
+{
+    // each container is serialized on its first recipient; every visibility class that sees it shares the bytes
+    SerializedServerMessage privateMessage, othersMessage;
+    for (const Recipient &recipient : dispatch.recipients) {
+        const bool privateView = seesPrivateEvents(recipient.visibility);
+        const GameEventContainer *cont = privateView ? dispatch.privateCont.data() : dispatch.othersCont.data();
+        if (!cont)
+            continue;
+
+        SerializedServerMessage &message = privateView ? privateMessage : othersMessage;
+        if (message.isNull()) {
+            const SerializedServerMessage &other = privateView ? othersMessage : privateMessage;
+            if (dispatch.privateCont == dispatch.othersCont && !other.isNull())
+                message = other;
+            else
+                message = SerializedServerMessage(*cont);
+        }
+        recipient.player->sendGameEvent(message);
+    }
+}
@@ -0,0 +1,69 @@
+#ifndef SERVER_GAME_EVENT_DISPATCHER_H
+#define SERVER_GAME_EVENT_DISPATCHER_H
+
+#include <QList>
+#include <QMutex>
+#include <QSharedPointer>
+
+class GameEventContainer;
+class Server_Player;
+
+/**
+ * Delivers the game event containers of one game to its players and spectators.
+ *
+ * The recipients of a container are snapshotted while the game mutex is held, but serialization and queueing on
+ * the recipients' sockets happen in flush(), which may run after the game mutex has been released. Events are
+ * always delivered in the order they were enqueued, no matter which thread flushes them.
+ *
+ * A Server_Player that appears in a pending snapshot must not be destroyed before flush() has returned; the game
+ * guarantees this by flushing before it destroys players.
+ */
+class Server_GameEventDispatcher
+{
+public:
+    enum VisibilityClass
+    {
+        PrivatePlayer,
+        OtherPlayer,
+        OmniscientSpectator,
+        Spectator
+    };
+    struct Recipient
+    {
+        Server_Player *player;
+        VisibilityClass visibility;
+    };
+
+private:
+    struct PendingDispatch
+    {
+        // either one may be null; they point to the same container if it goes to everybody
+        QSharedPointer<GameEventContainer> privateCont, othersCont;
+        QList<Recipient> recipients;
+    };
+
+    QMutex queueMutex;
+    QList<PendingDispatch> queue;
+
+#if (QT_VERSION >= QT_VERSION_CHECK(5, 14, 0))
+    QRecursiveMutex deliveryMutex;
+#else
+    QMutex deliveryMutex;
+#endif
+    bool delivering;
+
+    static bool seesPrivateEvents(VisibilityClass visibility)
+    {
+        return visibility == PrivatePlayer || visibility == OmniscientSpectator;
+    }
+    void deliver(const PendingDispatch &dispatch);
+
+public:
+    Server_GameEventDispatcher();
+
+    // Takes ownership of the containers.
+    void enqueue(GameEventContainer *privateCont, GameEventContainer *othersCont, const QList<Recipient> &recipients);
+    void flush();
+};
+
+#endif
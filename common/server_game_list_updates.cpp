@@ -0,0 +1,49 @@
+#include "server_game_list_updates.h"
+
+void Server_GameListUpdates::gameCreating(int gameId)
+{
+    // read in this order: a read that starts after the snapshot of readsStarted bumps it, one that started before
+    // and is still running shows up in readsRunning
+    const int started = readsStarted.loadAcquire();
+    const int running = readsRunning.loadAcquire();
+
+    QMutexLocker locker(&createdMutex);
+    createdGames.insert(gameId, running > 0 ? -1 : started);
+}
+
+bool Server_GameListUpdates::mayHaveBeenSeen(int gameId)
+{
+    QMutexLocker locker(&createdMutex);
+    const int startedBefore = createdGames.take(gameId);
+    return startedBefore == -1 || readsStarted.loadAcquire() != startedBefore;
+}
+
+void Server_GameListUpdates::add(const ServerInfo_Game &gameInfo)
+{
+    auto it = pending.find(gameInfo.game_id());
+    if (it == pending.end()) {
+        pending.insert(gameInfo.game_id(), gameInfo);
+    } else if (gameInfo.closed()) {
+        // Only the update sent when the game was created carries the creator, so the room hasn't heard of the game
+        // from us; only the users who joined the room meanwhile can know it.
+        if (it->has_creator_info() && !mayHaveBeenSeen(gameInfo.game_id()))
+            pending.erase(it);
+        else
+            *it = gameInfo;
+    } else {
+        it->MergeFrom(gameInfo);
+    }
+}
+
+QList<ServerInfo_Game> Server_GameListUpdates::take()
+{
+    QList<ServerInfo_Game> result = pending.values();
+    {
+        // the creation of these games is going out now, so everybody will know them
+        QMutexLocker locker(&createdMutex);
+        for (const ServerInfo_Game &gameInfo : result)
+            createdGames.remove(gameInfo.game_id());
+    }
+    pending.clear();
+    return result;
+}
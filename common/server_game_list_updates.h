@@ -0,0 +1,55 @@
+#ifndef SERVER_GAME_LIST_UPDATES_H
+#define SERVER_GAME_LIST_UPDATES_H
+
+#include "pb/serverinfo_game.pb.h"
+
+#include <QAtomicInt>
+#include <QHash>
+#include <QList>
+#include <QMap>
+#include <QMutex>
+
+/**
+ * The game list changes of a room waiting for the next flush, merged per game id the way clients merge them.
+ *
+ * A game that is created and closed again between two flushes is left out entirely, as long as nobody can have seen
+ * it: the game lists handed to joining users are reads too, so a game that was in the list while one of them was
+ * being built gets its closed record, or that user would keep a ghost of it.
+ *
+ * add() and take() belong to the room's thread; the other methods are thread safe.
+ */
+class Server_GameListUpdates
+{
+private:
+    QMap<int, ServerInfo_Game> pending;
+
+    // game list reads begun and still running
+    QAtomicInt readsStarted, readsRunning;
+    // game id -> readsStarted before the game became visible, or -1 if a read was running then
+    QMutex createdMutex;
+    QHash<int, int> createdGames;
+
+    bool mayHaveBeenSeen(int gameId);
+
+public:
+    // Must be called before the game becomes visible to game list reads
+    void gameCreating(int gameId);
+    void beginListRead()
+    {
+        readsStarted.ref();
+        readsRunning.ref();
+    }
+    void endListRead()
+    {
+        readsRunning.deref();
+    }
+
+    void add(const ServerInfo_Game &gameInfo);
+    bool isEmpty() const
+    {
+        return pending.isEmpty();
+    }
+    QList<ServerInfo_Game> take();
+};
+
+#endif
@@ -0,0 +1,211 @@
+#include "server_metrics.h"
+
+#include "pb/commands.pb.h"
+
+#include <QMutexLocker>
+#include <google/protobuf/descriptor.h>
+
+static const char *commandDurationName = "servatrice_command_duration_seconds";
+static const char *lockWaitName = "servatrice_lock_wait_seconds";
+static const char *lockHoldName = "servatrice_lock_hold_seconds";
+static const char *databaseQueryDurationName = "servatrice_database_query_duration_seconds";
+static const char *databaseWriteBatchDurationName = "servatrice_database_write_batch_duration_seconds";
+static const char *outputQueueDepthName = "servatrice_output_queue_depth";
+static const char *outputCompressionBytesName = "servatrice_output_compression_bytes";
+static const char *outputCompressionRatioName = "servatrice_output_compression_ratio";
+static const char *outputCompressionDurationName = "servatrice_output_compression_duration_seconds";
+
+static const double nsecsPerSecond = 1e9;
+// compression ratios are observed in thousandths
+static const double ratioResolution = 1000;
+
+static QByteArray formatValue(double value)
+{
+    return QByteArray::number(value, 'g', 12);
+}
+
+static QByteArray series(const QString &name, const char *suffix, const QString &labels, const QString &extraLabel)
+{
+    QByteArray result = name.toUtf8() + suffix;
+    QString allLabels = labels;
+    if (!extraLabel.isEmpty())
+        allLabels = allLabels.isEmpty() ? extraLabel : allLabels + "," + extraLabel;
+    if (!allLabels.isEmpty())
+        result += "{" + allLabels.toUtf8() + "}";
+    return result;
+}
+
+ServerMetrics::Histogram::Histogram(const QVector<qint64> &_bucketBounds)
+    : bucketBounds(_bucketBounds), bucketCounts(_bucketBounds.size() + 1), sum(0)
+{
+}
+
+void ServerMetrics::Histogram::observe(qint64 value)
+{
+    int bucket = 0;
+    while (bucket < bucketBounds.size() && value > bucketBounds[bucket])
+        ++bucket;
+    bucketCounts[bucket].fetchAndAddRelaxed(1);
+    sum.fetchAndAddRelaxed(value);
+}
+
+ServerMetrics::ServerMetrics()
+{
+    // 50us to 5s
+    const QVector<double> latencyBuckets = {0.00005, 0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005,
+                                            0.01,    0.025,  0.05,    0.1,    0.25,  0.5,    1,
+                                            2.5,     5};
+    addHistogram(commandDurationName, "Time spent processing a command container, by its first command",
+                 latencyBuckets, nsecsPerSecond);
+    addHistogram(lockWaitName, "Time spent waiting for a server lock", latencyBuckets, nsecsPerSecond);
+    addHistogram(lockHoldName, "Time a server lock was held by one command container", latencyBuckets,
+                 nsecsPerSecond);
+    addHistogram(databaseQueryDurationName, "Time spent executing a database query, by statement", latencyBuckets,
+                 nsecsPerSecond);
+    addHistogram(databaseWriteBatchDurationName, "Time spent executing a batch of queued database writes",
+                 latencyBuckets, nsecsPerSecond);
+    addHistogram(outputQueueDepthName, "Number of messages written to a client by one flush",
+                 {1, 2, 4, 8, 16, 32, 64, 128, 256, 512});
+    addHistogram(outputCompressionBytesName,
+                 "Size of the frames that qualified for compression, as serialized and as sent to the client",
+                 {256, 1024, 4096, 16384, 65536, 262144, 1048576});
+    addHistogram(outputCompressionRatioName,
+                 "Serialized size divided by sent size of the frames that qualified for compression",
+                 {1, 1.5, 2, 3, 4, 6, 8, 16}, ratioResolution);
+    addHistogram(outputCompressionDurationName, "Time spent compressing a frame", latencyBuckets, nsecsPerSecond);
+
+    const QString commandTypeNames[CommandTypeCount] = {"session", "room", "game", "moderator", "admin", "none"};
+    const ::google::protobuf::EnumDescriptor *commandTypeDescriptors[CommandTypeCount] = {
+        SessionCommand::SessionCommandType_descriptor(), RoomCommand::RoomCommandType_descriptor(),
+        GameCommand::GameCommandType_descriptor(), ModeratorCommand::ModeratorCommandType_descriptor(),
+        AdminCommand::AdminCommandType_descriptor(), nullptr};
+    for (int type = 0; type < CommandTypeCount; ++type) {
+        const QString typeLabel = "," + label("type", commandTypeNames[type]);
+        const ::google::protobuf::EnumDescriptor *descriptor = commandTypeDescriptors[type];
+        for (int i = 0; descriptor && i < descriptor->value_count(); ++i) {
+            const QString command = QString::fromStdString(descriptor->value(i)->name());
+            commandHistograms[type].insert(descriptor->value(i)->number(),
+                                           histogram(commandDurationName, label("command", command) + typeLabel));
+        }
+        unknownCommandHistograms[type] = histogram(commandDurationName, label("command", "unknown") + typeLabel);
+    }
+
+    const QString lockNames[LockCount] = {"clientsLock", "roomsLock", "gameMutex"};
+    for (int lock = 0; lock < LockCount; ++lock) {
+        lockWaitHistograms[lock] = histogram(lockWaitName, label("lock", lockNames[lock]));
+        lockHoldHistograms[lock] = histogram(lockHoldName, label("lock", lockNames[lock]));
+    }
+    databaseWriteBatchHistogram = histogram(databaseWriteBatchDurationName, QString());
+    outputQueueDepthHistogram = histogram(outputQueueDepthName, QString());
+    outputCompressionPayloadHistogram = histogram(outputCompressionBytesName, label("form", "serialized"));
+    outputCompressionSentHistogram = histogram(outputCompressionBytesName, label("form", "sent"));
+    outputCompressionRatioHistogram = histogram(outputCompressionRatioName, QString());
+    outputCompressionTimeHistogram = histogram(outputCompressionDurationName, QString());
+}
+
+ServerMetrics::~ServerMetrics()
+{
+    for (const HistogramFamily &family : histograms)
+        qDeleteAll(family.series);
+}
+
+void ServerMetrics::addHistogram(const QString &name,
+                                 const QString &help,
+                                 const QVector<double> &bucketBounds,
+                                 double valuesPerUnit)
+{
+    QMutexLocker locker(&mutex);
+    if (histograms.contains(name))
+        return;
+
+    HistogramFamily &family = histograms[name];
+    family.help = help;
+    family.valuesPerUnit = valuesPerUnit;
+    for (double bound : bucketBounds)
+        family.bucketBounds.append(qRound64(bound * valuesPerUnit));
+}
+
+ServerMetrics::Histogram *ServerMetrics::histogram(const QString &name, const QString &labels)
+{
+    QMutexLocker locker(&mutex);
+    auto family = histograms.find(name);
+    if (family == histograms.end())
+        return nullptr;
+
+    Histogram *&result = family->series[labels];
+    if (!result)
+        result = new Histogram(family->bucketBounds);
+    return result;
+}
+
+void ServerMetrics::setGauge(const QString &name, const QString &help, const QString &labels, double value)
+{
+    QMutexLocker locker(&mutex);
+    GaugeFamily &family = gauges[name];
+    family.help = help;
+    family.series.insert(labels, value);
+}
+
+QByteArray ServerMetrics::toPrometheusText() const
+{
+    QMutexLocker locker(&mutex);
+    QByteArray result;
+
+    for (auto family = histograms.constBegin(); family != histograms.constEnd(); ++family) {
+        result += "# HELP " + family.key().toUtf8() + " " + family->help.toUtf8() + "\n";
+        result += "# TYPE " + family.key().toUtf8() + " histogram\n";
+        for (auto histogram = family->series.constBegin(); histogram != family->series.constEnd(); ++histogram) {
+            // Observations may come in meanwhile, so the count is summed from the buckets to keep them consistent.
+            const Histogram &observed = *histogram.value();
+            quint64 cumulativeCount = 0;
+            for (int i = 0; i < family->bucketBounds.size(); ++i) {
+                cumulativeCount += observed.bucketCounts[i].loadAcquire();
+                const QString bucketLabel =
+                    label("le", QString::fromLatin1(formatValue(family->bucketBounds[i] / family->valuesPerUnit)));
+                result += series(family.key(), "_bucket", histogram.key(), bucketLabel) + " " +
+                          QByteArray::number(cumulativeCount) + "\n";
+            }
+            cumulativeCount += observed.bucketCounts[family->bucketBounds.size()].loadAcquire();
+            result += series(family.key(), "_bucket", histogram.key(), label("le", "+Inf")) + " " +
+                      QByteArray::number(cumulativeCount) + "\n";
+            result += series(family.key(), "_sum", histogram.key(), QString()) + " " +
+                      formatValue(observed.sum.loadAcquire() / family->valuesPerUnit) + "\n";
+            result += series(family.key(), "_count", histogram.key(), QString()) + " " +
+                      QByteArray::number(cumulativeCount) + "\n";
+        }
+    }
+
+    for (auto family = gauges.constBegin(); family != gauges.constEnd(); ++family) {
+        result += "# HELP " + family.key().toUtf8() + " " + family->help.toUtf8() + "\n";
+        result += "# TYPE " + family.key().toUtf8() + " gauge\n";
+        for (auto gauge = family->series.constBegin(); gauge != family->series.constEnd(); ++gauge)
+            result += series(family.key(), "", gauge.key(), QString()) + " " + formatValue(gauge.value()) + "\n";
+    }
+
+    return result;
+}
+
+QString ServerMetrics::label(const QString &name, const QString &value)
+{
+    QString escaped = value;
+    escaped.replace("\\", "\\\\").replace("\"", "\\\"").replace("\n", "\\n");
+    return name + "=\"" + escaped + "\"";
+}
+
+void ServerMetrics::observeCommand(CommandType commandType, int command, qint64 nsecs)
+{
+    Histogram *histogram = commandHistograms[commandType].value(command, unknownCommandHistograms[commandType]);
+    histogram->observe(nsecs);
+}
+
+ServerMetrics::Histogram *ServerMetrics::databaseQueryHistogram(const QString &statement)
+{
+    return histogram(databaseQueryDurationName, label("statement", statement));
+}
+
+void ServerMetrics::observeOutputCompression(qint64 payloadBytes, qint64 sentBytes)
+{
+    outputCompressionPayloadHistogram->observe(payloadBytes);
+    outputCompressionSentHistogram->observe(sentBytes);
+    outputCompressionRatioHistogram->observe(qRound64(payloadBytes * ratioResolution / qMax(sentBytes, qint64(1))));
+}
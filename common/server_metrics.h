@@ -0,0 +1,131 @@
+#ifndef SERVER_METRICS_H
+#define SERVER_METRICS_H
+
+#include <QAtomicInteger>
+#include <QByteArray>
+#include <QHash>
+#include <QMap>
+#include <QMutex>
+#include <QString>
+#include <QVector>
+
+/**
+ * Histograms and gauges collected by the server, exported in the Prometheus text format.
+ *
+ * Series are identified by their family name and an already formatted label set like
+ * command="LOGIN",type="session" (see label()). Histogram series are looked up once with histogram() and then
+ * observed without any locking, so the hot paths never build labels or wait for each other: the series of the
+ * built-in families are all created by the constructor, database statements get theirs when they are prepared.
+ */
+class ServerMetrics
+{
+public:
+    // One series of a histogram family. Values are observed in the family's integer unit, see addHistogram().
+    class Histogram
+    {
+    public:
+        explicit Histogram(const QVector<qint64> &_bucketBounds);
+        void observe(qint64 value);
+
+    private:
+        friend class ServerMetrics;
+        const QVector<qint64> bucketBounds;
+        QVector<QAtomicInteger<quint64>> bucketCounts; // not cumulative, one more than the bounds for +Inf
+        QAtomicInteger<qint64> sum;
+    };
+
+    enum Lock
+    {
+        ClientsLock,
+        RoomsLock,
+        GameMutex,
+        LockCount
+    };
+    enum CommandType
+    {
+        SessionCommandType,
+        RoomCommandType,
+        GameCommandType,
+        ModeratorCommandType,
+        AdminCommandType,
+        NoCommandType, // empty command containers
+        CommandTypeCount
+    };
+
+    ServerMetrics();
+    ~ServerMetrics();
+
+    // Observed values are integers in units of 1/valuesPerUnit of the exported unit, nanoseconds for a histogram
+    // of seconds with valuesPerUnit 1e9. The bucket bounds are given in the exported unit.
+    void addHistogram(const QString &name,
+                      const QString &help,
+                      const QVector<double> &bucketBounds,
+                      double valuesPerUnit = 1);
+    // The series of a registered family for a label set, created on first use; nullptr for unknown families.
+    // The series lives as long as this object.
+    Histogram *histogram(const QString &name, const QString &labels);
+    void setGauge(const QString &name, const QString &help, const QString &labels, double value);
+    QByteArray toPrometheusText() const;
+
+    // name="value", with the value escaped as the text format requires
+    static QString label(const QString &name, const QString &value);
+
+    // command is the id of the first command within its command type; unknown ids are recorded as "unknown"
+    void observeCommand(CommandType commandType, int command, qint64 nsecs);
+    void observeLockWait(Lock lock, qint64 nsecs)
+    {
+        lockWaitHistograms[lock]->observe(nsecs);
+    }
+    void observeLockHold(Lock lock, qint64 nsecs)
+    {
+        lockHoldHistograms[lock]->observe(nsecs);
+    }
+    // Observed with nanoseconds; statement must come from a fixed set of names, never from the query text itself
+    Histogram *databaseQueryHistogram(const QString &statement);
+    // Time taken to execute one batch of queued database writes
+    void observeDatabaseWriteBatch(qint64 nsecs)
+    {
+        databaseWriteBatchHistogram->observe(nsecs);
+    }
+    void observeOutputQueueDepth(int items)
+    {
+        outputQueueDepthHistogram->observe(items);
+    }
+    // A frame that qualified for compression was sent with sentBytes instead of payloadBytes
+    void observeOutputCompression(qint64 payloadBytes, qint64 sentBytes);
+    // Time taken to compress a frame, once for all the sockets it is sent to
+    void observeOutputCompressionTime(qint64 nsecs)
+    {
+        outputCompressionTimeHistogram->observe(nsecs);
+    }
+
+private:
+    struct HistogramFamily
+    {
+        QString help;
+        QVector<qint64> bucketBounds;
+        double valuesPerUnit;
+        QMap<QString, Histogram *> series;
+    };
+    struct GaugeFamily
+    {
+        QString help;
+        QMap<QString, double> series;
+    };
+
+    mutable QMutex mutex;
+    QMap<QString, HistogramFamily> histograms;
+    QMap<QString, GaugeFamily> gauges;
+
+    // only read after the constructor, so they need no locking
+    QHash<int, Histogram *> commandHistograms[CommandTypeCount];
+    Histogram *unknownCommandHistograms[CommandTypeCount];
+    Histogram *lockWaitHistograms[LockCount];
+    Histogram *lockHoldHistograms[LockCount];
+    Histogram *databaseWriteBatchHistogram;
+    Histogram *outputQueueDepthHistogram;
+    Histogram *outputCompressionPayloadHistogram, *outputCompressionSentHistogram;
+    Histogram *outputCompressionRatioHistogram, *outputCompressionTimeHistogram;
+};
+
+#endif
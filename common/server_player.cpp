@@ -70,6 +70,7 @@
 #include "pb/serverinfo_player.pb.h"
 #include "pb/serverinfo_user.pb.h"
 #include "rng_abstract.h"
+#include "serialized_server_message.h"
 #include "server.h"
 #include "server_abstractuserinterface.h"
 #include "server_arrow.h"
@@ -565,10 +566,10 @@ Response::ResponseCode Server_Player::moveCard(GameEventStorage &ges,
                 stashedCard->setId(newCardId());
                 ges.enqueueGameEvent(makeCreateTokenEvent(startzone, stashedCard, card->getX(), card->getY()),
                                      playerId);
-                card->deleteLater();
+                delete card;
                 card = stashedCard;
             } else {
-                card->deleteLater();
+                delete card;
                 card = nullptr;
             }
         }
@@ -1403,7 +1404,7 @@ Server_Player::cmdAttachCard(const Command_AttachCard &cmd, ResponseContainer &
         QList<Server_Arrow *> _arrows = p->getArrows().values();
         QList<Server_Arrow *> toDelete;
         for (auto a : _arrows) {
-            auto *tCard = qobject_cast<Server_Card *>(a->getTargetItem());
+            auto *tCard = dynamic_cast<Server_Card *>(a->getTargetItem());
             if ((tCard == card) || (a->getStartCard() == card)) {
                 toDelete.append(a);
             }
@@ -1514,7 +1515,6 @@ Server_Player::cmdCreateToken(const Command_CreateToken &cmd, ResponseContainer
     }
 
     auto *card = new Server_Card(cardName, cardProviderId, newCardId(), xCoord, yCoord);
-    card->moveToThread(thread());
     // Client should already prevent face-down tokens from having attributes; this just an extra server-side check
     if (!cmd.face_down()) {
         card->setColor(nameFromStdString(cmd.color()));
@@ -1629,11 +1629,11 @@ Server_Player::cmdCreateToken(const Command_CreateToken &cmd, ResponseContainer
                         arrowInfo->set_start_player_id(player->getPlayerId());
                         arrowInfo->set_start_zone(startCard->getZone()->getName().toStdString());
                         arrowInfo->set_start_card_id(startCard->getId());
-                        const Server_Player *arrowTargetPlayer = qobject_cast<const Server_Player *>(targetItem);
+                        const Server_Player *arrowTargetPlayer = dynamic_cast<const Server_Player *>(targetItem);
                         if (arrowTargetPlayer != nullptr) {
                             arrowInfo->set_target_player_id(arrowTargetPlayer->getPlayerId());
                         } else {
-                            const Server_Card *arrowTargetCard = qobject_cast<const Server_Card *>(targetItem);
+                            const Server_Card *arrowTargetCard = dynamic_cast<const Server_Card *>(targetItem);
                             arrowInfo->set_target_player_id(arrowTargetCard->getZone()->getPlayer()->getPlayerId());
                             arrowInfo->set_target_zone(arrowTargetCard->getZone()->getName().toStdString());
                             arrowInfo->set_target_card_id(arrowTargetCard->getId());
@@ -2440,6 +2440,15 @@ void Server_Player::sendGameEvent(const GameEventContainer &cont)
     }
 }
 
+void Server_Player::sendGameEvent(const SerializedServerMessage &event)
+{
+    QMutexLocker locker(&playerMutex);
+
+    if (userInterface) {
+        userInterface->sendProtocolItem(event);
+    }
+}
+
 void Server_Player::setUserInterface(Server_AbstractUserInterface *_userInterface)
 {
     playerMutex.lock();
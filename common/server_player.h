@@ -9,6 +9,7 @@
 #include <QList>
 #include <QMap>
 #include <QMutex>
+#include <QObject>
 #include <QString>
 
 class DeckList;
@@ -27,6 +28,7 @@ class GameEventContainer;
 class GameEventStorage;
 class ResponseContainer;
 class GameCommand;
+class SerializedServerMessage;
 
 class Command_KickFromGame;
 class Command_LeaveGame;
@@ -63,7 +65,7 @@ class Command_DeckSelect;
 class Command_SetSideboardLock;
 class Command_ChangeZoneProperties;
 
-class Server_Player : public Server_ArrowTarget, public ServerInfo_User_Container
+class Server_Player : public QObject, public Server_ArrowTarget, public ServerInfo_User_Container
 {
     Q_OBJECT
 private:
@@ -237,6 +239,7 @@ public:
 
     Response::ResponseCode processGameCommand(const GameCommand &command, ResponseContainer &rc, GameEventStorage &ges);
     void sendGameEvent(const GameEventContainer &event);
+    void sendGameEvent(const SerializedServerMessage &event);
 
     void getInfo(ServerInfo_Player *info, Server_Player *playerWhosAsking, bool omniscient, bool withUserInfo);
 };
@@ -17,6 +17,7 @@
 #include "pb/response_list_users.pb.h"
 #include "pb/response_login.pb.h"
 #include "pb/serverinfo_user.pb.h"
+#include "serialized_server_message.h"
 #include "server_database_interface.h"
 #include "server_game.h"
 #include "server_player.h"
@@ -25,6 +26,7 @@
 
 #include <QDateTime>
 #include <QDebug>
+#include <QElapsedTimer>
 #include <QtMath>
 #include <google/protobuf/descriptor.h>
 
@@ -128,6 +130,18 @@ void Server_ProtocolHandler::sendProtocolItem(const RoomEvent &item)
     transmitProtocolItem(msg);
 }
 
+void Server_ProtocolHandler::sendProtocolItem(const SerializedServerMessage &item)
+{
+    transmitSerializedItem(item);
+}
+
+void Server_ProtocolHandler::transmitSerializedItem(const SerializedServerMessage &item)
+{
+    ServerMessage msg;
+    if (item.toServerMessage(msg))
+        transmitProtocolItem(msg);
+}
+
 Response::ResponseCode Server_ProtocolHandler::processSessionCommandContainer(const CommandContainer &cont,
                                                                               ResponseContainer &rc)
 {
@@ -179,7 +193,10 @@ Response::ResponseCode Server_ProtocolHandler::processRoomCommandContainer(const
     if (authState == NotLoggedIn)
         return Response::RespLoginNeeded;
 
+    QElapsedTimer lockWaitTimer;
+    lockWaitTimer.start();
     QReadLocker locker(&server->roomsLock);
+    server->getMetrics().observeLockWait(ServerMetrics::RoomsLock, lockWaitTimer.nsecsElapsed());
     Server_Room *room = rooms.value(cont.room_id(), 0);
     if (!room)
         return Response::RespNotInRoom;
@@ -240,7 +257,10 @@ Response::ResponseCode Server_ProtocolHandler::processGameCommandContainer(const
         return Response::RespNotInRoom;
     const QPair<int, int> roomIdAndPlayerId = gameMap.value(cont.game_id());
 
+    QElapsedTimer lockWaitTimer;
+    lockWaitTimer.start();
     QReadLocker roomsLocker(&server->roomsLock);
+    server->getMetrics().observeLockWait(ServerMetrics::RoomsLock, lockWaitTimer.nsecsElapsed());
     Server_Room *room = server->getRooms().value(roomIdAndPlayerId.first);
     if (!room)
         return Response::RespNotInRoom;
@@ -256,7 +276,11 @@ Response::ResponseCode Server_ProtocolHandler::processGameCommandContainer(const
         return Response::RespNotInRoom;
     }
 
+    lockWaitTimer.restart();
     QMutexLocker gameLocker(&game->gameMutex);
+    server->getMetrics().observeLockWait(ServerMetrics::GameMutex, lockWaitTimer.nsecsElapsed());
+    QElapsedTimer gameLockTimer;
+    gameLockTimer.start();
     Server_Player *player = game->getPlayers().value(roomIdAndPlayerId.second);
     if (!player)
         return Response::RespNotInRoom;
@@ -294,7 +318,12 @@ Response::ResponseCode Server_ProtocolHandler::processGameCommandContainer(const
         if (resp != Response::RespOk)
             finalResponseCode = resp;
     }
-    ges.sendToGame(game);
+    ges.queueForGame(game);
+    gameLocker.unlock();
+    server->getMetrics().observeLockHold(ServerMetrics::GameMutex, gameLockTimer.nsecsElapsed());
+
+    // the game can't go away while we hold roomGamesLocker
+    game->flushGameEvents();
 
     return finalResponseCode;
 }
@@ -347,6 +376,30 @@ Response::ResponseCode Server_ProtocolHandler::processAdminCommandContainer(cons
     return finalResponseCode;
 }
 
+// The metrics of a command container are recorded under its first command
+static void getFirstCommand(const CommandContainer &cont, ServerMetrics::CommandType &commandType, int &command)
+{
+    if (cont.game_command_size()) {
+        commandType = ServerMetrics::GameCommandType;
+        command = getPbExtension(cont.game_command(0));
+    } else if (cont.room_command_size()) {
+        commandType = ServerMetrics::RoomCommandType;
+        command = getPbExtension(cont.room_command(0));
+    } else if (cont.session_command_size()) {
+        commandType = ServerMetrics::SessionCommandType;
+        command = getPbExtension(cont.session_command(0));
+    } else if (cont.moderator_command_size()) {
+        commandType = ServerMetrics::ModeratorCommandType;
+        command = getPbExtension(cont.moderator_command(0));
+    } else if (cont.admin_command_size()) {
+        commandType = ServerMetrics::AdminCommandType;
+        command = getPbExtension(cont.admin_command(0));
+    } else {
+        commandType = ServerMetrics::NoCommandType;
+        command = -1;
+    }
+}
+
 void Server_ProtocolHandler::processCommandContainer(const CommandContainer &cont)
 {
     // Command processing must be disabled after prepareDestroy() has been called.
@@ -355,6 +408,9 @@ void Server_ProtocolHandler::processCommandContainer(const CommandContainer &con
 
     lastDataReceived = timeRunning;
 
+    QElapsedTimer commandTimer;
+    commandTimer.start();
+
     ResponseContainer responseContainer(cont.has_cmd_id() ? cont.cmd_id() : -1);
     Response::ResponseCode finalResponseCode;
 
@@ -373,6 +429,11 @@ void Server_ProtocolHandler::processCommandContainer(const CommandContainer &con
 
     if ((finalResponseCode != Response::RespNothing))
         sendResponseContainer(responseContainer, finalResponseCode);
+
+    ServerMetrics::CommandType commandType;
+    int command;
+    getFirstCommand(cont, commandType, command);
+    server->getMetrics().observeCommand(commandType, command, commandTimer.nsecsElapsed());
 }
 
 void Server_ProtocolHandler::pingClockTimeout()
@@ -529,6 +590,9 @@ Response::ResponseCode Server_ProtocolHandler::cmdLogin(const Command_Login &cmd
         }
     }
 
+    if (receivedClientFeatures.contains("compression"))
+        enableOutputCompression();
+
     userName = QString::fromStdString(userInfo->name());
     Event_ServerMessage event;
     event.set_message(server->getLoginMessage().toStdString());
@@ -610,12 +674,10 @@ Response::ResponseCode Server_ProtocolHandler::cmdGetGamesOfUser(const Command_G
     QMapIterator<int, Server_Room *> roomIterator(server->getRooms());
     while (roomIterator.hasNext()) {
         Server_Room *room = roomIterator.next().value();
-        room->gamesLock.lockForRead();
         room->getInfo(*re->add_room_list(), false, true);
         QListIterator<ServerInfo_Game> gameIterator(room->getGamesOfUser(nameFromStdString(cmd.user_name())));
         while (gameIterator.hasNext())
             re->add_game_list()->CopyFrom(gameIterator.next());
-        room->gamesLock.unlock();
     }
     server->roomsLock.unlock();
 
@@ -684,18 +746,8 @@ Response::ResponseCode Server_ProtocolHandler::cmdJoinRoom(const Command_JoinRoo
     room->addClient(this);
     rooms.insert(room->getId(), room);
 
-    QReadLocker chatHistoryLocker(&room->historyLock);
-    QList<ServerInfo_ChatMessage> chatHistory = room->getChatHistory();
-    ServerInfo_ChatMessage chatMessage;
-    for (int i = 0; i < chatHistory.size(); ++i) {
-        chatMessage = chatHistory.at(i);
-        Event_RoomSay roomChatHistory;
-        roomChatHistory.set_message(chatMessage.sender_name() + ": " + chatMessage.message());
-        roomChatHistory.set_message_type(Event_RoomSay::ChatHistory);
-        roomChatHistory.set_time_of(
-            QDateTime::fromString(QString::fromStdString(chatMessage.time())).toMSecsSinceEpoch());
-        rc.enqueuePostResponseItem(ServerMessage::ROOM_EVENT, room->prepareRoomEvent(roomChatHistory));
-    }
+    for (const SerializedServerMessage &chatHistoryItem : room->getChatHistorySnapshot())
+        rc.enqueuePostResponseItem(chatHistoryItem);
 
     Event_RoomSay joinMessageEvent;
     joinMessageEvent.set_message(room->getJoinMessage().toStdString());
@@ -23,6 +23,7 @@ class SessionEvent;
 class GameEventContainer;
 class RoomEvent;
 class ResponseContainer;
+class SerializedServerMessage;
 
 class CommandContainer;
 class SessionCommand;
@@ -59,12 +60,18 @@ protected:
     virtual void logDebugMessage(const QString & /* message */)
     {
     }
+    // Called at login when the client announced the "compression" feature.
+    virtual void enableOutputCompression()
+    {
+    }
 
 private:
     QList<int> messageSizeOverTime, messageCountOverTime, commandCountOverTime;
     int timeRunning, lastDataReceived, lastActionReceived;
 
     virtual void transmitProtocolItem(const ServerMessage &item) = 0;
+    // Transports that can write pre-serialized frames directly should override this; the default unpacks the frame.
+    virtual void transmitSerializedItem(const SerializedServerMessage &item);
 
     Response::ResponseCode cmdPing(const Command_Ping &cmd, ResponseContainer &rc);
     Response::ResponseCode cmdLogin(const Command_Login &cmd, ResponseContainer &rc);
@@ -136,6 +143,7 @@ public:
     void sendProtocolItem(const SessionEvent &item);
     void sendProtocolItem(const GameEventContainer &item);
     void sendProtocolItem(const RoomEvent &item);
+    void sendProtocolItem(const SerializedServerMessage &item);
 };
 
 #endif
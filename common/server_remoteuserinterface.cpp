@@ -1,6 +1,7 @@
 #include "server_remoteuserinterface.h"
 
 #include "pb/serverinfo_user.pb.h"
+#include "serialized_server_message.h"
 #include "server.h"
 
 void Server_RemoteUserInterface::sendProtocolItem(const Response &item)
@@ -22,3 +23,32 @@ void Server_RemoteUserInterface::sendProtocolItem(const RoomEvent &item)
 {
     server->sendIsl_RoomEvent(item, userInfo->server_id(), userInfo->session_id());
 }
+
+void Server_RemoteUserInterface::sendProtocolItem(const SerializedServerMessage &item)
+{
+    // ISL peers speak IslMessage, so the shared frame has to be unpacked again for remote users.
+    ServerMessage msg;
+    if (!item.toServerMessage(msg))
+        return;
+
+    switch (msg.message_type()) {
+        case ServerMessage::RESPONSE:
+            sendProtocolItem(msg.response());
+            break;
+        case ServerMessage::SESSION_EVENT:
+            sendProtocolItem(msg.session_event());
+            break;
+        case ServerMessage::GAME_EVENT_CONTAINER:
+            sendProtocolItem(msg.game_event_container());
+            break;
+        case ServerMessage::ROOM_EVENT:
+            sendProtocolItem(msg.room_event());
+            break;
+        case ServerMessage::COMPRESSED: {
+            ServerMessage uncompressed;
+            if (SerializedServerMessage::uncompress(msg, uncompressed))
+                sendProtocolItem(SerializedServerMessage(uncompressed));
+            break;
+        }
+    }
+}
@@ -24,6 +24,7 @@ public:
     void sendProtocolItem(const SessionEvent &item);
     void sendProtocolItem(const GameEventContainer &item);
     void sendProtocolItem(const RoomEvent &item);
+    void sendProtocolItem(const SerializedServerMessage &item);
 };
 
 #endif
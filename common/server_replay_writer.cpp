@@ -0,0 +1,240 @@
+#include "server_replay_writer.h"
+
+#include "pb/game_replay.pb.h"
+
+#include <QDebug>
+#include <QDir>
+#include <QList>
+#include <QMutex>
+#include <QRunnable>
+#include <QTemporaryFile>
+#include <QThreadPool>
+#include <QWaitCondition>
+
+// protobuf wire types of the fields we write
+enum WireType
+{
+    WireTypeVarint = 0,
+    WireTypeLengthDelimited = 2
+};
+
+static void appendVarint(QByteArray &out, quint64 value)
+{
+    while (value >= 0x80) {
+        out.append(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.append(static_cast<char>(value));
+}
+
+static void appendTag(QByteArray &out, int fieldNumber, WireType wireType)
+{
+    appendVarint(out, (static_cast<quint64>(fieldNumber) << 3) | wireType);
+}
+
+static void appendMessage(QByteArray &out, int fieldNumber, const ::google::protobuf::Message &message)
+{
+#if GOOGLE_PROTOBUF_VERSION > 3001000
+    const unsigned int size = static_cast<unsigned int>(message.ByteSizeLong());
+#else
+    const unsigned int size = static_cast<unsigned int>(message.ByteSize());
+#endif
+    appendTag(out, fieldNumber, WireTypeLengthDelimited);
+    appendVarint(out, size);
+    const int offset = out.size();
+    out.resize(offset + static_cast<int>(size));
+    message.SerializeToArray(out.data() + offset, static_cast<int>(size));
+}
+
+struct Server_ReplayWriter::SpillState
+{
+    QMutex mutex;
+    QWaitCondition idle;
+    QTemporaryFile file;
+    // chunks handed off but not yet written, oldest first
+    QList<QByteArray> pending;
+    qint64 writtenBytes;
+    bool taskQueued;
+    // set once the spill file has failed us; the rest of the replay then stays in pending
+    bool failed;
+
+    SpillState()
+        : file(QDir::tempPath() + "/servatrice_replay_XXXXXX"), writtenBytes(0), taskQueued(false), failed(false)
+    {
+    }
+};
+
+class Server_ReplayWriter::SpillTask : public QRunnable
+{
+private:
+    QSharedPointer<SpillState> state;
+    quint64 replayId;
+
+    bool append(qint64 offset, const QByteArray &data)
+    {
+        // the file is only kept open while writing, so that idle games don't hold a descriptor each
+        if (!state->file.open()) {
+            qWarning() << "Replay" << replayId << "could not open spill file, keeping it in memory:"
+                       << state->file.errorString();
+            return false;
+        }
+        state->file.seek(offset);
+        const qint64 written = state->file.write(data);
+        state->file.close();
+        if (written != data.size()) {
+            qWarning() << "Replay" << replayId << "could not be written to" << state->file.fileName()
+                       << ", keeping it in memory";
+            return false;
+        }
+        return true;
+    }
+
+public:
+    SpillTask(const QSharedPointer<SpillState> &_state, quint64 _replayId) : state(_state), replayId(_replayId)
+    {
+    }
+    void run() override
+    {
+        QMutexLocker locker(&state->mutex);
+        while (!state->pending.isEmpty() && !state->failed) {
+            const QByteArray data = state->pending.first();
+            const qint64 offset = state->writtenBytes;
+            locker.unlock();
+            const bool written = append(offset, data);
+            locker.relock();
+            if (!written) {
+                state->failed = true;
+            } else if (!state->pending.isEmpty()) {
+                // the writer may have discarded the replay in the meantime
+                state->pending.removeFirst();
+                state->writtenBytes += data.size();
+            }
+        }
+        state->taskQueued = false;
+        state->idle.wakeAll();
+    }
+};
+
+// Appends are sequential per replay anyway, and one thread keeps the games from competing for the disk
+static QThreadPool *spillThreadPool()
+{
+    static QThreadPool *pool = [] {
+        auto *threadPool = new QThreadPool;
+        threadPool->setMaxThreadCount(1);
+        return threadPool;
+    }();
+    return pool;
+}
+
+Server_ReplayWriter::Server_ReplayWriter(quint64 _replayId, const ServerInfo_Game &_gameInfo, int _chunkSize)
+    : replayId(_replayId), gameInfo(_gameInfo), durationSeconds(0), chunkSize(_chunkSize), finished(false),
+      spill(new SpillState), handedOffBytes(0), readOffset(0)
+{
+    appendTag(chunk, GameReplay::kReplayIdFieldNumber, WireTypeVarint);
+    appendVarint(chunk, replayId);
+    appendMessage(chunk, GameReplay::kGameInfoFieldNumber, gameInfo);
+}
+
+Server_ReplayWriter::~Server_ReplayWriter()
+{
+    // a spill task that is still running stops after its current chunk and releases the file
+    QMutexLocker locker(&spill->mutex);
+    spill->pending.clear();
+}
+
+void Server_ReplayWriter::addEvent(const GameEventContainer &cont)
+{
+    if (finished)
+        return;
+
+    appendMessage(chunk, GameReplay::kEventListFieldNumber, cont);
+    if (chunk.size() >= chunkSize)
+        handOffChunk();
+}
+
+void Server_ReplayWriter::handOffChunk()
+{
+    handedOffBytes += chunk.size();
+
+    QMutexLocker locker(&spill->mutex);
+    spill->pending.append(chunk);
+    chunk = QByteArray();
+    if (spill->failed || spill->taskQueued)
+        return;
+    spill->taskQueued = true;
+    locker.unlock();
+
+    spillThreadPool()->start(new SpillTask(spill, replayId));
+}
+
+void Server_ReplayWriter::finish(unsigned int _durationSeconds)
+{
+    if (finished)
+        return;
+
+    durationSeconds = _durationSeconds;
+    appendTag(chunk, GameReplay::kDurationSecondsFieldNumber, WireTypeVarint);
+    appendVarint(chunk, durationSeconds);
+    finished = true;
+}
+
+bool Server_ReplayWriter::readReplayPiece(QByteArray &piece)
+{
+    QMutexLocker locker(&spill->mutex);
+    while (spill->taskQueued)
+        spill->idle.wait(&spill->mutex);
+
+    // the replay is the spill file, followed by the chunks that didn't make it there and the current chunk
+    qint64 offset = readOffset;
+    if (offset < spill->writtenBytes) {
+        piece.clear();
+        if (spill->file.open()) {
+            spill->file.seek(offset);
+            piece = spill->file.read(qMin<qint64>(chunkSize, spill->writtenBytes - offset));
+            spill->file.close();
+        }
+        if (piece.isEmpty()) {
+            qWarning() << "Replay" << replayId << "could not be read back from" << spill->file.fileName();
+            return false;
+        }
+        readOffset += piece.size();
+        return true;
+    }
+    offset -= spill->writtenBytes;
+    for (const QByteArray &pendingChunk : spill->pending) {
+        if (offset < pendingChunk.size()) {
+            readOffset += pendingChunk.size() - offset;
+            piece = offset == 0 ? pendingChunk : pendingChunk.mid(static_cast<int>(offset));
+            return true;
+        }
+        offset -= pendingChunk.size();
+    }
+    if (offset >= chunk.size()) {
+        piece.clear();
+        return true;
+    }
+    readOffset += chunk.size() - offset;
+    piece = offset == 0 ? chunk : chunk.mid(static_cast<int>(offset));
+    return true;
+}
+
+void Server_ReplayWriter::rewindReplay()
+{
+    readOffset = 0;
+}
+
+bool Server_ReplayWriter::readReplayData(QByteArray &result)
+{
+    rewindReplay();
+    result.clear();
+    result.reserve(static_cast<int>(getSize()));
+    QByteArray piece;
+    do {
+        if (!readReplayPiece(piece)) {
+            result.clear();
+            return false;
+        }
+        result.append(piece);
+    } while (!piece.isEmpty());
+    return true;
+}
@@ -0,0 +1,79 @@
+#ifndef SERVER_REPLAY_WRITER_H
+#define SERVER_REPLAY_WRITER_H
+
+#include "pb/serverinfo_game.pb.h"
+
+#include <QByteArray>
+#include <QSharedPointer>
+
+class GameEventContainer;
+
+/**
+ * Builds the serialized form of a GameReplay while the game is running.
+ *
+ * Protobuf allows a message to be written field by field, so the replay header, every event container and finally
+ * the duration are encoded as they arrive. Encoded events are collected in a buffer of chunkSize bytes. A full buffer
+ * is handed to a background thread, which appends it to a temporary spill file; addEvent() itself never touches the
+ * disk, so it can be called with the game mutex held. A running game therefore keeps about one chunk of its replay
+ * in memory, however long it lasts.
+ *
+ * The pieces read by readReplayPiece() concatenate to a regular GameReplay.
+ */
+class Server_ReplayWriter
+{
+public:
+    static const int defaultChunkSize = 64 * 1024;
+
+private:
+    // the spill file and the chunks waiting for it, shared with the spill task
+    struct SpillState;
+    class SpillTask;
+
+    quint64 replayId;
+    ServerInfo_Game gameInfo;
+    unsigned int durationSeconds;
+    int chunkSize;
+    bool finished;
+    QByteArray chunk;
+    QSharedPointer<SpillState> spill;
+    qint64 handedOffBytes;
+    qint64 readOffset;
+
+    void handOffChunk();
+
+public:
+    Server_ReplayWriter(quint64 _replayId, const ServerInfo_Game &_gameInfo, int _chunkSize = defaultChunkSize);
+    ~Server_ReplayWriter();
+
+    quint64 getReplayId() const
+    {
+        return replayId;
+    }
+    const ServerInfo_Game &getGameInfo() const
+    {
+        return gameInfo;
+    }
+    unsigned int getDurationSeconds() const
+    {
+        return durationSeconds;
+    }
+    // Encoded size of the replay so far, including the part that has been handed to the spill file
+    qint64 getSize() const
+    {
+        return handedOffBytes + chunk.size();
+    }
+
+    void addEvent(const GameEventContainer &cont);
+    // Closes the replay; events added afterwards are ignored.
+    void finish(unsigned int _durationSeconds);
+    // Sets piece to the next piece of about chunkSize bytes of the serialized GameReplay, or to an empty array once
+    // all of it has been read. Returns false if the spill file could not be read back. Waits for the spill task, so
+    // don't call it with the game mutex held.
+    bool readReplayPiece(QByteArray &piece);
+    // Starts reading from the beginning again, e.g. to retry a failed database write
+    void rewindReplay();
+    // The whole serialized GameReplay at once; returns false instead of a part of it if a piece can't be read
+    bool readReplayData(QByteArray &result);
+};
+
+#endif
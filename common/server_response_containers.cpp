@@ -49,6 +49,12 @@ void GameEventStorage::enqueueGameEvent(const ::google::protobuf::Message &event
 }
 
 void GameEventStorage::sendToGame(Server_Game *game)
+{
+    queueForGame(game);
+    game->flushGameEvents();
+}
+
+void GameEventStorage::queueForGame(Server_Game *game)
 {
     if (gameEventList.isEmpty())
         return;
@@ -77,8 +83,7 @@ void GameEventStorage::sendToGame(Server_Game *game)
         contPrivate->mutable_context()->CopyFrom(*gameEventContext);
         contOthers->mutable_context()->CopyFrom(*gameEventContext);
     }
-    game->sendGameEventContainer(contPrivate, GameEventStorageItem::SendToPrivate, id);
-    game->sendGameEventContainer(contOthers, GameEventStorageItem::SendToOthers, id);
+    game->queueGameEventContainers(contPrivate, contOthers, id);
 }
 
 ResponseContainer::ResponseContainer(int _cmdId) : cmdId(_cmdId), responseExtension(0)
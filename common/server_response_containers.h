@@ -2,6 +2,7 @@
 #define SERVER_RESPONSE_CONTAINERS_H
 
 #include "pb/server_message.pb.h"
+#include "serialized_server_message.h"
 
 #include <QList>
 #include <QPair>
@@ -84,6 +85,9 @@ public:
                                                                              GameEventStorageItem::SendToOthers,
                           int _privatePlayerId = -1);
     void sendToGame(Server_Game *game);
+    // Like sendToGame(), but leaves the delivery to a later Server_Game::flushGameEvents() so that it can happen
+    // after the game mutex has been released.
+    void queueForGame(Server_Game *game);
 };
 
 class ResponseContainer
@@ -92,6 +96,7 @@ private:
     int cmdId;
     ::google::protobuf::Message *responseExtension;
     QList<QPair<ServerMessage::MessageType, ::google::protobuf::Message *>> preResponseQueue, postResponseQueue;
+    QList<SerializedServerMessage> serializedPostResponseQueue;
 
 public:
     ResponseContainer(int _cmdId);
@@ -117,6 +122,11 @@ public:
     {
         postResponseQueue.append(qMakePair(type, item));
     }
+    // Sent right after the response, before the items of the post response queue.
+    void enqueuePostResponseItem(const SerializedServerMessage &item)
+    {
+        serializedPostResponseQueue.append(item);
+    }
     const QList<QPair<ServerMessage::MessageType, ::google::protobuf::Message *>> &getPreResponseQueue() const
     {
         return preResponseQueue;
@@ -125,6 +135,10 @@ public:
     {
         return postResponseQueue;
     }
+    const QList<SerializedServerMessage> &getSerializedPostResponseQueue() const
+    {
+        return serializedPostResponseQueue;
+    }
 };
 
 #endif
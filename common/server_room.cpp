@@ -7,14 +7,15 @@
 #include "pb/event_remove_messages.pb.h"
 #include "pb/event_room_say.pb.h"
 #include "pb/room_commands.pb.h"
-#include "pb/serverinfo_chat_message.pb.h"
 #include "pb/serverinfo_room.pb.h"
+#include "serialized_server_message.h"
 #include "server_game.h"
 #include "server_protocolhandler.h"
 #include "trice_limits.h"
 
 #include <QDateTime>
 #include <QDebug>
+#include <QTimer>
 #include <google/protobuf/descriptor.h>
 
 Server_Room::Server_Room(int _id,
@@ -29,8 +30,14 @@ Server_Room::Server_Room(int _id,
                          Server *parent)
     : QObject(parent), id(_id), chatHistorySize(_chatHistorySize), name(_name), description(_description),
       permissionLevel(_permissionLevel), privilegeLevel(_privilegeLevel), autoJoin(_autoJoin),
-      joinMessage(_joinMessage), gameTypes(_gameTypes), gamesLock(QReadWriteLock::Recursive)
+      joinMessage(_joinMessage), gameTypes(_gameTypes), chatHistoryStart(0), chatHistorySnapshotValid(false),
+      gameListCacheGeneration(-1),
+      gamesLock(QReadWriteLock::Recursive)
 {
+    gameListUpdateTimer = new QTimer(this);
+    gameListUpdateTimer->setSingleShot(true);
+    connect(gameListUpdateTimer, &QTimer::timeout, this, &Server_Room::flushGameListUpdates);
+
     connect(
         this, &Server_Room::gameListChanged, this, [this](auto gameInfo) { broadcastGameListUpdate(gameInfo); },
         Qt::QueuedConnection);
@@ -88,23 +95,19 @@ Server_Room::getInfo(ServerInfo_Room &result, bool complete, bool showGameTypes,
     result.set_permissionlevel(permissionLevel.toStdString());
     result.set_privilegelevel(privilegeLevel.toStdString());
 
-    gamesLock.lockForRead();
-    result.set_game_count(games.size() + externalGames.size());
+    fillRoomCounts(result);
     if (complete) {
-        QMapIterator<int, Server_Game *> gameIterator(games);
-        while (gameIterator.hasNext())
-            gameIterator.next().value()->getInfo(*result.add_game_list());
+        for (const ServerInfo_Game &gameInfo : getGameList())
+            result.add_game_list()->CopyFrom(gameInfo);
         if (includeExternalData) {
+            gamesLock.lockForRead();
             QMapIterator<int, ServerInfo_Game> externalGameIterator(externalGames);
             while (externalGameIterator.hasNext())
                 result.add_game_list()->CopyFrom(externalGameIterator.next().value());
+            gamesLock.unlock();
         }
-    }
-    gamesLock.unlock();
 
-    usersLock.lockForRead();
-    result.set_player_count(users.size() + externalUsers.size());
-    if (complete) {
+        usersLock.lockForRead();
         QMapIterator<QString, Server_ProtocolHandler *> userIterator(users);
         while (userIterator.hasNext())
             result.add_user_list()->CopyFrom(userIterator.next().value()->copyUserInfo(false));
@@ -113,8 +116,8 @@ Server_Room::getInfo(ServerInfo_Room &result, bool complete, bool showGameTypes,
             while (externalUserIterator.hasNext())
                 result.add_user_list()->CopyFrom(externalUserIterator.next().value().copyUserInfo(false));
         }
+        usersLock.unlock();
     }
-    usersLock.unlock();
 
     if (complete || showGameTypes)
         for (int i = 0; i < gameTypes.size(); ++i) {
@@ -126,6 +129,43 @@ Server_Room::getInfo(ServerInfo_Room &result, bool complete, bool showGameTypes,
     return result;
 }
 
+void Server_Room::fillRoomCounts(ServerInfo_Room &roomInfo) const
+{
+    roomInfo.set_game_count(gameCount.loadAcquire() + externalGameCount.loadAcquire());
+    roomInfo.set_player_count(playerCount.loadAcquire());
+}
+
+QList<ServerInfo_Game> Server_Room::getGameList() const
+{
+    // Cached lists are handed out too, so every call counts as a read.
+    pendingGameListUpdates.beginListRead();
+    const int generation = gameListGeneration.loadAcquire();
+    {
+        QMutexLocker locker(&gameListCacheMutex);
+        if (gameListCacheGeneration == generation) {
+            pendingGameListUpdates.endListRead();
+            return gameListCache;
+        }
+    }
+
+    // Built without gameListCacheMutex held: callers may already hold gamesLock.
+    QList<ServerInfo_Game> result;
+    gamesLock.lockForRead();
+    result.reserve(games.size());
+    for (const Server_Game *game : games) {
+        result.append(ServerInfo_Game());
+        game->getInfo(result.last());
+    }
+    gamesLock.unlock();
+    pendingGameListUpdates.endListRead();
+
+    // Tagged with the generation read before building, so that a change made meanwhile triggers another rebuild.
+    QMutexLocker locker(&gameListCacheMutex);
+    gameListCache = result;
+    gameListCacheGeneration = generation;
+    return result;
+}
+
 RoomEvent *Server_Room::prepareRoomEvent(const ::google::protobuf::Message &roomEvent)
 {
     RoomEvent *event = new RoomEvent;
@@ -142,19 +182,15 @@ void Server_Room::addClient(Server_ProtocolHandler *client)
     event.mutable_user_info()->CopyFrom(client->copyUserInfo(false));
     sendRoomEvent(prepareRoomEvent(event));
 
-    ServerInfo_Room roomInfo;
-    roomInfo.set_room_id(id);
-
     usersLock.lockForWrite();
     users.insert(QString::fromStdString(client->getUserInfo()->name()), client);
-    roomInfo.set_player_count(users.size() + externalUsers.size());
+    playerCount.storeRelease(users.size() + externalUsers.size());
     usersLock.unlock();
 
-    // XXX This can be removed during the next client update.
-    gamesLock.lockForRead();
-    roomInfo.set_game_count(games.size() + externalGames.size());
-    gamesLock.unlock();
-    // -----------
+    ServerInfo_Room roomInfo;
+    roomInfo.set_room_id(id);
+    // XXX The game count can be removed during the next client update.
+    fillRoomCounts(roomInfo);
 
     emit roomInfoChanged(roomInfo);
 }
@@ -163,21 +199,17 @@ void Server_Room::removeClient(Server_ProtocolHandler *client)
 {
     usersLock.lockForWrite();
     users.remove(QString::fromStdString(client->getUserInfo()->name()));
-
-    ServerInfo_Room roomInfo;
-    roomInfo.set_room_id(id);
-    roomInfo.set_player_count(users.size() + externalUsers.size());
+    playerCount.storeRelease(users.size() + externalUsers.size());
     usersLock.unlock();
 
     Event_LeaveRoom event;
     event.set_name(client->getUserInfo()->name());
     sendRoomEvent(prepareRoomEvent(event));
 
-    // XXX This can be removed during the next client update.
-    gamesLock.lockForRead();
-    roomInfo.set_game_count(games.size() + externalGames.size());
-    gamesLock.unlock();
-    // -----------
+    ServerInfo_Room roomInfo;
+    roomInfo.set_room_id(id);
+    // XXX The game count can be removed during the next client update.
+    fillRoomCounts(roomInfo);
 
     emit roomInfoChanged(roomInfo);
 }
@@ -186,19 +218,30 @@ void Server_Room::addExternalUser(const ServerInfo_User &userInfo)
 {
     // This function is always called from the Server thread with server->roomsMutex locked.
     ServerInfo_User_Container userInfoContainer(userInfo);
-    Event_JoinRoom event;
-    event.mutable_user_info()->CopyFrom(userInfoContainer.copyUserInfo(false));
-    sendRoomEvent(prepareRoomEvent(event), false);
+    const QString name = QString::fromStdString(userInfo.name());
+
+    // A state sync from another server repeats the joins of the users it kept in the room. Only this thread adds
+    // external users, so the user can't join in between.
+    usersLock.lockForRead();
+    const bool alreadyJoined = externalUsers.contains(name);
+    usersLock.unlock();
+    if (!alreadyJoined) {
+        Event_JoinRoom event;
+        event.mutable_user_info()->CopyFrom(userInfoContainer.copyUserInfo(false));
+        sendRoomEvent(prepareRoomEvent(event), false);
+    }
 
     ServerInfo_Room roomInfo;
     roomInfo.set_room_id(id);
 
     usersLock.lockForWrite();
-    externalUsers.insert(QString::fromStdString(userInfo.name()), userInfoContainer);
+    externalUsers.insert(name, userInfoContainer);
+    playerCount.storeRelease(users.size() + externalUsers.size());
     roomInfo.set_player_count(users.size() + externalUsers.size());
     usersLock.unlock();
 
-    emit roomInfoChanged(roomInfo);
+    if (!alreadyJoined)
+        emit roomInfoChanged(roomInfo);
 }
 
 void Server_Room::removeExternalUser(const QString &_name)
@@ -210,6 +253,7 @@ void Server_Room::removeExternalUser(const QString &_name)
     usersLock.lockForWrite();
     if (externalUsers.contains(_name))
         externalUsers.remove(_name);
+    playerCount.storeRelease(users.size() + externalUsers.size());
     roomInfo.set_player_count(users.size() + externalUsers.size());
     usersLock.unlock();
 
@@ -231,6 +275,7 @@ void Server_Room::updateExternalGameList(const ServerInfo_Game &gameInfo)
         externalGames.remove(gameInfo.game_id());
     else
         externalGames.insert(gameInfo.game_id(), gameInfo);
+    externalGameCount.storeRelease(externalGames.size());
     roomInfo.set_game_count(games.size() + externalGames.size());
     gamesLock.unlock();
 
@@ -284,20 +329,18 @@ void Server_Room::say(const QString &userName, const QString &userMessage, bool
     event.set_message(userMessage.toStdString());
     sendRoomEvent(prepareRoomEvent(event), sendToIsl);
 
-    if (chatHistorySize != 0) {
-        ServerInfo_ChatMessage chatMessage;
-        QDateTime dateTime = dateTime.currentDateTimeUtc();
-        QString dateTimeString = dateTime.toString();
-        chatMessage.set_time(dateTimeString.toStdString());
-        chatMessage.set_sender_name(userName.toStdString());
-        chatMessage.set_message(userMessage.simplified().toStdString());
+    if (chatHistorySize > 0) {
+        ChatHistoryEntry entry{QDateTime::currentMSecsSinceEpoch(), event.name(),
+                               userMessage.simplified().toStdString()};
 
         historyLock.lockForWrite();
-        if (chatHistory.size() >= chatHistorySize) {
-            chatHistory.removeAt(0);
+        if (chatHistory.size() < chatHistorySize) {
+            chatHistory.append(std::move(entry));
+        } else {
+            chatHistory[chatHistoryStart] = std::move(entry);
+            chatHistoryStart = (chatHistoryStart + 1) % chatHistory.size();
         }
-
-        chatHistory.push_back(std::move(chatMessage));
+        chatHistorySnapshotValid = false;
         historyLock.unlock();
     }
 }
@@ -310,27 +353,57 @@ void Server_Room::removeSaidMessages(const QString &userName, int amount, bool s
     event.set_amount(amount);
     sendRoomEvent(prepareRoomEvent(event), sendToIsl);
 
-    if (chatHistorySize != 0) {
+    if (chatHistorySize > 0) {
         int removed = 0;
         historyLock.lockForWrite();
         // redact [amount] of the most recent messages from this user from history
-        for (auto message = chatHistory.rbegin(); message != chatHistory.rend() && removed != amount; ++message) {
-            if (message->sender_name() == stdStringUserName) {
-                message->clear_message();
+        for (int i = chatHistory.size() - 1; i >= 0 && removed != amount; --i) {
+            ChatHistoryEntry &entry = chatHistory[(chatHistoryStart + i) % chatHistory.size()];
+            if (entry.senderName == stdStringUserName) {
+                entry.message.clear();
                 ++removed;
             }
         }
+        if (removed != 0)
+            chatHistorySnapshotValid = false;
         historyLock.unlock();
     }
 }
 
+QList<SerializedServerMessage> Server_Room::getChatHistorySnapshot() const
+{
+    QReadLocker locker(&historyLock);
+    QMutexLocker snapshotLocker(&chatHistorySnapshotMutex);
+    if (chatHistorySnapshotValid)
+        return chatHistorySnapshot;
+
+    chatHistorySnapshot.clear();
+    chatHistorySnapshot.reserve(chatHistory.size());
+    for (int i = 0; i < chatHistory.size(); ++i) {
+        const ChatHistoryEntry &entry = chatHistory[(chatHistoryStart + i) % chatHistory.size()];
+        Event_RoomSay roomChatHistory;
+        roomChatHistory.set_message(entry.senderName + ": " + entry.message);
+        roomChatHistory.set_message_type(Event_RoomSay::ChatHistory);
+        roomChatHistory.set_time_of(entry.timeOf);
+
+        RoomEvent event;
+        event.set_room_id(id);
+        event.MutableExtension(Event_RoomSay::ext)->CopyFrom(roomChatHistory);
+        chatHistorySnapshot.append(SerializedServerMessage(event));
+    }
+    chatHistorySnapshotValid = true;
+    return chatHistorySnapshot;
+}
+
 void Server_Room::sendRoomEvent(RoomEvent *event, bool sendToIsl)
 {
     usersLock.lockForRead();
-    {
+    if (!users.isEmpty()) {
+        // serialize once, every recipient queues the same shared frame
+        const SerializedServerMessage serializedEvent(*event);
         QMapIterator<QString, Server_ProtocolHandler *> userIterator(users);
         while (userIterator.hasNext())
-            userIterator.next().value()->sendProtocolItem(*event);
+            userIterator.next().value()->sendProtocolItem(serializedEvent);
     }
     usersLock.unlock();
 
@@ -342,32 +415,57 @@ void Server_Room::sendRoomEvent(RoomEvent *event, bool sendToIsl)
 
 void Server_Room::broadcastGameListUpdate(const ServerInfo_Game &gameInfo, bool sendToIsl)
 {
+    // External games are relayed as they come in, their server already merged them.
+    const int interval = getServer()->getGameListUpdateInterval();
+    if (!sendToIsl || interval <= 0) {
+        Event_ListGames event;
+        event.add_game_list()->CopyFrom(gameInfo);
+        sendRoomEvent(prepareRoomEvent(event), sendToIsl);
+        return;
+    }
+
+    pendingGameListUpdates.add(gameInfo);
+    if (!gameListUpdateTimer->isActive())
+        gameListUpdateTimer->start(interval);
+}
+
+void Server_Room::flushGameListUpdates()
+{
+    if (pendingGameListUpdates.isEmpty())
+        return;
+
     Event_ListGames event;
-    event.add_game_list()->CopyFrom(gameInfo);
-    sendRoomEvent(prepareRoomEvent(event), sendToIsl);
+    for (const ServerInfo_Game &gameInfo : pendingGameListUpdates.take())
+        event.add_game_list()->CopyFrom(gameInfo);
+    sendRoomEvent(prepareRoomEvent(event));
 }
 
 void Server_Room::addGame(Server_Game *game)
 {
-    ServerInfo_Room roomInfo;
-    roomInfo.set_room_id(id);
+    // The game isn't visible to anybody else yet, so its info can be taken before locking the room.
+    ServerInfo_Game gameInfo;
+    game->getInfo(gameInfo);
 
-    gamesLock.lockForWrite();
     connect(game, &Server_Game::gameInfoChanged, this, [this](auto gameInfo) { broadcastGameListUpdate(gameInfo); });
+    connect(game, &Server_Game::gameInfoChanged, this, [this] { invalidateGameList(); }, Qt::DirectConnection);
+
+    gameIndexMutex.lock();
+    ++gamesCreatedBy[QString::fromStdString(game->getCreatorInfo()->name())];
+    gameIndexMutex.unlock();
+
+    if (getServer()->getGameListUpdateInterval() > 0)
+        pendingGameListUpdates.gameCreating(game->getGameId());
 
-    game->gameMutex.lock();
+    gamesLock.lockForWrite();
     games.insert(game->getGameId(), game);
-    ServerInfo_Game gameInfo;
-    game->getInfo(gameInfo);
-    roomInfo.set_game_count(games.size() + externalGames.size());
-    game->gameMutex.unlock();
+    gameCount.storeRelease(games.size());
+    invalidateGameList();
     gamesLock.unlock();
 
-    // XXX This can be removed during the next client update.
-    usersLock.lockForRead();
-    roomInfo.set_player_count(users.size() + externalUsers.size());
-    usersLock.unlock();
-    // -----------
+    ServerInfo_Room roomInfo;
+    roomInfo.set_room_id(id);
+    // XXX The player count can be removed during the next client update.
+    fillRoomCounts(roomInfo);
 
     emit gameListChanged(gameInfo);
     emit roomInfoChanged(roomInfo);
@@ -385,41 +483,58 @@ void Server_Room::removeGame(Server_Game *game)
     emit gameListChanged(gameInfo);
 
     games.remove(game->getGameId());
+    gameCount.storeRelease(games.size());
+    invalidateGameList();
+
+    gameIndexMutex.lock();
+    const QString creatorName = QString::fromStdString(game->getCreatorInfo()->name());
+    if (--gamesCreatedBy[creatorName] <= 0)
+        gamesCreatedBy.remove(creatorName);
+    gameIndexMutex.unlock();
 
     ServerInfo_Room roomInfo;
     roomInfo.set_room_id(id);
-    roomInfo.set_game_count(games.size() + externalGames.size());
-
-    // XXX This can be removed during the next client update.
-    usersLock.lockForRead();
-    roomInfo.set_player_count(users.size() + externalUsers.size());
-    usersLock.unlock();
-    // -----------
+    // XXX The player count can be removed during the next client update.
+    fillRoomCounts(roomInfo);
 
     emit roomInfoChanged(roomInfo);
 }
 
-int Server_Room::getGamesCreatedByUser(const QString &userName) const
+void Server_Room::playerJoinedGame(const QString &userName, int gameId)
 {
-    QReadLocker locker(&gamesLock);
+    QMutexLocker locker(&gameIndexMutex);
+    gamesByPlayer.insert(userName, gameId);
+    invalidateGameList();
+}
 
-    QMapIterator<int, Server_Game *> gamesIterator(games);
-    int result = 0;
-    while (gamesIterator.hasNext())
-        if (gamesIterator.next().value()->getCreatorInfo()->name() == userName.toStdString())
-            ++result;
-    return result;
+void Server_Room::playerLeftGame(const QString &userName, int gameId)
+{
+    QMutexLocker locker(&gameIndexMutex);
+    gamesByPlayer.remove(userName, gameId);
+    invalidateGameList();
+}
+
+int Server_Room::getGamesCreatedByUser(const QString &userName) const
+{
+    QMutexLocker locker(&gameIndexMutex);
+    return gamesCreatedBy.value(userName);
 }
 
 QList<ServerInfo_Game> Server_Room::getGamesOfUser(const QString &userName) const
 {
-    QReadLocker locker(&gamesLock);
+    gameIndexMutex.lock();
+    const QList<int> gameIds = gamesByPlayer.values(userName);
+    gameIndexMutex.unlock();
 
     QList<ServerInfo_Game> result;
-    QMapIterator<int, Server_Game *> gamesIterator(games);
-    while (gamesIterator.hasNext()) {
-        Server_Game *game = gamesIterator.next().value();
-        if (game->containsUser(userName)) {
+    if (gameIds.isEmpty())
+        return result;
+
+    QReadLocker locker(&gamesLock);
+    for (int gameId : gameIds) {
+        // games still being created are indexed before they are added to the room
+        Server_Game *game = games.value(gameId);
+        if (game) {
             ServerInfo_Game gameInfo;
             game->getInfo(gameInfo);
             result.append(gameInfo);
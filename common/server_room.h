@@ -2,15 +2,20 @@
 #define SERVER_ROOM_H
 
 #include "pb/response.pb.h"
-#include "pb/serverinfo_chat_message.pb.h"
+#include "serialized_server_message.h"
+#include "server_game_list_updates.h"
 #include "serverinfo_user_container.h"
 
+#include <QAtomicInt>
+#include <QHash>
 #include <QList>
 #include <QMap>
+#include <QMultiHash>
 #include <QMutex>
 #include <QObject>
 #include <QReadWriteLock>
 #include <QStringList>
+#include <QVector>
 
 class Server_DatabaseInterface;
 class Server_ProtocolHandler;
@@ -20,6 +25,7 @@ class ServerInfo_Room;
 class ServerInfo_Game;
 class Server_Game;
 class Server;
+class QTimer;
 
 class Command_JoinGame;
 class ResponseContainer;
@@ -46,9 +52,48 @@ private:
     QMap<int, ServerInfo_Game> externalGames;
     QMap<QString, Server_ProtocolHandler *> users;
     QMap<QString, ServerInfo_User_Container> externalUsers;
-    QList<ServerInfo_ChatMessage> chatHistory;
+
+    struct ChatHistoryEntry
+    {
+        qint64 timeOf; // msecs since epoch, utc
+        std::string senderName;
+        std::string message;
+    };
+    // Ring buffer of at most chatHistorySize entries, the oldest one at chatHistoryStart.
+    QVector<ChatHistoryEntry> chatHistory;
+    int chatHistoryStart;
+    // The history as sent to joining users, serialized on the first join after it changed.
+    mutable QMutex chatHistorySnapshotMutex;
+    mutable QList<SerializedServerMessage> chatHistorySnapshot;
+    mutable bool chatHistorySnapshotValid;
+
+    // Kept up to date under the write locks of the maps they count, so that they can be read without any lock.
+    QAtomicInt gameCount, externalGameCount, playerCount;
+
+    // Indexes for the per user lookups, guarded by gameIndexMutex only. Never lock gamesLock while holding it.
+    mutable QMutex gameIndexMutex;
+    QHash<QString, int> gamesCreatedBy;
+    QMultiHash<QString, int> gamesByPlayer;
+
+    // The info of the local games, rebuilt on demand once any of them changed. Implicitly shared, so that the joins
+    // of a busy room only copy it once per change and don't keep gamesLock and every gameMutex locked.
+    mutable QMutex gameListCacheMutex;
+    mutable QList<ServerInfo_Game> gameListCache;
+    mutable int gameListCacheGeneration;
+    QAtomicInt gameListGeneration;
+    QList<ServerInfo_Game> getGameList() const;
+    void invalidateGameList()
+    {
+        gameListGeneration.ref();
+    }
+    void fillRoomCounts(ServerInfo_Room &roomInfo) const;
+
+    // Local game list changes waiting for the next flush. getGameList() reports its reads to it.
+    QTimer *gameListUpdateTimer;
+    mutable Server_GameListUpdates pendingGameListUpdates;
 private slots:
     void broadcastGameListUpdate(const ServerInfo_Game &gameInfo, bool sendToIsl = true);
+    void flushGameListUpdates();
 
 public:
     mutable QReadWriteLock usersLock;
@@ -109,12 +154,14 @@ public:
     Server *getServer() const;
     const ServerInfo_Room &
     getInfo(ServerInfo_Room &result, bool complete, bool showGameTypes = false, bool includeExternalData = true) const;
-    int getGamesCreatedByUser(const QString &name) const;
-    QList<ServerInfo_Game> getGamesOfUser(const QString &name) const;
-    QList<ServerInfo_ChatMessage> &getChatHistory()
+    // Number of local games, without locking gamesLock.
+    int getGameCount() const
     {
-        return chatHistory;
+        return gameCount.loadAcquire();
     }
+    int getGamesCreatedByUser(const QString &name) const;
+    QList<ServerInfo_Game> getGamesOfUser(const QString &name) const;
+    QList<SerializedServerMessage> getChatHistorySnapshot() const;
 
     void addClient(Server_ProtocolHandler *client);
     void removeClient(Server_ProtocolHandler *client);
@@ -136,6 +183,9 @@ public:
 
     void addGame(Server_Game *game);
     void removeGame(Server_Game *game);
+    // Called by Server_Game with its gameMutex locked, to keep getGamesOfUser() from having to visit every game.
+    void playerJoinedGame(const QString &userName, int gameId);
+    void playerLeftGame(const QString &userName, int gameId);
 
     void sendRoomEvent(RoomEvent *event, bool sendToIsl = true);
     RoomEvent *prepareRoomEvent(const ::google::protobuf::Message &roomEvent);
@@ -0,0 +1,691 @@
+#include "loadgen_session.h"
+
+#include "decklist.h"
+#include "get_pb_extension.h"
+#include "loadgen_stats.h"
+#include "pb/command_deck_select.pb.h"
+#include "pb/command_draw_cards.pb.h"
+#include "pb/command_inc_card_counter.pb.h"
+#include "pb/command_inc_counter.pb.h"
+#include "pb/command_leave_game.pb.h"
+#include "pb/command_move_card.pb.h"
+#include "pb/command_next_turn.pb.h"
+#include "pb/command_ready_start.pb.h"
+#include "pb/command_set_card_attr.pb.h"
+#include "pb/command_shuffle.pb.h"
+#include "pb/commands.pb.h"
+#include "pb/event_connection_closed.pb.h"
+#include "pb/event_draw_cards.pb.h"
+#include "pb/event_game_joined.pb.h"
+#include "pb/event_game_state_changed.pb.h"
+#include "pb/event_join.pb.h"
+#include "pb/event_leave.pb.h"
+#include "pb/event_move_card.pb.h"
+#include "pb/event_set_active_player.pb.h"
+#include "pb/game_event_container.pb.h"
+#include "pb/room_commands.pb.h"
+#include "pb/server_message.pb.h"
+#include "pb/session_commands.pb.h"
+#include "serialized_server_message.h"
+
+#include <QTcpSocket>
+#include <QTimer>
+#include <QUrl>
+#include <QWebSocket>
+#include <cmath>
+
+// the table is cleaned up to the graveyard beyond this many cards
+static const int maxTableCards = 8;
+
+void LoadgenGameBroker::offerGame(int gameId)
+{
+    QMutexLocker locker(&mutex);
+    openGames.append(gameId);
+}
+
+int LoadgenGameBroker::takeGame()
+{
+    QMutexLocker locker(&mutex);
+    return openGames.isEmpty() ? -1 : openGames.takeFirst();
+}
+
+void LoadgenGameBroker::withdrawGame(int gameId)
+{
+    QMutexLocker locker(&mutex);
+    openGames.removeAll(gameId);
+}
+
+// a deck of 60 basic lands, the names don't need to be known to the server
+static QString makeDeck()
+{
+    DeckList deck;
+    const QStringList names = {"Plains", "Island", "Swamp", "Mountain", "Forest"};
+    for (const QString &name : names)
+        deck.addCard(name, DECK_ZONE_MAIN)->setNumber(12);
+    return deck.writeToString_Native();
+}
+
+template <class T> static QString commandName()
+{
+    return QString::fromStdString(T::descriptor()->name()).remove("Command_");
+}
+
+LoadgenSession::LoadgenSession(const LoadgenOptions &_options,
+                               int _index,
+                               LoadgenStats *_stats,
+                               LoadgenGameBroker *_broker,
+                               QObject *parent)
+    : QObject(parent), options(_options), index(_index), userName(QString("%1%2").arg(_options.namePrefix).arg(_index)),
+      useWebSocket(std::floor((_index + 1) * _options.webSocketRatio) > std::floor(_index * _options.webSocketRatio)),
+      isPlayer(std::floor((_index + 1) * _options.playerRatio) > std::floor(_index * _options.playerRatio)),
+      stats(_stats), broker(_broker), random(static_cast<quint32>(_index)), socket(nullptr), webSocket(nullptr),
+      preambleBytesLeft(0), state(Disconnected), nextCmdId(1), lastPing(0), gameState(NoGame), gameId(-1), playerId(-1),
+      activePlayerId(-1), turnsPlayed(0), turnActions(0), hosting(false)
+{
+    if (useWebSocket) {
+        webSocket = new QWebSocket(QString(), QWebSocketProtocol::VersionLatest, this);
+        connect(webSocket, &QWebSocket::connected, this, &LoadgenSession::connected);
+        connect(webSocket, &QWebSocket::binaryMessageReceived, this, &LoadgenSession::webSocketMessageReceived);
+        connect(webSocket, &QWebSocket::disconnected, this, &LoadgenSession::disconnected);
+#if (QT_VERSION >= QT_VERSION_CHECK(6, 5, 0))
+        connect(webSocket, &QWebSocket::errorOccurred, this, &LoadgenSession::socketError);
+#else
+        connect(webSocket, qOverload<QAbstractSocket::SocketError>(&QWebSocket::error), this,
+                &LoadgenSession::socketError);
+#endif
+    } else {
+        socket = new QTcpSocket(this);
+        socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+        connect(socket, &QTcpSocket::connected, this, &LoadgenSession::connected);
+        connect(socket, &QTcpSocket::readyRead, this, &LoadgenSession::readTcpData);
+        connect(socket, &QTcpSocket::disconnected, this, &LoadgenSession::disconnected);
+#if (QT_VERSION >= QT_VERSION_CHECK(5, 14, 0))
+        connect(socket, &QTcpSocket::errorOccurred, this, &LoadgenSession::socketError);
+#else
+        connect(socket, qOverload<QAbstractSocket::SocketError>(&QTcpSocket::error), this,
+                &LoadgenSession::socketError);
+#endif
+    }
+
+    tickTimer = new QTimer(this);
+    tickTimer->setInterval(1000);
+    connect(tickTimer, &QTimer::timeout, this, &LoadgenSession::tick);
+
+    chatTimer = new QTimer(this);
+    chatTimer->setSingleShot(true);
+    connect(chatTimer, &QTimer::timeout, this, &LoadgenSession::chat);
+
+    gameTimer = new QTimer(this);
+    connect(gameTimer, &QTimer::timeout, this, &LoadgenSession::gameAction);
+
+    lobbyTimer = new QTimer(this);
+    lobbyTimer->setSingleShot(true);
+    connect(lobbyTimer, &QTimer::timeout, this, &LoadgenSession::lookForGame);
+}
+
+LoadgenSession::~LoadgenSession()
+{
+    stop();
+}
+
+void LoadgenSession::start()
+{
+    if (state != Disconnected)
+        return;
+
+    clock.start();
+    setState(Connecting);
+    if (useWebSocket) {
+        webSocket->open(QUrl(QString("ws://%1:%2/servatrice").arg(options.host).arg(options.webSocketPort)));
+    } else {
+        preambleBytesLeft = 60;
+        socket->connectToHost(options.host, options.port);
+    }
+}
+
+void LoadgenSession::stop()
+{
+    if (state == Disconnected)
+        return;
+
+    setState(Disconnected);
+    if (useWebSocket)
+        webSocket->close();
+    else
+        socket->abort();
+}
+
+void LoadgenSession::setState(State newState)
+{
+    const bool wasConnected = state != Disconnected && state != Connecting;
+    const bool wasLoggedIn = state == JoiningRoom || state == InRoom;
+    const bool isConnected = newState != Disconnected && newState != Connecting;
+    const bool isLoggedIn = newState == JoiningRoom || newState == InRoom;
+    state = newState;
+
+    if (isConnected != wasConnected)
+        isConnected ? stats->sessionsConnected.ref() : stats->sessionsConnected.deref();
+    if (isLoggedIn != wasLoggedIn)
+        isLoggedIn ? stats->sessionsLoggedIn.ref() : stats->sessionsLoggedIn.deref();
+
+    if (state == Disconnected) {
+        tickTimer->stop();
+        chatTimer->stop();
+        lobbyTimer->stop();
+        if (hosting && gameState == WaitingForOpponent)
+            broker->withdrawGame(gameId);
+        resetGame();
+        pendingCommands.clear();
+    }
+}
+
+void LoadgenSession::setGameState(GameState newState)
+{
+    if ((newState == Playing) != (gameState == Playing))
+        newState == Playing ? stats->sessionsPlaying.ref() : stats->sessionsPlaying.deref();
+    gameState = newState;
+
+    if (gameState == Playing)
+        gameTimer->start(qMax(1, static_cast<int>(1000 / options.actionsPerSecond)));
+    else
+        gameTimer->stop();
+}
+
+void LoadgenSession::resetGame()
+{
+    setGameState(NoGame);
+    gameId = playerId = activePlayerId = -1;
+    turnsPlayed = turnActions = 0;
+    hosting = false;
+    handCards.clear();
+    tableCards.clear();
+}
+
+void LoadgenSession::connected()
+{
+    setState(LoggingIn);
+    tickTimer->start();
+    lastPing = clock.elapsed();
+
+    // the server expects a container without a command id before the real ones, an empty one is an empty frame
+    if (!useWebSocket)
+        socket->write(QByteArray(4, 0));
+}
+
+void LoadgenSession::socketError(QAbstractSocket::SocketError /* error */)
+{
+    if (state == Disconnected)
+        return;
+
+    stats->recordFailure(state == Connecting ? "connection failed" : "connection lost");
+    setState(Disconnected);
+}
+
+void LoadgenSession::disconnected()
+{
+    if (state == Disconnected)
+        return;
+
+    stats->recordFailure("disconnected by server");
+    setState(Disconnected);
+}
+
+void LoadgenSession::readTcpData()
+{
+    QByteArray data = socket->readAll();
+    if (preambleBytesLeft > 0) {
+        const int skip = qMin(preambleBytesLeft, static_cast<int>(data.size()));
+        preambleBytesLeft -= skip;
+        data.remove(0, skip);
+    }
+    int messages = 0;
+    const qint64 bytes = data.size();
+    inputBuffer.append(data);
+
+    const char *frame;
+    int frameLength;
+    while (inputBuffer.nextFrame(frame, frameLength)) {
+        ServerMessage message;
+        message.ParseFromArray(frame, frameLength);
+        ++messages;
+        processServerMessage(message);
+        if (state == Disconnected)
+            return;
+    }
+    inputBuffer.compact();
+    stats->recordReceived(messages, bytes);
+}
+
+void LoadgenSession::webSocketMessageReceived(const QByteArray &data)
+{
+    stats->recordReceived(1, data.size());
+
+    ServerMessage message;
+    message.ParseFromArray(data.data(), data.size());
+    processServerMessage(message);
+}
+
+void LoadgenSession::sendContainer(CommandContainer &cont,
+                                   const QString &name,
+                                   std::function<void(const Response &)> callback)
+{
+    if (state == Disconnected || state == Connecting)
+        return;
+
+    const quint64 cmdId = nextCmdId++;
+    cont.set_cmd_id(cmdId);
+    pendingCommands.insert(cmdId, {name, clock.nsecsElapsed(), std::move(callback)});
+
+#if GOOGLE_PROTOBUF_VERSION > 3001000
+    const auto size = static_cast<unsigned int>(cont.ByteSizeLong());
+#else
+    const auto size = static_cast<unsigned int>(cont.ByteSize());
+#endif
+    QByteArray buf;
+    if (useWebSocket) {
+        buf.resize(size);
+        cont.SerializeToArray(buf.data(), size);
+        webSocket->sendBinaryMessage(buf);
+    } else {
+        buf.resize(size + 4);
+        cont.SerializeToArray(buf.data() + 4, size);
+        buf.data()[3] = (unsigned char)size;
+        buf.data()[2] = (unsigned char)(size >> 8);
+        buf.data()[1] = (unsigned char)(size >> 16);
+        buf.data()[0] = (unsigned char)(size >> 24);
+        socket->write(buf);
+    }
+    stats->recordSent(buf.size());
+}
+
+template <class T>
+void LoadgenSession::sendSessionCommand(const T &command, std::function<void(const Response &)> callback)
+{
+    CommandContainer cont;
+    cont.add_session_command()->MutableExtension(T::ext)->CopyFrom(command);
+    sendContainer(cont, commandName<T>(), std::move(callback));
+}
+
+template <class T>
+void LoadgenSession::sendRoomCommand(const T &command, std::function<void(const Response &)> callback)
+{
+    CommandContainer cont;
+    cont.set_room_id(options.roomId);
+    cont.add_room_command()->MutableExtension(T::ext)->CopyFrom(command);
+    sendContainer(cont, commandName<T>(), std::move(callback));
+}
+
+template <class T>
+void LoadgenSession::sendGameCommand(const T &command, std::function<void(const Response &)> callback)
+{
+    CommandContainer cont;
+    cont.set_game_id(gameId);
+    cont.add_game_command()->MutableExtension(T::ext)->CopyFrom(command);
+    sendContainer(cont, commandName<T>(), std::move(callback));
+}
+
+void LoadgenSession::processServerMessage(const ServerMessage &message)
+{
+    switch (message.message_type()) {
+        case ServerMessage::RESPONSE:
+            processResponse(message.response());
+            break;
+        case ServerMessage::SESSION_EVENT:
+            processSessionEvent(message.session_event());
+            break;
+        case ServerMessage::GAME_EVENT_CONTAINER:
+            processGameEventContainer(message.game_event_container());
+            break;
+        case ServerMessage::COMPRESSED: {
+            ServerMessage uncompressed;
+            if (SerializedServerMessage::uncompress(message, uncompressed))
+                processServerMessage(uncompressed);
+            else
+                stats->recordFailure("invalid compressed message");
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+void LoadgenSession::processResponse(const Response &response)
+{
+    auto pending = pendingCommands.find(response.cmd_id());
+    if (pending == pendingCommands.end())
+        return;
+
+    PendingCommand command = pending.value();
+    pendingCommands.erase(pending);
+    stats->recordCommand(command.name, clock.nsecsElapsed() - command.sentAt, response.response_code());
+    if (command.callback)
+        command.callback(response);
+}
+
+void LoadgenSession::processSessionEvent(const SessionEvent &event)
+{
+    switch (getPbExtension(event)) {
+        case SessionEvent::SERVER_IDENTIFICATION:
+            if (state == LoggingIn)
+                login();
+            break;
+        case SessionEvent::CONNECTION_CLOSED: {
+            const auto &closed = event.GetExtension(Event_ConnectionClosed::ext);
+            const QString reason = QString::fromStdString(Event_ConnectionClosed::CloseReason_Name(closed.reason()));
+            stats->recordFailure(QString("connection closed: %1").arg(reason));
+            stop();
+            break;
+        }
+        case SessionEvent::GAME_JOINED: {
+            const auto &joined = event.GetExtension(Event_GameJoined::ext);
+            if (gameState == WaitingForGame)
+                gameJoined(joined.game_info().game_id(), joined.player_id(), hosting);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+void LoadgenSession::processGameEventContainer(const GameEventContainer &cont)
+{
+    if (static_cast<int>(cont.game_id()) != gameId || gameState == NoGame || gameState == WaitingForGame)
+        return;
+
+    for (const GameEvent &event : cont.event_list()) {
+        switch (getPbExtension(event)) {
+            case GameEvent::JOIN:
+                // the host only gets ready once there's someone to play against, or the game would start right away
+                if (gameState == WaitingForOpponent &&
+                    event.GetExtension(Event_Join::ext).player_properties().player_id() != playerId) {
+                    setGameState(WaitingForStart);
+                    Command_ReadyStart cmd;
+                    cmd.set_ready(true);
+                    sendGameCommand(cmd);
+                }
+                break;
+            case GameEvent::LEAVE:
+                if (event.player_id() != playerId)
+                    leaveGame();
+                break;
+            case GameEvent::GAME_CLOSED:
+            case GameEvent::KICKED:
+                gameOver();
+                break;
+            case GameEvent::GAME_STATE_CHANGED: {
+                const auto &changed = event.GetExtension(Event_GameStateChanged::ext);
+                if (changed.game_started() && gameState == WaitingForStart) {
+                    activePlayerId = changed.active_player_id();
+                    setGameState(Playing);
+                } else if (!changed.game_started() && gameState == Playing) {
+                    leaveGame();
+                }
+                break;
+            }
+            case GameEvent::SET_ACTIVE_PLAYER:
+                activePlayerId = event.GetExtension(Event_SetActivePlayer::ext).active_player_id();
+                turnActions = 0;
+                if (++turnsPlayed >= options.turnsPerGame)
+                    leaveGame();
+                break;
+            case GameEvent::DRAW_CARDS:
+                if (event.player_id() == playerId)
+                    for (const ServerInfo_Card &card : event.GetExtension(Event_DrawCards::ext).cards())
+                        handCards.append(card.id());
+                break;
+            case GameEvent::MOVE_CARD: {
+                const auto &move = event.GetExtension(Event_MoveCard::ext);
+                if (event.player_id() != playerId)
+                    break;
+                if (move.start_zone() == "hand")
+                    handCards.removeAll(move.card_id());
+                else if (move.start_zone() == "table")
+                    tableCards.removeAll(move.card_id());
+                if (move.target_zone() == "table" && move.target_player_id() == playerId)
+                    tableCards.append(move.new_card_id() != -1 ? move.new_card_id() : move.card_id());
+                break;
+            }
+            default:
+                break;
+        }
+        if (gameState == NoGame || gameState == LeavingGame)
+            return;
+    }
+}
+
+void LoadgenSession::login()
+{
+    Command_Login cmd;
+    cmd.set_user_name(userName.toStdString());
+    cmd.set_clientid(QString("loadgen%1").arg(index).toStdString());
+    cmd.set_clientver("loadgen");
+    if (options.compression)
+        cmd.add_clientfeatures("compression");
+
+    sendSessionCommand(cmd, [this](const Response &response) {
+        if (response.response_code() != Response::RespOk) {
+            const QString code = QString::fromStdString(Response::ResponseCode_Name(response.response_code()));
+            stats->recordFailure(QString("login refused: %1").arg(code));
+            stop();
+            return;
+        }
+        setState(JoiningRoom);
+        joinRoom();
+    });
+}
+
+void LoadgenSession::joinRoom()
+{
+    Command_JoinRoom cmd;
+    cmd.set_room_id(options.roomId);
+    sendSessionCommand(cmd, [this](const Response &response) {
+        if (response.response_code() != Response::RespOk) {
+            stats->recordFailure(QString("room %1 not joined").arg(options.roomId));
+            stop();
+            return;
+        }
+        setState(InRoom);
+        scheduleChat();
+        if (isPlayer)
+            lobbyTimer->start(random.bounded(static_cast<int>(options.pauseBetweenGames * 1000) + 1));
+    });
+}
+
+void LoadgenSession::tick()
+{
+    const qint64 now = clock.elapsed();
+    if (now - lastPing >= options.pingInterval * 1000) {
+        lastPing = now;
+        sendSessionCommand(Command_Ping());
+    }
+
+    const qint64 timeout = static_cast<qint64>(options.commandTimeout * 1e9);
+    const qint64 nowNsecs = clock.nsecsElapsed();
+    for (auto it = pendingCommands.begin(); it != pendingCommands.end();) {
+        if (nowNsecs - it->sentAt > timeout) {
+            stats->recordTimeout(it->name);
+            it = pendingCommands.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void LoadgenSession::scheduleChat()
+{
+    if (options.chatPerMinute <= 0)
+        return;
+
+    // exponentially distributed, so the messages of all sessions arrive like independent users typing
+    const double mean = 60000 / options.chatPerMinute;
+    chatTimer->start(static_cast<int>(-std::log(1 - random.generateDouble()) * mean));
+}
+
+void LoadgenSession::chat()
+{
+    if (state != InRoom)
+        return;
+
+    Command_RoomSay cmd;
+    cmd.set_message(QString("chat message %1 from %2").arg(nextCmdId).arg(userName).toStdString());
+    sendRoomCommand(cmd);
+    scheduleChat();
+}
+
+void LoadgenSession::lookForGame()
+{
+    if (state != InRoom || gameState != NoGame)
+        return;
+
+    setGameState(WaitingForGame);
+    const int openGame = broker->takeGame();
+    if (openGame == -1)
+        createGame();
+    else
+        joinGame(openGame);
+}
+
+void LoadgenSession::createGame()
+{
+    hosting = true;
+
+    Command_CreateGame cmd;
+    cmd.set_description(QString("game of %1").arg(userName).toStdString());
+    cmd.set_max_players(2);
+    cmd.set_spectators_allowed(true);
+    sendRoomCommand(cmd, [this](const Response &response) {
+        if (response.response_code() != Response::RespOk && gameState == WaitingForGame)
+            gameOver();
+    });
+}
+
+void LoadgenSession::joinGame(int id)
+{
+    hosting = false;
+
+    Command_JoinGame cmd;
+    cmd.set_game_id(id);
+    sendRoomCommand(cmd, [this](const Response &response) {
+        // the game filled up or was closed in the meantime
+        if (response.response_code() != Response::RespOk && gameState == WaitingForGame) {
+            resetGame();
+            lobbyTimer->start(random.bounded(1000) + 1);
+        }
+    });
+}
+
+void LoadgenSession::gameJoined(int id, int player, bool host)
+{
+    gameId = id;
+    playerId = player;
+
+    Command_DeckSelect deckSelect;
+    static const std::string deck = makeDeck().toStdString();
+    deckSelect.set_deck(deck);
+    sendGameCommand(deckSelect);
+
+    if (host) {
+        setGameState(WaitingForOpponent);
+        broker->offerGame(gameId);
+    } else {
+        setGameState(WaitingForStart);
+        Command_ReadyStart readyStart;
+        readyStart.set_ready(true);
+        sendGameCommand(readyStart);
+    }
+}
+
+void LoadgenSession::leaveGame()
+{
+    if (gameState == NoGame || gameState == LeavingGame)
+        return;
+
+    if (hosting && gameState == WaitingForOpponent)
+        broker->withdrawGame(gameId);
+    setGameState(LeavingGame);
+    sendGameCommand(Command_LeaveGame(), [this](const Response &) { gameOver(); });
+}
+
+void LoadgenSession::gameOver()
+{
+    resetGame();
+    lobbyTimer->start(static_cast<int>(options.pauseBetweenGames * 1000));
+}
+
+/**
+ * One step of the turn script of the active player: draw, play a card, tap it, put a counter on it, lose a life and
+ * shuffle the library, then pass the turn.
+ */
+void LoadgenSession::gameAction()
+{
+    if (gameState != Playing || activePlayerId != playerId)
+        return;
+
+    if (turnActions >= options.actionsPerTurn) {
+        sendGameCommand(Command_NextTurn());
+        return;
+    }
+
+    switch (turnActions++ % 6) {
+        case 0: {
+            Command_DrawCards cmd;
+            cmd.set_number(1);
+            sendGameCommand(cmd);
+            break;
+        }
+        case 1: {
+            Command_MoveCard cmd;
+            if (tableCards.size() >= maxTableCards) {
+                cmd.set_start_zone("table");
+                cmd.mutable_cards_to_move()->add_card()->set_card_id(tableCards.first());
+                cmd.set_target_zone("grave");
+            } else if (!handCards.isEmpty()) {
+                cmd.set_start_zone("hand");
+                cmd.mutable_cards_to_move()->add_card()->set_card_id(handCards.first());
+                cmd.set_target_zone("table");
+                cmd.set_x(tableCards.size());
+                cmd.set_y(0);
+            } else {
+                break;
+            }
+            cmd.set_start_player_id(playerId);
+            cmd.set_target_player_id(playerId);
+            sendGameCommand(cmd);
+            break;
+        }
+        case 2:
+            if (!tableCards.isEmpty()) {
+                Command_SetCardAttr cmd;
+                cmd.set_zone("table");
+                cmd.set_card_id(tableCards.last());
+                cmd.set_attribute(AttrTapped);
+                cmd.set_attr_value("1");
+                sendGameCommand(cmd);
+            }
+            break;
+        case 3:
+            if (!tableCards.isEmpty()) {
+                Command_IncCardCounter cmd;
+                cmd.set_zone("table");
+                cmd.set_card_id(tableCards.last());
+                cmd.set_counter_id(0);
+                cmd.set_counter_delta(1);
+                sendGameCommand(cmd);
+            }
+            break;
+        case 4: {
+            // life
+            Command_IncCounter cmd;
+            cmd.set_counter_id(0);
+            cmd.set_delta(-1);
+            sendGameCommand(cmd);
+            break;
+        }
+        case 5: {
+            Command_Shuffle cmd;
+            cmd.set_zone_name("deck");
+            sendGameCommand(cmd);
+            break;
+        }
+    }
+}
@@ -0,0 +1,177 @@
+#ifndef LOADGEN_SESSION_H
+#define LOADGEN_SESSION_H
+
+#include "framed_input_buffer.h"
+
+#include <QAbstractSocket>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QObject>
+#include <QRandomGenerator>
+#include <QString>
+#include <functional>
+
+class LoadgenStats;
+class QTcpSocket;
+class QTimer;
+class QWebSocket;
+class CommandContainer;
+class GameEventContainer;
+class Response;
+class ServerMessage;
+class SessionEvent;
+
+struct LoadgenOptions
+{
+    QString host = "localhost";
+    quint16 port = 4747;
+    quint16 webSocketPort = 4748;
+    // share of the sessions that connect over a websocket instead of tcp
+    double webSocketRatio = 0;
+    QString namePrefix = "loadgen";
+    int roomId = 0;
+    bool compression = false;
+
+    // per session
+    double chatPerMinute = 2;
+    double pingInterval = 5;
+    double commandTimeout = 10;
+    // share of the sessions that create and join games
+    double playerRatio = 0.5;
+    // game actions per second of each player in a started game
+    double actionsPerSecond = 1;
+    int actionsPerTurn = 6;
+    int turnsPerGame = 10;
+    double pauseBetweenGames = 5;
+};
+
+/**
+ * Hands the games created by hosting sessions out to sessions looking for an opponent. Thread safe.
+ */
+class LoadgenGameBroker
+{
+public:
+    void offerGame(int gameId);
+    // -1 if no game is waiting for a player
+    int takeGame();
+    void withdrawGame(int gameId);
+
+private:
+    QMutex mutex;
+    QList<int> openGames;
+};
+
+/**
+ * One simulated client: logs in, joins a room, chats, and plays games against other sessions with a fixed script of
+ * draws, moves, taps, counters and shuffles. Lives in one of the worker threads, see main.cpp.
+ */
+class LoadgenSession : public QObject
+{
+    Q_OBJECT
+public:
+    LoadgenSession(const LoadgenOptions &options,
+                   int index,
+                   LoadgenStats *stats,
+                   LoadgenGameBroker *broker,
+                   QObject *parent = nullptr);
+    ~LoadgenSession() override;
+
+public slots:
+    void start();
+    void stop();
+
+private slots:
+    void connected();
+    void readTcpData();
+    void webSocketMessageReceived(const QByteArray &message);
+    void socketError(QAbstractSocket::SocketError error);
+    void disconnected();
+    void tick();
+    void chat();
+    void gameAction();
+    void lookForGame();
+
+private:
+    enum State
+    {
+        Disconnected,
+        Connecting,
+        LoggingIn,
+        JoiningRoom,
+        InRoom
+    };
+    enum GameState
+    {
+        NoGame,
+        WaitingForGame,
+        WaitingForOpponent,
+        WaitingForStart,
+        Playing,
+        LeavingGame
+    };
+    struct PendingCommand
+    {
+        QString name;
+        qint64 sentAt;
+        std::function<void(const Response &)> callback;
+    };
+
+    const LoadgenOptions &options;
+    const int index;
+    const QString userName;
+    const bool useWebSocket;
+    const bool isPlayer;
+    LoadgenStats *stats;
+    LoadgenGameBroker *broker;
+    QRandomGenerator random;
+
+    QTcpSocket *socket;
+    QWebSocket *webSocket;
+    FramedInputBuffer inputBuffer;
+    // the server greets tcp clients with 60 bytes of xml for clients older than protocol version 14
+    int preambleBytesLeft;
+
+    State state;
+    quint64 nextCmdId;
+    QElapsedTimer clock;
+    qint64 lastPing;
+    QHash<quint64, PendingCommand> pendingCommands;
+    QTimer *tickTimer, *chatTimer, *gameTimer, *lobbyTimer;
+
+    GameState gameState;
+    int gameId;
+    int playerId;
+    int activePlayerId;
+    int turnsPlayed;
+    int turnActions;
+    bool hosting;
+    QList<int> handCards;
+    QList<int> tableCards;
+
+    void setState(State newState);
+    void setGameState(GameState newState);
+    void scheduleChat();
+    void resetGame();
+
+    void sendContainer(CommandContainer &cont, const QString &name, std::function<void(const Response &)> callback);
+    template <class T> void sendSessionCommand(const T &command, std::function<void(const Response &)> callback = {});
+    template <class T> void sendRoomCommand(const T &command, std::function<void(const Response &)> callback = {});
+    template <class T> void sendGameCommand(const T &command, std::function<void(const Response &)> callback = {});
+
+    void processServerMessage(const ServerMessage &message);
+    void processResponse(const Response &response);
+    void processSessionEvent(const SessionEvent &event);
+    void processGameEventContainer(const GameEventContainer &cont);
+
+    void login();
+    void joinRoom();
+    void createGame();
+    void joinGame(int id);
+    void leaveGame();
+    void gameOver();
+    void gameJoined(int id, int player, bool host);
+};
+
+#endif
@@ -0,0 +1,190 @@
+#include "loadgen_stats.h"
+
+#include "pb/response.pb.h"
+
+#include <QMutexLocker>
+#include <cmath>
+#include <utility>
+
+LatencyHistogram::LatencyHistogram() : buckets(bucketCount), total(0), maxValue(0)
+{
+}
+
+int LatencyHistogram::bucketFor(qint64 nsecs)
+{
+    const double usecs = nsecs / 1000.0;
+    if (usecs <= 1)
+        return 0;
+    const int bucket = static_cast<int>(std::ceil(std::log2(usecs) * bucketsPerDoubling));
+    return qMin(bucket, bucketCount - 1);
+}
+
+qint64 LatencyHistogram::upperBound(int bucket)
+{
+    return static_cast<qint64>(std::exp2(static_cast<double>(bucket) / bucketsPerDoubling) * 1000);
+}
+
+void LatencyHistogram::record(qint64 nsecs)
+{
+    ++buckets[bucketFor(nsecs)];
+    ++total;
+    maxValue = qMax(maxValue, nsecs);
+}
+
+void LatencyHistogram::merge(const LatencyHistogram &other)
+{
+    for (int i = 0; i < bucketCount; ++i)
+        buckets[i] += other.buckets[i];
+    total += other.total;
+    maxValue = qMax(maxValue, other.maxValue);
+}
+
+qint64 LatencyHistogram::percentile(double fraction) const
+{
+    if (total == 0)
+        return 0;
+
+    const quint64 rank = qMax<quint64>(static_cast<quint64>(std::ceil(fraction * total)), 1);
+    quint64 seen = 0;
+    for (int i = 0; i < bucketCount; ++i) {
+        seen += buckets[i];
+        if (seen >= rank)
+            return qMin(upperBound(i), maxValue);
+    }
+    return maxValue;
+}
+
+void LoadgenStats::CommandStats::merge(const CommandStats &other)
+{
+    latency.merge(other.latency);
+    errors += other.errors;
+    timeouts += other.timeouts;
+}
+
+void LoadgenStats::Counters::merge(const Counters &other)
+{
+    for (auto it = other.commands.constBegin(); it != other.commands.constEnd(); ++it)
+        commands[it.key()].merge(it.value());
+    for (auto it = other.failures.constBegin(); it != other.failures.constEnd(); ++it)
+        failures[it.key()] += it.value();
+    messagesReceived += other.messagesReceived;
+    bytesReceived += other.bytesReceived;
+    bytesSent += other.bytesSent;
+}
+
+LoadgenStats::LoadgenStats() : sessionsConnected(0), sessionsLoggedIn(0), sessionsPlaying(0)
+{
+}
+
+void LoadgenStats::recordCommand(const QString &command, qint64 nsecs, int responseCode)
+{
+    QMutexLocker locker(&mutex);
+    CommandStats &stats = interval.commands[command];
+    stats.latency.record(nsecs);
+    if (responseCode != Response::RespOk)
+        ++stats.errors;
+}
+
+void LoadgenStats::recordTimeout(const QString &command)
+{
+    QMutexLocker locker(&mutex);
+    ++interval.commands[command].timeouts;
+}
+
+void LoadgenStats::recordFailure(const QString &reason)
+{
+    QMutexLocker locker(&mutex);
+    ++interval.failures[reason];
+}
+
+void LoadgenStats::recordReceived(int messages, qint64 bytes)
+{
+    QMutexLocker locker(&mutex);
+    interval.messagesReceived += messages;
+    interval.bytesReceived += bytes;
+}
+
+void LoadgenStats::recordSent(qint64 bytes)
+{
+    QMutexLocker locker(&mutex);
+    interval.bytesSent += bytes;
+}
+
+QString LoadgenStats::takeIntervalReport(double seconds)
+{
+    Counters finished;
+    {
+        QMutexLocker locker(&mutex);
+        std::swap(finished, interval);
+        totals.merge(finished);
+    }
+    return format(finished, seconds);
+}
+
+QString LoadgenStats::totalReport(double seconds)
+{
+    QMutexLocker locker(&mutex);
+    Counters all = totals;
+    all.merge(interval);
+    locker.unlock();
+
+    return format(all, seconds);
+}
+
+static QString formatMsecs(qint64 nsecs)
+{
+    return QString::number(nsecs / 1e6, 'f', nsecs < 10000000 ? 2 : 1);
+}
+
+QString LoadgenStats::format(const Counters &counters, double seconds) const
+{
+    if (seconds <= 0)
+        seconds = 1;
+
+    QString result = QString("sessions: %1 connected, %2 logged in, %3 playing\n")
+                         .arg(sessionsConnected.loadAcquire())
+                         .arg(sessionsLoggedIn.loadAcquire())
+                         .arg(sessionsPlaying.loadAcquire());
+    result += QString("server: %1 messages/s, %2 KiB/s received, %3 KiB/s sent\n")
+                  .arg(counters.messagesReceived / seconds, 0, 'f', 1)
+                  .arg(counters.bytesReceived / seconds / 1024, 0, 'f', 1)
+                  .arg(counters.bytesSent / seconds / 1024, 0, 'f', 1);
+
+    result += QString("%1 %2 %3 %4 %5 %6 %7 %8\n")
+                  .arg("command", -20)
+                  .arg("count", 9)
+                  .arg("per s", 9)
+                  .arg("errors", 8)
+                  .arg("p50 ms", 9)
+                  .arg("p90 ms", 9)
+                  .arg("p99 ms", 9)
+                  .arg("max ms", 9);
+    quint64 allCount = 0, allErrors = 0;
+    for (auto it = counters.commands.constBegin(); it != counters.commands.constEnd(); ++it) {
+        const CommandStats &stats = it.value();
+        const quint64 count = stats.latency.count();
+        const quint64 errors = stats.errors + stats.timeouts;
+        const quint64 attempts = count + stats.timeouts;
+        allCount += count;
+        allErrors += errors;
+        const QString errorRate = attempts ? QString::number(100.0 * errors / attempts, 'f', 1) + "%" : QString("-");
+        result += QString("%1 %2 %3 %4 %5 %6 %7 %8\n")
+                      .arg(it.key(), -20)
+                      .arg(count, 9)
+                      .arg(count / seconds, 9, 'f', 1)
+                      .arg(errorRate, 8)
+                      .arg(formatMsecs(stats.latency.percentile(0.5)), 9)
+                      .arg(formatMsecs(stats.latency.percentile(0.9)), 9)
+                      .arg(formatMsecs(stats.latency.percentile(0.99)), 9)
+                      .arg(formatMsecs(stats.latency.max()), 9);
+    }
+    result += QString("total: %1 commands, %2/s, %3 errors\n")
+                  .arg(allCount)
+                  .arg(allCount / seconds, 0, 'f', 1)
+                  .arg(allErrors);
+
+    for (auto it = counters.failures.constBegin(); it != counters.failures.constEnd(); ++it)
+        result += QString("failure: %1 x%2\n").arg(it.key()).arg(it.value());
+
+    return result;
+}
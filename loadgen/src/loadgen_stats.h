@@ -0,0 +1,95 @@
+#ifndef LOADGEN_STATS_H
+#define LOADGEN_STATS_H
+
+#include <QAtomicInt>
+#include <QMap>
+#include <QMutex>
+#include <QString>
+#include <QVector>
+
+/**
+ * Latency histogram with logarithmic buckets, eight per power of two starting at one microsecond. Percentiles are
+ * accurate to about 9%, and histograms of different sessions or intervals can be merged.
+ */
+class LatencyHistogram
+{
+public:
+    LatencyHistogram();
+
+    void record(qint64 nsecs);
+    void merge(const LatencyHistogram &other);
+
+    quint64 count() const
+    {
+        return total;
+    }
+    qint64 max() const
+    {
+        return maxValue;
+    }
+    // fraction between 0 and 1, in nsecs
+    qint64 percentile(double fraction) const;
+
+private:
+    static const int bucketsPerDoubling = 8;
+    static const int bucketCount = bucketsPerDoubling * 40 + 1;
+
+    QVector<quint64> buckets;
+    quint64 total;
+    qint64 maxValue;
+
+    static int bucketFor(qint64 nsecs);
+    static qint64 upperBound(int bucket);
+};
+
+/**
+ * Command round trip times and errors of all sessions, reported per interval and for the whole run. Thread safe.
+ */
+class LoadgenStats
+{
+public:
+    LoadgenStats();
+
+    void recordCommand(const QString &command, qint64 nsecs, int responseCode);
+    void recordTimeout(const QString &command);
+    // connection failures, disconnects by the server and the like
+    void recordFailure(const QString &reason);
+    void recordReceived(int messages, qint64 bytes);
+    void recordSent(qint64 bytes);
+
+    QAtomicInt sessionsConnected;
+    QAtomicInt sessionsLoggedIn;
+    QAtomicInt sessionsPlaying;
+
+    // Formats the stats since the last call and adds them to the totals
+    QString takeIntervalReport(double seconds);
+    QString totalReport(double seconds);
+
+private:
+    struct CommandStats
+    {
+        LatencyHistogram latency;
+        quint64 errors = 0;
+        quint64 timeouts = 0;
+
+        void merge(const CommandStats &other);
+    };
+    struct Counters
+    {
+        QMap<QString, CommandStats> commands;
+        QMap<QString, quint64> failures;
+        quint64 messagesReceived = 0;
+        quint64 bytesReceived = 0;
+        quint64 bytesSent = 0;
+
+        void merge(const Counters &other);
+    };
+
+    QMutex mutex;
+    Counters interval;
+    Counters totals;
+
+    QString format(const Counters &counters, double seconds) const;
+};
+
+#endif
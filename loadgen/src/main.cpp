@@ -0,0 +1,196 @@
+// Headless load generator for servatrice: many simulated clients in one process, reporting round trip times per
+// command. loadgen/servatrice_loadgen.ini configures a local server for it that needs no database.
+
+#include "loadgen_session.h"
+#include "loadgen_stats.h"
+#include "version_string.h"
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QNetworkRequest>
+#include <QThread>
+#include <QTimer>
+#include <QUrl>
+#include <iostream>
+
+// servatrice's metrics endpoint, see servatrice.ini.example
+static const char *serverCommandCountName = "servatrice_command_duration_seconds_count";
+static const char *serverCommandSumName = "servatrice_command_duration_seconds_sum";
+
+static double sumMetric(const QByteArray &text, const char *name)
+{
+    double sum = 0;
+    for (const QByteArray &line : text.split('\n')) {
+        if (!line.startsWith(name))
+            continue;
+        const int valueStart = line.lastIndexOf(' ');
+        if (valueStart != -1)
+            sum += line.mid(valueStart + 1).toDouble();
+    }
+    return sum;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setOrganizationName("Cockatrice");
+    QCoreApplication::setApplicationName("loadgen");
+    QCoreApplication::setApplicationVersion(VERSION_STRING);
+
+    LoadgenOptions options;
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Simulates clients of a servatrice server and reports the round trip times of "
+                                     "their commands");
+    parser.addHelpOption();
+    parser.addVersionOption();
+
+    QCommandLineOption hostOpt("host", "Server address", "host", options.host);
+    QCommandLineOption portOpt("port", "Server tcp port", "port", QString::number(options.port));
+    QCommandLineOption webSocketPortOpt("websocket-port", "Server websocket port", "port",
+                                        QString::number(options.webSocketPort));
+    QCommandLineOption webSocketRatioOpt("websocket-ratio", "Share of the sessions using websockets, 0 to 1", "ratio",
+                                         QString::number(options.webSocketRatio));
+    QCommandLineOption sessionsOpt("sessions", "Number of simulated sessions", "count", "100");
+    QCommandLineOption rampOpt("ramp", "Sessions started per second", "rate", "50");
+    QCommandLineOption threadsOpt("threads", "Worker threads, defaults to the number of cores", "count");
+    QCommandLineOption durationOpt("duration", "Seconds to run after the last session started", "seconds", "60");
+    QCommandLineOption reportOpt("report-interval", "Seconds between reports", "seconds", "10");
+    QCommandLineOption namePrefixOpt("name-prefix", "Prefix of the user names", "prefix", options.namePrefix);
+    QCommandLineOption roomOpt("room", "Id of the room to join", "id", QString::number(options.roomId));
+    QCommandLineOption compressionOpt("compression", "Announce the compression feature");
+    QCommandLineOption chatOpt("chat-rate", "Room messages per session and minute", "rate",
+                               QString::number(options.chatPerMinute));
+    QCommandLineOption pingOpt("ping-interval", "Seconds between pings", "seconds",
+                               QString::number(options.pingInterval));
+    QCommandLineOption timeoutOpt("command-timeout", "Seconds until a command without response counts as failed",
+                                  "seconds", QString::number(options.commandTimeout));
+    QCommandLineOption playerRatioOpt("player-ratio", "Share of the sessions playing games, 0 to 1", "ratio",
+                                      QString::number(options.playerRatio));
+    QCommandLineOption actionRateOpt("action-rate", "Game actions per second of the active player", "rate",
+                                     QString::number(options.actionsPerSecond));
+    QCommandLineOption turnActionsOpt("turn-actions", "Game actions per turn", "count",
+                                      QString::number(options.actionsPerTurn));
+    QCommandLineOption turnsOpt("turns", "Turns per game", "count", QString::number(options.turnsPerGame));
+    QCommandLineOption gamePauseOpt("game-pause", "Seconds between games", "seconds",
+                                    QString::number(options.pauseBetweenGames));
+    QCommandLineOption metricsPortOpt("metrics-port", "Port of the server's metrics endpoint, to report its throughput",
+                                      "port");
+    parser.addOptions({hostOpt, portOpt, webSocketPortOpt, webSocketRatioOpt, sessionsOpt, rampOpt, threadsOpt,
+                       durationOpt, reportOpt, namePrefixOpt, roomOpt, compressionOpt, chatOpt, pingOpt, timeoutOpt,
+                       playerRatioOpt, actionRateOpt, turnActionsOpt, turnsOpt, gamePauseOpt, metricsPortOpt});
+    parser.process(app);
+
+    options.host = parser.value(hostOpt);
+    options.port = static_cast<quint16>(parser.value(portOpt).toUInt());
+    options.webSocketPort = static_cast<quint16>(parser.value(webSocketPortOpt).toUInt());
+    options.webSocketRatio = qBound(0.0, parser.value(webSocketRatioOpt).toDouble(), 1.0);
+    options.namePrefix = parser.value(namePrefixOpt);
+    options.roomId = parser.value(roomOpt).toInt();
+    options.compression = parser.isSet(compressionOpt);
+    options.chatPerMinute = parser.value(chatOpt).toDouble();
+    options.pingInterval = qMax(1.0, parser.value(pingOpt).toDouble());
+    options.commandTimeout = qMax(1.0, parser.value(timeoutOpt).toDouble());
+    options.playerRatio = qBound(0.0, parser.value(playerRatioOpt).toDouble(), 1.0);
+    options.actionsPerSecond = qMax(0.01, parser.value(actionRateOpt).toDouble());
+    options.actionsPerTurn = qMax(1, parser.value(turnActionsOpt).toInt());
+    options.turnsPerGame = qMax(1, parser.value(turnsOpt).toInt());
+    options.pauseBetweenGames = qMax(0.0, parser.value(gamePauseOpt).toDouble());
+
+    const int sessionCount = qMax(1, parser.value(sessionsOpt).toInt());
+    const double rampRate = qMax(0.1, parser.value(rampOpt).toDouble());
+    const int threadCount =
+        parser.isSet(threadsOpt) ? qMax(1, parser.value(threadsOpt).toInt()) : qMax(1, QThread::idealThreadCount());
+    const double duration = parser.value(durationOpt).toDouble();
+    const int reportInterval = qMax(1, parser.value(reportOpt).toInt());
+    const int metricsPort = parser.value(metricsPortOpt).toInt();
+
+    LoadgenStats stats;
+    LoadgenGameBroker broker;
+
+    QList<QThread *> threads;
+    for (int i = 0; i < threadCount; ++i) {
+        auto *thread = new QThread;
+        thread->start();
+        threads.append(thread);
+    }
+
+    QList<LoadgenSession *> sessions;
+    for (int i = 0; i < sessionCount; ++i) {
+        auto *session = new LoadgenSession(options, i, &stats, &broker);
+        QThread *thread = threads[i % threadCount];
+        session->moveToThread(thread);
+        QObject::connect(thread, &QThread::finished, session, &QObject::deleteLater);
+        QTimer::singleShot(static_cast<int>(i * 1000 / rampRate), session, &LoadgenSession::start);
+        sessions.append(session);
+    }
+
+    std::cout << "starting " << sessionCount << " sessions against " << options.host.toStdString() << " with "
+              << threadCount << " threads" << std::endl;
+
+    QElapsedTimer runTimer;
+    runTimer.start();
+    QElapsedTimer intervalTimer;
+    intervalTimer.start();
+
+    QNetworkAccessManager *network = metricsPort > 0 ? new QNetworkAccessManager(&app) : nullptr;
+    double lastServerCount = -1, lastServerSum = 0;
+    QElapsedTimer serverTimer;
+
+    QTimer reportTimer;
+    QObject::connect(&reportTimer, &QTimer::timeout, [&]() {
+        const double seconds = intervalTimer.restart() / 1000.0;
+        std::cout << "--- " << runTimer.elapsed() / 1000 << " s\n"
+                  << stats.takeIntervalReport(seconds).toStdString() << std::flush;
+
+        if (!network)
+            return;
+        QNetworkReply *reply = network->get(
+            QNetworkRequest(QUrl(QString("http://%1:%2/metrics").arg(options.host).arg(metricsPort))));
+        QObject::connect(reply, &QNetworkReply::finished, [&, reply]() {
+            reply->deleteLater();
+            if (reply->error() != QNetworkReply::NoError) {
+                std::cout << "server metrics: " << reply->errorString().toStdString() << std::endl;
+                return;
+            }
+            const QByteArray text = reply->readAll();
+            const double count = sumMetric(text, serverCommandCountName);
+            const double sum = sumMetric(text, serverCommandSumName);
+            if (lastServerCount >= 0 && count > lastServerCount) {
+                const double commands = count - lastServerCount;
+                std::cout << QString("server metrics: %1 commands/s, %2 ms mean processing time\n")
+                                 .arg(commands / (serverTimer.elapsed() / 1000.0), 0, 'f', 1)
+                                 .arg((sum - lastServerSum) / commands * 1000, 0, 'f', 3)
+                                 .toStdString()
+                          << std::flush;
+            }
+            lastServerCount = count;
+            lastServerSum = sum;
+            serverTimer.start();
+        });
+    });
+    reportTimer.start(reportInterval * 1000);
+
+    const int runTime = static_cast<int>((sessionCount / rampRate + qMax(0.0, duration)) * 1000);
+    QTimer::singleShot(runTime, &app, [&]() {
+        reportTimer.stop();
+        for (LoadgenSession *session : sessions)
+            QMetaObject::invokeMethod(session, "stop", Qt::BlockingQueuedConnection);
+
+        std::cout << "=== total after " << runTimer.elapsed() / 1000 << " s\n"
+                  << stats.totalReport(runTimer.elapsed() / 1000.0).toStdString() << std::flush;
+        app.quit();
+    });
+
+    const int result = app.exec();
+
+    for (QThread *thread : threads) {
+        thread->quit();
+        thread->wait();
+        delete thread;
+    }
+    return result;
+}
@@ -0,0 +1,284 @@
+#!/usr/bin/env python3
+"""Runs two servatrice instances linked by the server network on localhost and measures how they resync.
+
+The servers talk to each other through a proxy that can cut the link. Users log in on the first server, the link
+is cut for a while, more users log in and leave, and the link comes back. The "[ISL]" log lines of both servers
+show whether the resync was incremental, how long it took and how much was sent over each link.
+
+Servers identify incoming links by address, so with both on 127.0.0.1 only the link opened by the first server is
+accepted; the second server's attempts are refused and retried, which shows up in the logs.
+
+Needs a MySQL database with the servatrice schema (the servers table is rewritten), openssl, the mysql command line
+client and the python protobuf messages built by mk_pypb.sh.
+"""
+
+import argparse
+import os
+import socket
+import struct
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+
+from pypb.commands_pb2 import CommandContainer
+from pypb.session_commands_pb2 import Command_Login
+
+SERVER_IDS = (1, 2)
+
+
+def run_sql(args, statement):
+    subprocess.run(["mysql", "-h", args.db_host, "-u", args.db_user, "-p" + args.db_password, args.db_name,
+                    "-e", statement], check=True)
+
+
+def make_cert(workdir, server_id):
+    cert = os.path.join(workdir, "isl%d_cert.pem" % server_id)
+    key = os.path.join(workdir, "isl%d_key.pem" % server_id)
+    subprocess.run(["openssl", "req", "-x509", "-newkey", "rsa:2048", "-nodes", "-days", "1", "-subj",
+                    "/CN=isl%d" % server_id, "-keyout", key, "-out", cert], check=True, stderr=subprocess.DEVNULL)
+    return cert, key
+
+
+def write_config(args, workdir, server_id, cert, key):
+    path = os.path.join(workdir, "servatrice%d.ini" % server_id)
+    with open(path, "w") as config:
+        config.write("""[server]
+id={id}
+host=127.0.0.1
+port={client_port}
+websocket_number_pools=0
+statusupdate=5000
+
+[authentication]
+method=none
+
+[database]
+type=mysql
+prefix={prefix}
+hostname={db_host}
+database={db_name}
+user={db_user}
+password={db_password}
+
+[rooms]
+method=config
+roomlist\\size=1
+roomlist\\1\\name="General room"
+roomlist\\1\\autojoin=true
+roomlist\\1\\game_types\\size=0
+
+[servernetwork]
+active=1
+port={isl_port}
+ssl_cert={cert}
+ssl_key={key}
+batch_interval={batch_interval}
+reconnect_interval=1
+resync_grace_period={grace}
+""".format(id=server_id, client_port=client_port(args, server_id), prefix=args.prefix, db_host=args.db_host,
+           db_name=args.db_name, db_user=args.db_user, db_password=args.db_password,
+           isl_port=isl_port(args, server_id), cert=cert, key=key, batch_interval=args.batch_interval,
+           grace=args.grace_period))
+    return path
+
+
+def client_port(args, server_id):
+    return args.base_port + server_id * 10
+
+
+def isl_port(args, server_id):
+    return args.base_port + server_id * 10 + 1
+
+
+def proxy_port(args, server_id):
+    return args.base_port + server_id * 10 + 2
+
+
+class LinkProxy:
+    """Forwards connections to a server network port until the link is cut."""
+
+    def __init__(self, listen_port, target_port):
+        self.target_port = target_port
+        self.lock = threading.Lock()
+        self.connections = []
+        self.up = True
+        self.listener = socket.create_server(("127.0.0.1", listen_port))
+        threading.Thread(target=self.accept, daemon=True).start()
+
+    def accept(self):
+        while True:
+            downstream, _ = self.listener.accept()
+            with self.lock:
+                if not self.up:
+                    downstream.close()
+                    continue
+                try:
+                    upstream = socket.create_connection(("127.0.0.1", self.target_port))
+                except OSError:
+                    downstream.close()
+                    continue
+                self.connections += [downstream, upstream]
+            threading.Thread(target=self.pipe, args=(downstream, upstream), daemon=True).start()
+            threading.Thread(target=self.pipe, args=(upstream, downstream), daemon=True).start()
+
+    @staticmethod
+    def pipe(source, destination):
+        try:
+            while True:
+                data = source.recv(65536)
+                if not data:
+                    break
+                destination.sendall(data)
+        except OSError:
+            pass
+        for sock in (source, destination):
+            try:
+                sock.shutdown(socket.SHUT_RDWR)
+            except OSError:
+                pass
+
+    def cut(self):
+        with self.lock:
+            self.up = False
+            for sock in self.connections:
+                try:
+                    sock.shutdown(socket.SHUT_RDWR)
+                except OSError:
+                    pass
+                sock.close()
+            self.connections = []
+
+    def restore(self):
+        with self.lock:
+            self.up = True
+
+
+class Client:
+    """A user logged in with the client protocol, auto joining the configured room."""
+
+    def __init__(self, port, name):
+        self.sock = socket.create_connection(("127.0.0.1", port))
+        # the server discards the first message, it expects old xml clients there
+        self.send(CommandContainer())
+        self.sock.recv(60)
+        threading.Thread(target=self.drain, daemon=True).start()
+
+        cmd = CommandContainer()
+        cmd.cmd_id = 1
+        login = cmd.session_command.add().Extensions[Command_Login.ext]
+        login.user_name = name
+        login.clientver = "isl_harness"
+        self.send(cmd)
+
+    def send(self, msg):
+        data = msg.SerializeToString()
+        self.sock.sendall(struct.pack(">I", len(data)) + data)
+
+    def drain(self):
+        try:
+            while self.sock.recv(65536):
+                pass
+        except OSError:
+            pass
+
+    def close(self):
+        self.sock.close()
+
+
+def start_server(args, config, server_id, log):
+    process = subprocess.Popen([args.servatrice, "--config", config, "--log-to-console"], stdout=subprocess.PIPE,
+                               stderr=subprocess.STDOUT, universal_newlines=True)
+
+    def read():
+        for line in process.stdout:
+            if "[ISL]" in line:
+                entry = "server %d: %s" % (server_id, line.rstrip())
+                log.append(entry)
+                print(entry, flush=True)
+
+    threading.Thread(target=read, daemon=True).start()
+    return process
+
+
+def login_users(args, names):
+    clients = []
+    for name in names:
+        clients.append(Client(client_port(args, SERVER_IDS[0]), name))
+    return clients
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--servatrice", default="servatrice", help="servatrice binary")
+    parser.add_argument("--db-host", default="localhost")
+    parser.add_argument("--db-name", default="servatrice")
+    parser.add_argument("--db-user", default="servatrice")
+    parser.add_argument("--db-password", default="")
+    parser.add_argument("--prefix", default="cockatrice")
+    parser.add_argument("--base-port", type=int, default=24700)
+    parser.add_argument("--users", type=int, default=200, help="users logged in before the first outage")
+    parser.add_argument("--churn", type=int, default=50, help="users logging in and out during each outage")
+    parser.add_argument("--outages", type=int, default=3)
+    parser.add_argument("--outage-seconds", type=float, default=5)
+    parser.add_argument("--batch-interval", type=int, default=20)
+    parser.add_argument("--grace-period", type=int, default=30)
+    args = parser.parse_args()
+
+    workdir = tempfile.mkdtemp(prefix="isl_harness")
+    configs = {}
+    statements = ["delete from %s_servers where id in (%s)" % (args.prefix, ",".join(map(str, SERVER_IDS)))]
+    for server_id in SERVER_IDS:
+        cert, key = make_cert(workdir, server_id)
+        configs[server_id] = write_config(args, workdir, server_id, cert, key)
+        with open(cert) as f:
+            pem = f.read()
+        # the peers connect through the proxy
+        statements.append(
+            "insert into %s_servers (id, ssl_cert, hostname, address, game_port, control_port) "
+            "values (%d, '%s', 'isl%d', '127.0.0.1', %d, %d)" %
+            (args.prefix, server_id, pem, server_id, client_port(args, server_id), proxy_port(args, server_id)))
+    run_sql(args, "; ".join(statements))
+
+    proxies = [LinkProxy(proxy_port(args, server_id), isl_port(args, server_id)) for server_id in SERVER_IDS]
+    log = []
+    processes = [start_server(args, configs[server_id], server_id, log) for server_id in SERVER_IDS]
+    try:
+        time.sleep(3)
+        clients = login_users(args, ["harness%d" % i for i in range(args.users)])
+        time.sleep(2)
+
+        for outage in range(args.outages):
+            print("--- outage %d: cutting the link for %.1f s" % (outage + 1, args.outage_seconds), flush=True)
+            for proxy in proxies:
+                proxy.cut()
+            churn = login_users(args, ["churn%d_%d" % (outage, i) for i in range(args.churn)])
+            time.sleep(args.outage_seconds / 2)
+            for client in churn[:len(churn) // 2]:
+                client.close()
+            time.sleep(args.outage_seconds / 2)
+            clients += churn[len(churn) // 2:]
+            for proxy in proxies:
+                proxy.restore()
+            print("--- outage %d: link restored" % (outage + 1), flush=True)
+            time.sleep(5)
+
+        for client in clients:
+            client.close()
+        time.sleep(2)
+    finally:
+        for process in processes:
+            process.terminate()
+        for process in processes:
+            process.wait()
+        run_sql(args, "delete from %s_servers where id in (%s)" % (args.prefix, ",".join(map(str, SERVER_IDS))))
+
+    print("\nstate syncs:")
+    for entry in log:
+        if "state sync" in entry or "closed after" in entry:
+            print(entry)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
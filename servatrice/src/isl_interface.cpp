@@ -19,14 +19,34 @@
 #include "server_room.h"
 
 #include <QSslSocket>
+#include <QTimer>
 #include <google/protobuf/descriptor.h>
 
+// how long to wait for the peer's state sync request before sending the full state anyway, in ms
+static const int stateSyncRequestTimeout = 5000;
+
 void IslInterface::sharedCtor(const QSslCertificate &cert, const QSslKey &privateKey)
 {
+    registered = false;
+    batchInterval = server->getISLBatchInterval();
+    stateSyncTarget = 0;
+    stateSyncIncremental = false;
+    stateSyncChanges = 0;
+    txMessages = txBatches = txBytes = 0;
+    rxMessages = rxBytes = 0;
+
     socket = new QSslSocket(this);
     socket->setLocalCertificate(cert);
     socket->setPrivateKey(privateKey);
 
+    batchTimer = new QTimer(this);
+    batchTimer->setSingleShot(true);
+    connect(batchTimer, SIGNAL(timeout()), this, SLOT(writeOutputBatch()));
+
+    stateSyncTimer = new QTimer(this);
+    stateSyncTimer->setSingleShot(true);
+    connect(stateSyncTimer, SIGNAL(timeout()), this, SLOT(sendFullStateSync()));
+
     connect(socket, SIGNAL(readyRead()), this, SLOT(readClient()), Qt::QueuedConnection);
     connect(socket, SIGNAL(error(QAbstractSocket::SocketError)), this,
             SLOT(catchSocketError(QAbstractSocket::SocketError)));
@@ -37,7 +57,7 @@ IslInterface::IslInterface(int _socketDescriptor,
                            const QSslCertificate &cert,
                            const QSslKey &privateKey,
                            Servatrice *_server)
-    : QObject(), socketDescriptor(_socketDescriptor), server(_server), messageInProgress(false)
+    : QObject(), serverId(-1), socketDescriptor(_socketDescriptor), server(_server)
 {
     sharedCtor(cert, privateKey);
 }
@@ -51,7 +71,7 @@ IslInterface::IslInterface(int _serverId,
                            const QSslKey &privateKey,
                            Servatrice *_server)
     : QObject(), serverId(_serverId), peerHostName(_peerHostName), peerAddress(_peerAddress), peerPort(_peerPort),
-      peerCert(_peerCert), server(_server), messageInProgress(false)
+      peerCert(_peerCert), server(_server)
 {
     sharedCtor(cert, privateKey);
 }
@@ -60,34 +80,23 @@ IslInterface::~IslInterface()
 {
     logger->logMessage("[ISL] session ended", this);
 
-    flushOutputBuffer();
-
-    // As these signals are connected with Qt::QueuedConnection implicitly,
-    // we don't need to worry about them modifying the lists while we're iterating.
-
-    server->roomsLock.lockForRead();
-    QMapIterator<int, Server_Room *> roomIterator(server->getRooms());
-    while (roomIterator.hasNext()) {
-        Server_Room *room = roomIterator.next().value();
-        room->usersLock.lockForRead();
-        QMapIterator<QString, ServerInfo_User_Container> roomUsers(room->getExternalUsers());
-        while (roomUsers.hasNext()) {
-            roomUsers.next();
-            if (roomUsers.value().getUserInfo()->server_id() == serverId)
-                emit externalRoomUserLeft(room->getId(), roomUsers.key());
-        }
-        room->usersLock.unlock();
+    writeOutputBatch();
+
+    if (registered) {
+        logger->logMessage(QString("[ISL] link to #%1 closed after %2 s: sent %3 messages in %4 batches (%5 bytes, "
+                                   "%6 game list updates merged), received %7 messages (%8 bytes)")
+                               .arg(serverId)
+                               .arg(linkTimer.isValid() ? linkTimer.elapsed() / 1000 : 0)
+                               .arg(txMessages)
+                               .arg(txBatches)
+                               .arg(txBytes)
+                               .arg(outputQueue.getMergedGameUpdates())
+                               .arg(rxMessages)
+                               .arg(rxBytes),
+                           this);
+        // the server drops the peer's users unless the link comes back within the grace period
+        QMetaObject::invokeMethod(server, "islPeerDisconnected", Qt::QueuedConnection, Q_ARG(int, serverId));
     }
-    server->roomsLock.unlock();
-
-    server->clientsLock.lockForRead();
-    QMapIterator<QString, Server_AbstractUserInterface *> extUsers(server->getExternalUsers());
-    while (extUsers.hasNext()) {
-        extUsers.next();
-        if (extUsers.value()->getUserInfo()->server_id() == serverId)
-            emit externalUserLeft(extUsers.key());
-    }
-    server->clientsLock.unlock();
 }
 
 void IslInterface::initServer()
@@ -134,48 +143,18 @@ void IslInterface::initServer()
     }
     serverId = serverList[listIndex].id;
 
-    Event_ServerCompleteList event;
-    event.set_server_id(server->getServerID());
-
-    server->clientsLock.lockForRead();
-    QMapIterator<QString, Server_ProtocolHandler *> userIterator(server->getUsers());
-    while (userIterator.hasNext())
-        event.add_user_list()->CopyFrom(userIterator.next().value()->copyUserInfo(true, true));
-    server->clientsLock.unlock();
-
-    server->roomsLock.lockForRead();
-    QMapIterator<int, Server_Room *> roomIterator(server->getRooms());
-    while (roomIterator.hasNext()) {
-        Server_Room *room = roomIterator.next().value();
-        room->usersLock.lockForRead();
-        room->gamesLock.lockForRead();
-        room->getInfo(*event.add_room_list(), true, true, false);
-    }
-
-    IslMessage message;
-    message.set_message_type(IslMessage::SESSION_EVENT);
-    SessionEvent *sessionEvent = message.mutable_session_event();
-    sessionEvent->GetReflection()
-        ->MutableMessage(sessionEvent, event.GetDescriptor()->FindExtensionByName("ext"))
-        ->CopyFrom(event);
-
     server->islLock.lockForWrite();
     if (server->islConnectionExists(serverId)) {
         qDebug() << "[ISL] Duplicate connection to #" << serverId << "terminating connection";
+        server->islLock.unlock();
         deleteLater();
-    } else {
-        transmitMessage(message);
-        server->addIslInterface(serverId, this);
+        return;
     }
+    server->addIslInterface(serverId, this);
+    registered = true;
     server->islLock.unlock();
 
-    roomIterator.toFront();
-    while (roomIterator.hasNext()) {
-        roomIterator.next();
-        roomIterator.value()->gamesLock.unlock();
-        roomIterator.value()->usersLock.unlock();
-    }
-    server->roomsLock.unlock();
+    requestStateSync();
 }
 
 void IslInterface::initClient()
@@ -209,53 +188,182 @@ void IslInterface::initClient()
     server->islLock.lockForWrite();
     if (server->islConnectionExists(serverId)) {
         qDebug() << "[ISL] Duplicate connection to #" << serverId << "terminating connection";
+        server->islLock.unlock();
         deleteLater();
         return;
     }
 
     server->addIslInterface(serverId, this);
+    registered = true;
     server->islLock.unlock();
+
+    requestStateSync();
+}
+
+/**
+ * Asks the peer for its state. If we still hold the state of an earlier link, only the changes since are requested.
+ * The peer holds back its changes until it answered, see finishStateSync().
+ */
+void IslInterface::requestStateSync()
+{
+    linkTimer.start();
+
+    quint64 epoch, sequence;
+    server->getIslPeerState(serverId, epoch, sequence);
+
+    IslMessage message;
+    message.set_message_type(IslMessage::STATE_SYNC_REQUEST);
+    if (epoch != 0) {
+        message.set_state_epoch(epoch);
+        message.set_state_sequence(sequence);
+    }
+    transmitMessage(message);
+
+    // peers that don't know about state sync requests only send theirs
+    stateSyncTimer->start(stateSyncRequestTimeout);
+}
+
+void IslInterface::sendStateSync(quint64 epoch, quint64 sequence)
+{
+    stateSyncTimer->stop();
+
+    QList<IslMessage> changes;
+    quint64 lastSequence;
+    if (epoch == 0 || !server->getIslStateChangesSince(epoch, sequence, changes, lastSequence)) {
+        sendFullStateSync();
+        return;
+    }
+
+    Event_ServerCompleteList event;
+    event.set_server_id(server->getServerID());
+    event.set_state_epoch(server->getIslStateEpoch());
+    event.set_state_sequence(lastSequence);
+    event.set_incremental(true);
+
+    IslMessage message;
+    message.set_message_type(IslMessage::SESSION_EVENT);
+    SessionEvent *sessionEvent = message.mutable_session_event();
+    sessionEvent->GetReflection()
+        ->MutableMessage(sessionEvent, event.GetDescriptor()->FindExtensionByName("ext"))
+        ->CopyFrom(event);
+
+    logger->logMessage(
+        QString("[ISL] sending #%1 the %2 changes since %3").arg(serverId).arg(changes.size()).arg(sequence), this);
+    finishStateSync(message, changes, lastSequence);
+}
+
+void IslInterface::sendFullStateSync()
+{
+    stateSyncTimer->stop();
+
+    // Changes after this sequence may already be part of the lists. The peer applies them twice, which changes nothing:
+    // repeated joins are dropped, see Server_Room::addExternalUser().
+    const quint64 lastSequence = server->getIslStateSequence();
+
+    Event_ServerCompleteList event;
+    event.set_server_id(server->getServerID());
+    event.set_state_epoch(server->getIslStateEpoch());
+    event.set_state_sequence(lastSequence);
+
+    server->clientsLock.lockForRead();
+    QMapIterator<QString, Server_ProtocolHandler *> userIterator(server->getUsers());
+    while (userIterator.hasNext())
+        event.add_user_list()->CopyFrom(userIterator.next().value()->copyUserInfo(true, true));
+    server->clientsLock.unlock();
+
+    server->roomsLock.lockForRead();
+    QMapIterator<int, Server_Room *> roomIterator(server->getRooms());
+    while (roomIterator.hasNext()) {
+        Server_Room *room = roomIterator.next().value();
+        room->usersLock.lockForRead();
+        room->gamesLock.lockForRead();
+        room->getInfo(*event.add_room_list(), true, true, false);
+        room->gamesLock.unlock();
+        room->usersLock.unlock();
+    }
+    server->roomsLock.unlock();
+
+    IslMessage message;
+    message.set_message_type(IslMessage::SESSION_EVENT);
+    SessionEvent *sessionEvent = message.mutable_session_event();
+    sessionEvent->GetReflection()
+        ->MutableMessage(sessionEvent, event.GetDescriptor()->FindExtensionByName("ext"))
+        ->CopyFrom(event);
+
+    logger->logMessage(QString("[ISL] sending #%1 our full state").arg(serverId), this);
+    finishStateSync(message, QList<IslMessage>(), lastSequence);
+}
+
+void IslInterface::finishStateSync(const IslMessage &syncMessage, const QList<IslMessage> &changes, quint64 sequence)
+{
+    QMutexLocker locker(&outputBufferMutex);
+    if (!outputQueue.finishStateSync(syncMessage, changes, sequence))
+        return;
+    locker.unlock();
+
+    emit outputBufferChanged();
 }
 
 void IslInterface::flushOutputBuffer()
 {
+    // everything queued until the batch timer fires goes out with one write
+    if (batchInterval <= 0)
+        writeOutputBatch();
+    else if (!batchTimer->isActive())
+        batchTimer->start(batchInterval);
+}
+
+void IslInterface::writeOutputBatch()
+{
+    batchTimer->stop();
+
     QMutexLocker locker(&outputBufferMutex);
-    if (outputBuffer.isEmpty())
+    const QList<IslMessage> batch = outputQueue.takeBatch();
+    locker.unlock();
+
+    QByteArray buf;
+    for (const IslMessage &item : batch) {
+#if GOOGLE_PROTOBUF_VERSION > 3001000
+        unsigned int size = static_cast<unsigned int>(item.ByteSizeLong());
+#else
+        unsigned int size = static_cast<unsigned int>(item.ByteSize());
+#endif
+        const int offset = buf.size();
+        buf.resize(offset + size + 4);
+        item.SerializeToArray(buf.data() + offset + 4, size);
+        buf.data()[offset + 3] = (unsigned char)size;
+        buf.data()[offset + 2] = (unsigned char)(size >> 8);
+        buf.data()[offset + 1] = (unsigned char)(size >> 16);
+        buf.data()[offset] = (unsigned char)(size >> 24);
+        ++txMessages;
+    }
+    if (buf.isEmpty())
         return;
-    server->incTxBytes(outputBuffer.size());
-    socket->write(outputBuffer);
+
+    ++txBatches;
+    txBytes += buf.size();
+    server->incTxBytes(buf.size());
+    socket->write(buf);
     socket->flush();
-    outputBuffer.clear();
 }
 
 void IslInterface::readClient()
 {
     QByteArray data = socket->readAll();
     server->incRxBytes(data.size());
+    rxBytes += data.size();
     inputBuffer.append(data);
 
-    do {
-        if (!messageInProgress) {
-            if (inputBuffer.size() >= 4) {
-                messageLength = (((quint32)(unsigned char)inputBuffer[0]) << 24) +
-                                (((quint32)(unsigned char)inputBuffer[1]) << 16) +
-                                (((quint32)(unsigned char)inputBuffer[2]) << 8) +
-                                ((quint32)(unsigned char)inputBuffer[3]);
-                inputBuffer.remove(0, 4);
-                messageInProgress = true;
-            } else
-                return;
-        }
-        if (inputBuffer.size() < messageLength)
-            return;
-
+    const char *frame;
+    int frameLength;
+    while (inputBuffer.nextFrame(frame, frameLength)) {
         IslMessage newMessage;
-        newMessage.ParseFromArray(inputBuffer.data(), messageLength);
-        inputBuffer.remove(0, messageLength);
-        messageInProgress = false;
+        newMessage.ParseFromArray(frame, frameLength);
+        ++rxMessages;
 
         processMessage(newMessage);
-    } while (!inputBuffer.isEmpty());
+    }
+    inputBuffer.compact();
 }
 
 void IslInterface::catchSocketError(QAbstractSocket::SocketError socketError)
@@ -271,45 +379,56 @@ void IslInterface::catchSocketError(QAbstractSocket::SocketError socketError)
 
 void IslInterface::transmitMessage(const IslMessage &item)
 {
-    QByteArray buf;
-#if GOOGLE_PROTOBUF_VERSION > 3001000
-    unsigned int size = static_cast<unsigned int>(item.ByteSizeLong());
-#else
-    unsigned int size = static_cast<unsigned int>(item.ByteSize());
-#endif
-    buf.resize(size + 4);
-    item.SerializeToArray(buf.data() + 4, size);
-    buf.data()[3] = (unsigned char)size;
-    buf.data()[2] = (unsigned char)(size >> 8);
-    buf.data()[1] = (unsigned char)(size >> 16);
-    buf.data()[0] = (unsigned char)(size >> 24);
-
-    outputBufferMutex.lock();
-    outputBuffer.append(buf);
-    outputBufferMutex.unlock();
+    QMutexLocker locker(&outputBufferMutex);
+    const bool wasEmpty = outputQueue.isEmpty();
+    if (!outputQueue.enqueue(item) || !wasEmpty)
+        return;
+    locker.unlock();
+
     emit outputBufferChanged();
 }
 
 void IslInterface::sessionEvent_ServerCompleteList(const Event_ServerCompleteList &event)
 {
-    for (int i = 0; i < event.user_list_size(); ++i) {
-        ServerInfo_User temp(event.user_list(i));
-        temp.set_server_id(serverId);
-        emit externalUserJoined(temp);
-    }
-    for (int i = 0; i < event.room_list_size(); ++i) {
-        const ServerInfo_Room &room = event.room_list(i);
-        for (int j = 0; j < room.user_list_size(); ++j) {
-            ServerInfo_User userInfo(room.user_list(j));
-            userInfo.set_server_id(serverId);
-            emit externalRoomUserJoined(room.room_id(), userInfo);
-        }
-        for (int j = 0; j < room.game_list_size(); ++j) {
-            ServerInfo_Game gameInfo(room.game_list(j));
-            gameInfo.set_server_id(serverId);
-            emit externalRoomGameListChanged(room.room_id(), gameInfo);
-        }
+    stateSyncTarget = event.state_sequence();
+    stateSyncIncremental = event.incremental();
+    stateSyncChanges = 0;
+    if (event.incremental()) {
+        // the users we kept are still valid, the changes since follow
+        quint64 epoch, sequence;
+        server->getIslPeerState(serverId, epoch, sequence);
+        server->setIslPeerState(serverId, event.state_epoch(), sequence);
+        stateChangeProcessed(0);
+        return;
     }
+
+    // applied in one go, so the users that stayed don't leave and join again
+    emit externalServerStateReplaced(serverId, event);
+    server->setIslPeerState(serverId, event.state_epoch(), event.state_sequence());
+    stateChangeProcessed(event.state_sequence());
+}
+
+/**
+ * Logs how long the state sync took once the peer's changes up to the state it sent are in.
+ */
+void IslInterface::stateChangeProcessed(quint64 sequence)
+{
+    if (stateSyncTarget == 0 && !linkTimer.isValid())
+        return;
+    if (sequence != 0)
+        ++stateSyncChanges;
+    if (sequence < stateSyncTarget)
+        return;
+
+    logger->logMessage(QString("[ISL] %1 state sync from #%2 done after %3 ms, %4 changes, %5 bytes received")
+                           .arg(stateSyncIncremental ? "incremental" : "full")
+                           .arg(serverId)
+                           .arg(linkTimer.elapsed())
+                           .arg(stateSyncChanges)
+                           .arg(rxBytes),
+                       this);
+    stateSyncTarget = 0;
+    linkTimer.invalidate();
 }
 
 void IslInterface::sessionEvent_UserJoined(const Event_UserJoined &event)
@@ -441,6 +560,10 @@ void IslInterface::processMessage(const IslMessage &item)
     qDebug() << getSafeDebugString(item);
 
     switch (item.message_type()) {
+        case IslMessage::STATE_SYNC_REQUEST: {
+            sendStateSync(item.state_epoch(), item.state_sequence());
+            break;
+        }
         case IslMessage::ROOM_COMMAND_CONTAINER: {
             processRoomCommand(item.room_command(), item.session_id());
             break;
@@ -467,4 +590,11 @@ void IslInterface::processMessage(const IslMessage &item)
         }
         default:;
     }
+
+    if (item.has_state_sequence() && item.message_type() != IslMessage::STATE_SYNC_REQUEST) {
+        quint64 epoch, sequence;
+        server->getIslPeerState(serverId, epoch, sequence);
+        server->setIslPeerState(serverId, epoch, item.state_sequence());
+        stateChangeProcessed(item.state_sequence());
+    }
 }
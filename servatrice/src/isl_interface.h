@@ -1,20 +1,24 @@
 #ifndef ISL_INTERFACE_H
 #define ISL_INTERFACE_H
 
+#include "framed_input_buffer.h"
+#include "isl_output_queue.h"
+#include "pb/event_server_complete_list.pb.h"
+#include "pb/isl_message.pb.h"
 #include "pb/serverinfo_game.pb.h"
 #include "pb/serverinfo_room.pb.h"
 #include "pb/serverinfo_user.pb.h"
 #include "servatrice.h"
 
+#include <QElapsedTimer>
 #include <QSslCertificate>
 #include <QWaitCondition>
 
 class Servatrice;
 class QSslSocket;
 class QSslKey;
-class IslMessage;
+class QTimer;
 
-class Event_ServerCompleteList;
 class Event_UserMessage;
 class Event_UserJoined;
 class Event_UserLeft;
@@ -32,9 +36,13 @@ private slots:
     void readClient();
     void catchSocketError(QAbstractSocket::SocketError socketError);
     void flushOutputBuffer();
+    void writeOutputBatch();
+    void sendFullStateSync();
 signals:
     void outputBufferChanged();
 
+    void externalServerStateReplaced(int serverId, Event_ServerCompleteList state);
+
     void externalUserJoined(ServerInfo_User userInfo);
     void externalUserLeft(QString userName);
     void externalRoomUserJoined(int roomId, ServerInfo_User userInfo);
@@ -57,10 +65,30 @@ private:
     QMutex outputBufferMutex;
     Servatrice *server;
     QSslSocket *socket;
-
-    QByteArray inputBuffer, outputBuffer;
-    bool messageInProgress;
-    int messageLength;
+    // set once the interface was added to the server, only then it owns the peer's state
+    bool registered;
+
+    FramedInputBuffer inputBuffer;
+
+    // messages waiting for the next batch, guarded by outputBufferMutex
+    IslOutputQueue outputQueue;
+    QTimer *batchTimer;
+    int batchInterval;
+    QTimer *stateSyncTimer;
+
+    // receiving side of the state sync
+    QElapsedTimer linkTimer;
+    quint64 stateSyncTarget;
+    bool stateSyncIncremental;
+    int stateSyncChanges;
+
+    quint64 txMessages, txBatches, txBytes;
+    quint64 rxMessages, rxBytes;
+
+    void requestStateSync();
+    void sendStateSync(quint64 epoch, quint64 sequence);
+    void finishStateSync(const IslMessage &syncMessage, const QList<IslMessage> &changes, quint64 sequence);
+    void stateChangeProcessed(quint64 sequence);
 
     void sessionEvent_ServerCompleteList(const Event_ServerCompleteList &event);
     void sessionEvent_UserJoined(const Event_UserJoined &event);
@@ -0,0 +1,98 @@
+#include "isl_output_queue.h"
+
+#include "get_pb_extension.h"
+#include "pb/event_list_games.pb.h"
+#include "pb/room_event.pb.h"
+
+IslOutputQueue::IslOutputQueue() : stateSyncSent(false), syncedSequence(0), mergedGameUpdates(0)
+{
+}
+
+bool IslOutputQueue::enqueue(const IslMessage &item)
+{
+    if (item.has_state_sequence() && item.message_type() != IslMessage::STATE_SYNC_REQUEST) {
+        // changes the peer gets with the state sync, or that build on a state it doesn't have yet
+        if (!stateSyncSent) {
+            heldStateChanges.append(item);
+            return false;
+        }
+        if (item.state_sequence() <= syncedSequence)
+            return false;
+    }
+    append(item);
+    return true;
+}
+
+bool IslOutputQueue::finishStateSync(const IslMessage &syncMessage, const QList<IslMessage> &changes, quint64 sequence)
+{
+    if (stateSyncSent)
+        return false;
+
+    append(syncMessage);
+    for (const IslMessage &change : changes)
+        append(change);
+    syncedSequence = sequence;
+    for (const IslMessage &change : heldStateChanges)
+        if (change.state_sequence() > syncedSequence)
+            append(change);
+    heldStateChanges.clear();
+    stateSyncSent = true;
+    return true;
+}
+
+QList<IslMessage> IslOutputQueue::takeBatch()
+{
+    QList<IslMessage> batch;
+    for (const IslMessage &item : pendingMessages)
+        // merged away, see append()
+        if (item.has_message_type())
+            batch.append(item);
+    pendingMessages.clear();
+    pendingGames.clear();
+    return batch;
+}
+
+/**
+ * A game list update for a game that already has one waiting takes it over: the waiting update is merged into the new
+ * one and removed from its message, which is dropped once it's empty. Merging into the later message keeps the state
+ * sequences safe, a peer that got a later sequence also got the merged update.
+ */
+void IslOutputQueue::append(const IslMessage &item)
+{
+    const int index = pendingMessages.size();
+    pendingMessages.append(item);
+    if (item.message_type() != IslMessage::ROOM_EVENT ||
+        getPbExtension(item.room_event()) != RoomEvent::LIST_GAMES)
+        return;
+
+    IslMessage &message = pendingMessages.last();
+    const int roomId = message.room_event().room_id();
+    Event_ListGames *event = message.mutable_room_event()->MutableExtension(Event_ListGames::ext);
+    for (int i = 0; i < event->game_list_size(); ++i) {
+        ServerInfo_Game *gameInfo = event->mutable_game_list(i);
+        const QPair<int, int> key(roomId, gameInfo->game_id());
+
+        auto pending = pendingGames.find(key);
+        if (pending != pendingGames.end()) {
+            Event_ListGames *pendingEvent =
+                pendingMessages[*pending].mutable_room_event()->MutableExtension(Event_ListGames::ext);
+            for (int j = 0; j < pendingEvent->game_list_size(); ++j) {
+                if (pendingEvent->game_list(j).game_id() != gameInfo->game_id())
+                    continue;
+                if (!gameInfo->closed()) {
+                    ServerInfo_Game merged(pendingEvent->game_list(j));
+                    if (gameInfo->game_types_size() > 0)
+                        merged.clear_game_types();
+                    merged.MergeFrom(*gameInfo);
+                    gameInfo->Swap(&merged);
+                }
+                pendingEvent->mutable_game_list()->DeleteSubrange(j, 1);
+                break;
+            }
+            if (pendingEvent->game_list_size() == 0)
+                pendingMessages[*pending].Clear();
+            ++mergedGameUpdates;
+        }
+        pendingGames.insert(key, index);
+    }
+}
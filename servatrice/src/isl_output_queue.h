@@ -0,0 +1,50 @@
+#ifndef ISL_OUTPUT_QUEUE_H
+#define ISL_OUTPUT_QUEUE_H
+
+#include "pb/isl_message.pb.h"
+
+#include <QHash>
+#include <QList>
+#include <QPair>
+
+/**
+ * The messages waiting to be sent to another server with the next batch.
+ *
+ * Game list updates of the same game are merged while they wait. Changes of our state, the messages carrying a
+ * state sequence, are held back until the peer got the state they build on, see finishStateSync(). Not thread safe,
+ * IslInterface guards it with its output buffer mutex.
+ */
+class IslOutputQueue
+{
+public:
+    IslOutputQueue();
+
+    // Returns whether the message was queued; state changes are held back or dropped around the state sync
+    bool enqueue(const IslMessage &item);
+    // Queues the state sync followed by the changes it needs and the held back changes newer than sequence.
+    // Returns false if a state sync was queued already.
+    bool finishStateSync(const IslMessage &syncMessage, const QList<IslMessage> &changes, quint64 sequence);
+    bool isEmpty() const
+    {
+        return pendingMessages.isEmpty();
+    }
+    // The queued messages in the order they are to be sent
+    QList<IslMessage> takeBatch();
+    quint64 getMergedGameUpdates() const
+    {
+        return mergedGameUpdates;
+    }
+
+private:
+    // pendingGames maps room and game id to the message holding the waiting update
+    QList<IslMessage> pendingMessages;
+    QHash<QPair<int, int>, int> pendingGames;
+    bool stateSyncSent;
+    quint64 syncedSequence;
+    QList<IslMessage> heldStateChanges;
+    quint64 mergedGameUpdates;
+
+    void append(const IslMessage &item);
+};
+
+#endif
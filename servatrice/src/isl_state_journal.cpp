@@ -0,0 +1,54 @@
+#include "isl_state_journal.h"
+
+#include "get_pb_extension.h"
+#include "pb/room_event.pb.h"
+#include "pb/session_event.pb.h"
+
+IslStateJournal::IslStateJournal(quint64 _epoch) : epoch(_epoch), sequence(0)
+{
+}
+
+bool IslStateJournal::isStateChange(const IslMessage &msg)
+{
+    switch (msg.message_type()) {
+        case IslMessage::SESSION_EVENT: {
+            const int type = getPbExtension(msg.session_event());
+            return type == SessionEvent::USER_JOINED || type == SessionEvent::USER_LEFT;
+        }
+        case IslMessage::ROOM_EVENT: {
+            const int type = getPbExtension(msg.room_event());
+            return type == RoomEvent::JOIN_ROOM || type == RoomEvent::LEAVE_ROOM || type == RoomEvent::LIST_GAMES;
+        }
+        default:
+            return false;
+    }
+}
+
+IslMessage IslStateJournal::record(const IslMessage &change, int maxSize)
+{
+    IslMessage stampedChange(change);
+    stampedChange.set_state_sequence(++sequence);
+    changes.append(stampedChange);
+    while (changes.size() > maxSize)
+        changes.removeFirst();
+    return stampedChange;
+}
+
+bool IslStateJournal::changesSince(quint64 _epoch,
+                                   quint64 _sequence,
+                                   QList<IslMessage> &result,
+                                   quint64 &lastSequence) const
+{
+    if (_epoch != epoch || _sequence > sequence)
+        return false;
+
+    lastSequence = sequence;
+    if (_sequence == sequence)
+        return true;
+    const quint64 firstJournaled = sequence - static_cast<quint64>(changes.size()) + 1;
+    if (changes.isEmpty() || _sequence + 1 < firstJournaled)
+        return false;
+
+    result = changes.mid(static_cast<int>(_sequence + 1 - firstJournaled));
+    return true;
+}
@@ -0,0 +1,42 @@
+#ifndef ISL_STATE_JOURNAL_H
+#define ISL_STATE_JOURNAL_H
+
+#include "pb/isl_message.pb.h"
+
+#include <QList>
+
+/**
+ * The changes of our users, room users and games sent to the other servers, numbered in sequence and kept so a peer
+ * that lost its link can catch up with only the changes it missed.
+ *
+ * The epoch tells the journals of different server runs apart. Not thread safe, Servatrice guards it.
+ */
+class IslStateJournal
+{
+public:
+    explicit IslStateJournal(quint64 _epoch);
+
+    // Whether every peer has to see the message to know our users, room users and games
+    static bool isStateChange(const IslMessage &msg);
+
+    quint64 getEpoch() const
+    {
+        return epoch;
+    }
+    quint64 getSequence() const
+    {
+        return sequence;
+    }
+    // Stamps the change with the next sequence and keeps it, dropping the oldest changes beyond maxSize
+    IslMessage record(const IslMessage &change, int maxSize);
+    // Copies the changes after sequence, or returns false if the epoch differs or they were dropped already
+    bool changesSince(quint64 _epoch, quint64 _sequence, QList<IslMessage> &result, quint64 &lastSequence) const;
+
+private:
+    const quint64 epoch;
+    quint64 sequence;
+    // the changes up to sequence, without gaps
+    QList<IslMessage> changes;
+};
+
+#endif
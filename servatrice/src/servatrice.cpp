@@ -27,8 +27,13 @@
 #include "pb/event_connection_closed.pb.h"
 #include "pb/event_server_message.pb.h"
 #include "pb/event_server_shutdown.pb.h"
+#include "servatrice_authentication_pool.h"
 #include "servatrice_connection_pool.h"
 #include "servatrice_database_interface.h"
+#include "servatrice_database_writer.h"
+#include "servatrice_metrics_server.h"
+#include "servatrice_user_id_cache.h"
+#include "servatrice_user_list_cache.h"
 #include "server_logger.h"
 #include "server_room.h"
 #include "serversocketinterface.h"
@@ -39,6 +44,7 @@
 #include <QDebug>
 #include <QFile>
 #include <QProcessEnvironment>
+#include <QRandomGenerator>
 #include <QSqlQuery>
 #include <QString>
 #include <QStringList>
@@ -199,10 +205,14 @@ void Servatrice_IslServer::incomingConnection(qintptr socketDescriptor)
 }
 
 Servatrice::Servatrice(QObject *parent)
-    : Server(parent), authenticationMethod(AuthenticationNone), uptime(0), txBytes(0), rxBytes(0),
-      shutdownTimer(nullptr)
+    : Server(parent), authenticationMethod(AuthenticationNone), gameServer(nullptr), websocketGameServer(nullptr),
+      metricsServer(nullptr), databaseWriter(nullptr), userIdCache(nullptr), userListCache(nullptr),
+      authenticationPool(nullptr), uptime(0), txBytes(0), rxBytes(0), reportedDroppedLogMessages(0),
+      reportedBlockedDatabaseWrites(0), shutdownTimer(nullptr), islReconnectTimer(nullptr),
+      islJournal(qMax<quint64>(QRandomGenerator::system()->generate64(), 1))
 {
     qRegisterMetaType<QSqlDatabase>("QSqlDatabase");
+    qRegisterMetaType<Event_ServerCompleteList>("Event_ServerCompleteList");
 }
 
 Servatrice::~Servatrice()
@@ -220,6 +230,21 @@ Servatrice::~Servatrice()
 
     servatriceDatabaseInterface->deleteLater();
     prepareDestroy();
+
+    // after the games have been destroyed, as they store their results on the way out
+    if (databaseWriter) {
+        logger->logMessage("Draining database write queue...");
+        databaseWriter->drain();
+        QThread *writerThread = databaseWriter->thread();
+        databaseWriter->deleteLater(); // writer destructor calls thread()->quit()
+        databaseWriter = nullptr;
+        writerThread->wait();
+        writerThread->deleteLater();
+    }
+
+    delete authenticationPool;
+    delete userIdCache;
+    delete userListCache;
 }
 
 bool Servatrice::initServer()
@@ -308,6 +333,35 @@ bool Servatrice::initServer()
         updateServerList();
         qDebug() << "Clearing previous sessions...";
         servatriceDatabaseInterface->clearSessionTables();
+
+        if (getUserIdCacheSize() > 0) {
+            qDebug() << "User id cache size:" << getUserIdCacheSize() << "ttl (in seconds):" << getUserIdCacheTtl();
+            userIdCache = new Servatrice_UserIdCache(getUserIdCacheSize(), getUserIdCacheTtl() * 1000LL);
+        }
+        userListCache = new Servatrice_UserListCache;
+
+        if (authenticationMethod == AuthenticationSql && getPasswordHashThreads() > 0) {
+            qDebug() << "Password hash threads:" << getPasswordHashThreads()
+                     << "queue size:" << getPasswordHashQueueSize()
+                     << "per address:" << getMaxPasswordHashesPerAddress();
+            authenticationPool = new Servatrice_AuthenticationPool(
+                getPasswordHashThreads(), getPasswordHashQueueSize(), getMaxPasswordHashesPerAddress());
+        }
+
+        if (getDatabaseWriteQueueSize() > 0) {
+            qDebug() << "Database write queue size:" << getDatabaseWriteQueueSize()
+                     << "batch size:" << getDatabaseWriteBatchSize();
+            databaseWriter = new Servatrice_DatabaseWriter(this, getDatabaseWriteQueueSize(),
+                                                           getDatabaseWriteBatchSize());
+            auto writerThread = new QThread;
+            writerThread->setObjectName("database_writer");
+            databaseWriter->moveToThread(writerThread);
+            databaseWriter->getDatabaseInterface()->moveToThread(writerThread);
+            writerThread->start();
+            QMetaObject::invokeMethod(databaseWriter->getDatabaseInterface(), "initDatabase",
+                                      Qt::BlockingQueuedConnection,
+                                      Q_ARG(QSqlDatabase, servatriceDatabaseInterface->getDatabase()));
+        }
     }
 
     if (getRoomsMethodString() == "sql") {
@@ -383,6 +437,8 @@ bool Servatrice::initServer()
             if (key.isNull())
                 throw QString("Invalid private key.");
 
+            islCert = cert;
+            islKey = key;
             QMutableListIterator<ServerProperties> serverIterator(serverList);
             while (serverIterator.hasNext()) {
                 const ServerProperties &prop = serverIterator.next();
@@ -391,17 +447,13 @@ bool Servatrice::initServer()
                     continue;
                 }
 
-                auto *thread = new QThread;
-                thread->setObjectName("isl_" + QString::number(prop.id));
-                connect(thread, SIGNAL(finished()), thread, SLOT(deleteLater()));
-
-                IslInterface *interface = new IslInterface(prop.id, prop.hostname, prop.address.toString(),
-                                                           prop.controlPort, prop.cert, cert, key, this);
-                interface->moveToThread(thread);
-                connect(interface, SIGNAL(destroyed()), thread, SLOT(quit()));
+                connectToIslPeer(prop, Qt::BlockingQueuedConnection);
+            }
 
-                thread->start();
-                QMetaObject::invokeMethod(interface, "initClient", Qt::BlockingQueuedConnection);
+            if (getISLReconnectInterval() > 0) {
+                islReconnectTimer = new QTimer(this);
+                connect(islReconnectTimer, SIGNAL(timeout()), this, SLOT(reconnectIslPeers()));
+                islReconnectTimer->start(getISLReconnectInterval() * 1000);
             }
 
             qDebug() << "Starting ISL server on port" << getISLNetworkPort();
@@ -458,6 +510,16 @@ bool Servatrice::initServer()
         }
     }
 
+    // METRICS SERVER
+    if (getMetricsPort() > 0) {
+        metricsServer = new Servatrice_MetricsServer(this, this);
+        qDebug() << "Starting metrics server on localhost port" << getMetricsPort();
+        if (metricsServer->listen(QHostAddress::LocalHost, static_cast<quint16>(getMetricsPort())))
+            qDebug() << "Metrics server listening.";
+        else
+            qDebug() << "metricsServer->listen(): Error:" << metricsServer->errorString();
+    }
+
     if (getIdleClientTimeout() > 0) {
         qDebug() << "Idle client timeout value:" << getIdleClientTimeout();
         if (getIdleClientTimeout() < 300)
@@ -601,6 +663,22 @@ void Servatrice::statusUpdate()
     rxBytes = 0;
     rxBytesMutex.unlock();
 
+    if (databaseWriter) {
+        const quint64 blockedDatabaseWrites = databaseWriter->getStatistics().blockedEnqueues;
+        if (blockedDatabaseWrites > reportedBlockedDatabaseWrites) {
+            qWarning() << blockedDatabaseWrites - reportedBlockedDatabaseWrites
+                       << "database writes waited on a full write queue since the last status update";
+            reportedBlockedDatabaseWrites = blockedDatabaseWrites;
+        }
+    }
+
+    const quint64 droppedLogMessages = logger->getDroppedMessages();
+    if (droppedLogMessages > reportedDroppedLogMessages) {
+        qWarning() << droppedLogMessages - reportedDroppedLogMessages
+                   << "log messages dropped on a full log queue since the last status update";
+        reportedDroppedLogMessages = droppedLogMessages;
+    }
+
     QSqlQuery *query = servatriceDatabaseInterface->prepareQuery(
         "insert into {prefix}_uptime (id_server, timest, uptime, users_count, mods_count, mods_list, games_count, "
         "tx_bytes, rx_bytes) values(:id, NOW(), :uptime, :users_count, :mods_count, :mods_list, :games_count, :tx, "
@@ -733,6 +811,15 @@ void Servatrice::addIslInterface(int _serverId, IslInterface *interface)
 {
     // Only call with islLock locked for writing
     islInterfaces.insert(_serverId, interface);
+
+    islPeersMutex.lock();
+    IslPeerState &peer = islPeers[_serverId];
+    peer.connected = true;
+    ++peer.linkGeneration;
+    islPeersMutex.unlock();
+
+    connect(interface, SIGNAL(externalServerStateReplaced(int, Event_ServerCompleteList)), this,
+            SLOT(replaceIslPeerState(int, Event_ServerCompleteList)));
     connect(interface, SIGNAL(externalUserJoined(ServerInfo_User)), this, SLOT(externalUserJoined(ServerInfo_User)));
     connect(interface, SIGNAL(externalUserLeft(QString)), this, SLOT(externalUserLeft(QString)));
     connect(interface, SIGNAL(externalRoomUserJoined(int, ServerInfo_User)), this,
@@ -754,6 +841,154 @@ void Servatrice::addIslInterface(int _serverId, IslInterface *interface)
             SLOT(externalGameEventContainerReceived(GameEventContainer, qint64)));
 }
 
+quint64 Servatrice::getIslStateSequence()
+{
+    QMutexLocker locker(&islJournalMutex);
+    return islJournal.getSequence();
+}
+
+bool Servatrice::getIslStateChangesSince(quint64 epoch,
+                                         quint64 sequence,
+                                         QList<IslMessage> &changes,
+                                         quint64 &lastSequence)
+{
+    QMutexLocker locker(&islJournalMutex);
+    return islJournal.changesSince(epoch, sequence, changes, lastSequence);
+}
+
+void Servatrice::getIslPeerState(int _serverId, quint64 &epoch, quint64 &sequence)
+{
+    QMutexLocker locker(&islPeersMutex);
+    const IslPeerState peer = islPeers.value(_serverId);
+    epoch = peer.epoch;
+    sequence = peer.sequence;
+}
+
+void Servatrice::setIslPeerState(int _serverId, quint64 epoch, quint64 sequence)
+{
+    QMutexLocker locker(&islPeersMutex);
+    IslPeerState &peer = islPeers[_serverId];
+    if (peer.epoch != epoch) {
+        peer.epoch = epoch;
+        peer.sequence = sequence;
+    } else {
+        peer.sequence = qMax(peer.sequence, sequence);
+    }
+}
+
+/**
+ * Called when the link to a peer that owned its state went down. Its users stay listed for the resync grace period,
+ * so a link that comes back in time only needs the changes it missed.
+ */
+void Servatrice::islPeerDisconnected(int _serverId)
+{
+    const int gracePeriod = getISLResyncGracePeriod();
+    islPeersMutex.lock();
+    IslPeerState &peer = islPeers[_serverId];
+    peer.connected = false;
+    const int linkGeneration = ++peer.linkGeneration;
+    if (gracePeriod <= 0)
+        peer.epoch = peer.sequence = 0;
+    islPeersMutex.unlock();
+
+    if (gracePeriod <= 0) {
+        purgeIslPeerState(_serverId);
+        return;
+    }
+
+    QTimer::singleShot(gracePeriod * 1000, this, [this, _serverId, linkGeneration] {
+        islPeersMutex.lock();
+        IslPeerState &peer = islPeers[_serverId];
+        const bool expired = !peer.connected && peer.linkGeneration == linkGeneration;
+        if (expired)
+            peer.epoch = peer.sequence = 0;
+        islPeersMutex.unlock();
+        if (expired) {
+            logger->logMessage(QString("[ISL] no link to #%1 within the resync grace period, dropping its users")
+                                   .arg(_serverId));
+            purgeIslPeerState(_serverId);
+        }
+    });
+}
+
+/**
+ * Removes the users of a peer once it is gone for good.
+ */
+void Servatrice::purgeIslPeerState(int _serverId)
+{
+    removeIslPeerUsers(_serverId, QSet<QString>(), QSet<QPair<int, QString>>());
+}
+
+/**
+ * Applies the full state of a peer. Its users and room users that are no longer listed leave, the listed ones that
+ * we still know from an earlier link don't join again, see Server::externalUserJoined() and
+ * Server_Room::addExternalUser(). Clients only see what changed, however long the peer was away.
+ */
+void Servatrice::replaceIslPeerState(int _serverId, const Event_ServerCompleteList &state)
+{
+    QSet<QString> users;
+    for (const ServerInfo_User &userInfo : state.user_list())
+        users.insert(QString::fromStdString(userInfo.name()));
+    QSet<QPair<int, QString>> roomUsers;
+    for (const ServerInfo_Room &room : state.room_list())
+        for (const ServerInfo_User &userInfo : room.user_list())
+            roomUsers.insert(qMakePair(room.room_id(), QString::fromStdString(userInfo.name())));
+    removeIslPeerUsers(_serverId, users, roomUsers);
+
+    for (const ServerInfo_User &userInfo : state.user_list()) {
+        ServerInfo_User temp(userInfo);
+        temp.set_server_id(_serverId);
+        externalUserJoined(temp);
+    }
+    for (const ServerInfo_Room &room : state.room_list()) {
+        for (const ServerInfo_User &userInfo : room.user_list()) {
+            ServerInfo_User temp(userInfo);
+            temp.set_server_id(_serverId);
+            externalRoomUserJoined(room.room_id(), temp);
+        }
+        for (const ServerInfo_Game &gameInfo : room.game_list()) {
+            ServerInfo_Game temp(gameInfo);
+            temp.set_server_id(_serverId);
+            externalRoomGameListChanged(room.room_id(), temp);
+        }
+    }
+}
+
+void Servatrice::removeIslPeerUsers(int _serverId,
+                                    const QSet<QString> &keptUsers,
+                                    const QSet<QPair<int, QString>> &keptRoomUsers)
+{
+    QList<QPair<int, QString>> roomUsers;
+    roomsLock.lockForRead();
+    for (Server_Room *room : getRooms()) {
+        room->usersLock.lockForRead();
+        QMapIterator<QString, ServerInfo_User_Container> userIterator(room->getExternalUsers());
+        while (userIterator.hasNext()) {
+            userIterator.next();
+            const QPair<int, QString> roomUser(room->getId(), userIterator.key());
+            if (userIterator.value().getUserInfo()->server_id() == _serverId && !keptRoomUsers.contains(roomUser))
+                roomUsers.append(roomUser);
+        }
+        room->usersLock.unlock();
+    }
+    roomsLock.unlock();
+
+    QStringList users;
+    clientsLock.lockForRead();
+    QMapIterator<QString, Server_AbstractUserInterface *> userIterator(getExternalUsers());
+    while (userIterator.hasNext()) {
+        userIterator.next();
+        if (userIterator.value()->getUserInfo()->server_id() == _serverId && !keptUsers.contains(userIterator.key()))
+            users.append(userIterator.key());
+    }
+    clientsLock.unlock();
+
+    for (const auto &roomUser : roomUsers)
+        externalRoomUserLeft(roomUser.first, roomUser.second);
+    for (const QString &userName : users)
+        externalUserLeft(userName);
+}
+
 void Servatrice::removeIslInterface(int _serverId)
 {
     // Only call with islLock locked for writing
@@ -762,11 +997,52 @@ void Servatrice::removeIslInterface(int _serverId)
     islInterfaces.remove(_serverId);
 }
 
+void Servatrice::connectToIslPeer(const ServerProperties &prop, Qt::ConnectionType initType)
+{
+    auto *thread = new QThread;
+    thread->setObjectName("isl_" + QString::number(prop.id));
+    connect(thread, SIGNAL(finished()), thread, SLOT(deleteLater()));
+
+    IslInterface *interface = new IslInterface(prop.id, prop.hostname, prop.address.toString(), prop.controlPort,
+                                               prop.cert, islCert, islKey, this);
+    interface->moveToThread(thread);
+    connect(interface, SIGNAL(destroyed()), thread, SLOT(quit()));
+
+    thread->start();
+    QMetaObject::invokeMethod(interface, "initClient", initType);
+}
+
+void Servatrice::reconnectIslPeers()
+{
+    const QList<ServerProperties> peers = getServerList();
+    for (const ServerProperties &prop : peers) {
+        if (prop.cert == islCert)
+            continue;
+        islLock.lockForRead();
+        const bool connected = islConnectionExists(prop.id);
+        islLock.unlock();
+        if (!connected)
+            connectToIslPeer(prop, Qt::QueuedConnection);
+    }
+}
+
 void Servatrice::doSendIslMessage(const IslMessage &msg, int _serverId)
 {
     QReadLocker locker(&islLock);
 
     if (_serverId == -1) {
+        if (IslStateJournal::isStateChange(msg)) {
+            const int journalSize = getISLJournalSize();
+            // transmitted under the journal lock, so every peer gets the changes in sequence order
+            QMutexLocker journalLocker(&islJournalMutex);
+            const IslMessage stampedMsg = islJournal.record(msg, journalSize);
+
+            QMapIterator<int, IslInterface *> islIterator(islInterfaces);
+            while (islIterator.hasNext())
+                islIterator.next().value()->transmitMessage(stampedMsg);
+            return;
+        }
+
         QMapIterator<int, IslInterface *> islIterator(islInterfaces);
         while (islIterator.hasNext())
             islIterator.next().value()->transmitMessage(msg);
@@ -949,6 +1225,11 @@ int Servatrice::getMaxGamesPerUser() const
     return settingsCache->value("security/max_games_per_user", 5).toInt();
 }
 
+int Servatrice::getGameListUpdateInterval() const
+{
+    return settingsCache->value("game/game_list_update_interval", 250).toInt();
+}
+
 int Servatrice::getCommandCountingInterval() const
 {
     return settingsCache->value("security/command_counting_interval", 10).toInt();
@@ -964,6 +1245,98 @@ int Servatrice::getServerStatusUpdateTime() const
     return settingsCache->value("server/statusupdate", 15000).toInt();
 }
 
+int Servatrice::getOutputCoalescingWindow() const
+{
+    return settingsCache->value("server/output_coalescing_window", 0).toInt();
+}
+
+int Servatrice::getOutputCompressionThreshold() const
+{
+    return settingsCache->value("server/output_compression_threshold", 1024).toInt();
+}
+
+int Servatrice::getMetricsPort() const
+{
+    return settingsCache->value("server/metrics_port", 0).toInt();
+}
+
+QByteArray Servatrice::getMetricsText()
+{
+    ServerMetrics &metrics = getMetrics();
+    metrics.setGauge("servatrice_users", "Users logged in to this server", QString(), getUsersCount());
+    metrics.setGauge("servatrice_games", "Games hosted by this server", QString(), getGamesCount());
+
+    metrics.setGauge("servatrice_log_queue_depth", "Log messages waiting to be written", QString(),
+                     logger->getQueueDepth());
+    metrics.setGauge("servatrice_log_dropped_messages", "Log messages dropped on a full log queue since startup",
+                     QString(), static_cast<double>(logger->getDroppedMessages()));
+
+    if (databaseWriter) {
+        const Servatrice_DatabaseWriter::Statistics writes = databaseWriter->getStatistics();
+        metrics.setGauge("servatrice_database_write_queue_depth", "Database writes waiting to be executed", QString(),
+                         writes.queueDepth);
+        metrics.setGauge("servatrice_database_writes", "Queued database writes executed since startup", QString(),
+                         static_cast<double>(writes.writes));
+        metrics.setGauge("servatrice_database_write_batches",
+                         "Batches of queued database writes executed since startup", QString(),
+                         static_cast<double>(writes.batches));
+        metrics.setGauge("servatrice_database_write_blocked_enqueues",
+                         "Database writes that waited on a full write queue since startup", QString(),
+                         static_cast<double>(writes.blockedEnqueues));
+    }
+
+    const QString poolHelp = "Sockets served by a connection pool";
+    if (gameServer) {
+        const QList<Servatrice_ConnectionPool *> &pools = gameServer->getConnectionPools();
+        for (int i = 0; i < pools.size(); ++i)
+            metrics.setGauge("servatrice_connection_pool_clients", poolHelp,
+                             ServerMetrics::label("pool", QString("tcp_%1").arg(i)), pools[i]->getClientCount());
+    }
+    if (websocketGameServer) {
+        const QList<Servatrice_ConnectionPool *> &pools = websocketGameServer->getConnectionPools();
+        for (int i = 0; i < pools.size(); ++i)
+            metrics.setGauge("servatrice_connection_pool_clients", poolHelp,
+                             ServerMetrics::label("pool", QString("websocket_%1").arg(i)), pools[i]->getClientCount());
+    }
+
+    return metrics.toPrometheusText();
+}
+
+int Servatrice::getDatabaseWriteQueueSize() const
+{
+    return settingsCache->value("database/write_queue_size", 10000).toInt();
+}
+
+int Servatrice::getDatabaseWriteBatchSize() const
+{
+    return settingsCache->value("database/write_batch_size", 100).toInt();
+}
+
+int Servatrice::getUserIdCacheSize() const
+{
+    return settingsCache->value("database/user_id_cache_size", 10000).toInt();
+}
+
+int Servatrice::getUserIdCacheTtl() const
+{
+    return settingsCache->value("database/user_id_cache_ttl", 300).toInt();
+}
+
+int Servatrice::getPasswordHashThreads() const
+{
+    return settingsCache->value("authentication/hash_threads", 2).toInt();
+}
+
+int Servatrice::getPasswordHashQueueSize() const
+{
+    return settingsCache->value("authentication/hash_queue_size", 200).toInt();
+}
+
+int Servatrice::getMaxPasswordHashesPerAddress() const
+{
+    return settingsCache->value("authentication/max_hashes_per_address", 2).toInt();
+}
+
 int Servatrice::getNumberOfTCPPools() const
 {
     return settingsCache->value("server/number_pools", 1).toInt();
@@ -1030,6 +1403,26 @@ int Servatrice::getISLNetworkPort() const
     return settingsCache->value("servernetwork/port", 14747).toInt();
 }
 
+int Servatrice::getISLBatchInterval() const
+{
+    return settingsCache->value("servernetwork/batch_interval", 20).toInt();
+}
+
+int Servatrice::getISLReconnectInterval() const
+{
+    return settingsCache->value("servernetwork/reconnect_interval", 10).toInt();
+}
+
+int Servatrice::getISLJournalSize() const
+{
+    return qMax(settingsCache->value("servernetwork/journal_size", 10000).toInt(), 0);
+}
+
+int Servatrice::getISLResyncGracePeriod() const
+{
+    return settingsCache->value("servernetwork/resync_grace_period", 30).toInt();
+}
+
 int Servatrice::getIdleClientTimeout() const
 {
     return settingsCache->value("server/idleclienttimeout", 3600).toInt();
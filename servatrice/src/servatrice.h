@@ -20,12 +20,16 @@
 #ifndef SERVATRICE_H
 #define SERVATRICE_H
 
+#include "isl_state_journal.h"
+#include "pb/event_server_complete_list.pb.h"
+#include "pb/isl_message.pb.h"
 #include "server.h"
 
 #include <QHostAddress>
 #include <QMetaType>
 #include <QMutex>
 #include <QReadWriteLock>
+#include <QSet>
 #include <QSqlDatabase>
 #include <QSslCertificate>
 #include <QSslKey>
@@ -40,8 +44,13 @@ class QTimer;
 
 class GameReplay;
 class Servatrice;
+class Servatrice_AuthenticationPool;
 class Servatrice_ConnectionPool;
 class Servatrice_DatabaseInterface;
+class Servatrice_DatabaseWriter;
+class Servatrice_MetricsServer;
+class Servatrice_UserIdCache;
+class Servatrice_UserListCache;
 class AbstractServerSocketInterface;
 class IslInterface;
 class FeatureSet;
@@ -59,6 +68,10 @@ public:
                           const QSqlDatabase &_sqlDatabase,
                           QObject *parent = nullptr);
     ~Servatrice_GameServer() override;
+    const QList<Servatrice_ConnectionPool *> &getConnectionPools() const
+    {
+        return connectionPools;
+    }
 
 protected:
     void incomingConnection(qintptr socketDescriptor) override;
@@ -78,6 +91,10 @@ public:
                                    const QSqlDatabase &_sqlDatabase,
                                    QObject *parent = nullptr);
     ~Servatrice_WebsocketGameServer() override;
+    const QList<Servatrice_ConnectionPool *> &getConnectionPools() const
+    {
+        return connectionPools;
+    }
 
 protected:
     Servatrice_ConnectionPool *findLeastUsedConnectionPool();
@@ -141,6 +158,7 @@ public:
 private slots:
     void statusUpdate();
     void shutdownTimeout();
+    void reconnectIslPeers();
 
 protected:
     void doSendIslMessage(const IslMessage &msg, int _serverId) override;
@@ -157,16 +175,23 @@ private:
     Servatrice_GameServer *gameServer;
     Servatrice_WebsocketGameServer *websocketGameServer;
     Servatrice_IslServer *islServer;
+    Servatrice_MetricsServer *metricsServer;
     mutable QMutex loginMessageMutex;
     QString loginMessage;
     QString dbPrefix;
     QMap<QString, bool> serverRequiredFeatureList;
     QString officialWarnings;
     Servatrice_DatabaseInterface *servatriceDatabaseInterface;
+    Servatrice_DatabaseWriter *databaseWriter;
+    Servatrice_UserIdCache *userIdCache;
+    Servatrice_UserListCache *userListCache;
+    Servatrice_AuthenticationPool *authenticationPool;
     int serverId;
     int uptime;
     QMutex txBytesMutex, rxBytesMutex;
     quint64 txBytes, rxBytes;
+    // dropped log messages and blocked database writes already reported by statusUpdate()
+    quint64 reportedDroppedLogMessages, reportedBlockedDatabaseWrites;
 
     QString shutdownReason;
     int shutdownMinutes;
@@ -178,6 +203,30 @@ private:
     void updateServerList();
 
     QMap<int, IslInterface *> islInterfaces;
+    QSslCertificate islCert;
+    QSslKey islKey;
+    QTimer *islReconnectTimer;
+
+    // Changes of our state sent to the peers, kept so a peer that lost its link can catch up, see
+    // getIslStateChangesSince(). The epoch tells the journals of different server runs apart.
+    QMutex islJournalMutex;
+    IslStateJournal islJournal;
+
+    // What we know of the state of each peer. It is kept for the resync grace period after a link is lost.
+    struct IslPeerState
+    {
+        quint64 epoch = 0;
+        quint64 sequence = 0;
+        bool connected = false;
+        int linkGeneration = 0;
+    };
+    QMutex islPeersMutex;
+    QMap<int, IslPeerState> islPeers;
+
+    void connectToIslPeer(const ServerProperties &prop, Qt::ConnectionType initType);
+    void removeIslPeerUsers(int _serverId,
+                            const QSet<QString> &keptUsers,
+                            const QSet<QPair<int, QString>> &keptRoomUsers);
 
     QString getDBPrefixString() const;
     QString getDBHostNameString() const;
@@ -194,12 +243,18 @@ private:
     int getServerWebSocketPort() const;
     int getISLNetworkPort() const;
     bool getISLNetworkEnabled() const;
+    int getISLReconnectInterval() const;
+    int getISLJournalSize() const;
+    int getISLResyncGracePeriod() const;
     bool getEnableInternalSMTPClient() const;
     QHostAddress getServerTCPHost() const;
     QHostAddress getServerWebSocketHost() const;
 
 public slots:
     void scheduleShutdown(const QString &reason, int minutes);
+    void islPeerDisconnected(int _serverId);
+    void purgeIslPeerState(int _serverId);
+    void replaceIslPeerState(int _serverId, const Event_ServerCompleteList &state);
     void updateLoginMessage();
     void setRequiredFeatures(const QString &featureList);
 
@@ -262,12 +317,41 @@ public:
     int getMaxMessageCountPerInterval() const override;
     int getMaxMessageSizePerInterval() const override;
     int getMaxGamesPerUser() const override;
+    int getGameListUpdateInterval() const override;
     int getCommandCountingInterval() const override;
     int getMaxCommandCountPerInterval() const override;
     int getMaxUserTotal() const override;
     bool permitCreateGameAsJudge() const override;
     int getMaxTcpUserLimit() const;
     int getMaxWebSocketUserLimit() const;
+    int getOutputCoalescingWindow() const;
+    int getOutputCompressionThreshold() const;
+    int getMetricsPort() const;
+    // Refreshes the gauges and returns every metric in the Prometheus text format
+    QByteArray getMetricsText();
+    int getDatabaseWriteQueueSize() const;
+    int getDatabaseWriteBatchSize() const;
+    Servatrice_DatabaseWriter *getDatabaseWriter() const
+    {
+        return databaseWriter;
+    }
+    int getUserIdCacheSize() const;
+    int getUserIdCacheTtl() const;
+    Servatrice_UserIdCache *getUserIdCache() const
+    {
+        return userIdCache;
+    }
+    Servatrice_UserListCache *getUserListCache() const
+    {
+        return userListCache;
+    }
+    int getPasswordHashThreads() const;
+    int getPasswordHashQueueSize() const;
+    int getMaxPasswordHashesPerAddress() const;
+    Servatrice_AuthenticationPool *getAuthenticationPool() const
+    {
+        return authenticationPool;
+    }
     int getUsersWithAddress(const QHostAddress &address) const;
     int getMaxAccountsPerEmail() const;
     int getForgotPasswordTokenLife() const;
@@ -279,6 +363,16 @@ public:
     bool islConnectionExists(int _serverId) const;
     void addIslInterface(int _serverId, IslInterface *interface);
     void removeIslInterface(int _serverId);
+    int getISLBatchInterval() const;
+    quint64 getIslStateEpoch() const
+    {
+        return islJournal.getEpoch();
+    }
+    quint64 getIslStateSequence();
+    // Copies the journaled changes after sequence, or returns false if the epoch differs or they were dropped already
+    bool getIslStateChangesSince(quint64 epoch, quint64 sequence, QList<IslMessage> &changes, quint64 &lastSequence);
+    void getIslPeerState(int _serverId, quint64 &epoch, quint64 &sequence);
+    void setIslPeerState(int _serverId, quint64 epoch, quint64 sequence);
     QReadWriteLock islLock;
 
     QList<ServerProperties> getServerList() const;
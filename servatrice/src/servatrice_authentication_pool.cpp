@@ -0,0 +1,100 @@
+#include "servatrice_authentication_pool.h"
+
+#include "passwordhasher.h"
+
+#include <QMetaObject>
+#include <QObject>
+#include <QRunnable>
+
+class Servatrice_AuthenticationPool::HashTask : public QRunnable
+{
+private:
+    Servatrice_AuthenticationPool *pool;
+    QObject *receiver;
+    QString address, password, salt;
+
+public:
+    HashTask(Servatrice_AuthenticationPool *_pool,
+             QObject *_receiver,
+             const QString &_address,
+             const QString &_password,
+             const QString &_salt)
+        : pool(_pool), receiver(_receiver), address(_address), password(_password), salt(_salt)
+    {
+    }
+    void run() override
+    {
+        pool->finished(receiver, address, PasswordHasher::computeHash(password, salt));
+    }
+};
+
+Servatrice_AuthenticationPool::Servatrice_AuthenticationPool(int threadCount,
+                                                             int _maxQueueSize,
+                                                             int _maxPendingPerAddress)
+    : maxQueueSize(_maxQueueSize), maxPendingPerAddress(_maxPendingPerAddress), pendingCount(0)
+{
+    threadPool.setMaxThreadCount(qMax(1, threadCount));
+}
+
+Servatrice_AuthenticationPool::~Servatrice_AuthenticationPool()
+{
+    {
+        QMutexLocker locker(&mutex);
+        receivers.clear();
+    }
+    threadPool.waitForDone();
+}
+
+Servatrice_AuthenticationPool::Admission Servatrice_AuthenticationPool::submit(QObject *receiver,
+                                                                               const char *member,
+                                                                               const QString &address,
+                                                                               const QString &password,
+                                                                               const QString &salt)
+{
+    QMutexLocker locker(&mutex);
+    if (maxQueueSize > 0 && pendingCount >= maxQueueSize)
+        return QueueFull;
+    int &pendingFromAddress = pendingByAddress[address];
+    if (maxPendingPerAddress > 0 && pendingFromAddress >= maxPendingPerAddress) {
+        if (pendingFromAddress == 0)
+            pendingByAddress.remove(address);
+        return TooManyFromAddress;
+    }
+
+    ++pendingCount;
+    ++pendingFromAddress;
+    receivers.insert(receiver, QByteArray(member));
+    locker.unlock();
+
+    threadPool.start(new HashTask(this, receiver, address, password, salt));
+    return Accepted;
+}
+
+void Servatrice_AuthenticationPool::finished(QObject *receiver, const QString &address, const QString &hashedPassword)
+{
+    QMutexLocker locker(&mutex);
+    --pendingCount;
+    auto pending = pendingByAddress.find(address);
+    if (pending != pendingByAddress.end() && --pending.value() <= 0)
+        pendingByAddress.erase(pending);
+
+    // still under the mutex, so that the receiver can't be cancelled and destroyed meanwhile
+    auto it = receivers.find(receiver);
+    if (it == receivers.end())
+        return;
+    const QByteArray member = it.value();
+    receivers.erase(it);
+    QMetaObject::invokeMethod(receiver, member.constData(), Qt::QueuedConnection, Q_ARG(QString, hashedPassword));
+}
+
+void Servatrice_AuthenticationPool::cancel(QObject *receiver)
+{
+    QMutexLocker locker(&mutex);
+    receivers.remove(receiver);
+}
+
+int Servatrice_AuthenticationPool::getPendingCount()
+{
+    QMutexLocker locker(&mutex);
+    return pendingCount;
+}
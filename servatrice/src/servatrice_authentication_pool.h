@@ -0,0 +1,58 @@
+#ifndef SERVATRICE_AUTHENTICATION_POOL_H
+#define SERVATRICE_AUTHENTICATION_POOL_H
+
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include <QThreadPool>
+
+class QObject;
+
+/**
+ * Worker pool for the password hashing done on login, so that the 1000 hashing rounds don't block every other socket
+ * served by the same connection pool thread.
+ *
+ * The number of hashes waiting or running is bounded, both in total and per address, so that a login flood can't
+ * take all the CPU time away from the games. A receiver has at most one request in flight; the result is delivered
+ * to it as a queued call of a slot taking the hashed password as a QString.
+ */
+class Servatrice_AuthenticationPool
+{
+public:
+    enum Admission
+    {
+        Accepted,
+        QueueFull,
+        TooManyFromAddress
+    };
+
+private:
+    class HashTask;
+
+    QThreadPool threadPool;
+    int maxQueueSize;
+    int maxPendingPerAddress;
+
+    QMutex mutex;
+    int pendingCount;
+    QHash<QString, int> pendingByAddress;
+    // receiver -> slot to call, for the requests whose receiver is still waiting
+    QHash<QObject *, QByteArray> receivers;
+
+    void finished(QObject *receiver, const QString &address, const QString &hashedPassword);
+
+public:
+    Servatrice_AuthenticationPool(int threadCount, int _maxQueueSize, int _maxPendingPerAddress);
+    ~Servatrice_AuthenticationPool();
+
+    Admission submit(QObject *receiver,
+                     const char *member,
+                     const QString &address,
+                     const QString &password,
+                     const QString &salt);
+    // Drops the result of the receiver's request, if any. Must be called before the receiver is destroyed.
+    void cancel(QObject *receiver);
+    int getPendingCount();
+};
+
+#endif
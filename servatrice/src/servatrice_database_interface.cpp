@@ -2,19 +2,24 @@
 
 #include "decklist.h"
 #include "passwordhasher.h"
-#include "pb/game_replay.pb.h"
 #include "servatrice.h"
+#include "servatrice_user_id_cache.h"
+#include "servatrice_user_list_cache.h"
+#include "server_replay_writer.h"
 #include "serversocketinterface.h"
 #include "settingscache.h"
 
 #include <QChar>
 #include <QDateTime>
 #include <QDebug>
+#include <QElapsedTimer>
+#include <QRegularExpression>
 #include <QSqlError>
 #include <QSqlQuery>
 
 Servatrice_DatabaseInterface::Servatrice_DatabaseInterface(int _instanceId, Servatrice *_server)
-    : instanceId(_instanceId), sqlDatabase(QSqlDatabase()), server(_server)
+    : instanceId(_instanceId), sqlDatabase(QSqlDatabase()), server(_server), inWriteBatch(false),
+      writeBatchFailed(false)
 {
 }
 
@@ -23,6 +28,7 @@ Servatrice_DatabaseInterface::~Servatrice_DatabaseInterface()
     // reset all prepared statements
     qDeleteAll(preparedStatements);
     preparedStatements.clear();
+    queryDurations.clear();
 
     sqlDatabase.close();
 }
@@ -98,6 +104,7 @@ bool Servatrice_DatabaseInterface::openDatabase()
     // reset all prepared statements
     qDeleteAll(preparedStatements);
     preparedStatements.clear();
+    queryDurations.clear();
     return true;
 }
 
@@ -109,11 +116,20 @@ bool Servatrice_DatabaseInterface::checkSql()
 
     auto query = QSqlQuery(sqlDatabase);
     if (query.exec("select 1") && !query.isActive()) {
+        if (inWriteBatch) {
+            writeBatchFailed = true;
+            return false;
+        }
         return openDatabase();
     }
 
     if (query.lastError().isValid()) {
         const auto &poolStr = instanceId == -1 ? QString("main") : QString("pool %1").arg(instanceId);
+        if (inWriteBatch) {
+            qCritical() << QString("[%1] Error executing query: %2").arg(poolStr).arg(query.lastError().text());
+            writeBatchFailed = true;
+            return false;
+        }
         qCritical() << QString("[%1] Error executing query: %2, resetting connection")
                            .arg(poolStr)
                            .arg(query.lastError().text());
@@ -125,6 +141,19 @@ bool Servatrice_DatabaseInterface::checkSql()
     return true;
 }
 
+// Names a statement after its first keyword and table, like "select users". The metrics are labelled with it: the
+// query text itself would make a series of every merged write batch.
+static QString statementName(const QString &queryText)
+{
+    static const QRegularExpression tablePattern("\\{prefix\\}_(\\w+)");
+    const QString simplifiedText = queryText.simplified();
+    QString result = simplifiedText.section(' ', 0, 0).toLower();
+    const QRegularExpressionMatch table = tablePattern.match(simplifiedText);
+    if (table.hasMatch())
+        result += " " + table.captured(1);
+    return result;
+}
+
 QSqlQuery *Servatrice_DatabaseInterface::prepareQuery(const QString &queryText)
 {
     if (preparedStatements.contains(queryText)) {
@@ -137,20 +166,107 @@ QSqlQuery *Servatrice_DatabaseInterface::prepareQuery(const QString &queryText)
     query->prepare(prefixedQueryText);
 
     preparedStatements.insert(queryText, query);
+    queryDurations.insert(query, server->getMetrics().databaseQueryHistogram(statementName(queryText)));
     return query;
 }
 
 bool Servatrice_DatabaseInterface::execSqlQuery(QSqlQuery *query)
 {
-    if (query->exec())
+    ServerMetrics::Histogram *duration = queryDurations.value(query);
+    if (!duration)
+        duration = server->getMetrics().databaseQueryHistogram("other");
+    return execSqlQuery(query, duration);
+}
+
+bool Servatrice_DatabaseInterface::execSqlQuery(QSqlQuery *query, ServerMetrics::Histogram *duration)
+{
+    QElapsedTimer queryTimer;
+    queryTimer.start();
+    const bool success = query->exec();
+    duration->observe(queryTimer.nsecsElapsed());
+    if (success)
         return true;
     const QString poolStr = instanceId == -1 ? QString("main") : QString("pool %1").arg(instanceId);
     qCritical() << QString("[%1] Error executing query: %2").arg(poolStr).arg(query->lastError().text());
+    if (inWriteBatch) {
+        // the batch is rolled back and retried; reconnecting here would lose its earlier writes silently
+        writeBatchFailed = true;
+        return false;
+    }
     sqlDatabase.close();
     openDatabase();
     return false;
 }
 
+void Servatrice_DatabaseInterface::execWrite(const Servatrice_DatabaseWrite &write)
+{
+    Servatrice_DatabaseWriter *writer = server->getDatabaseWriter();
+    if (writer && writer->getDatabaseInterface() != this && writer->enqueue(write))
+        return;
+
+    execWriteBatch({write});
+}
+
+void Servatrice_DatabaseInterface::execWriteBatch(const QList<Servatrice_DatabaseWrite> &writes)
+{
+    if (!checkSql())
+        return;
+
+    Servatrice_DatabaseWrite::executeBatch(writes, *this);
+}
+
+bool Servatrice_DatabaseInterface::beginWriteBatch()
+{
+    if (!sqlDatabase.transaction())
+        return false;
+    inWriteBatch = true;
+    writeBatchFailed = false;
+    return true;
+}
+
+bool Servatrice_DatabaseInterface::commitWriteBatch()
+{
+    if (writeBatchFailed)
+        return false;
+    inWriteBatch = false;
+    return sqlDatabase.commit();
+}
+
+void Servatrice_DatabaseInterface::rollbackWriteBatch()
+{
+    inWriteBatch = false;
+    writeBatchFailed = false;
+    if (!sqlDatabase.rollback()) {
+        // most likely the connection itself is gone
+        sqlDatabase.close();
+        openDatabase();
+    }
+}
+
+bool Servatrice_DatabaseInterface::execWriteStatement(const QString &queryText, const QVariantList &values, bool merged)
+{
+    QSqlQuery mergedQuery(sqlDatabase);
+    QSqlQuery *query = &mergedQuery;
+    if (!merged) {
+        query = prepareQuery(queryText);
+    } else {
+        QString prefixedQueryText = queryText;
+        prefixedQueryText.replace("{prefix}", server->getDbPrefix());
+        mergedQuery.prepare(prefixedQueryText);
+    }
+    for (const QVariant &value : values)
+        query->addBindValue(value);
+    if (merged)
+        return execSqlQuery(query, server->getMetrics().databaseQueryHistogram(statementName(queryText)));
+    return execSqlQuery(query);
+}
+
+bool Servatrice_DatabaseInterface::execWriteCallback(const Servatrice_DatabaseWrite &write)
+{
+    write.callback(*this);
+    return !writeBatchFailed;
+}
+
 bool Servatrice_DatabaseInterface::usernameIsValid(const QString &user, QString &error)
 {
     int minNameLength = settingsCache->value("users/minnamelength", 6).toInt();
@@ -260,6 +376,9 @@ bool Servatrice_DatabaseInterface::registerUser(const QString &userName,
         return false;
     }
 
+    // the name may have belonged to an account that has been deleted since
+    if (Servatrice_UserIdCache *userIdCache = server->getUserIdCache())
+        userIdCache->invalidate(userName);
     return true;
 }
 
@@ -292,6 +411,8 @@ bool Servatrice_DatabaseInterface::activateUser(const QString &userName, const Q
                 return false;
             }
 
+            if (Servatrice_UserIdCache *userIdCache = server->getUserIdCache())
+                userIdCache->invalidate(userName);
             return true;
         }
     }
@@ -538,27 +659,90 @@ QString Servatrice_DatabaseInterface::getUserSalt(const QString &user)
 int Servatrice_DatabaseInterface::getUserIdInDB(const QString &name)
 {
     if (server->getAuthenticationMethod() == Servatrice::AuthenticationSql) {
+        Servatrice_UserIdCache *userIdCache = server->getUserIdCache();
+        int id;
+        if (userIdCache && userIdCache->lookup(name, id))
+            return id;
+
         QSqlQuery *query = prepareQuery("select id from {prefix}_users where name = :name and active = 1");
         query->bindValue(":name", name);
         if (!execSqlQuery(query))
             return -1;
         if (!query->next())
             return -1;
-        return query->value(0).toInt();
+        id = query->value(0).toInt();
+        if (userIdCache)
+            userIdCache->insert(name, id);
+        return id;
     }
     return -1;
 }
 
+QMap<QString, int> Servatrice_DatabaseInterface::getUserIdsInDB(const QSet<QString> &names)
+{
+    QMap<QString, int> result;
+    if (server->getAuthenticationMethod() != Servatrice::AuthenticationSql)
+        return result;
+
+    Servatrice_UserIdCache *userIdCache = server->getUserIdCache();
+    QStringList missingNames;
+    for (const QString &name : names) {
+        int id;
+        if (userIdCache && userIdCache->lookup(name, id))
+            result.insert(name, id);
+        else
+            missingNames.append(name);
+    }
+    if (missingNames.isEmpty())
+        return result;
+
+    QStringList placeholders;
+    for (int i = 0; i < missingNames.size(); ++i)
+        placeholders.append("?");
+    QString queryText = QString("select name, id from {prefix}_users where active = 1 and name in (%1)")
+                            .arg(placeholders.join(", "));
+    queryText.replace("{prefix}", server->getDbPrefix());
+    // the number of names varies, so this doesn't go through the prepared statement cache
+    QSqlQuery query(sqlDatabase);
+    query.prepare(queryText);
+    for (const QString &name : missingNames)
+        query.addBindValue(name);
+    if (!execSqlQuery(&query))
+        return result;
+
+    // names compare case insensitively in the database
+    QMap<QString, QString> missingNamesLower;
+    for (const QString &name : missingNames)
+        missingNamesLower.insert(name.toLower(), name);
+    while (query.next()) {
+        const QString name = missingNamesLower.value(query.value(0).toString().toLower());
+        if (name.isEmpty())
+            continue;
+        const int id = query.value(1).toInt();
+        result.insert(name, id);
+        if (userIdCache)
+            userIdCache->insert(name, id);
+    }
+    return result;
+}
+
 bool Servatrice_DatabaseInterface::isInBuddyList(const QString &whoseList, const QString &who)
 {
     if (server->getAuthenticationMethod() == Servatrice::AuthenticationNone)
         return false;
 
+    bool contains;
+    Servatrice_UserListCache *userListCache = server->getUserListCache();
+    if (userListCache && userListCache->lookup(Servatrice_UserListCache::BuddyList, whoseList, who, contains))
+        return contains;
+
     if (!checkSql())
         return false;
 
     int id1 = getUserIdInDB(whoseList);
     int id2 = getUserIdInDB(who);
+    if (id1 == -1 || id2 == -1)
+        return false;
 
     QSqlQuery *query =
         prepareQuery("select 1 from {prefix}_buddylist where id_user1 = :id_user1 and id_user2 = :id_user2");
@@ -574,11 +758,18 @@ bool Servatrice_DatabaseInterface::isInIgnoreList(const QString &whoseList, cons
     if (server->getAuthenticationMethod() == Servatrice::AuthenticationNone)
         return false;
 
+    bool contains;
+    Servatrice_UserListCache *userListCache = server->getUserListCache();
+    if (userListCache && userListCache->lookup(Servatrice_UserListCache::IgnoreList, whoseList, who, contains))
+        return contains;
+
     if (!checkSql())
         return false;
 
     int id1 = getUserIdInDB(whoseList);
     int id2 = getUserIdInDB(who);
+    if (id1 == -1 || id2 == -1)
+        return false;
 
     QSqlQuery *query =
         prepareQuery("select 1 from {prefix}_ignorelist where id_user1 = :id_user1 and id_user2 = :id_user2");
@@ -744,12 +935,8 @@ void Servatrice_DatabaseInterface::endSession(qint64 sessionId)
     if (server->getAuthenticationMethod() == Servatrice::AuthenticationNone)
         return;
 
-    if (!checkSql())
-        return;
-
-    auto *query = prepareQuery("update {prefix}_sessions set end_time=NOW() where id = :id_session");
-    query->bindValue(":id_session", sessionId);
-    execSqlQuery(query);
+    execWrite(Servatrice_DatabaseWrite("update {prefix}_sessions set end_time=NOW() where id in (", "?",
+                                       {sessionId}, ")"));
 }
 
 QMap<QString, ServerInfo_User> Servatrice_DatabaseInterface::getBuddyList(const QString &name)
@@ -771,6 +958,8 @@ QMap<QString, ServerInfo_User> Servatrice_DatabaseInterface::getBuddyList(const
             const ServerInfo_User &temp = evalUserQueryResult(query, false);
             result.insert(QString::fromStdString(temp.name()), temp);
         }
+        if (Servatrice_UserListCache *userListCache = server->getUserListCache())
+            userListCache->setList(Servatrice_UserListCache::BuddyList, name, result.keys());
     }
     return result;
 }
@@ -794,10 +983,18 @@ QMap<QString, ServerInfo_User> Servatrice_DatabaseInterface::getIgnoreList(const
             ServerInfo_User temp = evalUserQueryResult(query, false);
             result.insert(QString::fromStdString(temp.name()), temp);
         }
+        if (Servatrice_UserListCache *userListCache = server->getUserListCache())
+            userListCache->setList(Servatrice_UserListCache::IgnoreList, name, result.keys());
     }
     return result;
 }
 
+void Servatrice_DatabaseInterface::releaseUserLists(const QString &name)
+{
+    if (Servatrice_UserListCache *userListCache = server->getUserListCache())
+        userListCache->removeUser(name);
+}
+
 int Servatrice_DatabaseInterface::getNextGameId()
 {
     if (!sqlDatabase.isValid())
@@ -834,12 +1031,26 @@ void Servatrice_DatabaseInterface::storeGameInformation(const QString &roomName,
                                                         const ServerInfo_Game &gameInfo,
                                                         const QSet<QString> &allPlayersEver,
                                                         const QSet<QString> &allSpectatorsEver,
-                                                        const QList<GameReplay *> &replayList)
+                                                        const QList<QSharedPointer<Server_ReplayWriter>> &replayList)
 {
-    if (!checkSql())
+    if (!settingsCache->value("game/store_replays", 1).toBool())
         return;
 
-    if (!settingsCache->value("game/store_replays", 1).toBool())
+    // the write keeps the replays alive; they are read back from their spill files piece by piece when it runs
+    execWrite(Servatrice_DatabaseWrite([=](Servatrice_DatabaseInterface &databaseInterface) {
+        databaseInterface.writeGameInformation(roomName, roomGameTypes, gameInfo, allPlayersEver, allSpectatorsEver,
+                                               replayList);
+    }));
+}
+
+void Servatrice_DatabaseInterface::writeGameInformation(const QString &roomName,
+                                                        const QStringList &roomGameTypes,
+                                                        const ServerInfo_Game &gameInfo,
+                                                        const QSet<QString> &allPlayersEver,
+                                                        const QSet<QString> &allSpectatorsEver,
+                                                        const QList<QSharedPointer<Server_ReplayWriter>> &replayList)
+{
+    if (!checkSql())
         return;
 
     QVariantList gameIds1, playerNames, gameIds2, userIds, replayNames;
@@ -849,34 +1060,13 @@ void Servatrice_DatabaseInterface::storeGameInformation(const QString &roomName,
         const QString &playerName = playerIterator.next();
         playerNames.append(playerName);
     }
-    QSet<QString> allUsersInGame = allPlayersEver + allSpectatorsEver;
-    QSetIterator<QString> allUsersIterator(allUsersInGame);
-    while (allUsersIterator.hasNext()) {
-        int id = getUserIdInDB(allUsersIterator.next());
-        if (id == -1)
-            continue;
+    const QMap<QString, int> allUserIdsInGame = getUserIdsInDB(allPlayersEver + allSpectatorsEver);
+    for (int id : allUserIdsInGame) {
         gameIds2.append(gameInfo.game_id());
         userIds.append(id);
         replayNames.append(QString::fromStdString(gameInfo.description()));
     }
 
-    QVariantList replayIds, replayGameIds, replayDurations, replayBlobs;
-    for (int i = 0; i < replayList.size(); ++i) {
-        QByteArray blob;
-#if GOOGLE_PROTOBUF_VERSION > 3001000
-        const unsigned int size = static_cast<unsigned int>(replayList[i]->ByteSizeLong());
-#else
-        const unsigned int size = static_cast<unsigned int>(replayList[i]->ByteSize());
-#endif
-        blob.resize(size);
-        replayList[i]->SerializeToArray(blob.data(), size);
-
-        replayIds.append(QVariant((qulonglong)replayList[i]->replay_id()));
-        replayGameIds.append(gameInfo.game_id());
-        replayDurations.append(replayList[i]->duration_seconds());
-        replayBlobs.append(blob);
-    }
-
     {
         QSqlQuery *query = prepareQuery("update {prefix}_games set room_name=:room_name, descr=:descr, "
                                         "creator_name=:creator_name, password=:password, game_types=:game_types, "
@@ -898,14 +1088,26 @@ void Servatrice_DatabaseInterface::storeGameInformation(const QString &roomName,
         query->bindValue(":player_name", playerNames);
         query->execBatch();
     }
-    {
+    for (const QSharedPointer<Server_ReplayWriter> &replay : replayList) {
+        // Read back from the spill file only now, and stored with one statement: appending piece by piece would
+        // make the database rewrite the whole blob for every piece.
+        QByteArray replayData;
+        if (!replay->readReplayData(replayData)) {
+            // a partial replay can't be parsed, so its row goes rather than storing one
+            qWarning() << "Replay" << replay->getReplayId() << "of game" << gameInfo.game_id() << "is lost";
+            QSqlQuery *query = prepareQuery("delete from {prefix}_replays where id=:id_replay");
+            query->bindValue(":id_replay", QVariant((qulonglong)replay->getReplayId()));
+            execSqlQuery(query);
+            continue;
+        }
+
         QSqlQuery *query = prepareQuery(
             "update {prefix}_replays set id_game=:id_game, duration=:duration, replay=:replay where id=:id_replay");
-        query->bindValue(":id_replay", replayIds);
-        query->bindValue(":id_game", replayGameIds);
-        query->bindValue(":duration", replayDurations);
-        query->bindValue(":replay", replayBlobs);
-        query->execBatch();
+        query->bindValue(":id_replay", QVariant((qulonglong)replay->getReplayId()));
+        query->bindValue(":id_game", gameInfo.game_id());
+        query->bindValue(":duration", replay->getDurationSeconds());
+        query->bindValue(":replay", replayData);
+        execSqlQuery(query);
     }
     {
         QSqlQuery *query = prepareQuery("insert into {prefix}_replays_access (id_game, id_player, replay_name) values "
@@ -969,17 +1171,13 @@ void Servatrice_DatabaseInterface::logMessage(const int senderId,
             return;
     }
 
-    QSqlQuery *query = prepareQuery("insert into {prefix}_log (log_time, sender_id, sender_name, sender_ip, "
-                                    "log_message, target_type, target_id, target_name) values (now(), :sender_id, "
-                                    ":sender_name, :sender_ip, :log_message, :target_type, :target_id, :target_name)");
-    query->bindValue(":sender_id", senderId < 1 ? QVariant() : senderId);
-    query->bindValue(":sender_name", senderName);
-    query->bindValue(":sender_ip", senderIp);
-    query->bindValue(":log_message", logMessage);
-    query->bindValue(":target_type", targetTypeString);
-    query->bindValue(":target_id", (targetType == MessageTargetChat && targetId < 1) ? QVariant() : targetId);
-    query->bindValue(":target_name", targetName);
-    execSqlQuery(query);
+    execWrite(Servatrice_DatabaseWrite("insert into {prefix}_log (log_time, sender_id, sender_name, sender_ip, "
+                                       "log_message, target_type, target_id, target_name) values ",
+                                       "(now(), ?, ?, ?, ?, ?, ?, ?)",
+                                       {senderId < 1 ? QVariant() : senderId, senderName, senderIp, logMessage,
+                                        targetTypeString,
+                                        (targetType == MessageTargetChat && targetId < 1) ? QVariant() : targetId,
+                                        targetName}));
 }
 
 bool Servatrice_DatabaseInterface::changeUserPassword(const QString &user,
@@ -1079,10 +1277,13 @@ void Servatrice_DatabaseInterface::updateUsersClientID(const QString &userName,
 
 void Servatrice_DatabaseInterface::updateUsersLastLoginData(const QString &userName, const QString &clientVersion)
 {
+    execWrite(Servatrice_DatabaseWrite([=](Servatrice_DatabaseInterface &databaseInterface) {
+        databaseInterface.writeUsersLastLoginData(userName, clientVersion);
+    }));
+}
 
-    if (!checkSql())
-        return;
-
+void Servatrice_DatabaseInterface::writeUsersLastLoginData(const QString &userName, const QString &clientVersion)
+{
     int usersID = 0;
 
     QSqlQuery *query = prepareQuery("select id from {prefix}_users where name = :user_name");
@@ -1437,25 +1638,14 @@ void Servatrice_DatabaseInterface::addAuditRecord(const QString &user,
                                                   const QString &details,
                                                   const bool &results = false)
 {
-    if (!checkSql())
-        return;
-
     if (!server->getEnableAudit())
         return;
 
     if (user.isEmpty() || ipaddress.isEmpty() || clientid.isEmpty() || action.isEmpty())
         return;
 
-    QSqlQuery *query = prepareQuery("insert into {prefix}_audit "
-                                    "(id_server,name,ip_address,clientid,incidentDate,action,results,details) values "
-                                    "(:idserver,:username,:ipaddress,:clientid,NOW(),:action,:results,:details)");
-    query->bindValue(":idserver", server->getServerID());
-    query->bindValue(":username", user);
-    query->bindValue(":ipaddress", ipaddress);
-    query->bindValue(":clientid", clientid);
-    query->bindValue(":action", action);
-    query->bindValue(":results", results ? "success" : "fail");
-
-    query->bindValue(":details", details);
-    execSqlQuery(query);
+    execWrite(Servatrice_DatabaseWrite(
+        "insert into {prefix}_audit (id_server,name,ip_address,clientid,incidentDate,action,results,details) values ",
+        "(?,?,?,?,NOW(),?,?,?)",
+        {server->getServerID(), user, ipaddress, clientid, action, results ? "success" : "fail", details}));
 }
@@ -1,26 +1,38 @@
 #ifndef SERVATRICE_DATABASE_INTERFACE_H
 #define SERVATRICE_DATABASE_INTERFACE_H
 
+#include "servatrice_database_writer.h"
+#include "servatrice_storage_listing.h"
 #include "server.h"
 #include "server_database_interface.h"
 
 #include <QChar>
 #include <QHash>
+#include <QMap>
 #include <QObject>
+#include <QSet>
 #include <QSqlDatabase>
 
 #define DATABASE_SCHEMA_VERSION 34
 
 class Servatrice;
 
-class Servatrice_DatabaseInterface : public Server_DatabaseInterface
+class Servatrice_DatabaseInterface : public Server_DatabaseInterface,
+                                     public Servatrice_DatabaseWriteConnection,
+                                     public Servatrice_QueryConnection
 {
     Q_OBJECT
 private:
     int instanceId;
     QSqlDatabase sqlDatabase;
     QHash<QString, QSqlQuery *> preparedStatements;
+    // the duration histogram of every prepared statement, looked up once when it is prepared
+    QHash<const QSqlQuery *, ServerMetrics::Histogram *> queryDurations;
     Servatrice *server;
+    // set while a write batch transaction is open; failing queries then don't reset the connection
+    bool inWriteBatch;
+    bool writeBatchFailed;
+    bool execSqlQuery(QSqlQuery *query, ServerMetrics::Histogram *duration);
     ServerInfo_User evalUserQueryResult(const QSqlQuery *query, bool complete, bool withId = false);
     /** Must be called after checkSql and server is known to be in auth mode. */
     bool checkUserIsIdBanned(const QString &clientId, QString &banReason, int &banSecondsRemaining);
@@ -28,6 +40,15 @@ private:
     bool checkUserIsIpBanned(const QString &ipAddress, QString &banReason, int &banSecondsRemaining);
     /** Must be called after checkSql and server is known to be in auth mode. */
     bool checkUserIsNameBanned(QString const &userName, QString &banReason, int &banSecondsRemaining);
+    /** Hands the write to the write-behind queue if there is one, executes it right away otherwise. */
+    void execWrite(const Servatrice_DatabaseWrite &write);
+    void writeUsersLastLoginData(const QString &userName, const QString &clientVersion);
+    void writeGameInformation(const QString &roomName,
+                              const QStringList &roomGameTypes,
+                              const ServerInfo_Game &gameInfo,
+                              const QSet<QString> &allPlayersEver,
+                              const QSet<QString> &allSpectatorsEver,
+                              const QList<QSharedPointer<Server_ReplayWriter>> &replayList);
 
 protected:
     AuthenticationResult checkUserPassword(Server_ProtocolHandler *handler,
@@ -51,8 +72,15 @@ public:
                       const QString &password);
     bool openDatabase();
     bool checkSql();
-    QSqlQuery *prepareQuery(const QString &queryText);
-    bool execSqlQuery(QSqlQuery *query);
+    QSqlQuery *prepareQuery(const QString &queryText) override;
+    bool execSqlQuery(QSqlQuery *query) override;
+    /** Executes the writes in one transaction, merging consecutive row writes into a single statement. */
+    void execWriteBatch(const QList<Servatrice_DatabaseWrite> &writes);
+    bool beginWriteBatch() override;
+    bool commitWriteBatch() override;
+    void rollbackWriteBatch() override;
+    bool execWriteStatement(const QString &queryText, const QVariantList &values, bool merged) override;
+    bool execWriteCallback(const Servatrice_DatabaseWrite &write) override;
     const QSqlDatabase &getDatabase()
     {
         return sqlDatabase;
@@ -62,17 +90,20 @@ public:
     bool userExists(const QString &user) override;
     QString getUserSalt(const QString &user) override;
     int getUserIdInDB(const QString &name);
+    /** Looks up the ids of all the names in a single query; names without an active account are left out. */
+    QMap<QString, int> getUserIdsInDB(const QSet<QString> &names);
     QMap<QString, ServerInfo_User> getBuddyList(const QString &name) override;
     QMap<QString, ServerInfo_User> getIgnoreList(const QString &name) override;
     bool isInBuddyList(const QString &whoseList, const QString &who) override;
     bool isInIgnoreList(const QString &whoseList, const QString &who) override;
+    void releaseUserLists(const QString &name) override;
     ServerInfo_User getUserData(const QString &name, bool withId = false) override;
     void storeGameInformation(const QString &roomName,
                               const QStringList &roomGameTypes,
                               const ServerInfo_Game &gameInfo,
                               const QSet<QString> &allPlayersEver,
                               const QSet<QString> &allSpectatorsEver,
-                              const QList<GameReplay *> &replayList) override;
+                              const QList<QSharedPointer<Server_ReplayWriter>> &replayList) override;
     DeckList *getDeckFromDatabase(int deckId, int userId) override;
 
     int getNextGameId() override;
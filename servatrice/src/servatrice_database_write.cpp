@@ -0,0 +1,56 @@
+#include "servatrice_database_write.h"
+
+#include <QDebug>
+#include <QStringList>
+
+// false as soon as a statement fails, if stopOnFailure
+static bool executeWrites(const QList<Servatrice_DatabaseWrite> &writes,
+                          Servatrice_DatabaseWriteConnection &connection,
+                          bool stopOnFailure)
+{
+    int first = 0;
+    while (first < writes.size()) {
+        const Servatrice_DatabaseWrite &write = writes[first];
+        if (write.callback) {
+            if (!connection.execWriteCallback(write) && stopOnFailure)
+                return false;
+            ++first;
+            continue;
+        }
+
+        int last = first + 1;
+        while (last < writes.size() && write.canBeMergedWith(writes[last]))
+            ++last;
+
+        QStringList rows;
+        QVariantList values;
+        for (int i = first; i < last; ++i) {
+            rows.append(write.row);
+            values.append(writes[i].values);
+        }
+        const QString queryText = write.prefix + rows.join(", ") + write.suffix;
+        if (!connection.execWriteStatement(queryText, values, last - first > 1) && stopOnFailure)
+            return false;
+
+        first = last;
+    }
+    return true;
+}
+
+void Servatrice_DatabaseWrite::executeBatch(const QList<Servatrice_DatabaseWrite> &writes,
+                                            Servatrice_DatabaseWriteConnection &connection)
+{
+    if (writes.size() > 1 && connection.beginWriteBatch()) {
+        if (executeWrites(writes, connection, true) && connection.commitWriteBatch())
+            return;
+
+        connection.rollbackWriteBatch();
+        qWarning() << "Database write batch failed and was rolled back, retrying its" << writes.size()
+                   << "writes one by one";
+        for (const Servatrice_DatabaseWrite &write : writes)
+            executeWrites({write}, connection, false);
+        return;
+    }
+
+    executeWrites(writes, connection, false);
+}
@@ -0,0 +1,76 @@
+#ifndef SERVATRICE_DATABASE_WRITE_H
+#define SERVATRICE_DATABASE_WRITE_H
+
+#include <QList>
+#include <QString>
+#include <QVariantList>
+#include <functional>
+
+class Servatrice_DatabaseInterface;
+class Servatrice_DatabaseWriteConnection;
+
+/**
+ * A fire-and-forget database write.
+ *
+ * Row writes are a statement split in three parts, so that consecutive writes sharing the same parts can be merged
+ * into a single statement: prefix + row + "," + row + ... + suffix, e.g. a multi-row insert. The values of each row
+ * are bound positionally. Writes that can't be expressed that way provide a callback instead, which is run on the
+ * connection doing the write.
+ */
+class Servatrice_DatabaseWrite
+{
+public:
+    QString prefix;
+    QString row;
+    QString suffix;
+    QVariantList values;
+    std::function<void(Servatrice_DatabaseInterface &)> callback;
+
+    Servatrice_DatabaseWrite(const QString &_prefix,
+                             const QString &_row,
+                             const QVariantList &_values,
+                             const QString &_suffix = QString())
+        : prefix(_prefix), row(_row), suffix(_suffix), values(_values)
+    {
+    }
+    explicit Servatrice_DatabaseWrite(std::function<void(Servatrice_DatabaseInterface &)> _callback)
+        : callback(std::move(_callback))
+    {
+    }
+    bool canBeMergedWith(const Servatrice_DatabaseWrite &other) const
+    {
+        return !callback && !other.callback && prefix == other.prefix && row == other.row && suffix == other.suffix;
+    }
+
+    /**
+     * Executes the writes in one transaction, merging consecutive row writes into a single statement.
+     *
+     * If any statement of the batch fails, the transaction is rolled back and the writes are retried one by one
+     * without a transaction, so that a bad write loses only itself and not the writes batched with it.
+     */
+    static void executeBatch(const QList<Servatrice_DatabaseWrite> &writes,
+                             Servatrice_DatabaseWriteConnection &connection);
+};
+
+/**
+ * The connection a batch of writes is executed on.
+ *
+ * While a write batch is open, a failing statement must leave the connection alone: reconnecting would silently roll
+ * back the writes done so far and run the rest in autocommit.
+ */
+class Servatrice_DatabaseWriteConnection
+{
+public:
+    virtual ~Servatrice_DatabaseWriteConnection() = default;
+
+    // Starts a transaction; false if the connection doesn't support them
+    virtual bool beginWriteBatch() = 0;
+    // false if a statement of the batch failed or the commit did
+    virtual bool commitWriteBatch() = 0;
+    virtual void rollbackWriteBatch() = 0;
+    // merged statements vary in size and shouldn't go through a prepared statement cache
+    virtual bool execWriteStatement(const QString &queryText, const QVariantList &values, bool merged) = 0;
+    virtual bool execWriteCallback(const Servatrice_DatabaseWrite &write) = 0;
+};
+
+#endif
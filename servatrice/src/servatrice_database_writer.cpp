@@ -0,0 +1,96 @@
+#include "servatrice_database_writer.h"
+
+#include "servatrice.h"
+#include "servatrice_database_interface.h"
+
+#include <QElapsedTimer>
+#include <QThread>
+
+#define DATABASE_WRITER_POOL_NUMBER 1999
+
+Servatrice_DatabaseWriter::Servatrice_DatabaseWriter(Servatrice *_server, int _maxQueueSize, int _maxBatchSize)
+    : QObject(), server(_server),
+      databaseInterface(new Servatrice_DatabaseInterface(DATABASE_WRITER_POOL_NUMBER, _server)),
+      maxQueueSize(_maxQueueSize), maxBatchSize(qMax(1, _maxBatchSize)), stopped(false), statistics()
+{
+    connect(this, SIGNAL(sigFlushQueue()), this, SLOT(flushQueue()), Qt::QueuedConnection);
+}
+
+Servatrice_DatabaseWriter::~Servatrice_DatabaseWriter()
+{
+    delete databaseInterface;
+    thread()->quit();
+}
+
+bool Servatrice_DatabaseWriter::enqueue(const Servatrice_DatabaseWrite &write)
+{
+    QMutexLocker locker(&queueMutex);
+    if (stopped)
+        return false;
+
+    if (queue.size() >= maxQueueSize) {
+        ++statistics.blockedEnqueues;
+        while (queue.size() >= maxQueueSize && !stopped)
+            queueNotFull.wait(&queueMutex);
+        if (stopped)
+            return false;
+    }
+
+    queue.append(write);
+    if (queue.size() == 1)
+        emit sigFlushQueue();
+    return true;
+}
+
+void Servatrice_DatabaseWriter::flushQueue()
+{
+    forever
+    {
+        QList<Servatrice_DatabaseWrite> batch;
+        queueMutex.lock();
+        if (queue.isEmpty()) {
+            queueMutex.unlock();
+            return;
+        }
+        if (queue.size() <= maxBatchSize) {
+            batch.swap(queue);
+        } else {
+            batch = queue.mid(0, maxBatchSize);
+            queue.erase(queue.begin(), queue.begin() + maxBatchSize);
+        }
+        queueMutex.unlock();
+
+        QElapsedTimer timer;
+        timer.start();
+        databaseInterface->execWriteBatch(batch);
+        server->getMetrics().observeDatabaseWriteBatch(timer.nsecsElapsed());
+
+        queueMutex.lock();
+        statistics.writes += batch.size();
+        ++statistics.batches;
+        queueNotFull.wakeAll();
+        queueMutex.unlock();
+    }
+}
+
+void Servatrice_DatabaseWriter::drain()
+{
+    // runs the remaining batches on the writer's thread and waits for them
+    QMetaObject::invokeMethod(this, "flushQueue", Qt::BlockingQueuedConnection);
+
+    QMutexLocker locker(&queueMutex);
+    stopped = true;
+    queueNotFull.wakeAll();
+    locker.unlock();
+
+    // writes that slipped in after the flush
+    QMetaObject::invokeMethod(this, "flushQueue", Qt::BlockingQueuedConnection);
+}
+
+Servatrice_DatabaseWriter::Statistics Servatrice_DatabaseWriter::getStatistics()
+{
+    QMutexLocker locker(&queueMutex);
+    Statistics result = statistics;
+    result.queueDepth = queue.size();
+    return result;
+}
@@ -0,0 +1,66 @@
+#ifndef SERVATRICE_DATABASE_WRITER_H
+#define SERVATRICE_DATABASE_WRITER_H
+
+#include "servatrice_database_write.h"
+
+#include <QList>
+#include <QMutex>
+#include <QObject>
+#include <QWaitCondition>
+
+class Servatrice;
+class Servatrice_DatabaseInterface;
+
+/**
+ * Write-behind queue for the database writes that nobody waits for (logs, audit records, session ends, game
+ * results...), so that a slow database doesn't stall the connection pools.
+ *
+ * The writes are executed in batches on a dedicated thread and connection. The queue is bounded: once it is full,
+ * enqueue() blocks until the writer has caught up.
+ */
+class Servatrice_DatabaseWriter : public QObject
+{
+    Q_OBJECT
+public:
+    struct Statistics
+    {
+        int queueDepth;
+        quint64 writes;
+        quint64 batches;
+        quint64 blockedEnqueues;
+    };
+
+private:
+    Servatrice *server;
+    Servatrice_DatabaseInterface *databaseInterface;
+    int maxQueueSize;
+    int maxBatchSize;
+
+    QMutex queueMutex;
+    QWaitCondition queueNotFull;
+    QList<Servatrice_DatabaseWrite> queue;
+    bool stopped;
+    Statistics statistics;
+
+signals:
+    void sigFlushQueue();
+private slots:
+    void flushQueue();
+
+public:
+    Servatrice_DatabaseWriter(Servatrice *_server, int _maxQueueSize, int _maxBatchSize);
+    ~Servatrice_DatabaseWriter() override;
+
+    Servatrice_DatabaseInterface *getDatabaseInterface() const
+    {
+        return databaseInterface;
+    }
+    // Returns false if the writer has been stopped; the caller should then execute the write itself.
+    bool enqueue(const Servatrice_DatabaseWrite &write);
+    // Writes everything still queued and stops accepting writes. Must be called from another thread.
+    void drain();
+    // Returns the counters collected since startup; batch durations are observed in the server metrics
+    Statistics getStatistics();
+};
+
+#endif
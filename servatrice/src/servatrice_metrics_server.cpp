@@ -0,0 +1,51 @@
+#include "servatrice_metrics_server.h"
+
+#include "servatrice.h"
+
+#include <QTcpSocket>
+
+// longest request line we bother to read, anything longer isn't a scrape
+static const int maxRequestLineLength = 1024;
+
+Servatrice_MetricsServer::Servatrice_MetricsServer(Servatrice *_server, QObject *parent)
+    : QTcpServer(parent), server(_server)
+{
+    connect(this, &QTcpServer::newConnection, this, &Servatrice_MetricsServer::acceptConnections);
+}
+
+void Servatrice_MetricsServer::acceptConnections()
+{
+    while (QTcpSocket *socket = nextPendingConnection()) {
+        connect(socket, &QTcpSocket::readyRead, this, &Servatrice_MetricsServer::readRequest);
+        connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+    }
+}
+
+void Servatrice_MetricsServer::readRequest()
+{
+    auto *socket = qobject_cast<QTcpSocket *>(sender());
+    if (!socket)
+        return;
+    if (!socket->canReadLine()) {
+        if (socket->bytesAvailable() > maxRequestLineLength)
+            socket->abort();
+        return;
+    }
+    disconnect(socket, &QTcpSocket::readyRead, this, &Servatrice_MetricsServer::readRequest);
+
+    const QList<QByteArray> requestLine = socket->readLine(maxRequestLineLength).trimmed().split(' ');
+    QByteArray status, body;
+    if (requestLine.size() >= 2 && requestLine[0] == "GET" && requestLine[1] == "/metrics") {
+        status = "200 OK";
+        body = server->getMetricsText();
+    } else {
+        status = "404 Not Found";
+        body = "Not found\n";
+    }
+
+    socket->write("HTTP/1.0 " + status +
+                  "\r\nContent-Type: text/plain; version=0.0.4; charset=utf-8\r\nContent-Length: " +
+                  QByteArray::number(body.size()) + "\r\nConnection: close\r\n\r\n");
+    socket->write(body);
+    socket->disconnectFromHost();
+}
@@ -0,0 +1,27 @@
+#ifndef SERVATRICE_METRICS_SERVER_H
+#define SERVATRICE_METRICS_SERVER_H
+
+#include <QTcpServer>
+
+class Servatrice;
+
+/**
+ * Minimal HTTP server answering GET /metrics with the server metrics in the Prometheus text format.
+ *
+ * It only ever listens on the loopback interface; put a reverse proxy in front of it to scrape it from elsewhere.
+ */
+class Servatrice_MetricsServer : public QTcpServer
+{
+    Q_OBJECT
+private:
+    Servatrice *server;
+
+private slots:
+    void acceptConnections();
+    void readRequest();
+
+public:
+    explicit Servatrice_MetricsServer(Servatrice *_server, QObject *parent = nullptr);
+};
+
+#endif
@@ -0,0 +1,140 @@
+#include "servatrice_storage_listing.h"
+
+#include "pb/response_deck_list.pb.h"
+#include "pb/response_replay_list.pb.h"
+
+#include <QDateTime>
+#include <QHash>
+#include <QList>
+#include <QSqlQuery>
+#include <QVariant>
+
+namespace
+{
+struct DeckStorageEntry
+{
+    int id;
+    QString name;
+    QDateTime uploadTime;
+};
+
+void fillDeckStorageFolder(int folderId,
+                           ServerInfo_DeckStorage_Folder *folder,
+                           const QHash<int, QList<DeckStorageEntry>> &foldersByParent,
+                           const QHash<int, QList<DeckStorageEntry>> &filesByFolder)
+{
+    for (const DeckStorageEntry &subFolder : foldersByParent.value(folderId)) {
+        ServerInfo_DeckStorage_TreeItem *newItem = folder->add_items();
+        newItem->set_id(subFolder.id);
+        newItem->set_name(subFolder.name.toStdString());
+        fillDeckStorageFolder(subFolder.id, newItem->mutable_folder(), foldersByParent, filesByFolder);
+    }
+
+    for (const DeckStorageEntry &file : filesByFolder.value(folderId)) {
+        ServerInfo_DeckStorage_TreeItem *newItem = folder->add_items();
+        newItem->set_id(file.id);
+        newItem->set_name(file.name.toStdString());
+
+        ServerInfo_DeckStorage_File *newFile = newItem->mutable_file();
+        newFile->set_creation_time(file.uploadTime.toSecsSinceEpoch());
+    }
+}
+} // namespace
+
+bool Servatrice_StorageListing::listDecks(Servatrice_QueryConnection &connection,
+                                          int userId,
+                                          ServerInfo_DeckStorage_Folder *root)
+{
+    QSqlQuery *query = connection.prepareQuery(
+        "select id, id_parent, name from {prefix}_decklist_folders where id_user = :id_user order by id");
+    query->bindValue(":id_user", userId);
+    if (!connection.execSqlQuery(query))
+        return false;
+
+    QHash<int, QList<DeckStorageEntry>> foldersByParent;
+    while (query->next())
+        foldersByParent[query->value(1).toInt()].append({query->value(0).toInt(), query->value(2).toString(), {}});
+
+    query = connection.prepareQuery(
+        "select id, id_folder, name, upload_time from {prefix}_decklist_files where id_user = :id_user order by id");
+    query->bindValue(":id_user", userId);
+    if (!connection.execSqlQuery(query))
+        return false;
+
+    QHash<int, QList<DeckStorageEntry>> filesByFolder;
+    while (query->next())
+        filesByFolder[query->value(1).toInt()].append(
+            {query->value(0).toInt(), query->value(2).toString(), query->value(3).toDateTime()});
+
+    fillDeckStorageFolder(0, root, foldersByParent, filesByFolder);
+    return true;
+}
+
+bool Servatrice_StorageListing::listReplays(Servatrice_QueryConnection &connection,
+                                            int userId,
+                                            int firstMatch,
+                                            int maxMatches,
+                                            Response_ReplayList &result)
+{
+    // the matches the user may see, newest first, limited to the requested page
+    const QString visibleMatches =
+        "select a.id_game, a.replay_name, a.do_not_hide, b.room_name, b.time_started, b.time_finished, b.descr from "
+        "{prefix}_replays_access a left join {prefix}_games b on b.id = a.id_game where a.id_player = :id_player and "
+        "(a.do_not_hide = 1 or date_add(b.time_started, interval 7 day) > now()) order by a.id_game desc limit "
+        ":first_match, :max_matches";
+
+    QSqlQuery *matchQuery = connection.prepareQuery(
+        "select m.id_game, m.replay_name, m.do_not_hide, m.room_name, m.time_started, m.time_finished, m.descr, r.id, "
+        "r.duration from (" +
+        visibleMatches + ") m left join {prefix}_replays r on r.id_game = m.id_game order by m.id_game desc, r.id");
+    matchQuery->bindValue(":id_player", userId);
+    matchQuery->bindValue(":first_match", firstMatch);
+    matchQuery->bindValue(":max_matches", maxMatches);
+    if (!connection.execSqlQuery(matchQuery))
+        return false;
+
+    QHash<int, ServerInfo_ReplayMatch *> matches;
+    while (matchQuery->next()) {
+        const int gameId = matchQuery->value(0).toInt();
+        const QString replayName = matchQuery->value(1).toString();
+
+        ServerInfo_ReplayMatch *matchInfo = matches.value(gameId);
+        if (!matchInfo) {
+            matchInfo = result.add_match_list();
+            matches.insert(gameId, matchInfo);
+
+            matchInfo->set_game_id(gameId);
+            matchInfo->set_room_name(matchQuery->value(3).toString().toStdString());
+            const int timeStarted = matchQuery->value(4).toDateTime().toSecsSinceEpoch();
+            const int timeFinished = matchQuery->value(5).toDateTime().toSecsSinceEpoch();
+            matchInfo->set_time_started(timeStarted);
+            matchInfo->set_length(timeFinished - timeStarted);
+            matchInfo->set_game_name(matchQuery->value(6).toString().toStdString());
+            matchInfo->set_do_not_hide(matchQuery->value(2).toBool());
+        }
+
+        if (!matchQuery->value(7).isNull()) {
+            ServerInfo_Replay *replayInfo = matchInfo->add_replay_list();
+            replayInfo->set_replay_id(matchQuery->value(7).toInt());
+            replayInfo->set_replay_name(replayName.toStdString());
+            replayInfo->set_duration(matchQuery->value(8).toInt());
+        }
+    }
+
+    if (matches.isEmpty())
+        return true;
+
+    QSqlQuery *playerQuery = connection.prepareQuery("select m.id_game, p.player_name from (" + visibleMatches +
+                                                     ") m join {prefix}_games_players p on p.id_game = m.id_game");
+    playerQuery->bindValue(":id_player", userId);
+    playerQuery->bindValue(":first_match", firstMatch);
+    playerQuery->bindValue(":max_matches", maxMatches);
+    if (!connection.execSqlQuery(playerQuery))
+        return false;
+    while (playerQuery->next()) {
+        ServerInfo_ReplayMatch *matchInfo = matches.value(playerQuery->value(0).toInt());
+        if (matchInfo)
+            matchInfo->add_player_names(playerQuery->value(1).toString().toStdString());
+    }
+    return true;
+}
@@ -0,0 +1,45 @@
+#ifndef SERVATRICE_STORAGE_LISTING_H
+#define SERVATRICE_STORAGE_LISTING_H
+
+#include <QString>
+
+class QSqlQuery;
+class Response_ReplayList;
+class ServerInfo_DeckStorage_Folder;
+
+/**
+ * The connection the storage listings are read from. Query texts use the {prefix} placeholder for the table prefix.
+ */
+class Servatrice_QueryConnection
+{
+public:
+    virtual ~Servatrice_QueryConnection() = default;
+
+    virtual QSqlQuery *prepareQuery(const QString &queryText) = 0;
+    virtual bool execSqlQuery(QSqlQuery *query) = 0;
+};
+
+/**
+ * The deck storage and replay listings of a user, each read with a fixed number of set based queries however many
+ * folders or matches there are.
+ */
+class Servatrice_StorageListing
+{
+public:
+    /**
+     * Loads all folders and all files of the user with one query each and builds the tree in memory.
+     * Folders and files that can't be reached from the root folder are left out.
+     */
+    static bool listDecks(Servatrice_QueryConnection &connection, int userId, ServerInfo_DeckStorage_Folder *root);
+    /**
+     * Adds the matches the user may see to result, newest first, skipping the first firstMatch of them and
+     * returning at most maxMatches: one query for the matches and their replays, one for their players.
+     */
+    static bool listReplays(Servatrice_QueryConnection &connection,
+                            int userId,
+                            int firstMatch,
+                            int maxMatches,
+                            Response_ReplayList &result);
+};
+
+#endif
@@ -0,0 +1,41 @@
+#include "servatrice_user_id_cache.h"
+
+Servatrice_UserIdCache::Servatrice_UserIdCache(int maxEntries, qint64 _ttlMsecs)
+    : cache(maxEntries), ttlMsecs(_ttlMsecs)
+{
+    clock.start();
+}
+
+bool Servatrice_UserIdCache::lookup(const QString &name, int &id)
+{
+    QMutexLocker locker(&mutex);
+
+    // object() also marks the entry as most recently used
+    Entry *entry = cache.object(name);
+    if (!entry)
+        return false;
+    if (entry->expiresAt <= clock.elapsed()) {
+        cache.remove(name);
+        return false;
+    }
+    id = entry->id;
+    return true;
+}
+
+void Servatrice_UserIdCache::insert(const QString &name, int id)
+{
+    QMutexLocker locker(&mutex);
+    cache.insert(name, new Entry{id, clock.elapsed() + ttlMsecs});
+}
+
+void Servatrice_UserIdCache::invalidate(const QString &name)
+{
+    QMutexLocker locker(&mutex);
+    cache.remove(name);
+}
+
+int Servatrice_UserIdCache::size()
+{
+    QMutexLocker locker(&mutex);
+    return static_cast<int>(cache.size());
+}
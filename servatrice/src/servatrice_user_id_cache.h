@@ -0,0 +1,39 @@
+#ifndef SERVATRICE_USER_ID_CACHE_H
+#define SERVATRICE_USER_ID_CACHE_H
+
+#include <QCache>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QString>
+
+/**
+ * Least recently used cache of user name -> database id, shared by all the connection pools.
+ *
+ * Only ids of existing, active accounts are cached. Accounts can be renamed or deleted behind the server's back, so
+ * entries also expire after a while; the server invalidates the entries it knows to be stale itself.
+ */
+class Servatrice_UserIdCache
+{
+private:
+    struct Entry
+    {
+        int id;
+        qint64 expiresAt;
+    };
+
+    QMutex mutex;
+    QCache<QString, Entry> cache;
+    qint64 ttlMsecs;
+    QElapsedTimer clock;
+
+public:
+    Servatrice_UserIdCache(int maxEntries, qint64 _ttlMsecs);
+
+    // Returns false if the name isn't cached or its entry has expired
+    bool lookup(const QString &name, int &id);
+    void insert(const QString &name, int id);
+    void invalidate(const QString &name);
+    int size();
+};
+
+#endif
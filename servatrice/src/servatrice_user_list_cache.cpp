@@ -0,0 +1,51 @@
+#include "servatrice_user_list_cache.h"
+
+void Servatrice_UserListCache::setList(ListType type, const QString &userName, const QStringList &names)
+{
+    QSet<QString> list;
+    for (const QString &name : names)
+        list.insert(key(name));
+
+    QWriteLocker locker(&lock);
+    UserLists &lists = users[key(userName)];
+    lists.names[type].swap(list);
+    lists.loaded[type] = true;
+}
+
+void Servatrice_UserListCache::removeUser(const QString &userName)
+{
+    QWriteLocker locker(&lock);
+    users.remove(key(userName));
+}
+
+bool Servatrice_UserListCache::lookup(ListType type, const QString &whoseList, const QString &who, bool &contains) const
+{
+    QReadLocker locker(&lock);
+    auto it = users.constFind(key(whoseList));
+    if (it == users.constEnd() || !it->loaded[type])
+        return false;
+    contains = it->names[type].contains(key(who));
+    return true;
+}
+
+void Servatrice_UserListCache::addToList(ListType type, const QString &whoseList, const QString &who)
+{
+    QWriteLocker locker(&lock);
+    auto it = users.find(key(whoseList));
+    if (it != users.end() && it->loaded[type])
+        it->names[type].insert(key(who));
+}
+
+void Servatrice_UserListCache::removeFromList(ListType type, const QString &whoseList, const QString &who)
+{
+    QWriteLocker locker(&lock);
+    auto it = users.find(key(whoseList));
+    if (it != users.end() && it->loaded[type])
+        it->names[type].remove(key(who));
+}
+
+int Servatrice_UserListCache::size() const
+{
+    QReadLocker locker(&lock);
+    return static_cast<int>(users.size());
+}
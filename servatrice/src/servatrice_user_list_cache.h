@@ -0,0 +1,53 @@
+#ifndef SERVATRICE_USER_LIST_CACHE_H
+#define SERVATRICE_USER_LIST_CACHE_H
+
+#include <QHash>
+#include <QReadWriteLock>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+
+/**
+ * Buddy and ignore lists of the users that are logged in, shared by all the connection pools.
+ *
+ * A user's lists are loaded from the database when they log in, kept current by the add/remove list commands and
+ * dropped when they log out. Lookups on a list that isn't cached fail, and the caller then has to ask the database.
+ * Names are compared case insensitively, like the database does.
+ */
+class Servatrice_UserListCache
+{
+public:
+    enum ListType
+    {
+        BuddyList,
+        IgnoreList
+    };
+
+private:
+    struct UserLists
+    {
+        QSet<QString> names[2];
+        bool loaded[2] = {false, false};
+    };
+
+    mutable QReadWriteLock lock;
+    QHash<QString, UserLists> users;
+
+    static QString key(const QString &name)
+    {
+        return name.toLower();
+    }
+
+public:
+    // Replaces the cached list of userName
+    void setList(ListType type, const QString &userName, const QStringList &names);
+    void removeUser(const QString &userName);
+    // Returns false if the list of whoseList isn't cached
+    bool lookup(ListType type, const QString &whoseList, const QString &who, bool &contains) const;
+    // These do nothing unless the list of whoseList is cached
+    void addToList(ListType type, const QString &whoseList, const QString &who);
+    void removeFromList(ListType type, const QString &whoseList, const QString &who);
+    int size() const;
+};
+
+#endif
@@ -6,23 +6,39 @@
 #include <QDir>
 #include <QFile>
 #include <QFileInfo>
-#include <QTextStream>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTimer>
 #include <iostream>
 
 ServerLogger::ServerLogger(bool _logToConsole, QObject *parent)
-    : QObject(parent), logToConsole(_logToConsole), flushRunning(false)
+    : QObject(parent), logToConsole(_logToConsole), flushRunning(false), config(nullptr), queueTail(new Entry),
+      queueDepth(0), droppedMessages(0), wakeupPending(0), unflushedBytes(0), flushTimer(new QTimer(this))
 {
+    // the queue always holds one consumed entry that the producers link the next one to
+    queueTail->next.storeRelease(nullptr);
+    queueHead.storeRelease(queueTail);
+
+    flushTimer->setSingleShot(true);
+    connect(flushTimer, SIGNAL(timeout()), this, SLOT(flushFile()));
+    connect(this, SIGNAL(sigFlushBuffer()), this, SLOT(flushBuffer()), Qt::QueuedConnection);
 }
 
 ServerLogger::~ServerLogger()
 {
     flushBuffer();
+    flushFile();
+    delete queueTail;
+    delete config.loadAcquire();
+    qDeleteAll(retiredConfigs);
     // This does not work with the destroyed() signal as this destructor is called after the main event loop is done.
     thread()->quit();
 }
 
 void ServerLogger::startLog(const QString &logFileName)
 {
+    reloadConfiguration();
+
     if (!logFileName.isEmpty()) {
         QFileInfo fi(logFileName);
         QDir fileDir(fi.path());
@@ -41,8 +57,30 @@ void ServerLogger::startLog(const QString &logFileName)
         }
     } else
         logFile = 0;
+}
 
-    connect(this, SIGNAL(sigFlushBuffer()), this, SLOT(flushBuffer()), Qt::QueuedConnection);
+void ServerLogger::reloadConfiguration()
+{
+    auto *newConfig = new Config;
+    newConfig->writeLog = settingsCache->value("server/writelog", 1).toBool();
+#if (QT_VERSION >= QT_VERSION_CHECK(5, 14, 0))
+    const QStringList logFilters = settingsCache->value("server/logfilters").toString().split(",", Qt::SkipEmptyParts);
+#else
+    const QStringList logFilters =
+        settingsCache->value("server/logfilters").toString().split(",", QString::SkipEmptyParts);
+#endif
+    for (const QString &logFilter : logFilters)
+        if (!logFilter.trimmed().isEmpty())
+            newConfig->filters.append(QStringMatcher(logFilter, Qt::CaseInsensitive));
+    newConfig->format =
+        settingsCache->value("server/logformat", "text").toString() == "json" ? JsonFormat : TextFormat;
+    newConfig->queueSize = qMax(settingsCache->value("server/logqueue_size", 100000).toInt(), 1);
+    newConfig->flushInterval = qMax(settingsCache->value("server/logflush_interval", 500).toInt(), 0);
+    newConfig->flushSize = qMax(settingsCache->value("server/logflush_size", 65536).toInt(), 0);
+
+    const Config *oldConfig = config.fetchAndStoreOrdered(newConfig);
+    if (oldConfig)
+        retiredConfigs.append(oldConfig);
 }
 
 void ServerLogger::logMessage(const QString &message, void *caller)
@@ -50,66 +88,110 @@ void ServerLogger::logMessage(const QString &message, void *caller)
     if (!logFile)
         return;
 
-    QString callerString;
-    if (caller)
-        callerString = QString::number((qulonglong)caller, 16) + " ";
-
     // filter out all log entries based on values in configuration file
-    bool shouldWeWriteLog = settingsCache->value("server/writelog", 1).toBool();
-    QString logFilters = settingsCache->value("server/logfilters").toString();
-#if (QT_VERSION >= QT_VERSION_CHECK(5, 14, 0))
-    QStringList listlogFilters = logFilters.split(",", Qt::SkipEmptyParts);
-#else
-    QStringList listlogFilters = logFilters.split(",", QString::SkipEmptyParts);
-#endif
-    bool shouldWeSkipLine = false;
-
-    if (!shouldWeWriteLog)
+    const Config *currentConfig = config.loadAcquire();
+    if (!currentConfig || !currentConfig->writeLog)
         return;
 
-    if (!logFilters.trimmed().isEmpty()) {
-        shouldWeSkipLine = true;
-        for (const QString &logFilter : listlogFilters) {
-            if (message.contains(logFilter, Qt::CaseInsensitive)) {
+    if (!currentConfig->filters.isEmpty()) {
+        bool shouldWeSkipLine = true;
+        for (const QStringMatcher &logFilter : currentConfig->filters) {
+            if (logFilter.indexIn(message) != -1) {
                 shouldWeSkipLine = false;
                 break;
             }
         }
+        if (shouldWeSkipLine)
+            return;
     }
 
-    if (shouldWeSkipLine)
+    if (queueDepth.fetchAndAddRelaxed(1) >= currentConfig->queueSize) {
+        queueDepth.fetchAndSubRelaxed(1);
+        droppedMessages.fetchAndAddRelaxed(1);
         return;
+    }
 
-    bufferMutex.lock();
-    buffer.append(QDateTime::currentDateTime().toString() + " " + callerString + message);
-    bufferMutex.unlock();
-    emit sigFlushBuffer();
+    auto *entry = new Entry;
+    entry->next.storeRelease(nullptr);
+    entry->time = QDateTime::currentMSecsSinceEpoch();
+    entry->caller = reinterpret_cast<quintptr>(caller);
+    entry->message = message;
+
+    // Vyukov's intrusive queue: claim the head, then link the previous head to the new entry. Until that link is
+    // stored the logger thread stops at the previous entry, it will be woken up again below.
+    Entry *previous = queueHead.fetchAndStoreAcqRel(entry);
+    previous->next.storeRelease(entry);
+
+    // only one wakeup is posted until the logger thread starts draining
+    if (wakeupPending.fetchAndStoreAcqRel(1) == 0)
+        emit sigFlushBuffer();
+}
+
+QByteArray ServerLogger::formatEntry(const Entry &entry, LogFormat format) const
+{
+    const QDateTime time = QDateTime::fromMSecsSinceEpoch(entry.time);
+    if (format == JsonFormat) {
+        QJsonObject line;
+        line.insert("time", time.toString(Qt::ISODateWithMs));
+        if (entry.caller)
+            line.insert("caller", QString::number(static_cast<qulonglong>(entry.caller), 16));
+        line.insert("message", entry.message);
+        return QJsonDocument(line).toJson(QJsonDocument::Compact) + "\n";
+    }
+
+    QString callerString;
+    if (entry.caller)
+        callerString = QString::number(static_cast<qulonglong>(entry.caller), 16) + " ";
+    return (time.toString() + " " + callerString + entry.message).toUtf8() + "\n";
 }
 
 void ServerLogger::flushBuffer()
 {
-    if (flushRunning)
+    if (flushRunning || !logFile)
         return;
 
     flushRunning = true;
-    QTextStream stream(logFile);
+    // messages pushed from now on post a new wakeup
+    wakeupPending.fetchAndStoreAcqRel(0);
+
+    const Config *currentConfig = config.loadAcquire();
+    const LogFormat format = currentConfig ? currentConfig->format : TextFormat;
+    QByteArray batch;
     forever
     {
-        bufferMutex.lock();
-        if (buffer.isEmpty()) {
-            bufferMutex.unlock();
-            flushRunning = false;
-            return;
-        }
-        QString message = buffer.takeFirst();
-        bufferMutex.unlock();
+        Entry *next = queueTail->next.loadAcquire();
+        if (!next)
+            break;
+        delete queueTail;
+        queueTail = next;
+        queueDepth.fetchAndSubRelaxed(1);
+        batch += formatEntry(*next, format);
+        // the entry stays in the queue as the one to link to, its text is not needed anymore
+        next->message.clear();
+    }
 
-        stream << message << "\n";
-        stream.flush();
+    if (!batch.isEmpty()) {
+        logFile->write(batch);
+        unflushedBytes += batch.size();
+        if (logToConsole) {
+            std::cout.write(batch.constData(), batch.size());
+            std::cout.flush();
+        }
 
-        if (logToConsole)
-            std::cout << message.toStdString() << std::endl;
+        if (!currentConfig || unflushedBytes >= currentConfig->flushSize)
+            flushFile();
+        else if (!flushTimer->isActive())
+            flushTimer->start(currentConfig->flushInterval);
     }
+    flushRunning = false;
+}
+
+void ServerLogger::flushFile()
+{
+    flushTimer->stop();
+    if (logFile)
+        logFile->flush();
+    unflushedBytes = 0;
 }
 
 void ServerLogger::rotateLogs()
@@ -118,6 +200,7 @@ void ServerLogger::rotateLogs()
         return;
 
     flushBuffer();
+    flushFile();
 
     logFile->close();
     logFile->open(QIODevice::Append);
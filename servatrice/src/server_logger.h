@@ -1,36 +1,96 @@
 #ifndef SERVER_LOGGER_H
 #define SERVER_LOGGER_H
 
-#include <QMutex>
+#include <QAtomicInteger>
+#include <QAtomicPointer>
+#include <QByteArray>
+#include <QList>
 #include <QObject>
-#include <QStringList>
+#include <QStringMatcher>
 #include <QThread>
-#include <QWaitCondition>
+#include <QVector>
 
 class QFile;
+class QTimer;
 class Server_ProtocolHandler;
 
+/**
+ * Writes the server log from its own thread.
+ *
+ * logMessage() may be called from any thread: it checks the message against the filters compiled by
+ * reloadConfiguration() and pushes it onto a lock-free queue, dropping it if the queue is full. The logger thread
+ * drains the queue in batches, formats the lines as plain text or JSON lines and flushes the file once enough bytes
+ * piled up or the flush interval elapsed.
+ */
 class ServerLogger : public QObject
 {
     Q_OBJECT
 public:
     ServerLogger(bool _logToConsole, QObject *parent = 0);
     ~ServerLogger();
+
+    int getQueueDepth() const
+    {
+        return queueDepth.loadAcquire();
+    }
+    quint64 getDroppedMessages() const
+    {
+        return droppedMessages.loadAcquire();
+    }
 public slots:
     void startLog(const QString &logFileName);
     void logMessage(const QString &message, void *caller = 0);
     void rotateLogs();
+    // Compiles the log settings again; called at startup and after the configuration is reloaded
+    void reloadConfiguration();
 private slots:
     void flushBuffer();
+    void flushFile();
 signals:
     void sigFlushBuffer();
 
 private:
+    enum LogFormat
+    {
+        TextFormat,
+        JsonFormat
+    };
+    struct Config
+    {
+        bool writeLog;
+        QVector<QStringMatcher> filters;
+        LogFormat format;
+        int queueSize;
+        int flushInterval;
+        int flushSize;
+    };
+    // node of the multi producer single consumer queue, see logMessage()
+    struct Entry
+    {
+        QAtomicPointer<Entry> next;
+        qint64 time;
+        quintptr caller;
+        QString message;
+    };
+
     bool logToConsole;
     static QFile *logFile;
     bool flushRunning;
-    QStringList buffer;
-    QMutex bufferMutex;
+
+    // replaced configurations are kept alive until the logger is destroyed, as a caller might still be reading one
+    QAtomicPointer<const Config> config;
+    QList<const Config *> retiredConfigs;
+
+    QAtomicPointer<Entry> queueHead; // last pushed, written by the producers
+    Entry *queueTail;                // next to pop, only touched by the logger thread
+    QAtomicInt queueDepth;
+    QAtomicInteger<quint64> droppedMessages;
+    QAtomicInt wakeupPending;
+
+    int unflushedBytes;
+    QTimer *flushTimer;
+
+    QByteArray formatEntry(const Entry &entry, LogFormat format) const;
 };
 
 #endif
@@ -60,7 +60,10 @@
 #include "pb/serverinfo_replay.pb.h"
 #include "pb/serverinfo_user.pb.h"
 #include "servatrice.h"
+#include "servatrice_authentication_pool.h"
 #include "servatrice_database_interface.h"
+#include "servatrice_storage_listing.h"
+#include "servatrice_user_list_cache.h"
 #include "server_logger.h"
 #include "server_player.h"
 #include "server_response_containers.h"
@@ -71,26 +74,45 @@
 
 #include <QDateTime>
 #include <QDebug>
+#include <QElapsedTimer>
+#include <QHash>
 #include <QHostAddress>
 #include <QRegularExpression>
 #include <QSqlError>
 #include <QSqlQuery>
 #include <QString>
+#include <climits>
 #include <iostream>
 #include <string>
 
 static const int protocolVersion = 14;
+// commands a client may send while its login is being checked; a well behaved client waits for the response
+static const int maxDeferredCommands = 32;
 
 AbstractServerSocketInterface::AbstractServerSocketInterface(Servatrice *_server,
                                                              Servatrice_DatabaseInterface *_databaseInterface,
                                                              QObject *parent)
     : Server_ProtocolHandler(_server, _databaseInterface, parent), servatrice(_server),
-      sqlInterface(reinterpret_cast<Servatrice_DatabaseInterface *>(databaseInterface))
+      outputCompressionThreshold(0),
+      sqlInterface(reinterpret_cast<Servatrice_DatabaseInterface *>(databaseInterface)), passwordHashPending(false)
 {
+    // Optionally hold back output for a few milliseconds so everything queued in that window goes out in one write.
+    // The timer is a child of this object, so it follows it into the connection pool thread.
+    flushTimer = new QTimer(this);
+    flushTimer->setSingleShot(true);
+    flushTimer->setInterval(qMax(0, servatrice->getOutputCoalescingWindow()));
+    connect(flushTimer, SIGNAL(timeout()), this, SLOT(flushOutputQueue()));
+
     // Never call flushOutputQueue directly from outputQueueChanged. In case of a socket error,
     // it could lead to this object being destroyed while another function is still on the call stack. -> mutex
     // deadlocks etc.
-    connect(this, SIGNAL(outputQueueChanged()), this, SLOT(flushOutputQueue()), Qt::QueuedConnection);
+    connect(this, SIGNAL(outputQueueChanged()), this, SLOT(scheduleFlush()), Qt::QueuedConnection);
+}
+
+AbstractServerSocketInterface::~AbstractServerSocketInterface()
+{
+    if (passwordHashPending && servatrice->getAuthenticationPool())
+        servatrice->getAuthenticationPool()->cancel(this);
 }
 
 bool AbstractServerSocketInterface::initSession()
@@ -137,12 +159,126 @@ void AbstractServerSocketInterface::catchSocketDisconnected()
 }
 
 void AbstractServerSocketInterface::transmitProtocolItem(const ServerMessage &item)
+{
+    // Serialize right away instead of deep-copying the message into the queue
+    transmitSerializedItem(SerializedServerMessage(item));
+}
+
+void AbstractServerSocketInterface::transmitSerializedItem(const SerializedServerMessage &item)
 {
     outputQueueMutex.lock();
+    const bool wasEmpty = outputQueue.isEmpty();
     outputQueue.append(item);
     outputQueueMutex.unlock();
 
-    emit outputQueueChanged();
+    // a flush is already pending for a non-empty queue, and it will take this item along
+    if (wasEmpty)
+        emit outputQueueChanged();
+}
+
+void AbstractServerSocketInterface::enableOutputCompression()
+{
+    outputCompressionThreshold = qMax(0, servatrice->getOutputCompressionThreshold());
+}
+
+void AbstractServerSocketInterface::compressOutputItems(QList<SerializedServerMessage> &items)
+{
+    if (outputCompressionThreshold == 0)
+        return;
+
+    ServerMetrics &metrics = servatrice->getMetrics();
+    for (SerializedServerMessage &item : items) {
+        if (item.getPayloadSize() < outputCompressionThreshold)
+            continue;
+
+        QElapsedTimer timer;
+        timer.start();
+        bool compressedNow;
+        SerializedServerMessage compressedItem = item.compressed(&compressedNow);
+        if (compressedNow)
+            metrics.observeOutputCompressionTime(timer.nsecsElapsed());
+        const int sentSize = compressedItem.isNull() ? item.getPayloadSize() : compressedItem.getPayloadSize();
+        metrics.observeOutputCompression(item.getPayloadSize(), sentSize);
+        if (!compressedItem.isNull())
+            item = compressedItem;
+    }
+}
+
+void AbstractServerSocketInterface::scheduleFlush()
+{
+    if (flushTimer->interval() == 0)
+        flushOutputQueue();
+    else if (!flushTimer->isActive())
+        flushTimer->start();
+}
+
+void AbstractServerSocketInterface::processIncomingCommandContainer(const CommandContainer &cont)
+{
+    if (passwordHashPending) {
+        if (deferredCommandContainers.size() >= maxDeferredCommands) {
+            qDebug() << "Too many commands sent during login by" << getAddress();
+            prepareDestroy();
+            return;
+        }
+        deferredCommandContainers.append(cont);
+        return;
+    }
+
+    if (!startPasswordHash(cont))
+        processCommandContainer(cont);
+}
+
+bool AbstractServerSocketInterface::startPasswordHash(const CommandContainer &cont)
+{
+    Servatrice_AuthenticationPool *authenticationPool = servatrice->getAuthenticationPool();
+    if (!authenticationPool || userInfo || cont.session_command_size() != 1)
+        return false;
+    const SessionCommand &sc = cont.session_command(0);
+    if (!sc.HasExtension(Command_Login::ext))
+        return false;
+    const Command_Login &cmd = sc.GetExtension(Command_Login::ext);
+    // over-long passwords are refused by cmdLogin without hashing them
+    if (!cmd.has_password() || cmd.password().length() > MAX_NAME_LENGTH)
+        return false;
+
+    // unknown users log in without a password check
+    const QString salt = sqlInterface->getUserSalt(nameFromStdString(cmd.user_name()).simplified());
+    if (salt.isEmpty())
+        return false;
+
+    switch (authenticationPool->submit(this, "passwordHashComputed", getAddress(),
+                                       QString::fromStdString(cmd.password()), salt)) {
+        case Servatrice_AuthenticationPool::Accepted:
+            passwordHashPending = true;
+            pendingLoginContainer = cont;
+            break;
+        case Servatrice_AuthenticationPool::QueueFull:
+        case Servatrice_AuthenticationPool::TooManyFromAddress: {
+            qDebug() << "Login refused: too many pending logins, address" << getAddress();
+            ResponseContainer rc(cont.has_cmd_id() ? cont.cmd_id() : -1);
+            sendResponseContainer(rc, Response::RespTooManyRequests);
+            break;
+        }
+    }
+    return true;
+}
+
+void AbstractServerSocketInterface::passwordHashComputed(const QString &hashedPassword)
+{
+    passwordHashPending = false;
+
+    // continue the login as if the client had sent the hashed password itself
+    CommandContainer cont;
+    cont.Swap(&pendingLoginContainer);
+    Command_Login *cmd = cont.mutable_session_command(0)->MutableExtension(Command_Login::ext);
+    cmd->clear_password();
+    cmd->set_hashed_password(hashedPassword.toStdString());
+    processCommandContainer(cont);
+    if (authState != NotLoggedIn)
+        usingRealPassword = true;
+
+    while (!passwordHashPending && !deferredCommandContainers.isEmpty())
+        processIncomingCommandContainer(deferredCommandContainers.takeFirst());
 }
 
 void AbstractServerSocketInterface::logDebugMessage(const QString &message)
@@ -287,6 +423,11 @@ Response::ResponseCode AbstractServerSocketInterface::cmdAddToList(const Command
     if (!sqlInterface->execSqlQuery(query))
         return Response::RespInternalError;
 
+    if (Servatrice_UserListCache *userListCache = servatrice->getUserListCache())
+        userListCache->addToList(list == "buddy" ? Servatrice_UserListCache::BuddyList
+                                                 : Servatrice_UserListCache::IgnoreList,
+                                 QString::fromStdString(userInfo->name()), user);
+
     Event_AddToList event;
     event.set_list_name(cmd.list());
     event.mutable_user_info()->CopyFrom(databaseInterface->getUserData(user));
@@ -326,6 +467,11 @@ Response::ResponseCode AbstractServerSocketInterface::cmdRemoveFromList(const Co
     if (!sqlInterface->execSqlQuery(query))
         return Response::RespInternalError;
 
+    if (Servatrice_UserListCache *userListCache = servatrice->getUserListCache())
+        userListCache->removeFromList(list == "buddy" ? Servatrice_UserListCache::BuddyList
+                                                      : Servatrice_UserListCache::IgnoreList,
+                                      QString::fromStdString(userInfo->name()), user);
+
     Event_RemoveFromList event;
     event.set_list_name(cmd.list());
     event.set_user_name(cmd.user_name());
@@ -362,46 +508,6 @@ int AbstractServerSocketInterface::getDeckPathId(const QString &path)
     return getDeckPathId(0, path.split("/"));
 }
 
-bool AbstractServerSocketInterface::deckListHelper(int folderId, ServerInfo_DeckStorage_Folder *folder)
-{
-    QSqlQuery *query = sqlInterface->prepareQuery(
-        "select id, name from {prefix}_decklist_folders where id_parent = :id_parent and id_user = :id_user");
-    query->bindValue(":id_parent", folderId);
-    query->bindValue(":id_user", userInfo->id());
-    if (!sqlInterface->execSqlQuery(query))
-        return false;
-
-    QMap<int, QString> results;
-    while (query->next())
-        results[query->value(0).toInt()] = query->value(1).toString();
-
-    for (int key : results.keys()) {
-        ServerInfo_DeckStorage_TreeItem *newItem = folder->add_items();
-        newItem->set_id(key);
-        newItem->set_name(results.value(key).toStdString());
-
-        if (!deckListHelper(newItem->id(), newItem->mutable_folder()))
-            return false;
-    }
-
-    query = sqlInterface->prepareQuery("select id, name, upload_time from {prefix}_decklist_files where id_folder = "
-                                       ":id_folder and id_user = :id_user");
-    query->bindValue(":id_folder", folderId);
-    query->bindValue(":id_user", userInfo->id());
-    if (!sqlInterface->execSqlQuery(query))
-        return false;
-
-    while (query->next()) {
-        ServerInfo_DeckStorage_TreeItem *newItem = folder->add_items();
-        newItem->set_id(query->value(0).toInt());
-        newItem->set_name(query->value(1).toString().toStdString());
-
-        ServerInfo_DeckStorage_File *newFile = newItem->mutable_file();
-        newFile->set_creation_time(query->value(2).toDateTime().toSecsSinceEpoch());
-    }
-
-    return true;
-}
 
 // CHECK AUTHENTICATION!
 // Also check for every function that data belonging to other users cannot be accessed.
@@ -417,7 +523,7 @@ Response::ResponseCode AbstractServerSocketInterface::cmdDeckList(const Command_
     Response_DeckList *re = new Response_DeckList;
     ServerInfo_DeckStorage_Folder *root = re->mutable_root();
 
-    if (!deckListHelper(0, root))
+    if (!Servatrice_StorageListing::listDecks(*sqlInterface, userInfo->id(), root))
         return Response::RespContextError;
 
     rc.setResponseExtension(re);
@@ -608,54 +714,20 @@ Response::ResponseCode AbstractServerSocketInterface::cmdDeckDownload(const Comm
     return Response::RespOk;
 }
 
-Response::ResponseCode AbstractServerSocketInterface::cmdReplayList(const Command_ReplayList & /*cmd*/,
+Response::ResponseCode AbstractServerSocketInterface::cmdReplayList(const Command_ReplayList &cmd,
                                                                     ResponseContainer &rc)
 {
     if (authState != PasswordRight)
         return Response::RespFunctionNotAllowed;
 
-    Response_ReplayList *re = new Response_ReplayList;
+    const int firstMatch = static_cast<int>(qMin<quint32>(cmd.first_match(), INT_MAX));
+    const int maxMatches =
+        cmd.max_matches() > 0 ? static_cast<int>(qMin<quint32>(cmd.max_matches(), INT_MAX)) : INT_MAX;
 
-    QSqlQuery *query1 = sqlInterface->prepareQuery(
-        "select a.id_game, a.replay_name, b.room_name, b.time_started, b.time_finished, b.descr, a.do_not_hide from "
-        "{prefix}_replays_access a left join {prefix}_games b on b.id = a.id_game where a.id_player = :id_player and "
-        "(a.do_not_hide = 1 or date_add(b.time_started, interval 7 day) > now())");
-    query1->bindValue(":id_player", userInfo->id());
-    sqlInterface->execSqlQuery(query1);
-    while (query1->next()) {
-        ServerInfo_ReplayMatch *matchInfo = re->add_match_list();
-
-        const int gameId = query1->value(0).toInt();
-        matchInfo->set_game_id(gameId);
-        matchInfo->set_room_name(query1->value(2).toString().toStdString());
-        const int timeStarted = query1->value(3).toDateTime().toSecsSinceEpoch();
-        const int timeFinished = query1->value(4).toDateTime().toSecsSinceEpoch();
-        matchInfo->set_time_started(timeStarted);
-        matchInfo->set_length(timeFinished - timeStarted);
-        matchInfo->set_game_name(query1->value(5).toString().toStdString());
-        const QString replayName = query1->value(1).toString();
-        matchInfo->set_do_not_hide(query1->value(6).toBool());
-
-        {
-            QSqlQuery *query2 =
-                sqlInterface->prepareQuery("select player_name from {prefix}_games_players where id_game = :id_game");
-            query2->bindValue(":id_game", gameId);
-            sqlInterface->execSqlQuery(query2);
-            while (query2->next())
-                matchInfo->add_player_names(query2->value(0).toString().toStdString());
-        }
-        {
-            QSqlQuery *query3 =
-                sqlInterface->prepareQuery("select id, duration from {prefix}_replays where id_game = :id_game");
-            query3->bindValue(":id_game", gameId);
-            sqlInterface->execSqlQuery(query3);
-            while (query3->next()) {
-                ServerInfo_Replay *replayInfo = matchInfo->add_replay_list();
-                replayInfo->set_replay_id(query3->value(0).toInt());
-                replayInfo->set_replay_name(replayName.toStdString());
-                replayInfo->set_duration(query3->value(1).toInt());
-            }
-        }
+    Response_ReplayList *re = new Response_ReplayList;
+    if (!Servatrice_StorageListing::listReplays(*sqlInterface, userInfo->id(), firstMatch, maxMatches, *re)) {
+        delete re;
+        return Response::RespInternalError;
     }
 
     rc.setResponseExtension(re);
@@ -1786,8 +1858,7 @@ Response::ResponseCode AbstractServerSocketInterface::cmdUpdateAdminNotes(const
 TcpServerSocketInterface::TcpServerSocketInterface(Servatrice *_server,
                                                    Servatrice_DatabaseInterface *_databaseInterface,
                                                    QObject *parent)
-    : AbstractServerSocketInterface(_server, _databaseInterface, parent), messageInProgress(false),
-      handshakeStarted(false)
+    : AbstractServerSocketInterface(_server, _databaseInterface, parent), handshakeStarted(false)
 {
     socket = new QTcpSocket(this);
     socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
@@ -1836,30 +1907,21 @@ void TcpServerSocketInterface::flushOutputQueue()
     if (outputQueue.isEmpty())
         return;
 
-    int totalBytes = 0;
-    while (!outputQueue.isEmpty()) {
-        ServerMessage item = outputQueue.takeFirst();
-        locker.unlock();
+    QList<SerializedServerMessage> pendingItems;
+    pendingItems.swap(outputQueue);
+    locker.unlock();
 
-        QByteArray buf;
-#if GOOGLE_PROTOBUF_VERSION > 3001000
-        unsigned int size = static_cast<unsigned int>(item.ByteSizeLong());
-#else
-        unsigned int size = static_cast<unsigned int>(item.ByteSize());
-#endif
-        buf.resize(size + 4);
-        item.SerializeToArray(buf.data() + 4, size);
-        buf.data()[3] = (unsigned char)size;
-        buf.data()[2] = (unsigned char)(size >> 8);
-        buf.data()[1] = (unsigned char)(size >> 16);
-        buf.data()[0] = (unsigned char)(size >> 24);
-        // In case socket->write() calls catchSocketError(), the mutex must not be locked during this call.
-        writeToSocket(buf);
+    servatrice->getMetrics().observeOutputQueueDepth(pendingItems.size());
+    compressOutputItems(pendingItems);
 
-        totalBytes += size + 4;
-        locker.relock();
+    // In case socket->write() calls catchSocketError(), the mutex must not be locked during this call.
+    // The socket buffers the frames until the flush below, so they still go out together.
+    int totalBytes = 0;
+    for (const SerializedServerMessage &item : pendingItems) {
+        writeToSocket(item.getFrame());
+        totalBytes += item.getFrame().size();
     }
-    locker.unlock();
+
     emit incTxBytes(totalBytes);
     // see above wrt mutex
     flushSocket();
@@ -1871,24 +1933,11 @@ void TcpServerSocketInterface::readClient()
     servatrice->incRxBytes(data.size());
     inputBuffer.append(data);
 
-    do {
-        if (!messageInProgress) {
-            if (inputBuffer.size() >= 4) {
-                messageLength = (((quint32)(unsigned char)inputBuffer[0]) << 24) +
-                                (((quint32)(unsigned char)inputBuffer[1]) << 16) +
-                                (((quint32)(unsigned char)inputBuffer[2]) << 8) +
-                                ((quint32)(unsigned char)inputBuffer[3]);
-                inputBuffer.remove(0, 4);
-                messageInProgress = true;
-            } else
-                return;
-        }
-        if (inputBuffer.size() < messageLength || messageLength < 0)
-            return;
-
-        CommandContainer newCommandContainer;
+    const char *messageData;
+    int messageLength;
+    while (inputBuffer.nextFrame(messageData, messageLength)) {
         try {
-            newCommandContainer.ParseFromArray(inputBuffer.data(), messageLength);
+            inputCommandContainer.ParseFromArray(messageData, messageLength);
         } catch (std::exception &e) {
             qDebug() << "Caught std::exception in" << __FILE__ << __LINE__ <<
 #ifdef _MSC_VER // Visual Studio
@@ -1899,7 +1948,7 @@ void TcpServerSocketInterface::readClient()
             qDebug() << "Exception:" << e.what();
             qDebug() << "Message coming from:" << getAddress();
             qDebug() << "Message length:" << messageLength;
-            qDebug() << "Message content:" << inputBuffer.toHex();
+            qDebug() << "Message content:" << QByteArray::fromRawData(messageData, messageLength).toHex();
         } catch (...) {
             qDebug() << "Unhandled exception in" << __FILE__ << __LINE__ <<
 #ifdef _MSC_VER // Visual Studio
@@ -1910,19 +1959,18 @@ void TcpServerSocketInterface::readClient()
             qDebug() << "Message coming from:" << getAddress();
         }
 
-        inputBuffer.remove(0, messageLength);
-        messageInProgress = false;
-
         // dirty hack to make v13 client display the correct error message
         if (handshakeStarted)
-            processCommandContainer(newCommandContainer);
-        else if (!newCommandContainer.has_cmd_id()) {
+            processIncomingCommandContainer(inputCommandContainer);
+        else if (!inputCommandContainer.has_cmd_id()) {
             handshakeStarted = true;
             if (!initTcpSession())
                 prepareDestroy();
         }
         // end of hack
-    } while (!inputBuffer.isEmpty());
+    }
+    // discard all consumed messages at once instead of shifting the buffer after every single one
+    inputBuffer.compact();
 }
 
 bool TcpServerSocketInterface::initTcpSession()
@@ -2039,26 +2087,22 @@ void WebsocketServerSocketInterface::flushOutputQueue()
     if (outputQueue.isEmpty())
         return;
 
-    qint64 totalBytes = 0;
-    while (!outputQueue.isEmpty()) {
-        ServerMessage item = outputQueue.takeFirst();
-        locker.unlock();
+    QList<SerializedServerMessage> pendingItems;
+    pendingItems.swap(outputQueue);
+    locker.unlock();
 
-        QByteArray buf;
-#if GOOGLE_PROTOBUF_VERSION > 3001000
-        unsigned int size = static_cast<unsigned int>(item.ByteSizeLong());
-#else
-        unsigned int size = static_cast<unsigned int>(item.ByteSize());
-#endif
-        buf.resize(size);
-        item.SerializeToArray(buf.data(), size);
+    servatrice->getMetrics().observeOutputQueueDepth(pendingItems.size());
+    compressOutputItems(pendingItems);
+
+    // Every ServerMessage needs its own websocket message, so frames cannot be merged here; the coalescing window
+    // still batches them into a single flush.
+    qint64 totalBytes = 0;
+    for (const SerializedServerMessage &item : pendingItems) {
         // In case socket->write() calls catchSocketError(), the mutex must not be locked during this call.
-        writeToSocket(buf);
+        writeToSocket(item.getPayload());
 
-        totalBytes += size;
-        locker.relock();
+        totalBytes += item.getPayloadSize();
     }
-    locker.unlock();
     emit incTxBytes(totalBytes);
     // see above wrt mutex
     flushSocket();
@@ -2092,7 +2136,7 @@ void WebsocketServerSocketInterface::binaryMessageReceived(const QByteArray &mes
         qDebug() << "Message coming from:" << getAddress();
     }
 
-    processCommandContainer(newCommandContainer);
+    processIncomingCommandContainer(newCommandContainer);
 }
 
 bool AbstractServerSocketInterface::isPasswordLongEnough(const int passwordLength)
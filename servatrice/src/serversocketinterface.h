@@ -20,17 +20,19 @@
 #ifndef SERVERSOCKETINTERFACE_H
 #define SERVERSOCKETINTERFACE_H
 
+#include "framed_input_buffer.h"
+#include "serialized_server_message.h"
 #include "server_protocolhandler.h"
 
 #include <QHostAddress>
 #include <QMutex>
 #include <QTcpSocket>
+#include <QTimer>
 #include <QWebSocket>
 
 class Servatrice;
 class Servatrice_DatabaseInterface;
 class DeckList;
-class ServerInfo_DeckStorage_Folder;
 
 class Command_AddToList;
 class Command_RemoveFromList;
@@ -60,7 +62,10 @@ class AbstractServerSocketInterface : public Server_ProtocolHandler
 protected slots:
     void catchSocketError(QAbstractSocket::SocketError socketError);
     void catchSocketDisconnected();
+    void scheduleFlush();
     virtual void flushOutputQueue() = 0;
+private slots:
+    void passwordHashComputed(const QString &hashedPassword);
 signals:
     void outputQueueChanged();
     void incTxBytes(qint64 amount);
@@ -69,21 +74,34 @@ protected:
     void logDebugMessage(const QString &message);
     bool tooManyRegistrationAttempts(const QString &ipAddress);
 
-    virtual void writeToSocket(QByteArray &data) = 0;
+    virtual void writeToSocket(const QByteArray &data) = 0;
     virtual void flushSocket() = 0;
+    // Entry point for the commands received from the socket: logins with a password to hash are handed to the
+    // authentication pool, and the commands following them wait until the login has been processed.
+    void processIncomingCommandContainer(const CommandContainer &cont);
+    void enableOutputCompression() override;
+    // Replaces the items at or above the compression threshold by their compressed form, if that is smaller.
+    void compressOutputItems(QList<SerializedServerMessage> &items);
 
     Servatrice *servatrice;
-    QList<ServerMessage> outputQueue;
+    QList<SerializedServerMessage> outputQueue;
     QMutex outputQueueMutex;
+    QTimer *flushTimer;
+    // payload size from which frames are compressed, 0 while the client hasn't negotiated compression
+    int outputCompressionThreshold;
 
 private:
     Servatrice_DatabaseInterface *sqlInterface;
+    bool passwordHashPending;
+    CommandContainer pendingLoginContainer;
+    QList<CommandContainer> deferredCommandContainers;
+
+    bool startPasswordHash(const CommandContainer &cont);
 
     Response::ResponseCode cmdAddToList(const Command_AddToList &cmd, ResponseContainer &rc);
     Response::ResponseCode cmdRemoveFromList(const Command_RemoveFromList &cmd, ResponseContainer &rc);
     int getDeckPathId(int basePathId, QStringList path);
     int getDeckPathId(const QString &path);
-    bool deckListHelper(int folderId, ServerInfo_DeckStorage_Folder *folder);
     Response::ResponseCode cmdDeckList(const Command_DeckList &cmd, ResponseContainer &rc);
     Response::ResponseCode cmdDeckNewDir(const Command_DeckNewDir &cmd, ResponseContainer &rc);
     void deckDelDirHelper(int basePathId);
@@ -142,13 +160,14 @@ public:
     AbstractServerSocketInterface(Servatrice *_server,
                                   Servatrice_DatabaseInterface *_databaseInterface,
                                   QObject *parent = 0);
-    ~AbstractServerSocketInterface(){};
+    ~AbstractServerSocketInterface() override;
     bool initSession();
 
     virtual QHostAddress getPeerAddress() const = 0;
     virtual QString getAddress() const = 0;
 
     void transmitProtocolItem(const ServerMessage &item);
+    void transmitSerializedItem(const SerializedServerMessage &item);
 };
 
 class TcpServerSocketInterface : public AbstractServerSocketInterface
@@ -175,13 +194,13 @@ public:
 
 private:
     QTcpSocket *socket;
-    QByteArray inputBuffer;
-    bool messageInProgress;
+    FramedInputBuffer inputBuffer;
+    // reused for every incoming message so protobuf can keep its allocations between commands
+    CommandContainer inputCommandContainer;
     bool handshakeStarted;
-    int messageLength;
 
 protected:
-    void writeToSocket(QByteArray &data)
+    void writeToSocket(const QByteArray &data)
     {
         socket->write(data);
     };
@@ -225,7 +244,7 @@ private:
     QHostAddress address;
 
 protected:
-    void writeToSocket(QByteArray &data)
+    void writeToSocket(const QByteArray &data)
     {
         socket->sendBinaryMessage(data);
     };
@@ -0,0 +1,74 @@
+// Moves a pile of tokens back and forth between two zones the way Server_Player::moveCard does: every card is looked
+// up by id first, then taken out of its zone front to back and put into the other one. Prints the time per mass move,
+// and the time to set up and tear down a deck of that many cards, as a game start or a mulligan does.
+//
+// usage: card_zone_benchmark [tokens] [rounds]
+
+#include "../common/rng_abstract.h"
+#include "../common/server_card.h"
+#include "../common/server_cardzone.h"
+
+#include <QElapsedTimer>
+#include <QList>
+#include <cstdio>
+#include <cstdlib>
+
+RNG_Abstract *rng;
+
+static void moveAll(Server_CardZone &startZone, Server_CardZone &targetZone, const QList<int> &ids)
+{
+    QList<Server_Card *> cardsToMove;
+    for (int id : ids) {
+        int position;
+        cardsToMove.append(startZone.getCard(id, &position));
+    }
+    for (Server_Card *card : cardsToMove) {
+        startZone.removeCard(card);
+        const int x = targetZone.hasCoords() ? targetZone.getFreeGridColumn(-1, 0, card->getName(), false) : -1;
+        targetZone.insertCard(card, x, 0);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const int tokenCount = argc > 1 ? atoi(argv[1]) : 500;
+    const int rounds = argc > 2 ? atoi(argv[2]) : 200;
+
+    Server_CardZone table(nullptr, "table", true, ServerInfo_Zone::PublicZone);
+    Server_CardZone graveyard(nullptr, "grave", false, ServerInfo_Zone::PublicZone);
+    QList<int> ids;
+    for (int i = 0; i < tokenCount; ++i) {
+        table.insertCard(new Server_Card("Goblin", QString(), i, 0, 0), table.getFreeGridColumn(-1, 0, "Goblin", false),
+                         0);
+        ids.append(i);
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < rounds; ++i) {
+        moveAll(table, graveyard, ids);
+        moveAll(graveyard, table, ids);
+    }
+    const qint64 moveNsecs = timer.nsecsElapsed();
+
+    // single card commands (tap, attach, arrows...) only look the card up
+    timer.restart();
+    quint64 found = 0;
+    for (int i = 0; i < rounds; ++i)
+        for (int id : ids)
+            found += table.getCard(id) != nullptr;
+    const qint64 lookupNsecs = timer.nsecsElapsed();
+
+    timer.restart();
+    for (int i = 0; i < rounds; ++i) {
+        Server_CardZone deck(nullptr, "deck", false, ServerInfo_Zone::HiddenZone);
+        for (int id = 0; id < tokenCount; ++id)
+            deck.insertCard(new Server_Card("Island", QString(), id, 0, 0), -1, 0);
+    }
+    const qint64 setupNsecs = timer.nsecsElapsed();
+
+    printf("%d tokens: %.1f us per mass move, %.1f ns per lookup (%llu found), %.1f us per deck setup\n", tokenCount,
+           moveNsecs / 1000.0 / (2 * rounds), static_cast<double>(lookupNsecs) / (rounds * tokenCount),
+           static_cast<unsigned long long>(found), setupNsecs / 1000.0 / rounds);
+    return 0;
+}
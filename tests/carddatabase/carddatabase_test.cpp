@@ -30,6 +30,54 @@ TEST(CardDatabaseTest, LoadXml)
     ASSERT_EQ(0, db->getAllMainCardTypes().size()) << "Types not empty after clear";
     ASSERT_EQ(NotLoaded, db->getLoadStatus()) << "Incorrect status after clear";
 }
+
+CardInfoPerSet makePrinting(const CardSetPtr &set, const QString &uuid, const QString &num)
+{
+    CardInfoPerSet printing(set);
+    printing.setProperty("uuid", uuid);
+    printing.setProperty("num", num);
+    return printing;
+}
+
+TEST(CardDatabaseTest, PrintingLookups)
+{
+    if (!settingsCache)
+        settingsCache = new SettingsCache;
+    CardDatabase *db = new CardDatabase;
+
+    CardSetPtr oldSet = CardSet::newInstance("OLD");
+    oldSet->setSortKey(1);
+    oldSet->setEnabled(true);
+    CardSetPtr newSet = CardSet::newInstance("NEW");
+    newSet->setSortKey(0);
+    newSet->setEnabled(true);
+
+    CardInfoPerSetMap sets;
+    sets["OLD"] << makePrinting(oldSet, "uuid-old", "12");
+    sets["NEW"] << makePrinting(newSet, "uuid-new", "7") << makePrinting(newSet, "uuid-new-alt", "7a");
+    db->addCard(CardInfo::newInstance("Cat", "Meow!", false, {}, {}, {}, sets, false, false, 0, false));
+    db->refreshPreferredPrintings();
+
+    ASSERT_EQ("uuid-old", db->getSpecificSetForCard("Cat", "uuid-old").getProperty("uuid"));
+    ASSERT_EQ("uuid-new-alt", db->getSpecificSetForCard("Cat", "NEW", "7a").getProperty("uuid"));
+    ASSERT_EQ("uuid-new", db->getSpecificSetForCard("Cat", "NEW", "").getProperty("uuid"));
+    ASSERT_TRUE(db->getSpecificSetForCard("Cat", "uuid-missing").getPtr().isNull());
+    ASSERT_TRUE(db->getSpecificSetForCard("Dog", "uuid-old").getPtr().isNull());
+    ASSERT_TRUE(db->getSpecificSetForCard("Cat", "OLD", "7").getPtr().isNull());
+
+    ASSERT_EQ("uuid-new", db->getPreferredPrintingProviderIdForCard("Cat"));
+    ASSERT_TRUE(db->isProviderIdForPreferredPrinting("Cat", "uuid-new"));
+    ASSERT_TRUE(db->isProviderIdForPreferredPrinting("Cat", "card_Cat_uuid-new"));
+
+    // the preferred printing follows the set order
+    newSet->setSortKey(2);
+    db->notifyEnabledSetsChanged();
+    ASSERT_EQ("uuid-old", db->getPreferredPrintingProviderIdForCard("Cat"));
+
+    db->clear();
+    ASSERT_TRUE(db->getSpecificSetForCard("Cat", "uuid-old").getPtr().isNull());
+    delete db;
+}
 } // namespace
 
 int main(int argc, char **argv)
@@ -0,0 +1,101 @@
+// Parses a stream of pipelined ping commands the way TcpServerSocketInterface::readClient does, once with the
+// remove(0, n) framing it used before FramedInputBuffer and once with FramedInputBuffer. Prints the messages parsed
+// per second by each.
+//
+// usage: framed_input_buffer_benchmark [commands]
+
+#include "../common/framed_input_buffer.h"
+#include "pb/commands.pb.h"
+#include "pb/session_commands.pb.h"
+
+#include <QElapsedTimer>
+#include <cstdio>
+#include <cstdlib>
+
+static QByteArray pipelinedCommands(int count)
+{
+    QByteArray stream;
+    for (int i = 0; i < count; ++i) {
+        CommandContainer cont;
+        cont.set_cmd_id(static_cast<google::protobuf::uint64>(i));
+        cont.add_session_command()->MutableExtension(Command_Ping::ext);
+        const std::string serialized = cont.SerializeAsString();
+        const quint32 size = static_cast<quint32>(serialized.size());
+        stream.append((char)(size >> 24));
+        stream.append((char)(size >> 16));
+        stream.append((char)(size >> 8));
+        stream.append((char)size);
+        stream.append(serialized.data(), static_cast<int>(serialized.size()));
+    }
+    return stream;
+}
+
+// The framing TcpServerSocketInterface::readClient used before, kept here as the baseline
+static int parseLegacy(QByteArray inputBuffer)
+{
+    int parsed = 0;
+    bool messageInProgress = false;
+    int messageLength = 0;
+    CommandContainer cont;
+    do {
+        if (!messageInProgress) {
+            if (inputBuffer.size() >= 4) {
+                messageLength = (((quint32)(unsigned char)inputBuffer[0]) << 24) +
+                                (((quint32)(unsigned char)inputBuffer[1]) << 16) +
+                                (((quint32)(unsigned char)inputBuffer[2]) << 8) +
+                                ((quint32)(unsigned char)inputBuffer[3]);
+                inputBuffer.remove(0, 4);
+                messageInProgress = true;
+            } else
+                return parsed;
+        }
+        if (inputBuffer.size() < messageLength || messageLength < 0)
+            return parsed;
+        cont.ParseFromArray(inputBuffer.data(), messageLength);
+        inputBuffer.remove(0, messageLength);
+        messageInProgress = false;
+        ++parsed;
+    } while (!inputBuffer.isEmpty());
+    return parsed;
+}
+
+static int parseFramed(const QByteArray &stream)
+{
+    int parsed = 0;
+    FramedInputBuffer inputBuffer;
+    CommandContainer cont;
+    inputBuffer.append(stream);
+    const char *data;
+    int length;
+    while (inputBuffer.nextFrame(data, length)) {
+        cont.ParseFromArray(data, length);
+        ++parsed;
+    }
+    inputBuffer.compact();
+    return parsed;
+}
+
+int main(int argc, char **argv)
+{
+    const int commandCount = argc > 1 ? atoi(argv[1]) : 10000;
+    const QByteArray stream = pipelinedCommands(commandCount);
+
+    QElapsedTimer timer;
+    timer.start();
+    const int legacyParsed = parseLegacy(stream);
+    const qint64 legacyNsecs = qMax<qint64>(timer.nsecsElapsed(), 1);
+
+    timer.restart();
+    const int framedParsed = parseFramed(stream);
+    const qint64 framedNsecs = qMax<qint64>(timer.nsecsElapsed(), 1);
+
+    if (legacyParsed != commandCount || framedParsed != commandCount) {
+        fprintf(stderr, "parsed %d and %d of %d commands\n", legacyParsed, framedParsed, commandCount);
+        return 1;
+    }
+
+    printf("%d pipelined commands (%d bytes)\n", commandCount, static_cast<int>(stream.size()));
+    printf("  remove(0, n) framing: %.0f messages/sec\n", commandCount * 1e9 / legacyNsecs);
+    printf("  FramedInputBuffer:    %.0f messages/sec\n", commandCount * 1e9 / framedNsecs);
+    return 0;
+}
@@ -0,0 +1,79 @@
+#include "../common/framed_input_buffer.h"
+
+#include "gtest/gtest.h"
+
+namespace
+{
+
+QByteArray frame(const QByteArray &payload)
+{
+    QByteArray result;
+    const quint32 size = static_cast<quint32>(payload.size());
+    result.append((char)(size >> 24));
+    result.append((char)(size >> 16));
+    result.append((char)(size >> 8));
+    result.append((char)size);
+    result.append(payload);
+    return result;
+}
+
+TEST(FramedInputBufferTest, SingleFrame)
+{
+    FramedInputBuffer buffer;
+    buffer.append(frame("hello"));
+
+    const char *data;
+    int length;
+    ASSERT_TRUE(buffer.nextFrame(data, length));
+    ASSERT_EQ(QByteArray(data, length), QByteArray("hello"));
+    ASSERT_FALSE(buffer.nextFrame(data, length));
+    buffer.compact();
+    ASSERT_TRUE(buffer.isEmpty());
+}
+
+TEST(FramedInputBufferTest, FrameSplitAcrossReads)
+{
+    const QByteArray stream = frame("first") + frame("second");
+    FramedInputBuffer buffer;
+    const char *data;
+    int length;
+
+    // header split in the middle
+    buffer.append(stream.left(2));
+    ASSERT_FALSE(buffer.nextFrame(data, length));
+    // payload split in the middle
+    buffer.append(stream.mid(2, 5));
+    ASSERT_FALSE(buffer.nextFrame(data, length));
+    buffer.compact();
+    buffer.append(stream.mid(7, 8));
+    ASSERT_TRUE(buffer.nextFrame(data, length));
+    ASSERT_EQ(QByteArray(data, length), QByteArray("first"));
+    ASSERT_FALSE(buffer.nextFrame(data, length));
+    buffer.compact();
+    buffer.append(stream.mid(15));
+    ASSERT_TRUE(buffer.nextFrame(data, length));
+    ASSERT_EQ(QByteArray(data, length), QByteArray("second"));
+    buffer.compact();
+    ASSERT_TRUE(buffer.isEmpty());
+}
+
+TEST(FramedInputBufferTest, EmptyPayload)
+{
+    FramedInputBuffer buffer;
+    buffer.append(frame(QByteArray()) + frame("x"));
+
+    const char *data;
+    int length;
+    ASSERT_TRUE(buffer.nextFrame(data, length));
+    ASSERT_EQ(length, 0);
+    ASSERT_TRUE(buffer.nextFrame(data, length));
+    ASSERT_EQ(QByteArray(data, length), QByteArray("x"));
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
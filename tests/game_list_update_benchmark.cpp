@@ -0,0 +1,123 @@
+// Replays the game list changes of a busy room - games being created, filling up, starting and closing - and prints
+// the bytes every user in the room receives per second, once with every change sent on its own and once merged by
+// Server_GameListUpdates for the given game_list_update_interval.
+//
+// usage: game_list_update_benchmark [interval in ms] [games created per second] [seconds]
+
+#include "../common/serialized_server_message.h"
+#include "../common/server_game_list_updates.h"
+#include "pb/event_list_games.pb.h"
+#include "pb/room_event.pb.h"
+
+#include <QList>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+
+static qint64 frameSize(const QList<ServerInfo_Game> &games)
+{
+    Event_ListGames listGames;
+    for (const ServerInfo_Game &gameInfo : games)
+        listGames.add_game_list()->CopyFrom(gameInfo);
+    RoomEvent event;
+    event.set_room_id(1);
+    event.MutableExtension(Event_ListGames::ext)->CopyFrom(listGames);
+    return SerializedServerMessage(event).getFrame().size();
+}
+
+struct Change
+{
+    int time;
+    ServerInfo_Game gameInfo;
+};
+
+int main(int argc, char **argv)
+{
+    const int interval = argc > 1 ? atoi(argv[1]) : 250;
+    const int gamesPerSecond = argc > 2 ? atoi(argv[2]) : 20;
+    const int seconds = argc > 3 ? atoi(argv[3]) : 60;
+
+    // Every game gets its players one by one, starts and closes again; a fifth is given up before it starts.
+    std::mt19937 random(1);
+    QList<Change> changes;
+    const int gameCount = gamesPerSecond * seconds;
+    for (int gameId = 0; gameId < gameCount; ++gameId) {
+        int time = static_cast<int>(static_cast<qint64>(gameId) * 1000 / gamesPerSecond);
+        ServerInfo_Game gameInfo;
+        gameInfo.set_room_id(1);
+        gameInfo.set_game_id(gameId);
+        gameInfo.set_description("Commander, no proxies, be nice");
+        gameInfo.set_max_players(4);
+        gameInfo.add_game_types(1);
+        gameInfo.set_spectators_allowed(true);
+        gameInfo.set_player_count(1);
+        gameInfo.mutable_creator_info()->set_name("player" + std::to_string(gameId));
+        changes.append({time, gameInfo});
+
+        const bool givenUp = random() % 5 == 0;
+        const int players = givenUp ? static_cast<int>(random() % 3) + 1 : 4;
+        ServerInfo_Game update;
+        update.set_game_id(gameId);
+        for (int count = 2; count <= players; ++count) {
+            time += static_cast<int>(random() % 3000);
+            update.set_player_count(count);
+            changes.append({time, update});
+        }
+        if (!givenUp) {
+            time += static_cast<int>(random() % 2000);
+            update.Clear();
+            update.set_game_id(gameId);
+            update.set_started(true);
+            changes.append({time, update});
+            time += 60000;
+        } else {
+            time += static_cast<int>(random() % 500);
+        }
+        update.Clear();
+        update.set_game_id(gameId);
+        update.set_closed(true);
+        changes.append({time, update});
+    }
+    std::stable_sort(changes.begin(), changes.end(),
+                     [](const Change &a, const Change &b) { return a.time < b.time; });
+    const int duration = changes.last().time;
+
+    qint64 immediateBytes = 0;
+    for (const Change &change : changes)
+        immediateBytes += frameSize({change.gameInfo});
+
+    qint64 mergedBytes = 0, mergedFrames = 0;
+    if (interval > 0) {
+        Server_GameListUpdates updates;
+        int flushTime = -1;
+        for (const Change &change : changes) {
+            if (flushTime >= 0 && change.time >= flushTime) {
+                mergedBytes += frameSize(updates.take());
+                ++mergedFrames;
+                flushTime = -1;
+            }
+            if (change.gameInfo.has_creator_info())
+                updates.gameCreating(change.gameInfo.game_id());
+            updates.add(change.gameInfo);
+            // the room only starts the timer when there is something to send
+            if (flushTime < 0 && !updates.isEmpty())
+                flushTime = change.time + interval;
+        }
+        if (!updates.isEmpty()) {
+            mergedBytes += frameSize(updates.take());
+            ++mergedFrames;
+        }
+    }
+
+    const double durationSeconds = duration / 1000.0;
+    printf("%d changes to %d games over %.0f s\n", static_cast<int>(changes.size()), gameCount, durationSeconds);
+    printf("every change on its own: %lld frames, %.0f bytes/s per user\n", static_cast<long long>(changes.size()),
+           immediateBytes / durationSeconds);
+    if (interval > 0)
+        printf("merged every %d ms:     %lld frames, %.0f bytes/s per user (%.1f%%)\n", interval,
+               static_cast<long long>(mergedFrames), mergedBytes / durationSeconds,
+               100.0 * mergedBytes / immediateBytes);
+    return 0;
+}
@@ -0,0 +1,244 @@
+#include "../servatrice/src/isl_output_queue.h"
+#include "../servatrice/src/isl_state_journal.h"
+#include "pb/event_join_room.pb.h"
+#include "pb/event_list_games.pb.h"
+#include "pb/event_room_say.pb.h"
+#include "pb/event_server_complete_list.pb.h"
+#include "pb/event_user_joined.pb.h"
+
+#include "gtest/gtest.h"
+
+namespace
+{
+
+IslMessage userJoined(const std::string &name)
+{
+    IslMessage message;
+    message.set_message_type(IslMessage::SESSION_EVENT);
+    message.mutable_session_event()->MutableExtension(Event_UserJoined::ext)->mutable_user_info()->set_name(name);
+    return message;
+}
+
+IslMessage roomJoined(int roomId, const std::string &name)
+{
+    IslMessage message;
+    message.set_message_type(IslMessage::ROOM_EVENT);
+    message.mutable_room_event()->set_room_id(roomId);
+    message.mutable_room_event()->MutableExtension(Event_JoinRoom::ext)->mutable_user_info()->set_name(name);
+    return message;
+}
+
+IslMessage roomSay(int roomId, const std::string &text)
+{
+    IslMessage message;
+    message.set_message_type(IslMessage::ROOM_EVENT);
+    message.mutable_room_event()->set_room_id(roomId);
+    message.mutable_room_event()->MutableExtension(Event_RoomSay::ext)->set_message(text);
+    return message;
+}
+
+IslMessage gameUpdate(int roomId, const ServerInfo_Game &gameInfo)
+{
+    IslMessage message;
+    message.set_message_type(IslMessage::ROOM_EVENT);
+    message.mutable_room_event()->set_room_id(roomId);
+    message.mutable_room_event()->MutableExtension(Event_ListGames::ext)->add_game_list()->CopyFrom(gameInfo);
+    return message;
+}
+
+IslMessage stateSync(quint64 sequence)
+{
+    IslMessage message;
+    message.set_message_type(IslMessage::SESSION_EVENT);
+    Event_ServerCompleteList *event = message.mutable_session_event()->MutableExtension(Event_ServerCompleteList::ext);
+    event->set_state_sequence(sequence);
+    event->set_incremental(true);
+    return message;
+}
+
+// the state sequences of the batch, 0 for messages without one
+QList<quint64> sequences(const QList<IslMessage> &batch)
+{
+    QList<quint64> result;
+    for (const IslMessage &message : batch)
+        result.append(message.state_sequence());
+    return result;
+}
+
+TEST(IslStateJournalTest, ChangesAreNumberedInOrder)
+{
+    IslStateJournal journal(7);
+    ASSERT_EQ(journal.record(userJoined("a"), 10).state_sequence(), 1u);
+    ASSERT_EQ(journal.record(roomJoined(1, "a"), 10).state_sequence(), 2u);
+    ASSERT_EQ(journal.getSequence(), 2u);
+    ASSERT_EQ(journal.getEpoch(), 7u);
+}
+
+TEST(IslStateJournalTest, ReturnsTheChangesAPeerMissed)
+{
+    IslStateJournal journal(7);
+    for (int i = 0; i < 5; ++i)
+        journal.record(userJoined("user" + std::to_string(i)), 10);
+
+    QList<IslMessage> changes;
+    quint64 lastSequence = 0;
+    ASSERT_TRUE(journal.changesSince(7, 2, changes, lastSequence));
+    ASSERT_EQ(lastSequence, 5u);
+    ASSERT_EQ(sequences(changes), QList<quint64>({3, 4, 5}));
+    ASSERT_EQ(changes[0].session_event().GetExtension(Event_UserJoined::ext).user_info().name(), "user2");
+
+    changes.clear();
+    ASSERT_TRUE(journal.changesSince(7, 5, changes, lastSequence));
+    ASSERT_TRUE(changes.isEmpty());
+}
+
+TEST(IslStateJournalTest, PeersOfAnotherEpochNeedTheFullState)
+{
+    IslStateJournal journal(7);
+    journal.record(userJoined("a"), 10);
+
+    QList<IslMessage> changes;
+    quint64 lastSequence;
+    ASSERT_FALSE(journal.changesSince(8, 0, changes, lastSequence));
+    // a sequence we never reached is from another run that happened to pick the same epoch
+    ASSERT_FALSE(journal.changesSince(7, 2, changes, lastSequence));
+}
+
+TEST(IslStateJournalTest, PeersBehindTheJournalNeedTheFullState)
+{
+    IslStateJournal journal(7);
+    for (int i = 0; i < 5; ++i)
+        journal.record(userJoined("user" + std::to_string(i)), 3);
+
+    QList<IslMessage> changes;
+    quint64 lastSequence;
+    ASSERT_FALSE(journal.changesSince(7, 1, changes, lastSequence));
+    ASSERT_TRUE(journal.changesSince(7, 2, changes, lastSequence));
+    ASSERT_EQ(sequences(changes), QList<quint64>({3, 4, 5}));
+}
+
+TEST(IslStateJournalTest, OnlyUserAndGameChangesAreJournaled)
+{
+    ASSERT_TRUE(IslStateJournal::isStateChange(userJoined("a")));
+    ASSERT_TRUE(IslStateJournal::isStateChange(roomJoined(1, "a")));
+    ASSERT_TRUE(IslStateJournal::isStateChange(gameUpdate(1, ServerInfo_Game())));
+    ASSERT_FALSE(IslStateJournal::isStateChange(roomSay(1, "hello")));
+}
+
+TEST(IslOutputQueueTest, BatchKeepsTheOrderMessagesWereQueuedIn)
+{
+    IslOutputQueue queue;
+    ASSERT_TRUE(queue.finishStateSync(stateSync(0), QList<IslMessage>(), 0));
+    ASSERT_TRUE(queue.enqueue(roomSay(1, "first")));
+    IslMessage joined = roomJoined(1, "a");
+    joined.set_state_sequence(1);
+    ASSERT_TRUE(queue.enqueue(joined));
+    ASSERT_TRUE(queue.enqueue(roomSay(1, "second")));
+
+    const QList<IslMessage> batch = queue.takeBatch();
+    ASSERT_EQ(batch.size(), 4);
+    ASSERT_TRUE(batch[0].session_event().HasExtension(Event_ServerCompleteList::ext));
+    ASSERT_EQ(batch[1].room_event().GetExtension(Event_RoomSay::ext).message(), "first");
+    ASSERT_EQ(batch[2].state_sequence(), 1u);
+    ASSERT_EQ(batch[3].room_event().GetExtension(Event_RoomSay::ext).message(), "second");
+    ASSERT_TRUE(queue.isEmpty());
+    ASSERT_TRUE(queue.takeBatch().isEmpty());
+}
+
+TEST(IslOutputQueueTest, WaitingGameUpdatesAreMergedIntoTheLatest)
+{
+    IslOutputQueue queue;
+    queue.finishStateSync(stateSync(0), QList<IslMessage>(), 0);
+    queue.takeBatch();
+
+    ServerInfo_Game created;
+    created.set_game_id(3);
+    created.set_description("casual");
+    created.set_player_count(1);
+    ServerInfo_Game joined;
+    joined.set_game_id(3);
+    joined.set_player_count(2);
+    queue.enqueue(gameUpdate(1, created));
+    queue.enqueue(roomSay(1, "in between"));
+    queue.enqueue(gameUpdate(1, joined));
+    // same game id in another room
+    queue.enqueue(gameUpdate(2, created));
+
+    const QList<IslMessage> batch = queue.takeBatch();
+    ASSERT_EQ(batch.size(), 3);
+    ASSERT_TRUE(batch[0].room_event().HasExtension(Event_RoomSay::ext));
+    const ServerInfo_Game &merged = batch[1].room_event().GetExtension(Event_ListGames::ext).game_list(0);
+    ASSERT_EQ(merged.description(), "casual");
+    ASSERT_EQ(merged.player_count(), 2u);
+    ASSERT_EQ(batch[2].room_event().room_id(), 2);
+    ASSERT_EQ(queue.getMergedGameUpdates(), 1u);
+}
+
+TEST(IslOutputQueueTest, ClosedGameReplacesItsWaitingUpdate)
+{
+    IslOutputQueue queue;
+    queue.finishStateSync(stateSync(0), QList<IslMessage>(), 0);
+    queue.takeBatch();
+
+    ServerInfo_Game created;
+    created.set_game_id(3);
+    created.set_description("casual");
+    ServerInfo_Game closed;
+    closed.set_game_id(3);
+    closed.set_closed(true);
+    queue.enqueue(gameUpdate(1, created));
+    queue.enqueue(gameUpdate(1, closed));
+
+    const QList<IslMessage> batch = queue.takeBatch();
+    ASSERT_EQ(batch.size(), 1);
+    const ServerInfo_Game &update = batch[0].room_event().GetExtension(Event_ListGames::ext).game_list(0);
+    ASSERT_TRUE(update.closed());
+    ASSERT_FALSE(update.has_description());
+}
+
+TEST(IslOutputQueueTest, StateChangesWaitForTheStateSync)
+{
+    IslOutputQueue queue;
+    IslMessage first = userJoined("a"), second = userJoined("b");
+    first.set_state_sequence(1);
+    second.set_state_sequence(2);
+    ASSERT_FALSE(queue.enqueue(first));
+    ASSERT_FALSE(queue.enqueue(second));
+    ASSERT_TRUE(queue.enqueue(roomSay(1, "not a state change")));
+
+    // the sync already holds the first change
+    ASSERT_TRUE(queue.finishStateSync(stateSync(1), QList<IslMessage>(), 1));
+    ASSERT_FALSE(queue.finishStateSync(stateSync(2), QList<IslMessage>(), 2));
+    ASSERT_EQ(sequences(queue.takeBatch()), QList<quint64>({0, 0, 2}));
+    ASSERT_FALSE(queue.enqueue(first));
+}
+
+TEST(IslOutputQueueTest, IncrementalResyncSendsEveryMissedChangeOnce)
+{
+    IslStateJournal journal(7);
+    for (int i = 0; i < 4; ++i)
+        journal.record(roomJoined(1, "user" + std::to_string(i)), 10);
+
+    // the peer came back knowing our state up to sequence 2; a change comes in before its sync request is answered
+    IslOutputQueue queue;
+    ASSERT_FALSE(queue.enqueue(journal.record(roomJoined(1, "late"), 10)));
+
+    QList<IslMessage> changes;
+    quint64 lastSequence;
+    ASSERT_TRUE(journal.changesSince(7, 2, changes, lastSequence));
+    ASSERT_TRUE(queue.finishStateSync(stateSync(lastSequence), changes, lastSequence));
+    ASSERT_TRUE(queue.enqueue(journal.record(roomJoined(1, "after"), 10)));
+
+    const QList<IslMessage> batch = queue.takeBatch();
+    ASSERT_EQ(sequences(batch), QList<quint64>({0, 3, 4, 5, 6}));
+    ASSERT_EQ(batch[0].session_event().GetExtension(Event_ServerCompleteList::ext).state_sequence(), 5u);
+    ASSERT_EQ(batch[3].room_event().GetExtension(Event_JoinRoom::ext).user_info().name(), "late");
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
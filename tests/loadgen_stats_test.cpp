@@ -0,0 +1,82 @@
+#include "../loadgen/src/loadgen_stats.h"
+
+#include "pb/response.pb.h"
+
+#include "gtest/gtest.h"
+
+namespace
+{
+
+TEST(LatencyHistogramTest, EmptyHistogramReportsZero)
+{
+    LatencyHistogram histogram;
+    ASSERT_EQ(histogram.count(), 0u);
+    ASSERT_EQ(histogram.percentile(0.5), 0);
+    ASSERT_EQ(histogram.max(), 0);
+}
+
+TEST(LatencyHistogramTest, PercentilesAreWithinBucketPrecision)
+{
+    LatencyHistogram histogram;
+    // 1 to 100 ms
+    for (int i = 1; i <= 100; ++i)
+        histogram.record(i * 1000000LL);
+
+    ASSERT_EQ(histogram.count(), 100u);
+    ASSERT_EQ(histogram.max(), 100000000LL);
+    ASSERT_GE(histogram.percentile(0.5), 50000000LL);
+    ASSERT_LE(histogram.percentile(0.5), 50000000LL * 110 / 100);
+    ASSERT_GE(histogram.percentile(0.99), 99000000LL);
+    ASSERT_LE(histogram.percentile(0.99), 100000000LL);
+    ASSERT_EQ(histogram.percentile(1), 100000000LL);
+}
+
+TEST(LatencyHistogramTest, MergeAddsCounts)
+{
+    LatencyHistogram fast, slow;
+    for (int i = 0; i < 90; ++i)
+        fast.record(1000000);
+    for (int i = 0; i < 10; ++i)
+        slow.record(500000000);
+
+    fast.merge(slow);
+    ASSERT_EQ(fast.count(), 100u);
+    ASSERT_EQ(fast.max(), 500000000LL);
+    ASSERT_LE(fast.percentile(0.9), 1100000LL);
+    ASSERT_GE(fast.percentile(0.95), 450000000LL);
+}
+
+TEST(LoadgenStatsTest, ReportCountsErrorsAndTimeouts)
+{
+    LoadgenStats stats;
+    stats.recordCommand("Command_Ping", 2000000, Response::RespOk);
+    stats.recordCommand("Command_Ping", 3000000, Response::RespOk);
+    stats.recordCommand("Command_Ping", 4000000, Response::RespInternalError);
+    stats.recordTimeout("Command_Ping");
+    stats.recordFailure("connection refused");
+
+    const QString report = stats.takeIntervalReport(1);
+    ASSERT_TRUE(report.contains("Command_Ping"));
+    ASSERT_TRUE(report.contains("50.0%"));
+    ASSERT_TRUE(report.contains("total: 3 commands"));
+    ASSERT_TRUE(report.contains("failure: connection refused x1"));
+}
+
+TEST(LoadgenStatsTest, IntervalReportsAddUpToTotal)
+{
+    LoadgenStats stats;
+    stats.recordCommand("Command_Ping", 1000000, Response::RespOk);
+    stats.takeIntervalReport(1);
+    stats.recordCommand("Command_Ping", 1000000, Response::RespOk);
+
+    ASSERT_TRUE(stats.takeIntervalReport(1).contains("total: 1 commands"));
+    ASSERT_TRUE(stats.totalReport(2).contains("total: 2 commands"));
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
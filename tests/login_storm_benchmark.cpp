@@ -0,0 +1,206 @@
+// Reconnect storm: many threads logging users in (and the same users in again) against a database with a fixed
+// latency per query, the way the connection pools of servatrice do. Prints the sustained logins per second.
+//
+// usage: login_storm_benchmark [threads] [users per thread] [database latency in microseconds]
+
+#include "../common/rng_abstract.h"
+#include "../common/serialized_server_message.h"
+#include "../common/server.h"
+#include "../common/server_database_interface.h"
+#include "../common/server_protocolhandler.h"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QThread>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// referenced by the game code linked in with the server
+RNG_Abstract *rng;
+
+namespace
+{
+
+class FakeDatabaseInterface : public Server_DatabaseInterface
+{
+private:
+    unsigned long latency;
+
+    void roundTrip() const
+    {
+        QThread::usleep(latency);
+    }
+
+public:
+    explicit FakeDatabaseInterface(unsigned long _latency) : latency(_latency)
+    {
+    }
+
+    AuthenticationResult checkUserPassword(Server_ProtocolHandler * /* handler */,
+                                           const QString &user,
+                                           const QString & /* password */,
+                                           const QString & /* clientId */,
+                                           QString & /* reasonStr */,
+                                           int & /* secondsLeft */,
+                                           bool /* passwordNeedsHash */) override
+    {
+        roundTrip();
+        // every other user is a guest
+        return user.endsWith('0') ? UnknownUser : PasswordRight;
+    }
+    ServerInfo_User getUserData(const QString &name, bool /* withId */) override
+    {
+        roundTrip();
+        ServerInfo_User result;
+        result.set_name(name.toStdString());
+        return result;
+    }
+    bool activeUserExists(const QString & /* user */) override
+    {
+        roundTrip();
+        return false;
+    }
+    bool userSessionExists(const QString & /* userName */) override
+    {
+        roundTrip();
+        return false;
+    }
+    qint64 startSession(const QString & /* userName */,
+                        const QString & /* address */,
+                        const QString & /* clientId */,
+                        const QString & /* connectionType */) override
+    {
+        static std::atomic<qint64> nextSessionId(1);
+        roundTrip();
+        return nextSessionId++;
+    }
+    void updateUsersClientID(const QString & /* userName */, const QString & /* userClientID */) override
+    {
+        roundTrip();
+    }
+    void updateUsersLastLoginData(const QString & /* userName */, const QString & /* clientVersion */) override
+    {
+        roundTrip();
+    }
+    int getNextGameId() override
+    {
+        return 0;
+    }
+    int getNextReplayId() override
+    {
+        return 0;
+    }
+    int getActiveUserCount(QString /* connectionType */) override
+    {
+        return 0;
+    }
+};
+
+class FakeSession : public Server_ProtocolHandler
+{
+private:
+    void transmitProtocolItem(const ServerMessage & /* item */) override
+    {
+        ++sentItems;
+    }
+    void transmitSerializedItem(const SerializedServerMessage & /* item */) override
+    {
+        ++sentItems;
+    }
+
+public:
+    static std::atomic<quint64> sentItems;
+
+    FakeSession(Server *_server, Server_DatabaseInterface *_databaseInterface)
+        : Server_ProtocolHandler(_server, _databaseInterface)
+    {
+        acceptsUserListChanges = true;
+    }
+    QString getAddress() const override
+    {
+        return QStringLiteral("127.0.0.1");
+    }
+    QString getConnectionType() const override
+    {
+        return QStringLiteral("tcp");
+    }
+};
+
+std::atomic<quint64> FakeSession::sentItems(0);
+
+class FakeServer : public Server
+{
+public:
+    void registerDatabaseInterface(Server_DatabaseInterface *databaseInterface)
+    {
+        setDatabaseInterface(databaseInterface);
+    }
+};
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+    const int threadCount = argc > 1 ? atoi(argv[1]) : 16;
+    const int usersPerThread = argc > 2 ? atoi(argv[2]) : 200;
+    const unsigned long latency = argc > 3 ? strtoul(argv[3], nullptr, 10) : 200;
+
+    FakeServer server;
+    std::mutex mutex;
+    std::condition_variable startCondition;
+    int registeredThreads = 0;
+    bool started = false;
+    std::atomic<int> logins(0);
+
+    auto worker = [&](int threadIndex) {
+        FakeDatabaseInterface databaseInterface(latency);
+        {
+            // the interfaces are registered one at a time and before any login, like the connection pools do
+            std::unique_lock<std::mutex> locker(mutex);
+            server.registerDatabaseInterface(&databaseInterface);
+            ++registeredThreads;
+            startCondition.notify_all();
+            startCondition.wait(locker, [&] { return started; });
+        }
+
+        // each user logs in twice: the second login supersedes the first session
+        for (int pass = 0; pass < 2; ++pass) {
+            for (int i = 0; i < usersPerThread; ++i) {
+                auto *session = new FakeSession(&server, &databaseInterface);
+                server.addClient(session);
+                QString name = QString("user%1_%2").arg(threadIndex).arg(i);
+                QString reasonStr, clientId("benchmark"), clientVersion, connectionType;
+                int secondsLeft = 0;
+                server.loginUser(session, name, QString(), false, reasonStr, secondsLeft, clientId, clientVersion,
+                                 connectionType);
+                ++logins;
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < threadCount; ++i)
+        threads.emplace_back(worker, i);
+
+    QElapsedTimer timer;
+    {
+        std::unique_lock<std::mutex> locker(mutex);
+        startCondition.wait(locker, [&] { return registeredThreads == threadCount; });
+        started = true;
+        timer.start();
+    }
+    startCondition.notify_all();
+    for (auto &thread : threads)
+        thread.join();
+    const qint64 elapsed = timer.elapsed();
+
+    printf("%d threads, %d logins, %lu us database latency: %lld ms, %.0f logins/sec, %llu items sent\n", threadCount,
+           logins.load(), latency, static_cast<long long>(elapsed), logins.load() * 1000.0 / qMax<qint64>(elapsed, 1),
+           static_cast<unsigned long long>(FakeSession::sentItems.load()));
+    return 0;
+}
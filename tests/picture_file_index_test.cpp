@@ -0,0 +1,67 @@
+#include "../cockatrice/src/client/ui/picture_loader/picture_file_index.h"
+
+#include "gtest/gtest.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QTemporaryDir>
+
+namespace
+{
+
+void touch(const QString &path)
+{
+    QDir().mkpath(QFileInfo(path).path());
+    QFile file(path);
+    file.open(QIODevice::WriteOnly);
+}
+
+TEST(PictureFileIndexTest, FindsFilesByAnyOfTheirNames)
+{
+    QTemporaryDir root;
+    touch(root.path() + "/a/b/Llanowar Elves.full.jpg");
+
+    PictureFileIndex index;
+    index.setRootPath(root.path());
+    const QStringList expected{root.path() + "/a/b/Llanowar Elves.full.jpg"};
+    ASSERT_EQ(index.findFiles("Llanowar Elves.full.jpg"), expected);
+    ASSERT_EQ(index.findFiles("Llanowar Elves.full"), expected);
+    ASSERT_EQ(index.findFiles("Llanowar Elves"), expected);
+    ASSERT_TRUE(index.findFiles("Llanowar").isEmpty());
+}
+
+TEST(PictureFileIndexTest, LookupsIgnoreCase)
+{
+    QTemporaryDir root;
+    touch(root.path() + "/custom/BLACK LOTUS.png");
+
+    PictureFileIndex index;
+    index.setRootPath(root.path());
+    ASSERT_EQ(index.findFiles("Black Lotus"), QStringList{root.path() + "/custom/BLACK LOTUS.png"});
+}
+
+TEST(PictureFileIndexTest, SetFolderWithMismatchedCase)
+{
+    QTemporaryDir root;
+    touch(root.path() + "/lea/Black Lotus.full.jpg");
+    touch(root.path() + "/downloadedPics/Lea/black lotus.jpg");
+
+    PictureFileIndex index;
+    index.setRootPath(root.path(), 2);
+    // found under the spelling on disk, so that reading them works on case sensitive file systems too
+    ASSERT_EQ(index.findFilesIn(root.path() + "/LEA", "Black Lotus.full"),
+              QStringList{root.path() + "/lea/Black Lotus.full.jpg"});
+    ASSERT_EQ(index.findFilesIn(root.path() + "/downloadedPics/LEA", "Black Lotus"),
+              QStringList{root.path() + "/downloadedPics/Lea/black lotus.jpg"});
+    // "Black Lotus.full.jpg" only has "Black Lotus" as its base name, which isn't enough
+    ASSERT_TRUE(index.findFilesIn(root.path() + "/LEA", "Black Lotus").isEmpty());
+    ASSERT_TRUE(index.findFilesIn(root.path() + "/2ED", "Black Lotus.full").isEmpty());
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,121 @@
+#include "../common/rng_abstract.h"
+#include "../common/rng_sfmt.h"
+#include "../common/server_card.h"
+#include "../common/server_cardzone.h"
+
+#include "gtest/gtest.h"
+#include <QSet>
+#include <algorithm>
+#include <thread>
+
+RNG_Abstract *rng;
+
+namespace
+{
+
+class RngSfmtTest : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        rng = new RNG_SFMT;
+    }
+
+    void TearDown() override
+    {
+        delete rng;
+    }
+
+    static QVector<unsigned int> drawNumbers(int count)
+    {
+        QVector<unsigned int> result;
+        for (int i = 0; i < count; ++i)
+            result.append(rng->rand(0, INT_MAX));
+        return result;
+    }
+
+    // the order Fisher-Yates with the given draws brings 0 .. size - 1 into, the way Server_CardZone::shuffle does
+    static QVector<int> applyDraws(int size, const QVector<unsigned int> &draws)
+    {
+        QVector<int> result(size);
+        for (int i = 0; i < size; ++i)
+            result[i] = i;
+        const int end = size - 1;
+        for (int i = end; i > 0; --i)
+            std::swap(result[static_cast<int>(draws[end - i])], result[i]);
+        return result;
+    }
+};
+
+TEST_F(RngSfmtTest, ShuffleDrawsStayInRange)
+{
+    const QVector<unsigned int> draws = rng->makeShuffleDraws(3, 62);
+    ASSERT_EQ(draws.size(), 59);
+    for (int k = 0; k < draws.size(); ++k) {
+        ASSERT_GE(draws[k], 3u);
+        ASSERT_LE(draws[k], 62u - k);
+    }
+    ASSERT_TRUE(rng->makeShuffleDraws(5, 5).isEmpty());
+}
+
+TEST_F(RngSfmtTest, ShuffleDrawsFormAPermutation)
+{
+    for (int round = 0; round < 100; ++round) {
+        QVector<int> order = applyDraws(60, rng->makeShuffleDraws(0, 59));
+        std::sort(order.begin(), order.end());
+        for (int i = 0; i < order.size(); ++i)
+            ASSERT_EQ(order[i], i);
+    }
+}
+
+TEST_F(RngSfmtTest, ShuffleDrawsReachEveryPermutation)
+{
+    // 4 elements have 24 orders; missing one after 2400 shuffles would point at a draw range that is off by one
+    QSet<int> seen;
+    for (int round = 0; round < 2400; ++round) {
+        const QVector<int> order = applyDraws(4, rng->makeShuffleDraws(0, 3));
+        seen.insert(((order[0] * 4 + order[1]) * 4 + order[2]) * 4 + order[3]);
+    }
+    ASSERT_EQ(seen.size(), 24);
+}
+
+TEST_F(RngSfmtTest, ShuffledZoneKeepsEveryCard)
+{
+    Server_CardZone zone(nullptr, "deck", false, ServerInfo_Zone::HiddenZone);
+    for (int id = 0; id < 60; ++id)
+        zone.insertCard(new Server_Card("Island", QString(), id, 0, 0), -1, 0);
+    zone.shuffle();
+
+    QVector<int> ids;
+    for (const Server_Card *card : zone.getCards())
+        ids.append(card->getId());
+    ASSERT_EQ(ids.size(), 60);
+    std::sort(ids.begin(), ids.end());
+    for (int id = 0; id < 60; ++id)
+        ASSERT_EQ(ids[id], id);
+}
+
+TEST_F(RngSfmtTest, ThreadsDrawFromSeparateStreams)
+{
+    QVector<unsigned int> first, second;
+    std::thread firstThread([&first] { first = drawNumbers(64); });
+    std::thread secondThread([&second] { second = drawNumbers(64); });
+    firstThread.join();
+    secondThread.join();
+    const QVector<unsigned int> mainThread = drawNumbers(64);
+
+    // Had the threads shared a stream or a seed, one sequence would repeat or continue another.
+    ASSERT_NE(first, second);
+    ASSERT_TRUE(std::search(first.begin(), first.end(), second.begin(), second.begin() + 8) == first.end());
+    ASSERT_TRUE(std::search(second.begin(), second.end(), first.begin(), first.begin() + 8) == second.end());
+    ASSERT_TRUE(std::search(first.begin(), first.end(), mainThread.begin(), mainThread.begin() + 8) == first.end());
+    ASSERT_TRUE(std::search(second.begin(), second.end(), mainThread.begin(), mainThread.begin() + 8) == second.end());
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
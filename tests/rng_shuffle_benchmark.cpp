@@ -0,0 +1,64 @@
+// Shuffles libraries the way Server_Player does on game start, mulligans and shuffle commands, from several threads at
+// once like the connection pools do. Prints shuffles per second for every library size and thread count.
+// The distribution of the generator is checked by servatrice --test-random.
+//
+// usage: rng_shuffle_benchmark [seconds per run] [max threads]
+
+#include "../common/rng_abstract.h"
+#include "../common/rng_sfmt.h"
+#include "../common/server_card.h"
+#include "../common/server_cardzone.h"
+
+#include <QElapsedTimer>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+RNG_Abstract *rng;
+
+static void shuffleUntil(int librarySize, const std::atomic<bool> &stop, std::atomic<quint64> &shuffles)
+{
+    Server_CardZone library(nullptr, "deck", false, ServerInfo_Zone::HiddenZone);
+    for (int id = 0; id < librarySize; ++id)
+        library.insertCard(new Server_Card("Island", QString(), id, 0, 0), -1, 0);
+
+    quint64 count = 0;
+    while (!stop.load(std::memory_order_relaxed)) {
+        library.shuffle();
+        ++count;
+    }
+    shuffles += count;
+}
+
+int main(int argc, char **argv)
+{
+    const double seconds = argc > 1 ? atof(argv[1]) : 1.0;
+    const int maxThreads = argc > 2 ? atoi(argv[2]) : 16;
+
+    rng = new RNG_SFMT;
+    for (int librarySize : {60, 100}) {
+        for (int threadCount = 1; threadCount <= maxThreads; threadCount *= 2) {
+            std::atomic<bool> stop(false);
+            std::atomic<quint64> shuffles(0);
+            std::vector<std::thread> threads;
+
+            QElapsedTimer timer;
+            timer.start();
+            for (int i = 0; i < threadCount; ++i)
+                threads.emplace_back(shuffleUntil, librarySize, std::cref(stop), std::ref(shuffles));
+            std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+            stop = true;
+            for (std::thread &thread : threads)
+                thread.join();
+            const double elapsed = timer.nsecsElapsed() / 1e9;
+
+            printf("%d cards, %2d threads: %.0f shuffles/s\n", librarySize, threadCount,
+                   static_cast<double>(shuffles.load()) / elapsed);
+        }
+    }
+    delete rng;
+    return 0;
+}
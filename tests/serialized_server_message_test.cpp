@@ -0,0 +1,127 @@
+#include "../common/serialized_server_message.h"
+#include "pb/event_list_games.pb.h"
+
+#include "gtest/gtest.h"
+
+namespace
+{
+
+RoomEvent makeLargeRoomEvent()
+{
+    RoomEvent event;
+    event.set_room_id(3);
+    Event_ListGames listGames;
+    for (int i = 0; i < 50; ++i) {
+        ServerInfo_Game *gameInfo = listGames.add_game_list();
+        gameInfo->set_game_id(i);
+        gameInfo->set_description("a game description that repeats itself");
+    }
+    event.MutableExtension(Event_ListGames::ext)->CopyFrom(listGames);
+    return event;
+}
+
+TEST(SerializedServerMessageTest, NullByDefault)
+{
+    SerializedServerMessage item;
+    ASSERT_TRUE(item.isNull());
+    ASSERT_EQ(item.getPayloadSize(), 0);
+    ASSERT_TRUE(item.getPayload().isEmpty());
+}
+
+TEST(SerializedServerMessageTest, FrameHasBigEndianLengthPrefix)
+{
+    RoomEvent event;
+    event.set_room_id(42);
+    SerializedServerMessage item(event);
+
+    const QByteArray &frame = item.getFrame();
+    ASSERT_EQ(frame.size(), item.getPayloadSize() + SerializedServerMessage::headerSize);
+
+    const quint32 length = (((quint32)(unsigned char)frame[0]) << 24) + (((quint32)(unsigned char)frame[1]) << 16) +
+                           (((quint32)(unsigned char)frame[2]) << 8) + ((quint32)(unsigned char)frame[3]);
+    ASSERT_EQ(length, static_cast<quint32>(item.getPayloadSize()));
+}
+
+TEST(SerializedServerMessageTest, RoundTrip)
+{
+    RoomEvent event;
+    event.set_room_id(7);
+    SerializedServerMessage item(event);
+
+    ServerMessage parsed;
+    ASSERT_TRUE(item.toServerMessage(parsed));
+    ASSERT_EQ(parsed.message_type(), ServerMessage::ROOM_EVENT);
+    ASSERT_EQ(parsed.room_event().room_id(), 7u);
+
+    ServerMessage fromPayload;
+    const QByteArray payload = item.getPayload();
+    ASSERT_TRUE(fromPayload.ParseFromArray(payload.constData(), payload.size()));
+    ASSERT_EQ(fromPayload.SerializeAsString(), parsed.SerializeAsString());
+}
+
+TEST(SerializedServerMessageTest, CopiesShareTheFrame)
+{
+    Response response;
+    response.set_cmd_id(1);
+    response.set_response_code(Response::RespOk);
+    SerializedServerMessage item(response);
+    SerializedServerMessage copy = item;
+
+    ASSERT_EQ(item.getFrame().constData(), copy.getFrame().constData()) << "Copies must not duplicate the buffer";
+}
+
+TEST(SerializedServerMessageTest, CompressedRoundTrip)
+{
+    SerializedServerMessage item(makeLargeRoomEvent());
+
+    SerializedServerMessage compressed = item.compressed();
+    ASSERT_FALSE(compressed.isNull());
+    ASSERT_LT(compressed.getPayloadSize(), item.getPayloadSize());
+
+    ServerMessage wrapper;
+    ASSERT_TRUE(compressed.toServerMessage(wrapper));
+    ASSERT_EQ(wrapper.message_type(), ServerMessage::COMPRESSED);
+
+    ServerMessage unpacked, original;
+    ASSERT_TRUE(SerializedServerMessage::uncompress(wrapper, unpacked));
+    ASSERT_TRUE(item.toServerMessage(original));
+    ASSERT_EQ(unpacked.SerializeAsString(), original.SerializeAsString());
+}
+
+TEST(SerializedServerMessageTest, CopiesShareTheCompressedFrame)
+{
+    SerializedServerMessage item(makeLargeRoomEvent());
+    SerializedServerMessage copy = item;
+
+    bool compressedNow;
+    SerializedServerMessage compressed = item.compressed(&compressedNow);
+    ASSERT_TRUE(compressedNow);
+    SerializedServerMessage compressedCopy = copy.compressed(&compressedNow);
+    ASSERT_FALSE(compressedNow);
+    ASSERT_EQ(compressedCopy.getFrame(), compressed.getFrame());
+    // the same bytes, not merely equal ones
+    ASSERT_EQ(compressedCopy.getFrame().constData(), compressed.getFrame().constData());
+
+    ASSERT_TRUE(compressed.compressed().isNull());
+}
+
+TEST(SerializedServerMessageTest, SmallMessagesAreNotCompressed)
+{
+    RoomEvent event;
+    event.set_room_id(1);
+    SerializedServerMessage item(event);
+
+    ASSERT_TRUE(item.compressed().isNull());
+
+    ServerMessage parsed, unpacked;
+    ASSERT_TRUE(item.toServerMessage(parsed));
+    ASSERT_FALSE(SerializedServerMessage::uncompress(parsed, unpacked));
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,120 @@
+#include "../servatrice/src/servatrice_database_write.h"
+
+#include "gtest/gtest.h"
+#include <QCoreApplication>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QVariant>
+
+namespace
+{
+
+// Runs the writes on an in-memory SQLite database the way servatrice's database interface runs them on MySQL
+class SqliteConnection : public Servatrice_DatabaseWriteConnection
+{
+public:
+    QSqlDatabase db;
+    bool inBatch = false;
+    bool batchFailed = false;
+    // failures outside a batch, after which servatrice would reset the connection
+    int reconnects = 0;
+
+    SqliteConnection()
+    {
+        db = QSqlDatabase::addDatabase("QSQLITE", "write_test");
+        db.setDatabaseName(":memory:");
+        db.open();
+        QSqlQuery(db).exec("create table log (id integer primary key, message text not null)");
+    }
+    ~SqliteConnection() override
+    {
+        db.close();
+        db = QSqlDatabase();
+        QSqlDatabase::removeDatabase("write_test");
+    }
+
+    bool beginWriteBatch() override
+    {
+        inBatch = db.transaction();
+        batchFailed = false;
+        return inBatch;
+    }
+    bool commitWriteBatch() override
+    {
+        inBatch = false;
+        return !batchFailed && db.commit();
+    }
+    void rollbackWriteBatch() override
+    {
+        inBatch = false;
+        db.rollback();
+    }
+    bool execWriteStatement(const QString &queryText, const QVariantList &values, bool /* merged */) override
+    {
+        QSqlQuery query(db);
+        query.prepare(queryText);
+        for (const QVariant &value : values)
+            query.addBindValue(value);
+        if (query.exec())
+            return true;
+        if (inBatch)
+            batchFailed = true;
+        else
+            ++reconnects;
+        return false;
+    }
+    bool execWriteCallback(const Servatrice_DatabaseWrite & /* write */) override
+    {
+        return true;
+    }
+
+    QStringList messages()
+    {
+        QStringList result;
+        QSqlQuery query(db);
+        query.exec("select message from log order by id");
+        while (query.next())
+            result.append(query.value(0).toString());
+        return result;
+    }
+};
+
+Servatrice_DatabaseWrite logWrite(const QVariant &message)
+{
+    return Servatrice_DatabaseWrite("insert into log (message) values ", "(?)", {message});
+}
+
+TEST(ServatriceDatabaseWriteTest, BatchIsMergedIntoOneStatement)
+{
+    if (!QSqlDatabase::isDriverAvailable("QSQLITE"))
+        GTEST_SKIP() << "no SQLite driver";
+    SqliteConnection connection;
+
+    Servatrice_DatabaseWrite::executeBatch({logWrite("a"), logWrite("b"), logWrite("c")}, connection);
+    ASSERT_EQ(connection.messages(), QStringList({"a", "b", "c"}));
+}
+
+TEST(ServatriceDatabaseWriteTest, FailingStatementKeepsTheOtherWrites)
+{
+    if (!QSqlDatabase::isDriverAvailable("QSQLITE"))
+        GTEST_SKIP() << "no SQLite driver";
+    SqliteConnection connection;
+
+    // a statement of its own that fails in the middle of the batch, after "a" and "b" have been written
+    Servatrice_DatabaseWrite broken("insert into missing_table (message) values ", "(?)", {"lost"});
+    Servatrice_DatabaseWrite::executeBatch({logWrite("a"), logWrite("b"), broken, logWrite("c")}, connection);
+
+    ASSERT_FALSE(connection.inBatch);
+    ASSERT_EQ(connection.messages(), QStringList({"a", "b", "c"}));
+    // only the broken write failed on its own
+    ASSERT_EQ(connection.reconnects, 1);
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
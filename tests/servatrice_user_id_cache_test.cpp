@@ -0,0 +1,67 @@
+#include "../servatrice/src/servatrice_user_id_cache.h"
+
+#include "gtest/gtest.h"
+#include <QThread>
+
+namespace
+{
+
+TEST(ServatriceUserIdCacheTest, ReturnsInsertedIds)
+{
+    Servatrice_UserIdCache cache(10, 60000);
+    cache.insert("alice", 1);
+    cache.insert("bob", 2);
+
+    int id = -1;
+    ASSERT_TRUE(cache.lookup("alice", id));
+    ASSERT_EQ(id, 1);
+    ASSERT_TRUE(cache.lookup("bob", id));
+    ASSERT_EQ(id, 2);
+    ASSERT_FALSE(cache.lookup("carol", id));
+}
+
+TEST(ServatriceUserIdCacheTest, EvictsLeastRecentlyUsed)
+{
+    Servatrice_UserIdCache cache(2, 60000);
+    cache.insert("alice", 1);
+    cache.insert("bob", 2);
+
+    int id;
+    ASSERT_TRUE(cache.lookup("alice", id));
+    cache.insert("carol", 3);
+
+    ASSERT_EQ(cache.size(), 2);
+    ASSERT_TRUE(cache.lookup("alice", id));
+    ASSERT_FALSE(cache.lookup("bob", id));
+    ASSERT_TRUE(cache.lookup("carol", id));
+}
+
+TEST(ServatriceUserIdCacheTest, InvalidateRemovesEntry)
+{
+    Servatrice_UserIdCache cache(10, 60000);
+    cache.insert("alice", 1);
+    cache.invalidate("alice");
+
+    int id;
+    ASSERT_FALSE(cache.lookup("alice", id));
+    ASSERT_EQ(cache.size(), 0);
+}
+
+TEST(ServatriceUserIdCacheTest, EntriesExpire)
+{
+    Servatrice_UserIdCache cache(10, 20);
+    cache.insert("alice", 1);
+    QThread::msleep(50);
+
+    int id;
+    ASSERT_FALSE(cache.lookup("alice", id));
+    ASSERT_EQ(cache.size(), 0);
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
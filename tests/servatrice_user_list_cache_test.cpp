@@ -0,0 +1,71 @@
+#include "../servatrice/src/servatrice_user_list_cache.h"
+
+#include "gtest/gtest.h"
+
+namespace
+{
+
+TEST(ServatriceUserListCacheTest, LookupFailsUntilListIsLoaded)
+{
+    Servatrice_UserListCache cache;
+    bool contains;
+    ASSERT_FALSE(cache.lookup(Servatrice_UserListCache::BuddyList, "alice", "bob", contains));
+
+    cache.setList(Servatrice_UserListCache::BuddyList, "alice", {"bob"});
+    ASSERT_TRUE(cache.lookup(Servatrice_UserListCache::BuddyList, "alice", "bob", contains));
+    ASSERT_TRUE(contains);
+    ASSERT_TRUE(cache.lookup(Servatrice_UserListCache::BuddyList, "alice", "carol", contains));
+    ASSERT_FALSE(contains);
+
+    // the ignore list of alice hasn't been loaded yet
+    ASSERT_FALSE(cache.lookup(Servatrice_UserListCache::IgnoreList, "alice", "bob", contains));
+}
+
+TEST(ServatriceUserListCacheTest, NamesAreCaseInsensitive)
+{
+    Servatrice_UserListCache cache;
+    cache.setList(Servatrice_UserListCache::IgnoreList, "Alice", {"Bob"});
+
+    bool contains = false;
+    ASSERT_TRUE(cache.lookup(Servatrice_UserListCache::IgnoreList, "alice", "BOB", contains));
+    ASSERT_TRUE(contains);
+}
+
+TEST(ServatriceUserListCacheTest, ChangesApplyToLoadedListsOnly)
+{
+    Servatrice_UserListCache cache;
+    cache.setList(Servatrice_UserListCache::BuddyList, "alice", {});
+    cache.addToList(Servatrice_UserListCache::BuddyList, "alice", "bob");
+    cache.addToList(Servatrice_UserListCache::BuddyList, "carol", "bob");
+
+    bool contains;
+    ASSERT_TRUE(cache.lookup(Servatrice_UserListCache::BuddyList, "alice", "bob", contains));
+    ASSERT_TRUE(contains);
+    ASSERT_FALSE(cache.lookup(Servatrice_UserListCache::BuddyList, "carol", "bob", contains));
+
+    cache.removeFromList(Servatrice_UserListCache::BuddyList, "alice", "bob");
+    ASSERT_TRUE(cache.lookup(Servatrice_UserListCache::BuddyList, "alice", "bob", contains));
+    ASSERT_FALSE(contains);
+}
+
+TEST(ServatriceUserListCacheTest, RemoveUserDropsBothLists)
+{
+    Servatrice_UserListCache cache;
+    cache.setList(Servatrice_UserListCache::BuddyList, "alice", {"bob"});
+    cache.setList(Servatrice_UserListCache::IgnoreList, "alice", {"carol"});
+    ASSERT_EQ(cache.size(), 1);
+
+    cache.removeUser("alice");
+    bool contains;
+    ASSERT_FALSE(cache.lookup(Servatrice_UserListCache::BuddyList, "alice", "bob", contains));
+    ASSERT_FALSE(cache.lookup(Servatrice_UserListCache::IgnoreList, "alice", "carol", contains));
+    ASSERT_EQ(cache.size(), 0);
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
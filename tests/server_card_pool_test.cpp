@@ -0,0 +1,100 @@
+#include "../common/server_card.h"
+
+#include "gtest/gtest.h"
+#include <QSet>
+#include <thread>
+
+namespace
+{
+
+Server_Card *makeCard(int id)
+{
+    return new Server_Card(QString("Token %1").arg(id), QString(), id, 0, 0);
+}
+
+TEST(ServerCardPoolTest, CardsGoBackToTheThreadThatCreatedThem)
+{
+    std::thread creator([] {
+        QList<Server_Card *> cards;
+        QSet<const void *> addresses;
+        for (int i = 0; i < 100; ++i) {
+            cards.append(makeCard(i));
+            addresses.insert(cards.last());
+        }
+
+        // destroyed on another thread, which must not keep them for itself
+        std::thread destroyer([&] {
+            qDeleteAll(cards);
+            for (int i = 0; i < 100; ++i) {
+                Server_Card *card = makeCard(i);
+                EXPECT_FALSE(addresses.contains(card));
+                delete card;
+            }
+        });
+        destroyer.join();
+
+        // but the creating thread gets them back
+        cards.clear();
+        for (int i = 0; i < 100; ++i) {
+            cards.append(makeCard(i));
+            EXPECT_TRUE(addresses.contains(cards.last()));
+        }
+        qDeleteAll(cards);
+    });
+    creator.join();
+}
+
+TEST(ServerCardPoolTest, CardsOutliveTheirThread)
+{
+    QList<Server_Card *> cards;
+    std::thread creator([&] {
+        for (int i = 0; i < 100; ++i)
+            cards.append(makeCard(i));
+        // half of them are destroyed by their own thread, and kept for later
+        for (int i = 0; i < 50; ++i)
+            delete cards.takeLast();
+    });
+    creator.join();
+
+    // the pool of the finished thread has to stay around until these are gone
+    for (Server_Card *card : cards)
+        ASSERT_EQ(card->getName(), QString("Token %1").arg(card->getId()));
+    qDeleteAll(cards);
+}
+
+TEST(ServerCardPoolTest, ManyThreadsExchangingCards)
+{
+    const int threadCount = 4;
+    QList<Server_Card *> cardsByThread[threadCount];
+    for (int round = 0; round < 20; ++round) {
+        std::thread threads[threadCount];
+        for (int t = 0; t < threadCount; ++t) {
+            threads[t] = std::thread([&, t] {
+                // the cards created by another thread in the previous round
+                QList<Server_Card *> &previous = cardsByThread[(t + 1) % threadCount];
+                qDeleteAll(previous);
+                previous.clear();
+            });
+        }
+        for (std::thread &thread : threads)
+            thread.join();
+        for (int t = 0; t < threadCount; ++t) {
+            threads[t] = std::thread([&, t] {
+                for (int i = 0; i < 200; ++i)
+                    cardsByThread[t].append(makeCard(i));
+            });
+        }
+        for (std::thread &thread : threads)
+            thread.join();
+    }
+    for (QList<Server_Card *> &cards : cardsByThread)
+        qDeleteAll(cards);
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,126 @@
+#include "../common/rng_abstract.h"
+#include "../common/rng_sfmt.h"
+#include "../common/server_card.h"
+#include "../common/server_cardzone.h"
+
+#include "gtest/gtest.h"
+
+RNG_Abstract *rng;
+
+namespace
+{
+
+class ServerCardZoneTest : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        rng = new RNG_SFMT;
+    }
+
+    void TearDown() override
+    {
+        delete rng;
+    }
+
+    static Server_Card *makeCard(int id)
+    {
+        return new Server_Card(QString("Token %1").arg(id), QString(), id, 0, 0);
+    }
+
+    // checks the cards found by id against a plain scan of the zone
+    static void expectConsistent(Server_CardZone &zone)
+    {
+        const QList<Server_Card *> &cards = zone.getCards();
+        for (int i = 0; i < cards.size(); ++i) {
+            int position = -1;
+            ASSERT_EQ(zone.getCard(cards[i]->getId(), &position), cards[i]);
+            ASSERT_EQ(position, i);
+        }
+    }
+};
+
+TEST_F(ServerCardZoneTest, FindsCardsByIdAfterInsertsAndRemovals)
+{
+    Server_CardZone zone(nullptr, "hand", false, ServerInfo_Zone::PrivateZone);
+    for (int i = 0; i < 20; ++i)
+        zone.insertCard(makeCard(i), i % 2 ? 0 : -1, 0);
+    expectConsistent(zone);
+
+    Server_Card *card = zone.getCard(7);
+    ASSERT_NE(card, nullptr);
+    zone.removeCard(card);
+    ASSERT_EQ(zone.getCard(7), nullptr);
+    ASSERT_EQ(card->getZone(), nullptr);
+    delete card;
+    expectConsistent(zone);
+
+    int position = -1;
+    card = zone.getCard(12, &position, true);
+    ASSERT_NE(card, nullptr);
+    ASSERT_EQ(zone.getCard(12), nullptr);
+    zone.insertCard(card, position, 0);
+    expectConsistent(zone);
+
+    zone.shuffle(3);
+    expectConsistent(zone);
+}
+
+TEST_F(ServerCardZoneTest, FollowsIdChanges)
+{
+    Server_CardZone zone(nullptr, "table", true, ServerInfo_Zone::PublicZone);
+    Server_Card *card = makeCard(1);
+    zone.insertCard(card, 0, 0);
+    card->setId(42);
+    ASSERT_EQ(zone.getCard(1), nullptr);
+    ASSERT_EQ(zone.getCard(42), card);
+}
+
+TEST_F(ServerCardZoneTest, RemovalsFrontToBackKeepPositions)
+{
+    Server_CardZone zone(nullptr, "table", true, ServerInfo_Zone::PublicZone);
+    for (int i = 0; i < 50; ++i)
+        zone.insertCard(makeCard(i), i * 3, 0);
+
+    for (int i = 0; i < 50; i += 2) {
+        int position = -1;
+        Server_Card *card = zone.getCard(i, &position);
+        ASSERT_EQ(position, i / 2);
+        ASSERT_EQ(zone.removeCard(card), i / 2);
+        delete card;
+    }
+    expectConsistent(zone);
+}
+
+TEST_F(ServerCardZoneTest, CachedCardListFollowsChanges)
+{
+    Server_CardZone zone(nullptr, "table", true, ServerInfo_Zone::PublicZone);
+    Server_Card *card = makeCard(1);
+    zone.insertCard(card, 0, 0);
+
+    ServerInfo_Zone info;
+    zone.getInfo(&info, nullptr, true);
+    ASSERT_EQ(info.card_list_size(), 1);
+    ASSERT_FALSE(info.card_list(0).tapped());
+
+    card->setTapped(true);
+    card->setCounter(2, 5);
+    info.Clear();
+    zone.getInfo(&info, nullptr, true);
+    ASSERT_TRUE(info.card_list(0).tapped());
+    ASSERT_EQ(info.card_list(0).counter_list_size(), 1);
+
+    zone.insertCard(makeCard(2), 3, 0);
+    info.Clear();
+    zone.getInfo(&info, nullptr, true);
+    ASSERT_EQ(info.card_list_size(), 2);
+    ASSERT_EQ(info.card_list(1).id(), 2);
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,129 @@
+#include "../common/server_game_list_updates.h"
+
+#include "gtest/gtest.h"
+
+namespace
+{
+
+ServerInfo_Game created(int gameId)
+{
+    ServerInfo_Game gameInfo;
+    gameInfo.set_game_id(gameId);
+    gameInfo.set_description("Commander, no proxies");
+    gameInfo.set_max_players(4);
+    gameInfo.set_player_count(1);
+    gameInfo.mutable_creator_info()->set_name("alice");
+    return gameInfo;
+}
+
+ServerInfo_Game playerCount(int gameId, int count)
+{
+    ServerInfo_Game gameInfo;
+    gameInfo.set_game_id(gameId);
+    gameInfo.set_player_count(count);
+    return gameInfo;
+}
+
+ServerInfo_Game closed(int gameId)
+{
+    ServerInfo_Game gameInfo;
+    gameInfo.set_game_id(gameId);
+    gameInfo.set_closed(true);
+    return gameInfo;
+}
+
+TEST(GameListUpdates, ChangesToOneGameAreMerged)
+{
+    Server_GameListUpdates updates;
+    updates.add(playerCount(1, 2));
+    updates.add(playerCount(2, 3));
+    updates.add(playerCount(1, 4));
+
+    const QList<ServerInfo_Game> games = updates.take();
+    ASSERT_EQ(games.size(), 2);
+    EXPECT_EQ(games[0].game_id(), 1);
+    EXPECT_EQ(games[0].player_count(), 4u);
+    EXPECT_EQ(games[1].game_id(), 2);
+    EXPECT_EQ(games[1].player_count(), 3u);
+    EXPECT_TRUE(updates.isEmpty());
+}
+
+TEST(GameListUpdates, CreationIsMergedWithLaterChanges)
+{
+    Server_GameListUpdates updates;
+    updates.gameCreating(1);
+    updates.add(created(1));
+    updates.add(playerCount(1, 3));
+
+    const QList<ServerInfo_Game> games = updates.take();
+    ASSERT_EQ(games.size(), 1);
+    EXPECT_EQ(games[0].player_count(), 3u);
+    EXPECT_EQ(games[0].max_players(), 4u);
+    EXPECT_EQ(games[0].creator_info().name(), "alice");
+}
+
+TEST(GameListUpdates, ClosingAGameNobodySawDropsIt)
+{
+    Server_GameListUpdates updates;
+    updates.beginListRead();
+    updates.endListRead();
+    updates.gameCreating(1);
+    updates.add(created(1));
+    updates.add(playerCount(1, 2));
+    updates.add(closed(1));
+
+    EXPECT_TRUE(updates.isEmpty());
+}
+
+TEST(GameListUpdates, ClosingAGameSomebodyListedSendsTheClosedRecord)
+{
+    Server_GameListUpdates updates;
+    updates.gameCreating(1);
+    updates.add(created(1));
+    // a user joining the room gets the game list with the new game in it
+    updates.beginListRead();
+    updates.endListRead();
+    updates.add(closed(1));
+
+    const QList<ServerInfo_Game> games = updates.take();
+    ASSERT_EQ(games.size(), 1);
+    EXPECT_EQ(games[0].game_id(), 1);
+    EXPECT_TRUE(games[0].closed());
+}
+
+TEST(GameListUpdates, ClosingAGameCreatedDuringAListReadSendsTheClosedRecord)
+{
+    Server_GameListUpdates updates;
+    updates.beginListRead();
+    updates.gameCreating(1);
+    updates.endListRead();
+    updates.add(created(1));
+    updates.add(closed(1));
+
+    const QList<ServerInfo_Game> games = updates.take();
+    ASSERT_EQ(games.size(), 1);
+    EXPECT_TRUE(games[0].closed());
+}
+
+TEST(GameListUpdates, ClosingAGameAnnouncedEarlierSendsTheClosedRecord)
+{
+    Server_GameListUpdates updates;
+    updates.gameCreating(1);
+    updates.add(created(1));
+    updates.take();
+
+    updates.add(playerCount(1, 2));
+    updates.add(closed(1));
+
+    const QList<ServerInfo_Game> games = updates.take();
+    ASSERT_EQ(games.size(), 1);
+    EXPECT_TRUE(games[0].closed());
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
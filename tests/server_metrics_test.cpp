@@ -0,0 +1,139 @@
+#include "../common/server_metrics.h"
+#include "pb/session_commands.pb.h"
+
+#include "gtest/gtest.h"
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+TEST(ServerMetricsTest, UnknownHistogramsHaveNoSeries)
+{
+    ServerMetrics metrics;
+    ASSERT_EQ(metrics.histogram("not_registered", QString()), nullptr);
+    ASSERT_FALSE(metrics.toPrometheusText().contains("not_registered"));
+}
+
+TEST(ServerMetricsTest, HistogramBucketsAreCumulative)
+{
+    ServerMetrics metrics;
+    metrics.addHistogram("test_sizes", "Sizes", {1, 10}, 10);
+    ServerMetrics::Histogram *sizes = metrics.histogram("test_sizes", ServerMetrics::label("kind", "a"));
+    sizes->observe(5);
+    sizes->observe(50);
+    sizes->observe(500);
+
+    const QByteArray text = metrics.toPrometheusText();
+    ASSERT_TRUE(text.contains("# TYPE test_sizes histogram\n"));
+    ASSERT_TRUE(text.contains("test_sizes_bucket{kind=\"a\",le=\"1\"} 1\n"));
+    ASSERT_TRUE(text.contains("test_sizes_bucket{kind=\"a\",le=\"10\"} 2\n"));
+    ASSERT_TRUE(text.contains("test_sizes_bucket{kind=\"a\",le=\"+Inf\"} 3\n"));
+    ASSERT_TRUE(text.contains("test_sizes_sum{kind=\"a\"} 55.5\n"));
+    ASSERT_TRUE(text.contains("test_sizes_count{kind=\"a\"} 3\n"));
+}
+
+TEST(ServerMetricsTest, BoundsAreInclusive)
+{
+    ServerMetrics metrics;
+    metrics.addHistogram("test_bounds", "Bounds", {1});
+    metrics.histogram("test_bounds", QString())->observe(1);
+
+    ASSERT_TRUE(metrics.toPrometheusText().contains("test_bounds_bucket{le=\"1\"} 1\n"));
+}
+
+TEST(ServerMetricsTest, LabelValuesAreEscaped)
+{
+    ASSERT_EQ(ServerMetrics::label("statement", "a \"b\"\\\n"), QString("statement=\"a \\\"b\\\"\\\\\\n\""));
+}
+
+TEST(ServerMetricsTest, GaugesKeepTheLastValue)
+{
+    ServerMetrics metrics;
+    metrics.setGauge("test_clients", "Clients", ServerMetrics::label("pool", "0"), 3);
+    metrics.setGauge("test_clients", "Clients", ServerMetrics::label("pool", "0"), 4);
+
+    const QByteArray text = metrics.toPrometheusText();
+    ASSERT_TRUE(text.contains("# TYPE test_clients gauge\n"));
+    ASSERT_TRUE(text.contains("test_clients{pool=\"0\"} 4\n"));
+    ASSERT_FALSE(text.contains("test_clients{pool=\"0\"} 3\n"));
+}
+
+TEST(ServerMetricsTest, SeriesAreLookedUpOnce)
+{
+    ServerMetrics metrics;
+    metrics.addHistogram("test_series", "Series", {1});
+    ServerMetrics::Histogram *series = metrics.histogram("test_series", ServerMetrics::label("kind", "a"));
+    ASSERT_EQ(metrics.histogram("test_series", ServerMetrics::label("kind", "a")), series);
+    ASSERT_NE(metrics.histogram("test_series", ServerMetrics::label("kind", "b")), series);
+}
+
+TEST(ServerMetricsTest, CommandsAreRecordedInSeconds)
+{
+    ServerMetrics metrics;
+    metrics.observeCommand(ServerMetrics::SessionCommandType, SessionCommand::PING, 2000000);
+
+    const QByteArray text = metrics.toPrometheusText();
+    ASSERT_TRUE(text.contains("servatrice_command_duration_seconds_count{command=\"PING\",type=\"session\"} 1\n"));
+    ASSERT_TRUE(text.contains("servatrice_command_duration_seconds_sum{command=\"PING\",type=\"session\"} 0.002\n"));
+}
+
+TEST(ServerMetricsTest, UnknownCommandsShareOneSeries)
+{
+    ServerMetrics metrics;
+    metrics.observeCommand(ServerMetrics::SessionCommandType, 123456, 1000);
+    metrics.observeCommand(ServerMetrics::SessionCommandType, 654321, 1000);
+    metrics.observeCommand(ServerMetrics::NoCommandType, -1, 1000);
+
+    const QByteArray text = metrics.toPrometheusText();
+    ASSERT_TRUE(
+        text.contains("servatrice_command_duration_seconds_count{command=\"unknown\",type=\"session\"} 2\n"));
+    ASSERT_TRUE(text.contains("servatrice_command_duration_seconds_count{command=\"unknown\",type=\"none\"} 1\n"));
+}
+
+TEST(ServerMetricsTest, LockHoldTimesAreRecorded)
+{
+    ServerMetrics metrics;
+    metrics.observeLockHold(ServerMetrics::GameMutex, 3000);
+
+    ASSERT_TRUE(metrics.toPrometheusText().contains("servatrice_lock_hold_seconds_count{lock=\"gameMutex\"} 1\n"));
+}
+
+TEST(ServerMetricsTest, CompressionRatiosAreRecorded)
+{
+    ServerMetrics metrics;
+    metrics.observeOutputCompression(4000, 1000);
+    metrics.observeOutputCompression(3000, 2000);
+
+    const QByteArray text = metrics.toPrometheusText();
+    ASSERT_TRUE(text.contains("servatrice_output_compression_bytes_sum{form=\"serialized\"} 7000\n"));
+    ASSERT_TRUE(text.contains("servatrice_output_compression_bytes_sum{form=\"sent\"} 3000\n"));
+    ASSERT_TRUE(text.contains("servatrice_output_compression_ratio_bucket{le=\"1.5\"} 1\n"));
+    ASSERT_TRUE(text.contains("servatrice_output_compression_ratio_sum 5.5\n"));
+}
+
+TEST(ServerMetricsTest, ConcurrentObservationsAreAllCounted)
+{
+    ServerMetrics metrics;
+    const int threadCount = 8, observations = 10000;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < threadCount; ++i)
+        threads.emplace_back([&metrics] {
+            for (int j = 0; j < observations; ++j)
+                metrics.observeLockWait(ServerMetrics::ClientsLock, 1000);
+        });
+    for (std::thread &thread : threads)
+        thread.join();
+
+    const QByteArray text = metrics.toPrometheusText();
+    ASSERT_TRUE(text.contains("servatrice_lock_wait_seconds_count{lock=\"clientsLock\"} 80000\n"));
+    ASSERT_TRUE(text.contains("servatrice_lock_wait_seconds_sum{lock=\"clientsLock\"} 0.08\n"));
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
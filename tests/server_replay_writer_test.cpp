@@ -0,0 +1,187 @@
+#include "../common/server_replay_writer.h"
+#include "pb/event_set_active_phase.pb.h"
+#include "pb/game_replay.pb.h"
+
+#include "gtest/gtest.h"
+#include <QDir>
+#include <QFile>
+#include <QTemporaryDir>
+
+namespace
+{
+
+ServerInfo_Game makeGameInfo()
+{
+    ServerInfo_Game gameInfo;
+    gameInfo.set_game_id(17);
+    gameInfo.set_room_id(1);
+    gameInfo.set_description("Commander, no proxies");
+    gameInfo.set_max_players(4);
+    return gameInfo;
+}
+
+GameEventContainer makeEvent(int i)
+{
+    GameEventContainer cont;
+    cont.set_seconds_elapsed(i);
+    GameEvent *event = cont.add_event_list();
+    event->set_player_id(i % 4);
+    Event_SetActivePhase phase;
+    phase.set_phase(i % 11);
+    event->MutableExtension(Event_SetActivePhase::ext)->CopyFrom(phase);
+    return cont;
+}
+
+std::string serialize(const GameReplay &replay)
+{
+    std::string result;
+    replay.SerializeToString(&result);
+    return result;
+}
+
+std::string toStdString(const QByteArray &data)
+{
+    return std::string(data.constData(), data.size());
+}
+
+QByteArray readAll(Server_ReplayWriter &writer)
+{
+    QByteArray data;
+    EXPECT_TRUE(writer.readReplayData(data));
+    return data;
+}
+
+TEST(ServerReplayWriterTest, EmptyReplayMatchesGameReplay)
+{
+    Server_ReplayWriter writer(5, makeGameInfo());
+    writer.finish(0);
+
+    GameReplay expected;
+    expected.set_replay_id(5);
+    expected.mutable_game_info()->CopyFrom(makeGameInfo());
+    expected.set_duration_seconds(0);
+
+    ASSERT_EQ(toStdString(readAll(writer)), serialize(expected));
+}
+
+TEST(ServerReplayWriterTest, SpilledReplayMatchesGameReplay)
+{
+    // small chunks, so that most of the replay goes through the spill file
+    Server_ReplayWriter writer(123456789012ULL, makeGameInfo(), 256);
+    GameReplay expected;
+    expected.set_replay_id(123456789012ULL);
+    expected.mutable_game_info()->CopyFrom(makeGameInfo());
+    for (int i = 0; i < 1000; ++i) {
+        writer.addEvent(makeEvent(i));
+        expected.add_event_list()->CopyFrom(makeEvent(i));
+    }
+    writer.finish(3600);
+    expected.set_duration_seconds(3600);
+
+    ASSERT_EQ(writer.getDurationSeconds(), 3600u);
+    ASSERT_EQ(writer.getSize(), static_cast<qint64>(serialize(expected).size()));
+
+    const QByteArray data = readAll(writer);
+    ASSERT_EQ(toStdString(data), serialize(expected));
+
+    GameReplay parsed;
+    ASSERT_TRUE(parsed.ParseFromArray(data.constData(), data.size()));
+    ASSERT_EQ(parsed.event_list_size(), 1000);
+    ASSERT_EQ(parsed.event_list(999).seconds_elapsed(), 999u);
+}
+
+TEST(ServerReplayWriterTest, ReplayIsTakenInPieces)
+{
+    const int chunkSize = 512;
+    Server_ReplayWriter writer(9, makeGameInfo(), chunkSize);
+    GameReplay expected;
+    expected.set_replay_id(9);
+    expected.mutable_game_info()->CopyFrom(makeGameInfo());
+    for (int i = 0; i < 500; ++i) {
+        writer.addEvent(makeEvent(i));
+        expected.add_event_list()->CopyFrom(makeEvent(i));
+    }
+    writer.finish(60);
+    expected.set_duration_seconds(60);
+
+    QByteArray data;
+    int pieces = 0;
+    QByteArray piece;
+    while (true) {
+        ASSERT_TRUE(writer.readReplayPiece(piece));
+        if (piece.isEmpty())
+            break;
+        // a chunk is handed off once it reaches chunkSize, so it can overshoot by one event
+        ASSERT_LT(piece.size(), chunkSize + 64);
+        data.append(piece);
+        ++pieces;
+    }
+    ASSERT_GT(pieces, 1);
+    ASSERT_EQ(toStdString(data), serialize(expected));
+
+    // a database write that failed reads it again
+    ASSERT_EQ(readAll(writer), data);
+}
+
+TEST(ServerReplayWriterTest, UnreadableSpillFileFailsTheRead)
+{
+    // the spill file goes to the temporary directory of the time the writer is created
+    QTemporaryDir spillDir;
+    ASSERT_TRUE(spillDir.isValid());
+    const bool hadTmpDir = qEnvironmentVariableIsSet("TMPDIR");
+    const QByteArray oldTmpDir = qgetenv("TMPDIR");
+    qputenv("TMPDIR", spillDir.path().toUtf8());
+    Server_ReplayWriter writer(3, makeGameInfo(), 64);
+    if (hadTmpDir)
+        qputenv("TMPDIR", oldTmpDir);
+    else
+        qunsetenv("TMPDIR");
+    for (int i = 0; i < 200; ++i)
+        writer.addEvent(makeEvent(i));
+    writer.finish(60);
+
+    // the first piece waits for the spill task, after that the file loses its contents
+    QByteArray piece;
+    ASSERT_TRUE(writer.readReplayPiece(piece));
+    ASSERT_FALSE(piece.isEmpty());
+    const QFileInfoList spillFiles = QDir(spillDir.path()).entryInfoList(QDir::Files);
+    ASSERT_EQ(spillFiles.size(), 1);
+    ASSERT_TRUE(QFile::resize(spillFiles.first().filePath(), 0));
+
+    ASSERT_FALSE(writer.readReplayPiece(piece));
+    QByteArray data;
+    ASSERT_FALSE(writer.readReplayData(data));
+    ASSERT_TRUE(data.isEmpty());
+}
+
+TEST(ServerReplayWriterTest, DiscardingAReplayWithPendingChunksIsSafe)
+{
+    for (int n = 0; n < 20; ++n) {
+        auto *writer = new Server_ReplayWriter(n, makeGameInfo(), 64);
+        for (int i = 0; i < 200; ++i)
+            writer->addEvent(makeEvent(i));
+        delete writer;
+    }
+}
+
+TEST(ServerReplayWriterTest, EventsAfterFinishAreIgnored)
+{
+    Server_ReplayWriter writer(1, makeGameInfo());
+    writer.addEvent(makeEvent(1));
+    writer.finish(10);
+    writer.addEvent(makeEvent(2));
+
+    const QByteArray data = readAll(writer);
+    GameReplay parsed;
+    ASSERT_TRUE(parsed.ParseFromArray(data.constData(), data.size()));
+    ASSERT_EQ(parsed.event_list_size(), 1);
+    ASSERT_EQ(parsed.duration_seconds(), 10u);
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
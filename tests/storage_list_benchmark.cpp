@@ -0,0 +1,274 @@
+// Compares the deck storage and replay listings of Servatrice_StorageListing, which servatrice runs, against the
+// baselines below that replay the pattern servatrice used before: one query per folder and per match. Needs a MySQL
+// or MariaDB database with the servatrice schema, for example a throwaway container:
+//
+//   docker run -d --name trice-bench -e MARIADB_ROOT_PASSWORD=bench -e MARIADB_DATABASE=servatrice -p 3306:3306 mariadb
+//   docker exec -i trice-bench mariadb -uroot -pbench servatrice < servatrice/servatrice.sql
+//
+// The benchmark seeds a user named storage_benchmark with the given number of decks and matches, replacing whatever
+// that user had before, and prints the time per listing for both variants.
+//
+// usage: storage_list_benchmark host database user password [folders] [decks per folder] [matches] [rounds]
+
+#include "../servatrice/src/servatrice_storage_listing.h"
+#include "pb/response_deck_list.pb.h"
+#include "pb/response_replay_list.pb.h"
+
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QSqlDatabase>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QVariant>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+
+static bool exec(QSqlQuery &query)
+{
+    if (query.exec())
+        return true;
+    fprintf(stderr, "query failed: %s\n%s\n", qPrintable(query.lastError().text()), qPrintable(query.lastQuery()));
+    return false;
+}
+
+// Prepared statements are cached like Servatrice_DatabaseInterface does, with the default table prefix
+class BenchmarkConnection : public Servatrice_QueryConnection
+{
+private:
+    QSqlDatabase db;
+    QHash<QString, QSqlQuery *> preparedStatements;
+
+public:
+    explicit BenchmarkConnection(const QSqlDatabase &_db) : db(_db)
+    {
+    }
+    ~BenchmarkConnection() override
+    {
+        qDeleteAll(preparedStatements);
+    }
+    QSqlQuery *prepareQuery(const QString &queryText) override
+    {
+        QSqlQuery *&query = preparedStatements[queryText];
+        if (!query) {
+            query = new QSqlQuery(db);
+            query->prepare(QString(queryText).replace("{prefix}", "cockatrice"));
+        }
+        return query;
+    }
+    bool execSqlQuery(QSqlQuery *query) override
+    {
+        return exec(*query);
+    }
+};
+
+static bool exec(QSqlDatabase &db, const QString &statement)
+{
+    QSqlQuery query(db);
+    query.prepare(statement);
+    return exec(query);
+}
+
+static int seed(QSqlDatabase &db, int folders, int decksPerFolder, int matches)
+{
+    exec(db, "delete from cockatrice_games where creator_name = 'storage_benchmark'");
+    exec(db, "insert ignore into cockatrice_users (admin, name, realname, password_sha512, email, country, avatar_bmp, "
+             "registrationDate, active, clientid, adminnotes, privlevel, privlevelStartDate, privlevelEndDate) values "
+             "(0, 'storage_benchmark', '', '', '', '', '', now(), 1, '', '', 'NONE', now(), now())");
+    QSqlQuery query(db);
+    query.prepare("select id from cockatrice_users where name = 'storage_benchmark'");
+    if (!exec(query) || !query.next())
+        return -1;
+    const int userId = query.value(0).toInt();
+
+    db.transaction();
+    query.prepare("delete from cockatrice_decklist_files where id_user = :id_user");
+    query.bindValue(":id_user", userId);
+    exec(query);
+    query.prepare("delete from cockatrice_decklist_folders where id_user = :id_user");
+    query.bindValue(":id_user", userId);
+    exec(query);
+
+    // two levels: every folder below the root holds one subfolder, decks are split between them
+    QSqlQuery folderQuery(db), fileQuery(db);
+    folderQuery.prepare(
+        "insert into cockatrice_decklist_folders (id_parent, id_user, name) values (:id_parent, :id_user, :name)");
+    fileQuery.prepare("insert into cockatrice_decklist_files (id_folder, id_user, name, upload_time, content) values "
+                      "(:id_folder, :id_user, :name, now(), '')");
+    for (int i = 0; i < folders; ++i) {
+        int parentId = 0;
+        for (int level = 0; level < 2; ++level) {
+            folderQuery.bindValue(":id_parent", parentId);
+            folderQuery.bindValue(":id_user", userId);
+            folderQuery.bindValue(":name", QString("folder %1.%2").arg(i).arg(level));
+            if (!exec(folderQuery))
+                return -1;
+            parentId = folderQuery.lastInsertId().toInt();
+            for (int j = level; j < decksPerFolder; j += 2) {
+                fileQuery.bindValue(":id_folder", parentId);
+                fileQuery.bindValue(":id_user", userId);
+                fileQuery.bindValue(":name", QString("deck %1").arg(j));
+                if (!exec(fileQuery))
+                    return -1;
+            }
+        }
+    }
+
+    QSqlQuery gameQuery(db), playerQuery(db), replayQuery(db), accessQuery(db);
+    gameQuery.prepare("insert into cockatrice_games (room_name, descr, creator_name, password, game_types, "
+                      "player_count, time_started, time_finished) values ('Main', :descr, 'storage_benchmark', 0, '', "
+                      "2, now(), now())");
+    playerQuery.prepare("insert into cockatrice_games_players (id_game, player_name) values (:id_game, :name)");
+    replayQuery.prepare("insert into cockatrice_replays (id_game, duration, replay) values (:id_game, 600, '')");
+    accessQuery.prepare("insert into cockatrice_replays_access (id_game, id_player, replay_name, do_not_hide) values "
+                        "(:id_game, :id_player, :name, 1)");
+    for (int i = 0; i < matches; ++i) {
+        gameQuery.bindValue(":descr", QString("match %1").arg(i));
+        if (!exec(gameQuery))
+            return -1;
+        const int gameId = gameQuery.lastInsertId().toInt();
+        for (const QString &name : {QString("storage_benchmark"), QString("opponent")}) {
+            playerQuery.bindValue(":id_game", gameId);
+            playerQuery.bindValue(":name", name);
+            exec(playerQuery);
+        }
+        replayQuery.bindValue(":id_game", gameId);
+        exec(replayQuery);
+        accessQuery.bindValue(":id_game", gameId);
+        accessQuery.bindValue(":id_player", userId);
+        accessQuery.bindValue(":name", QString("match %1").arg(i));
+        exec(accessQuery);
+    }
+    db.commit();
+    return userId;
+}
+
+static int listDecksPerFolder(QSqlDatabase &db, int userId, int folderId)
+{
+    int items = 0;
+    QSqlQuery query(db);
+    query.prepare("select id, name from cockatrice_decklist_folders where id_parent = :id_parent and id_user = "
+                  ":id_user");
+    query.bindValue(":id_parent", folderId);
+    query.bindValue(":id_user", userId);
+    exec(query);
+    QList<int> subFolders;
+    while (query.next()) {
+        subFolders.append(query.value(0).toInt());
+        ++items;
+    }
+    for (int subFolder : subFolders)
+        items += listDecksPerFolder(db, userId, subFolder);
+
+    query.prepare("select id, name, upload_time from cockatrice_decklist_files where id_folder = :id_folder and "
+                  "id_user = :id_user");
+    query.bindValue(":id_folder", folderId);
+    query.bindValue(":id_user", userId);
+    exec(query);
+    while (query.next())
+        ++items;
+    return items;
+}
+
+static int countItems(const ServerInfo_DeckStorage_Folder &folder)
+{
+    int items = folder.items_size();
+    for (const ServerInfo_DeckStorage_TreeItem &item : folder.items())
+        if (item.has_folder())
+            items += countItems(item.folder());
+    return items;
+}
+
+static int listDecksSetBased(BenchmarkConnection &connection, int userId)
+{
+    Response_DeckList response;
+    if (!Servatrice_StorageListing::listDecks(connection, userId, response.mutable_root()))
+        return -1;
+    return countItems(response.root());
+}
+
+static int listReplaysPerMatch(QSqlDatabase &db, int userId)
+{
+    int items = 0;
+    QSqlQuery query1(db), query2(db), query3(db);
+    query1.prepare("select a.id_game, a.replay_name, b.room_name, b.time_started, b.time_finished, b.descr, "
+                   "a.do_not_hide from cockatrice_replays_access a left join cockatrice_games b on b.id = a.id_game "
+                   "where a.id_player = :id_player and (a.do_not_hide = 1 or date_add(b.time_started, interval 7 "
+                   "day) > now())");
+    query2.prepare("select player_name from cockatrice_games_players where id_game = :id_game");
+    query3.prepare("select id, duration from cockatrice_replays where id_game = :id_game");
+    query1.bindValue(":id_player", userId);
+    exec(query1);
+    while (query1.next()) {
+        ++items;
+        query2.bindValue(":id_game", query1.value(0));
+        exec(query2);
+        while (query2.next())
+            ++items;
+        query3.bindValue(":id_game", query1.value(0));
+        exec(query3);
+        while (query3.next())
+            ++items;
+    }
+    return items;
+}
+
+static int listReplaysSetBased(BenchmarkConnection &connection, int userId, int maxMatches)
+{
+    Response_ReplayList response;
+    if (!Servatrice_StorageListing::listReplays(connection, userId, 0, maxMatches, response))
+        return -1;
+    int items = 0;
+    for (const ServerInfo_ReplayMatch &match : response.match_list())
+        items += 1 + match.replay_list_size() + match.player_names_size();
+    return items;
+}
+
+template <typename Listing> static void run(const char *name, int rounds, Listing listing)
+{
+    QElapsedTimer timer;
+    timer.start();
+    int items = 0;
+    for (int i = 0; i < rounds; ++i)
+        items = listing();
+    printf("%-28s %8.2f ms per listing (%d rows)\n", name, timer.nsecsElapsed() / 1e6 / rounds, items);
+}
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+    if (argc < 5) {
+        fprintf(stderr, "usage: %s host database user password [folders] [decks per folder] [matches] [rounds]\n",
+                argv[0]);
+        return 1;
+    }
+    const int folders = argc > 5 ? atoi(argv[5]) : 50;
+    const int decksPerFolder = argc > 6 ? atoi(argv[6]) : 10;
+    const int matches = argc > 7 ? atoi(argv[7]) : 2000;
+    const int rounds = argc > 8 ? atoi(argv[8]) : 20;
+
+    QSqlDatabase db = QSqlDatabase::addDatabase("QMYSQL");
+    db.setHostName(argv[1]);
+    db.setDatabaseName(argv[2]);
+    db.setUserName(argv[3]);
+    db.setPassword(argv[4]);
+    if (!db.open()) {
+        fprintf(stderr, "can't open database: %s\n", qPrintable(db.lastError().text()));
+        return 1;
+    }
+
+    const int userId = seed(db, folders, decksPerFolder, matches);
+    if (userId < 0)
+        return 1;
+    printf("%d folders, %d decks, %d matches\n", 2 * folders, folders * decksPerFolder, matches);
+
+    BenchmarkConnection connection(db);
+    run("deck list, per folder", rounds, [&] { return listDecksPerFolder(db, userId, 0); });
+    run("deck list, set based", rounds, [&] { return listDecksSetBased(connection, userId); });
+    run("replay list, per match", rounds, [&] { return listReplaysPerMatch(db, userId); });
+    run("replay list, set based", rounds, [&] { return listReplaysSetBased(connection, userId, INT_MAX); });
+    run("replay list, first 50", rounds, [&] { return listReplaysSetBased(connection, userId, 50); });
+    return 0;
+}